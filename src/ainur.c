@@ -9,6 +9,7 @@
 
 
 //External libraries...
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,25 +21,43 @@
 //All our libraries...
 #include "ainur.h"
 #include "ainurio.h"
+#include "atlas.h"
 #include "color.h"
 #include "datatypes.h"
 #include "debug.h"
+#include "dice.h"
 #include "draw.h"
 #include "file.h"
 #include "font.h"
 #include "image.h"
+#include "intern.h"
 #include "lkernel.h"
 #include "map.h"
 #include "mem.h"
+#include "pack.h"
 #include "palette.h"
+#include "path.h"
 #include "randgen.h"
+#include "registry.h"
+#include "render.h"
+#include "rnd.h"
+#include "rqueue.h"
 #include "screen.h"
 #include "species.h"
 #include "sprite.h"
 #include "tile.h"
+#include "vfs.h"
+#include "workers.h"
+
+#define AINUR_SCREEN_WIDTH   400
+#define AINUR_SCREEN_HEIGHT  400
+#define AINUR_SCENE_COPIES   1024
 
 /* initialize the ainur engine struct */
-struct engine ainur = { NULL, NULL, NULL, NULL, NULL };
+struct engine ainur = { NULL, NULL, NULL, { 0 }, { 0 }, { 0 }, NULL };
+
+/* render backend chosen on the command line (--renderer=<name>) */
+static enum render_backend ainur_renderer = RENDER_SURFACE;
 
 
 
@@ -49,12 +68,54 @@ struct engine ainur = { NULL, NULL, NULL, NULL, NULL };
 static inline void ainur_close(void)
 {
     //functions are order dependent (reverse of loading)
+    #ifdef DEBUGGING
+    if( debug_getDebugStatus() ) {
+        render_dumpStats(stdout);   //only when run with --debug
+    }
+    #endif /*DEBUGGING*/
+    rqueue_close();
+    render_close();     //before the window it draws to
     screen_freeMain();
     font_close();
     tile_close();
+    atlas_close();      //after the tiles that point into it
     image_close();
+    pack_close(ainur.pack);     //after everything that refers to the mapping
+    ainur.pack = NULL;
     screen_close();
     lkernel_close();
+    dice_close();       //after the scripts holding compiled formats
+    path_close();       //per-thread search memory
+    workers_close();
+    vfs_close();
+    intern_close();
+    return;
+}
+
+
+
+/**
+ * @brief Add the VFS search roots, lowest priority first: the base game,
+ *        mods, then the user directory.
+ */
+static inline void ainur_initVfs(void) {
+    char path[PATH_MAX];
+    const char *home = getenv("HOME");
+
+    vfs_init();
+    if( file_exists(AINUR_MODS_DIR) ) {
+        vfs_exclude(AINUR_MODS_DIR);    //indexed as a root of its own
+        vfs_addRoot(".");
+        vfs_addRoot(AINUR_MODS_DIR);
+    }
+    else {
+        vfs_addRoot(".");
+    }
+    if( home && snprintf(path, sizeof(path), "%s/%s", home, AINUR_USER_DIR) < (int)sizeof(path) &&
+        file_exists(path) ) {
+        vfs_addRoot(path);
+    }
+
     return;
 }
 
@@ -64,13 +125,32 @@ static inline void ainur_close(void)
  * @brief Initialization protocols.
  */
 static inline void ainur_init(void) {
+    rnd_init();         //seed the random number generator
+    intern_init();      //initialize the tag string pool
+    workers_init(0);    //start the worker thread pool
+    ainur_initVfs();    //index the asset search roots
+
+    //optional; loose files are used without it
+    if( vfs_exists(AINUR_PACK) ) {
+        ainur.pack = pack_open(vfs_resolve(AINUR_PACK));
+    }
+    dice_init();        //initialize the compiled dice cache
     lkernel_init();     //initialize Lua
     screen_init();      //initialize SDL2
     image_init();       //initialize IMG (SDL2 extension)
     tile_init();        //initialize tiles
     font_init();        //initialize TTF (SDL2 extension)
 
-    screen_initMain("Testing...", 400, 400);    //open the main window
+    screen_initMain("Testing...", AINUR_SCREEN_WIDTH, AINUR_SCREEN_HEIGHT);    //open the main window
+    render_init(ainur_renderer);    //choose the render backend
+    rqueue_init(AINUR_SCENE_COPIES);    //allocate the render queue once
+
+    //packed assets need the render backend's pixel format
+    if(ainur.pack) {
+        pack_loadImages(ainur.pack);
+        pack_loadTiles(ainur.pack);
+        pack_runScripts(ainur.pack, ainur.lkernel);
+    }
 
     return;
 }
@@ -107,6 +187,11 @@ int main(int argc, char *argv[])
             debug_verboseOn();
         }
         #endif /*VERBOSE*/
+
+        if (strncmp(argv[arg], "--renderer=", 11) == 0 &&
+            !render_backendFromName(argv[arg] + 11, &ainur_renderer)) {
+            fprintf(stderr, "Unknown renderer \"%s\"; use surface, texture or software.\n", argv[arg] + 11);
+        }
     }
 
     //must be registered befor initialization.
@@ -114,23 +199,42 @@ int main(int argc, char *argv[])
 
     ainur_init();
 
-    image_load("brick.png", "i_brick");
-    image_load("brick.png", "i_brick2");
-    image_load("brick.poop", "i_poop");
-    image_load("brick.png", "i_the");
-    image_load("brick.png", "telk");
-    image_load("brick.png", "bewn");
-    image_load("brick.png", "nror");
-    image_load("brick.png", "obne");
+    image_loadMultiple(16, "brick.png", "i_brick",
+                           "brick.png", "i_brick2",
+                           "brick.poop", "i_poop",
+                           "brick.png", "i_the",
+                           "brick.png", "telk",
+                           "brick.png", "bewn",
+                           "brick.png", "nror",
+                           "brick.png", "obne");
 
     image_dumpAll(stdout);
 
-    struct image **img = image_bsearch("i_brick");
-    image_dump(stdout, img[0]);
+    struct image *img = image_lookup("i_brick");
+    image_dump(stdout, img);
+
+    //the same scene for every backend: the window tiled with bricks
+    SDL_Surface *brick = image_getSurface(img);
+    struct tile *t_brick = brick ? tile_create_fromImage(img, 0, 0, brick->w, brick->h, "t_brick") : NULL;
+    SDL_Rect viewport = { 0, 0, AINUR_SCREEN_WIDTH, AINUR_SCREEN_HEIGHT }, dest;
+    rqueue_setViewport(&viewport);
 
     while(1) {
         //ainurio_SDLreceive();   //receive key input
         ainurio_interpretInput(); //interpret keystroke
+
+        for (dest.y = 0; t_brick && dest.y < AINUR_SCREEN_HEIGHT; dest.y += t_brick->rect.h) {
+            for (dest.x = 0; dest.x < AINUR_SCREEN_WIDTH; dest.x += t_brick->rect.w) {
+                dest.w = t_brick->rect.w;
+                dest.h = t_brick->rect.h;
+                rqueue_push(0, t_brick, &dest, 0);
+            }
+        }
+
+        render_begin();
+        rqueue_flush();
+        render_present();
+
         SDL_Delay(16);            //delay/pause to save CPU
     }
 
@@ -13,6 +13,8 @@
 #include <SDL2/SDL_ttf.h>
 
 #include "image.h"
+#include "pack.h"
+#include "registry.h"
 #include "tile.h"
 
 
@@ -46,20 +48,24 @@ struct arguments {
  * @var lkernel
  *      Pointer to the Lua kernel state used to read .lua files.
  * @var images
- *      Pointer to an array of pointers to image structs.
- *      @note The array is NULL terminated.
+ *      Registry of pointers to image structs, indexed by tag.
  *      Contains all loaded images.
  * @var tiles
- *      Pointer to an array of pointers to tile structs.
- *      @note The array is NULL terminated.
+ *      Registry of pointers to tile structs, indexed by tag.
  *      Contains all created tiles.
+ * @var dice
+ *      Registry of pointers to compiled dice formats, indexed by format string.
+ * @var pack
+ *      The main asset pack (AINUR_PACK), or NULL to load loose files.
  */
 struct engine {
     SDL_Window *screen;         //main window
     TTF_Font *font;             //main font
     lua_State *lkernel;         //Lua kernel state
-    struct image **images;
-    struct tile **tiles;
+    struct registry images;
+    struct registry tiles;
+    struct registry dice;
+    struct pack *pack;          //main asset pack
 /*#ifdef VERBOSE
     SDL_Surface *verbose; //for possible use in engine
 #endif VEROBSE*/
@@ -70,4 +76,12 @@ extern struct engine ainur;     /* This struct is initialized in ainur.c */
 
 #define LKERNEL ainur.lkernel
 
+/* Asset pack opened at startup when it exists (see pack.h). */
+#define AINUR_PACK "ainur.pack"
+
+/* VFS search roots after the working directory (see vfs.h); the user
+ * directory is relative to $HOME. */
+#define AINUR_MODS_DIR  "mods"
+#define AINUR_USER_DIR  ".ainur"
+
 #endif /* AINUR_H_ */
@@ -0,0 +1,105 @@
+/*
+ * astar.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ *
+ *  Pieces shared by the grid searches of path.c and hpa.c: the 8 moves and
+ *  the open list. Internal; the functions are static inline so the search
+ *  loops keep them inlined.
+ */
+
+#ifndef ASTAR_H
+#define ASTAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "debug.h"
+
+#define ASTAR_SUCCESS   1
+#define ASTAR_FAILURE   0
+
+/* The 8 moves, cardinal first: north, east, south, west, then the diagonals. */
+static const int astar_dx[8] = { 0, 1, 0, -1, 1, 1, -1, -1 };
+static const int astar_dy[8] = { -1, 0, 1, 0, -1, 1, 1, -1 };
+
+/**
+ * @struct astar_entry
+ *         An entry of an open list.
+ */
+struct astar_entry {
+    uint32_t f;     //priority
+    uint32_t g;     //cost when pushed; stale if the node's cost is lower now
+    uint32_t id;    //what the search expands: a cell, or a graph node in hpa.c
+};
+
+/**
+ * @struct astar_heap
+ *         Binary min-heap of entries, ordered by f.
+ */
+struct astar_heap {
+    struct astar_entry *entries;
+    size_t count;
+    size_t capacity;
+};
+
+
+
+/**
+ * @brief Push an entry onto an open list, growing it if needed.
+ *
+ * @return ASTAR_SUCCESS or ASTAR_FAILURE.
+ */
+static inline int astar_heapPush(struct astar_heap *heap, uint32_t f, uint32_t g, uint32_t id) {
+    struct astar_entry *entries;
+    size_t i, parent, capacity;
+
+    if(heap->count == heap->capacity) {
+        capacity = heap->capacity ? heap->capacity * 2 : 256;
+        if( !(entries = realloc(heap->entries, capacity * sizeof(struct astar_entry))) ) {
+            dbgprint("astar_heapPush: %s\n", ERROR_REALLOC);
+            return ASTAR_FAILURE;
+        }
+        heap->entries = entries;
+        heap->capacity = capacity;
+    }
+
+    for(i = heap->count++; i; i = parent) {
+        parent = (i - 1) / 2;
+        if(heap->entries[parent].f <= f) { break; }
+        heap->entries[i] = heap->entries[parent];
+    }
+    heap->entries[i].f = f;
+    heap->entries[i].g = g;
+    heap->entries[i].id = id;
+
+    return ASTAR_SUCCESS;
+}
+
+
+
+/**
+ * @brief Pop the entry with the lowest f off a non-empty open list.
+ */
+static inline struct astar_entry astar_heapPop(struct astar_heap *heap) {
+    struct astar_entry top = heap->entries[0], last = heap->entries[--heap->count];
+    size_t i = 0, child;
+
+    while( (child = 2 * i + 1) < heap->count ) {
+        if(child + 1 < heap->count && heap->entries[child + 1].f < heap->entries[child].f) {
+            child++;
+        }
+        if(last.f <= heap->entries[child].f) { break; }
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    if(heap->count) {
+        heap->entries[i] = last;
+    }
+
+    return top;
+}
+
+#endif /*ASTAR_H*/
@@ -0,0 +1,482 @@
+/*
+ * atlas.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief Texture atlas builder. Every registered tile is repacked into a few
+ *        large pages with a skyline (bottom-left) packer, and each tile's 'src'
+ *        and 'rect' are rewritten to point into its page. Drawing a scene then
+ *        switches between a handful of surfaces instead of one per image.
+ *        Tiles that share a region of the same pixels share it in the atlas.
+ *
+ * Field Overview:
+ *  static:
+ *      atlas
+ *      atlas_compareHeight
+ *      atlas_compareRegion
+ *      atlas_skyline_fit
+ *      atlas_skyline_insert
+ *  extern:
+ *      atlas_build
+ *      atlas_close
+ *      atlas_getStats
+ *      atlas_numPages
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "ainur.h"
+#include "atlas.h"
+#include "debug.h"
+#include "image.h"
+#include "registry.h"
+#include "render.h"
+#include "tile.h"
+
+
+
+/**
+ * @struct atlas_node
+ *         One segment of a skyline: the free space above y, from x to x + width.
+ */
+struct atlas_node {
+    int x;
+    int y;
+    int width;
+};
+
+/**
+ * @struct atlas_skyline
+ *         Packing state of one page.
+ */
+struct atlas_skyline {
+    struct atlas_node *nodes;
+    int count;
+};
+
+/**
+ * @struct atlas_item
+ *         A tile being packed.
+ * @var tile
+ *      The tile.
+ * @var source
+ *      Pixels the tile currently refers to.
+ * @var from
+ *      Region of the tile in 'source'.
+ * @var to
+ *      Region of the tile in its page.
+ * @var page
+ *      Index of its page among the new pages, or -1 if it is not packed.
+ * @var region
+ *      The item that packs the pixels of this item (itself if it is the first
+ *      tile with this region).
+ */
+struct atlas_item {
+    struct tile *tile;
+    struct image_source *source;
+    SDL_Rect from;
+    SDL_Rect to;
+    int page;
+    struct atlas_item *region;
+};
+
+/**
+ * @brief Atlas state.
+ * @var pages
+ *      Images of the atlas pages.
+ * @var npages
+ *      Number of pages.
+ * @var capacity
+ *      Allocated length of 'pages'.
+ * @var generation
+ *      Number of builds so far; keeps page tags unique across rebuilds.
+ * @var stats
+ *      Result of the last build.
+ */
+static struct {
+    struct image **pages;
+    size_t npages;
+    size_t capacity;
+    unsigned int generation;
+    struct atlas_stats stats;
+} atlas = { NULL, 0, 0, 0, { 0, 0, 0, 0, 0, 0, 0.0 } };
+
+
+
+/**
+ * @brief qsort() comparator: tallest regions first, then widest.
+ */
+static int atlas_compareHeight(const void *a, const void *b) {
+    const struct atlas_item *x = *(struct atlas_item * const *)a, *y = *(struct atlas_item * const *)b;
+
+    if(x->from.h != y->from.h) {
+        return y->from.h - x->from.h;
+    }
+
+    return y->from.w - x->from.w;
+}
+
+
+
+/**
+ * @brief qsort() comparator: groups items with the same pixels and region.
+ */
+static int atlas_compareRegion(const void *a, const void *b) {
+    const struct atlas_item *x = a, *y = b;
+
+    if(x->source != y->source) {
+        return x->source < y->source ? -1 : 1;
+    }
+
+    return memcmp(&x->from, &y->from, sizeof(SDL_Rect));
+}
+
+
+
+/**
+ * @brief Find the lowest y at which a w x h box fits with its left edge at
+ *        node 'index' of a skyline.
+ *
+ * @return The y coordinate, or -1 if the box does not fit there.
+ */
+static int atlas_skyline_fit(const struct atlas_skyline *skyline, int index, int w, int h, int size) {
+    int x = skyline->nodes[index].x, y = 0, remaining = w;
+
+    if(x + w > size) {
+        return -1;
+    }
+
+    while(remaining > 0) {
+        if(skyline->nodes[index].y > y) {
+            y = skyline->nodes[index].y;
+        }
+        if(y + h > size) {
+            return -1;
+        }
+        remaining -= skyline->nodes[index].width;
+        index++;
+    }
+
+    return y;
+}
+
+
+
+/**
+ * @brief Place a w x h box on a skyline at the position that leaves its top
+ *        edge lowest (ties: the narrowest segment).
+ *
+ * @return ATLAS_SUCCESS with the position in *x, *y, or ATLAS_FAILURE if the
+ *         page is full.
+ */
+static int atlas_skyline_insert(struct atlas_skyline *skyline, int w, int h, int size, int *x, int *y) {
+    int i, fit, best = -1, best_top = INT_MAX, best_width = INT_MAX;
+
+    for(i = 0; i < skyline->count; i++) {
+        fit = atlas_skyline_fit(skyline, i, w, h, size);
+        if( fit >= 0 && (fit + h < best_top ||
+                         (fit + h == best_top && skyline->nodes[i].width < best_width)) ) {
+            best = i;
+            best_top = fit + h;
+            best_width = skyline->nodes[i].width;
+        }
+    }
+    if(best < 0) {
+        return ATLAS_FAILURE;
+    }
+
+    *x = skyline->nodes[best].x;
+    *y = best_top - h;
+
+    //insert the new segment in front of 'best'
+    memmove(&skyline->nodes[best + 1], &skyline->nodes[best],
+            (skyline->count - best) * sizeof(struct atlas_node));
+    skyline->nodes[best].x = *x;
+    skyline->nodes[best].y = best_top;
+    skyline->nodes[best].width = w;
+    skyline->count++;
+
+    //shrink or drop the segments now hidden under it
+    for(i = best + 1; i < skyline->count; ) {
+        int end = skyline->nodes[best].x + skyline->nodes[best].width;
+        int shrink = end - skyline->nodes[i].x;
+
+        if(shrink <= 0) { break; }
+
+        skyline->nodes[i].x += shrink;
+        skyline->nodes[i].width -= shrink;
+        if(skyline->nodes[i].width > 0) { break; }
+
+        memmove(&skyline->nodes[i], &skyline->nodes[i + 1],
+                (skyline->count - i - 1) * sizeof(struct atlas_node));
+        skyline->count--;
+    }
+
+    //merge neighbours of equal height
+    for(i = 0; i + 1 < skyline->count; ) {
+        if(skyline->nodes[i].y == skyline->nodes[i + 1].y) {
+            skyline->nodes[i].width += skyline->nodes[i + 1].width;
+            memmove(&skyline->nodes[i + 1], &skyline->nodes[i + 2],
+                    (skyline->count - i - 2) * sizeof(struct atlas_node));
+            skyline->count--;
+        }
+        else {
+            i++;
+        }
+    }
+
+    return ATLAS_SUCCESS;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Pack every registered tile into atlas pages and point the tiles at
+ *        them. Calling it again repacks everything, including tiles that
+ *        already point into the atlas.
+ *
+ * @param page_size
+ *        Width and height of each page; 0 for ATLAS_PAGE_SIZE.
+ * @param padding
+ *        Transparent pixels kept between regions (avoids bleeding when pages
+ *        are scaled or filtered).
+ *
+ * @return ATLAS_SUCCESS or ATLAS_FAILURE. Tiles that cannot be packed keep
+ *         their own image and are counted in atlas_stats.skipped.
+ * @note The images the tiles came from are not freed; free them once nothing
+ *       else refers to them.
+ */
+int atlas_build(int page_size, int padding) {
+    size_t n = tile_numRegistered(), i, k, nregions = 0, npages = 0;
+    struct atlas_skyline skylines[ATLAS_MAX_PAGES];
+    SDL_Surface *surfaces[ATLAS_MAX_PAGES], *source;
+    struct image *pages[ATLAS_MAX_PAGES];
+    struct atlas_item *items, **regions;
+    const SDL_PixelFormat *format = render_pixelFormat();
+    registry_handle handle = REGISTRY_INVALID_HANDLE;
+    struct atlas_stats stats = { 0, 0, 0, 0, 0, 0, 0.0 };
+    char name[64], tag[64];
+    SDL_BlendMode mode;
+    SDL_Rect to;
+    int x, y;
+
+    if(page_size <= 0) {
+        page_size = ATLAS_PAGE_SIZE;
+    }
+    if(padding < 0) {
+        padding = 0;
+    }
+    if(!n) {
+        atlas.stats = stats;
+        return ATLAS_SUCCESS;
+    }
+
+    if( !(items = malloc(n * sizeof(struct atlas_item))) ||
+        !(regions = malloc(n * sizeof(struct atlas_item *))) ) {
+        dbgprint("atlas_build: Unable to allocate %lu items: %s\n", (unsigned long)n, ERROR_MALLOC);
+
+        free(items);
+        return ATLAS_FAILURE;
+    }
+
+    //first, collect the tiles and find the distinct regions
+    for(i = 0; (handle = registry_next(&ainur.tiles, handle)) && i < n; i++) {
+        items[i].tile = tile_get(handle);
+        items[i].source = items[i].tile->src->source;
+        items[i].from = items[i].tile->rect;
+        items[i].page = -1;
+    }
+    n = i;
+    qsort(items, n, sizeof(struct atlas_item), atlas_compareRegion);
+    for(i = 0; i < n; i++) {
+        if( i && !atlas_compareRegion(&items[i - 1], &items[i]) ) {
+            items[i].region = items[i - 1].region;
+            continue;
+        }
+        items[i].region = &items[i];
+        regions[nregions++] = &items[i];
+    }
+
+    //second, pack the regions, tallest first, into the first page they fit
+    qsort(regions, nregions, sizeof(struct atlas_item *), atlas_compareHeight);
+    for(i = 0; i < nregions; i++) {
+        struct atlas_item *region = regions[i];
+        int w = region->from.w + padding, h = region->from.h + padding;
+
+        if( region->from.w <= 0 || region->from.h <= 0 || w > page_size || h > page_size ) {
+            continue;
+        }
+
+        for(k = 0; k < npages; k++) {
+            if( atlas_skyline_insert(&skylines[k], w, h, page_size, &x, &y) ) {
+                break;
+            }
+        }
+        if(k == npages) {
+            if(npages == ATLAS_MAX_PAGES) {
+                continue;
+            }
+            if( !(skylines[k].nodes = malloc((page_size + 2) * sizeof(struct atlas_node))) ) {
+                continue;
+            }
+            if( !(surfaces[k] = SDL_CreateRGBSurfaceWithFormat(0, page_size, page_size,
+                                                               format->BitsPerPixel, format->format)) ) {
+                dbgprint("atlas_build: Unable to create page %lu: %s\n", (unsigned long)k, SDL_GetError());
+
+                free(skylines[k].nodes);
+                continue;
+            }
+            skylines[k].nodes[0].x = 0;
+            skylines[k].nodes[0].y = 0;
+            skylines[k].nodes[0].width = page_size;
+            skylines[k].count = 1;
+            npages++;
+
+            if( !atlas_skyline_insert(&skylines[k], w, h, page_size, &x, &y) ) {
+                continue;
+            }
+        }
+
+        //copy the pixels, alpha included
+        if( !(source = image_getSurface(region->tile->src)) ) {
+            continue;
+        }
+        to.x = x;
+        to.y = y;
+        to.w = region->from.w;
+        to.h = region->from.h;
+        SDL_GetSurfaceBlendMode(source, &mode);
+        SDL_SetSurfaceBlendMode(source, SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(source, &region->from, surfaces[k], &to);
+        SDL_SetSurfaceBlendMode(source, mode);
+
+        region->to = to;
+        region->page = (int)k;
+        stats.used += (unsigned long)to.w * to.h;
+    }
+
+    for(k = 0; k < npages; k++) {
+        free(skylines[k].nodes);
+    }
+
+    //third, register the pages; each page gets a new tag in every build
+    atlas.generation++;
+    for(k = 0; k < npages; k++) {
+        snprintf(name, sizeof(name), "atlas:%u:%lu", atlas.generation, (unsigned long)k);
+        snprintf(tag, sizeof(tag), "atlas%u_%lu", atlas.generation, (unsigned long)k);
+        pages[k] = image_create_fromSurface(surfaces[k], name, tag);  //frees the surface on failure
+    }
+
+    //fourth, point the tiles into the pages
+    for(i = 0; i < n; i++) {
+        struct atlas_item *region = items[i].region;
+
+        if( region->page < 0 || !pages[region->page] ) {
+            stats.skipped++;
+            continue;
+        }
+        items[i].tile->src = pages[region->page];
+        items[i].tile->rect = region->to;
+        stats.tiles++;
+    }
+
+    //fifth, free the pages of the previous build that no tile refers to anymore
+    for(k = 0; k < atlas.npages; ) {
+        for(i = 0; i < n && items[i].tile->src != atlas.pages[k]; i++);
+
+        if(i == n) {
+            image_free(atlas.pages[k]);
+            atlas.pages[k] = atlas.pages[--atlas.npages];
+        }
+        else {
+            k++;
+        }
+    }
+    if( atlas.npages + npages > atlas.capacity ) {
+        struct image **grown = realloc(atlas.pages, (atlas.npages + npages) * sizeof(struct image *));
+
+        if(!grown) {
+            dbgprint("atlas_build: Unable to track atlas pages: %s\n", ERROR_REALLOC);
+        }
+        else {
+            atlas.pages = grown;
+            atlas.capacity = atlas.npages + npages;
+        }
+    }
+    for(k = 0; k < npages && atlas.npages < atlas.capacity; k++) {
+        if(pages[k]) {
+            atlas.pages[atlas.npages++] = pages[k];
+        }
+    }
+
+    stats.pages = npages;
+    stats.regions = nregions;
+    stats.area = (unsigned long)npages * page_size * page_size;
+    stats.efficiency = stats.area ? (double)stats.used / stats.area : 0.0;
+    atlas.stats = stats;
+
+    dbgprint("atlas_build: %lu tiles (%lu regions) on %lu pages of %dx%d, %.1f%% used, %lu skipped.\n",
+             (unsigned long)stats.tiles, (unsigned long)stats.regions, (unsigned long)stats.pages,
+             page_size, page_size, stats.efficiency * 100.0, (unsigned long)stats.skipped);
+
+    free(regions);
+    free(items);
+    return ATLAS_SUCCESS;
+}
+
+
+
+/**
+ * @brief Free every atlas page. Tiles that point into the atlas must be freed
+ *        first.
+ */
+void atlas_close(void) {
+    size_t k;
+
+    for(k = 0; k < atlas.npages; k++) {
+        image_free(atlas.pages[k]);
+    }
+    free(atlas.pages);
+
+    atlas.pages = NULL;
+    atlas.npages = 0;
+    atlas.capacity = 0;
+
+    return;
+}
+
+
+
+/**
+ * @brief Retrieve the result of the last atlas_build().
+ *
+ * @param stats
+ *        Filled with the page count and packing efficiency.
+ */
+void atlas_getStats(struct atlas_stats *stats) {
+    if(stats) {
+        *stats = atlas.stats;
+    }
+    return;
+}
+
+
+
+/**
+ * @brief Number of atlas pages currently in use.
+ */
+size_t atlas_numPages(void) {
+    return atlas.npages;
+}
@@ -0,0 +1,57 @@
+/*
+ * atlas.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <stddef.h>
+
+#include "image.h"
+
+#define ATLAS_SUCCESS   1
+#define ATLAS_FAILURE   0
+
+#define ATLAS_PAGE_SIZE 2048    //default width and height of a page
+#define ATLAS_MAX_PAGES 64
+
+/**
+ * @struct atlas_stats
+ *         Result of the last atlas_build(), see atlas_getStats().
+ * @var pages
+ *      Number of atlas pages.
+ * @var tiles
+ *      Number of tiles that now point into a page.
+ * @var regions
+ *      Number of distinct regions packed (tiles that share a region share pixels).
+ * @var skipped
+ *      Number of tiles left on their own image (too large, or not resident).
+ * @var used
+ *      Pixels covered by packed regions.
+ * @var area
+ *      Total pixels of all pages.
+ * @var efficiency
+ *      used / area.
+ */
+struct atlas_stats {
+    size_t pages;
+    size_t tiles;
+    size_t regions;
+    size_t skipped;
+    unsigned long used;
+    unsigned long area;
+    double efficiency;
+};
+
+/*
+ * Function declarations.
+ */
+extern int     atlas_build    (int page_size, int padding);
+extern void    atlas_close    (void);
+extern void    atlas_getStats (struct atlas_stats *stats);
+extern size_t  atlas_numPages (void);
+
+#endif /*ATLAS_H*/
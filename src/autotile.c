@@ -0,0 +1,394 @@
+/**
+ * @file autotile.c
+ *
+ * @brief Autotiling: picks the variant of every grouped palette entry
+ *        (WALLG1_0 to WALLG7_7 and their floor equivalents) from the cell's
+ *        neighbors. A neighbor mask says which neighbors are in the same group,
+ *        and a lookup table maps the mask to one of the group's 8 variants.
+ *        autotile_apply() does a whole map chunk by chunk: the groups of a
+ *        chunk and its one-cell border are copied into a byte grid, and the
+ *        masks of 16 cells are computed at once with SSE2 byte compares (with
+ *        a scalar fallback). Once created, an autotiler listens to its map and
+ *        only redoes the 3x3 cells around a changed cell.
+ *
+ * Field Overview:
+ *  static:
+ *      autotile_changed
+ *      autotile_chunk
+ *      autotile_group
+ *      autotile_maskAt
+ *      autotile_masks
+ *      autotile_set
+ *  extern:
+ *      autotile_apply
+ *      autotile_create
+ *      autotile_free
+ *      autotile_setVariant
+ *      autotile_update
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /*__SSE2__*/
+
+#include "autotile.h"
+#include "debug.h"
+#include "map.h"
+
+/* Row stride of the group grid: a chunk row, its two border cells and room
+ * for the last 16-byte load. */
+#define AUTOTILE_STRIDE     48
+
+/**
+ * @struct autotile
+ *         Autotiler of one layer of a map.
+ * @var map
+ *      The map.
+ * @var layer
+ *      The layer.
+ * @var neighbors
+ *      4 or 8.
+ * @var busy
+ *      Set while the autotiler changes cells itself, so that it does not
+ *      react to its own changes.
+ * @var lut
+ *      Variant of every neighbor mask.
+ */
+struct autotile {
+    struct map *map;
+    enum map_layer layer;
+    int neighbors;
+    int busy;
+    uint8_t lut[256];
+};
+
+/* Offsets of the neighbors, in mask bit order. */
+static const int autotile_dx[8] = { 0, 1, 0, -1,  1, 1, -1, -1 };
+static const int autotile_dy[8] = { -1, 0, 1, 0, -1, 1,  1, -1 };
+
+
+
+/**
+ * @brief Autotiled group of a cell value, or 0 if the value is not autotiled.
+ */
+static inline uint8_t autotile_group(uint16_t value) {
+    if(value <= AUTOTILE_VARIANTS || value > AUTOTILE_GROUPS * AUTOTILE_VARIANTS) {
+        return 0;
+    }
+
+    return (uint8_t)((value - 1) >> 3);
+}
+
+
+
+/**
+ * @brief Map listener: redo the cells around a changed cell.
+ */
+static void autotile_changed(struct map *m, unsigned int x, unsigned int y, void *context) {
+    struct autotile *at = context;
+
+    (void)m;
+    if(!at->busy) {
+        autotile_update(at, x, y);
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Compute the neighbor masks of a chunk from its group grid: cell (x,
+ *        y) of the chunk is grid[(y + 1) * AUTOTILE_STRIDE + x + 1]. Cells of
+ *        group 0 get mask 0.
+ */
+static void autotile_masks(const uint8_t *grid, uint8_t *masks, int neighbors) {
+    unsigned int x, y;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    __m128i c, m;
+
+    #define AUTOTILE_BIT(offset, bit) \
+        _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + (offset))), c), \
+                      _mm_set1_epi8((char)(bit)))
+
+    for(y = 0; y < MAP_CHUNK_SIZE; y++) {
+        for(x = 0; x < MAP_CHUNK_SIZE; x += 16) {
+            const uint8_t *row = grid + (y + 1) * AUTOTILE_STRIDE + x + 1;
+
+            c = _mm_loadu_si128((const __m128i *)row);
+            m = _mm_or_si128(_mm_or_si128(AUTOTILE_BIT(-AUTOTILE_STRIDE, AUTOTILE_N),
+                                          AUTOTILE_BIT(1, AUTOTILE_E)),
+                             _mm_or_si128(AUTOTILE_BIT(AUTOTILE_STRIDE, AUTOTILE_S),
+                                          AUTOTILE_BIT(-1, AUTOTILE_W)));
+            if(neighbors == 8) {
+                m = _mm_or_si128(m, _mm_or_si128(_mm_or_si128(AUTOTILE_BIT(1 - AUTOTILE_STRIDE, AUTOTILE_NE),
+                                                              AUTOTILE_BIT(1 + AUTOTILE_STRIDE, AUTOTILE_SE)),
+                                                 _mm_or_si128(AUTOTILE_BIT(AUTOTILE_STRIDE - 1, AUTOTILE_SW),
+                                                              AUTOTILE_BIT(-1 - AUTOTILE_STRIDE, AUTOTILE_NW))));
+            }
+            m = _mm_andnot_si128(_mm_cmpeq_epi8(c, zero), m);  //group 0 is not autotiled
+
+            _mm_storeu_si128((__m128i *)(masks + (y << MAP_CHUNK_SHIFT) + x), m);
+        }
+    }
+
+    #undef AUTOTILE_BIT
+#else
+    int k;
+
+    for(y = 0; y < MAP_CHUNK_SIZE; y++) {
+        for(x = 0; x < MAP_CHUNK_SIZE; x++) {
+            const uint8_t *cell = grid + (y + 1) * AUTOTILE_STRIDE + x + 1;
+            uint8_t m = 0;
+
+            for(k = 0; *cell && k < neighbors; k++) {
+                if(cell[autotile_dy[k] * AUTOTILE_STRIDE + autotile_dx[k]] == *cell) {
+                    m |= (uint8_t)(1 << k);
+                }
+            }
+            masks[(y << MAP_CHUNK_SHIFT) + x] = m;
+        }
+    }
+#endif /*__SSE2__*/
+
+    return;
+}
+
+
+
+/**
+ * @brief Neighbor mask of cell (x, y), which is in group 'group'.
+ */
+static uint8_t autotile_maskAt(const struct autotile *at, unsigned int x, unsigned int y, uint8_t group) {
+    uint8_t mask = 0;
+    int k;
+
+    for(k = 0; k < at->neighbors; k++) {
+        //coordinates left of or above the map wrap around and read as empty
+        if( autotile_group(map_getLayer(map_getCell(at->map, x + (unsigned int)autotile_dx[k],
+                                                              y + (unsigned int)autotile_dy[k]),
+                                        at->layer)) == group ) {
+            mask |= (uint8_t)(1 << k);
+        }
+    }
+
+    return mask;
+}
+
+
+
+/**
+ * @brief Give cell (x, y), of group 'group', the variant of 'mask'.
+ *
+ * @return 1 if the cell changed, 0 otherwise.
+ */
+static int autotile_set(struct autotile *at, unsigned int x, unsigned int y, uint8_t group, uint8_t mask) {
+    const struct map_cell *cell = map_getCell(at->map, x, y);
+    uint16_t value = (uint16_t)(group * AUTOTILE_VARIANTS + at->lut[mask] + 1);
+
+    if(map_getLayer(cell, at->layer) == value) {
+        return 0;
+    }
+
+    return map_setCell(at->map, x, y,
+                       at->layer == MAP_FLOOR ? value : cell->floor,
+                       at->layer == MAP_WALL ? value : cell->wall);
+}
+
+
+
+/**
+ * @brief Autotile every cell of chunk (cx, cy).
+ *
+ * @return The number of cells changed.
+ */
+static size_t autotile_chunk(struct autotile *at, unsigned int cx, unsigned int cy) {
+    uint8_t grid[(MAP_CHUNK_SIZE + 2) * AUTOTILE_STRIDE];
+    uint8_t masks[MAP_CHUNK_CELLS];
+    const struct map_chunk *chunk;
+    unsigned int x, y, x0, y0;
+    size_t changed = 0;
+    uint8_t group;
+
+    if( !(chunk = map_getChunk(at->map, cx, cy)) ) { return 0; }
+
+    //groups of the chunk and of its border; the border comes from the neighbor chunks
+    memset(grid, 0, sizeof(grid));
+    x0 = (cx << MAP_CHUNK_SHIFT) - 1;
+    y0 = (cy << MAP_CHUNK_SHIFT) - 1;
+    for(y = 0; y < MAP_CHUNK_SIZE + 2; y++) {
+        for(x = 0; x < MAP_CHUNK_SIZE + 2; x++) {
+            if(x && y && x <= MAP_CHUNK_SIZE && y <= MAP_CHUNK_SIZE) {
+                grid[y * AUTOTILE_STRIDE + x] =
+                    autotile_group(map_getLayer(&chunk->cells[((y - 1) << MAP_CHUNK_SHIFT) + x - 1], at->layer));
+            }
+            else {
+                grid[y * AUTOTILE_STRIDE + x] =
+                    autotile_group(map_getLayer(map_getCell(at->map, x0 + x, y0 + y), at->layer));
+            }
+        }
+    }
+
+    autotile_masks(grid, masks, at->neighbors);
+
+    for(y = 0; y < MAP_CHUNK_SIZE; y++) {
+        for(x = 0; x < MAP_CHUNK_SIZE; x++) {
+            if( (group = grid[(y + 1) * AUTOTILE_STRIDE + x + 1]) ) {
+                changed += autotile_set(at, x0 + 1 + x, y0 + 1 + y, group, masks[(y << MAP_CHUNK_SHIFT) + x]);
+            }
+        }
+    }
+
+    return changed;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Autotile every cell of the map.
+ *
+ * @return The number of cells changed.
+ */
+size_t autotile_apply(struct autotile *at) {
+    unsigned int cx, cy;
+    size_t changed = 0;
+
+    if(!at) { return 0; }
+
+    at->busy = 1;
+    for(cy = 0; cy < at->map->chunks_h; cy++) {
+        for(cx = 0; cx < at->map->chunks_w; cx++) {
+            changed += autotile_chunk(at, cx, cy);
+        }
+    }
+    at->busy = 0;
+
+    return changed;
+}
+
+
+
+/**
+ * @brief Create an autotiler for one layer of a map. It keeps the layer
+ *        autotiled as cells change, but existing cells are only fixed by
+ *        autotile_apply().
+ *
+ *        The default table gives variant 0 to isolated cells, 1 to ends
+ *        (one neighbor), 2 to horizontal runs (E and W), 3 to vertical runs
+ *        (N and S), 4 to corners, 5 to T junctions and 6 to crossings; with 8
+ *        neighbors, variant 7 goes to cells surrounded on all sides.
+ *
+ * @param neighbors
+ *        4 or 8.
+ *
+ * @return The autotiler, or NULL on failure.
+ */
+struct autotile *autotile_create(struct map *m, enum map_layer layer, int neighbors) {
+    static const uint8_t cardinal[16] = {
+        0, 1, 1, 4,     //none, N, E, NE corner
+        1, 3, 4, 5,     //S, N+S, E+S corner, N+E+S
+        1, 4, 2, 5,     //W, N+W corner, E+W, N+E+W
+        4, 5, 5, 6      //S+W corner, N+S+W, E+S+W, all four
+    };
+    struct autotile *at;
+    int mask;
+
+    if(!m || layer >= MAP_LAYERS || (neighbors != 4 && neighbors != 8)) {
+        dbgprint("autotile_create: Invalid map, layer or neighbor count.\n");
+        return NULL;
+    }
+
+    if( !(at = calloc(1, sizeof(struct autotile))) ) {
+        dbgprint("autotile_create: %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+    at->map = m;
+    at->layer = layer;
+    at->neighbors = neighbors;
+
+    for(mask = 0; mask < 256; mask++) {
+        at->lut[mask] = cardinal[mask & 0xf];
+    }
+    at->lut[0xff] = 7;
+
+    if( !map_addListener(m, autotile_changed, at) ) {
+        free(at);
+        return NULL;
+    }
+
+    return at;
+}
+
+
+
+/**
+ * @brief Free an autotiler and stop listening to its map.
+ */
+void autotile_free(struct autotile *at) {
+    if(!at) { return; }
+
+    map_removeListener(at->map, autotile_changed, at);
+    free(at);
+
+    return;
+}
+
+
+
+/**
+ * @brief Choose the variant of a neighbor mask (AUTOTILE_N | AUTOTILE_E ...).
+ *
+ * @return AUTOTILE_SUCCESS, or AUTOTILE_FAILURE if the mask uses diagonals
+ *         with 4 neighbors or the variant is not below AUTOTILE_VARIANTS.
+ */
+int autotile_setVariant(struct autotile *at, uint8_t mask, uint8_t variant) {
+    if(!at || variant >= AUTOTILE_VARIANTS || (at->neighbors == 4 && mask > 0xf)) {
+        return AUTOTILE_FAILURE;
+    }
+
+    at->lut[mask] = variant;
+    return AUTOTILE_SUCCESS;
+}
+
+
+
+/**
+ * @brief Autotile cell (x, y) and its neighbors, e.g. after it changed.
+ *        Called for every change once the autotiler exists.
+ *
+ * @return The number of cells changed.
+ */
+size_t autotile_update(struct autotile *at, unsigned int x, unsigned int y) {
+    unsigned int cx, cy;
+    size_t changed = 0;
+    uint8_t group;
+    int dx, dy;
+
+    if(!at) { return 0; }
+
+    at->busy = 1;
+    for(dy = -1; dy <= 1; dy++) {
+        for(dx = -1; dx <= 1; dx++) {
+            cx = x + (unsigned int)dx;
+            cy = y + (unsigned int)dy;
+            if(cx >= at->map->width || cy >= at->map->height) { continue; }
+
+            if( (group = autotile_group(map_getLayer(map_getCell(at->map, cx, cy), at->layer))) ) {
+                changed += autotile_set(at, cx, cy, group, autotile_maskAt(at, cx, cy, group));
+            }
+        }
+    }
+    at->busy = 0;
+
+    return changed;
+}
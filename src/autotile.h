@@ -0,0 +1,48 @@
+/*
+ * autotile.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef AUTOTILE_H
+#define AUTOTILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+#define AUTOTILE_SUCCESS    1
+#define AUTOTILE_FAILURE    0
+
+/* Bits of a neighbor mask; a bit is set when that neighbor is in the same
+ * palette group as the cell. 4-neighbor masks only use the first four. */
+#define AUTOTILE_N      0x01
+#define AUTOTILE_E      0x02
+#define AUTOTILE_S      0x04
+#define AUTOTILE_W      0x08
+#define AUTOTILE_NE     0x10
+#define AUTOTILE_SE     0x20
+#define AUTOTILE_SW     0x40
+#define AUTOTILE_NW     0x80
+
+/* Palette groups: palette index p is variant (p & 7) of group (p >> 3).
+ * Groups 1 to AUTOTILE_GROUPS - 1 (FLOORG1_* to FLOORG7_*, WALLG1_* to
+ * WALLG7_*) are autotiled; group 0 holds the defaults and is left alone. A
+ * cell value v is palette index v - 1, as in maprender_setPalette(). */
+#define AUTOTILE_GROUPS     8
+#define AUTOTILE_VARIANTS   8
+
+struct autotile;
+
+/*
+ * Function declarations.
+ */
+extern size_t            autotile_apply      (struct autotile *at);
+extern struct autotile * autotile_create     (struct map *m, enum map_layer layer, int neighbors);
+extern void              autotile_free       (struct autotile *at);
+extern int               autotile_setVariant (struct autotile *at, uint8_t mask, uint8_t variant);
+extern size_t            autotile_update     (struct autotile *at, unsigned int x, unsigned int y);
+
+#endif /*AUTOTILE_H*/
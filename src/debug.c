@@ -17,6 +17,7 @@
  * @note  Not affected by DEBUGGING preprocessor options
  */
 const char *ERROR_MALLOC            = "Memory allocation failure";
+const char *ERROR_CALLOC            = "Memory clearing allocation failure";
 const char *ERROR_REALLOC           = "Memory reallocation failure";
 const char *ERROR_FREE              = "Heap space freeing failure";
 const char *ERROR_NO_FILE           = "No such file or directory";
@@ -9,193 +9,646 @@
  *
  * Field Overview:
  *  static:
+ *      dice_clamp
+ *      dice_compare
+ *      dice_emit
+ *      dice_number
  *      dice_parse
+ *      dice_rollDie
+ *      dice_rollPool
+ *      dice_run
+ *      dice_saturate
+ *      dice_sumFaces
+ *      dice_sumMany
  *  extern:
  *      dice_average
+ *      dice_averageCompiled
+ *      dice_close
+ *      dice_compile
+ *      dice_init
  *      dice_roll
+ *      dice_rollCompiled
+ *      dice_rollMany
  *      dice_roll_numeric
  *      dice_valid
  */
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "ainur.h"
+#include "debug.h"
 #include "dice.h"
+#include "dicedist.h"
+#include "registry.h"
+#include "rnd.h"
 
+#define DICE_LOOP_MAX 64        //largest pool rolled one die at a time
+#define DICE_BATCH    512       //faces drawn at a time by dice_rollMany()
+#define DICE_LANES    64        //rolls evaluated side by side by dice_run()
+#define DICE_CODE_MAX 128       //longest bytecode of a format
+#define DICE_SORT_MIN 16        //largest kept pool sorted without qsort()
+#define DICE_TERM_MAX (INT64_MAX / 2)   //terms and sums saturate here
 
 
-static int dice_parse(const char *ptr, int *num, int *faces, int *bias) {
-    int state = 0,
-        val = 0,
+
+static inline int dice_clamp(int64_t val) {
+    if(val > INT_MAX) {
+        return INT_MAX;
+    }
+    if(val < INT_MIN) {
+        return INT_MIN;
+    }
+    return (int)val;
+}
+
+
+
+static inline int64_t dice_saturate(int64_t val) {
+    return (val > DICE_TERM_MAX) ? DICE_TERM_MAX : (val < -DICE_TERM_MAX) ? -DICE_TERM_MAX : val;
+}
+
+
+
+static int dice_compare(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a,
+            y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+
+/**
+ * @brief Append an instruction of 'count' words to 'code'.
+ *
+ * @return 0, or -1 if the bytecode would be too long.
+ */
+static int dice_emit(int32_t *code, size_t *length, int count, const int32_t *words) {
+    if(*length + count > DICE_CODE_MAX) {
+        return -1;
+    }
+    memcpy(code + *length, words, count * sizeof(int32_t));
+    *length += count;
+    return 0;
+}
+
+
+
+/**
+ * @brief Read a decimal number at *ptr and advance past it.
+ *
+ * @return 0, or -1 if there are no digits or the number exceeds INT_MAX.
+ */
+static int dice_number(const char **ptr, int32_t *value) {
+    int64_t val = 0;
+
+    if( !isdigit((unsigned char)**ptr) ) {
+        return -1;
+    }
+    while( isdigit((unsigned char)**ptr) ) {
+        val = (val * 10) + *(*ptr)++ - '0';
+        if(val > INT_MAX) {
+            return -1;
+        }
+    }
+
+    *value = (int32_t)val;
+    return 0;
+}
+
+
+
+/**
+ * @brief Compile a format (see dice.h) to bytecode. The numbers of the format
+ *        are folded into one constant added last.
+ *
+ * @return 0, or -1 if the format is not legal.
+ */
+static int dice_parse(const char *ptr, int32_t *code, size_t *length) {
+    int64_t bias = 0;
+    int terms = 0,
         sign = 1;
 
-    *num = 0;
-    *faces = 0;
-    *bias = 0;
+    *length = 0;
+
+    if(*ptr == '+' || *ptr == '-') {
+        sign = (*ptr++ == '-') ? -1 : 1;
+    }
 
-    while (*ptr) {
-        switch (state) {
-            case 0:
-                if (*ptr == '+') {
-                    sign = 1;
-                    state = 4;
+    while(*ptr) {
+        int32_t num = 1,
+                faces,
+                flags = 0,
+                reroll = 0,
+                keep = 0;
+        bool counted = isdigit((unsigned char)*ptr);
+
+        if( counted && dice_number(&ptr, &num) ) {
+            return -1;
+        }
+
+        if(*ptr != 'd') {
+            //a number alone
+            if(!counted) {
+                return -1;
+            }
+            bias += sign * (int64_t)num;
+        }
+        else {
+            ptr++;
+            if( num < 1 || dice_number(&ptr, &faces) || faces < 1 ) {
+                return -1;
+            }
+
+            for(;;) {
+                if(*ptr == 'k') {
+                    int32_t which = DICE_POOL_KEEP_HIGH;
+                    if(*++ptr == 'h') {
+                        ptr++;
+                    }
+                    else if(*ptr == 'l') {
+                        which = DICE_POOL_KEEP_LOW;
+                        ptr++;
+                    }
+                    if( (flags & (DICE_POOL_KEEP_HIGH | DICE_POOL_KEEP_LOW)) ||
+                        dice_number(&ptr, &keep) || keep < 1 || keep > num ) {
+                        return -1;
+                    }
+                    flags |= which;
                 }
-                else if (*ptr == '-') {
-                    sign = -1;
-                    state = 4;
+                else if(*ptr == '!') {
+                    if(flags & DICE_POOL_EXPLODE) {
+                        return -1;
+                    }
+                    flags |= DICE_POOL_EXPLODE;
+                    ptr++;
                 }
-                else if (isdigit(*ptr)) {
-                    val = *ptr - '0';
-                    if (val)
-                        state = 1;
+                else if(*ptr == 'r') {
+                    int32_t which = DICE_POOL_REROLL;
+                    if(*++ptr == 'o') {
+                        which = DICE_POOL_REROLL_ONCE;
+                        ptr++;
+                    }
+                    //rerolling every face would never end
+                    if( (flags & (DICE_POOL_REROLL | DICE_POOL_REROLL_ONCE)) ||
+                        dice_number(&ptr, &reroll) || reroll < 1 || reroll >= faces ) {
+                        return -1;
+                    }
+                    flags |= which;
                 }
                 else {
-                    goto error;
-                }
-                break;
-            case 1:
-                if (*ptr == 'd') {
-                    *num = val * sign;
-                    val = 0;
-                    sign = 1;
-                    state = 2;
+                    break;
                 }
-                else if (isdigit(*ptr)) {
-                    val = (val * 10) + *ptr - '0';
+            }
+
+            if(flags) {
+                //dicedist must be able to tabulate one die
+                double support = (double)faces * ((flags & DICE_POOL_EXPLODE) ? DICE_EXPLODE_MAX + 1 : 1);
+                if( num > DICE_POOL_MAX || support > DICEDIST_MAX_OUTCOMES ) {
+                    return -1;
                 }
-                else {
-                    goto error;
+
+                int32_t pool[] = { DICE_OP_POOL, num, faces, flags, reroll, keep };
+                if( dice_emit(code, length, 6, pool) ) {
+                    return -1;
                 }
-                break;
-            case 2:
-                if (isdigit(*ptr)) {
-                    val = *ptr - '0';
-                    if (val)
-                        state = 3;
+            }
+            else {
+                int32_t roll[] = { DICE_OP_ROLL, num, faces };
+                if( dice_emit(code, length, 3, roll) ) {
+                    return -1;
                 }
-                else {
-                    goto error;
+            }
+
+            int32_t combine = terms ? ((sign < 0) ? DICE_OP_SUB : DICE_OP_ADD) : DICE_OP_NEG;
+            if( (terms || sign < 0) && dice_emit(code, length, 1, &combine) ) {
+                return -1;
+            }
+            terms++;
+        }
+
+        if(!*ptr) {
+            break;
+        }
+        if(*ptr != '+' && *ptr != '-') {
+            return -1;
+        }
+        sign = (*ptr++ == '-') ? -1 : 1;
+
+        //a sign must be followed by a term
+        if(!*ptr) {
+            return -1;
+        }
+    }
+
+    if(bias < INT_MIN || bias > INT_MAX) {
+        return -1;
+    }
+    if(bias || !terms) {
+        int32_t constant[] = { DICE_OP_CONST, (int32_t)bias, DICE_OP_ADD };
+        if( dice_emit(code, length, terms ? 3 : 2, constant) ) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief The value of one die of a DICE_OP_POOL instruction: rerolled, then
+ *        rolled again and added while it shows its highest face.
+ */
+static int64_t dice_rollDie(const int32_t *op) {
+    const uint32_t faces = (uint32_t)op[2],
+                   below = (uint32_t)op[4];
+    const int32_t flags = op[3];
+    int64_t total = 0;
+
+    for(int explosions = 0; ; explosions++) {
+        uint32_t face;
+
+        if(flags & DICE_POOL_REROLL) {
+            //rerolling until above 'below' is a draw from what is left
+            face = below + 1 + rnd_128_bounded(faces - below);
+        }
+        else {
+            face = rnd_128_bounded(faces) + 1;
+            if( (flags & DICE_POOL_REROLL_ONCE) && face <= below ) {
+                face = rnd_128_bounded(faces) + 1;
+            }
+        }
+        total += face;
+
+        if( !(flags & DICE_POOL_EXPLODE) || face != faces || explosions == DICE_EXPLODE_MAX ) {
+            return total;
+        }
+    }
+}
+
+
+
+/**
+ * @brief Roll a DICE_OP_POOL instruction: its dice, or those it keeps.
+ */
+static int64_t dice_rollPool(const int32_t *op) {
+    const int32_t num = op[1],
+                  flags = op[3],
+                  keep = op[5];
+    int64_t sum = 0;
+
+    if( !(flags & (DICE_POOL_KEEP_HIGH | DICE_POOL_KEEP_LOW)) ) {
+        for(int32_t i = 0; i < num; i++) {
+            sum += dice_rollDie(op);
+        }
+        return sum;
+    }
+
+    int64_t pool[DICE_POOL_MAX];
+    if(num <= DICE_SORT_MIN) {
+        //insertion sort as the dice come
+        for(int32_t i = 0; i < num; i++) {
+            int64_t die = dice_rollDie(op);
+            int32_t j = i;
+            for(; j > 0 && pool[j - 1] > die; j--) {
+                pool[j] = pool[j - 1];
+            }
+            pool[j] = die;
+        }
+    }
+    else {
+        for(int32_t i = 0; i < num; i++) {
+            pool[i] = dice_rollDie(op);
+        }
+        qsort(pool, num, sizeof(int64_t), dice_compare);
+    }
+
+    const int64_t *kept = (flags & DICE_POOL_KEEP_HIGH) ? pool + num - keep : pool;
+    for(int32_t i = 0; i < keep; i++) {
+        sum += kept[i];
+    }
+    return sum;
+}
+
+
+
+/**
+ * @brief The sum of 'num' uniform draws from [0, faces), in O(log^2 faces)
+ *        draws for large pools.
+ *
+ *        [0, faces) splits into blocks of the sizes of the set bits of
+ *        'faces', largest first. The dice per block are a multinomial,
+ *        drawn as binomials on what the earlier blocks left. A die in the
+ *        block of 2^k at 'offset' shows offset plus k fair bits, so the c
+ *        dice there sum to c*offset plus, for each bit j, 2^j heads of c coins.
+ */
+static int64_t dice_sumFaces(uint32_t num, uint32_t faces) {
+    int64_t sum = 0;
+
+    if(num <= DICE_LOOP_MAX) {
+        while(num--) {
+            sum += rnd_128_bounded(faces);
+        }
+        return sum;
+    }
+
+    uint64_t left = num;
+    uint32_t offset = 0;
+    for(int k = 31; k >= 0 && left; k--) {
+        uint32_t size = UINT32_C(1) << k;
+        if( !(faces & size) ) {
+            continue;
+        }
+
+        uint64_t count = (offset + size == faces) ? left
+                       : rnd_128_binomial(left, (double)size / (double)(faces - offset));
+        left -= count;
+
+        sum += (int64_t)count * offset;
+        for(int j = 0; j < k; j++) {
+            sum += (int64_t)rnd_128_coins(count) << j;
+        }
+        offset += size;
+    }
+
+    return sum;
+}
+
+
+
+/**
+ * @brief 'lanes' rolls of 'num' plain dice of 'faces' sides into 'sums'.
+ *        Pools small enough to roll die by die draw the faces of many rolls
+ *        in one batch.
+ */
+static void dice_sumMany(int32_t num, int32_t faces, int64_t *sums, size_t lanes) {
+    uint32_t draws[DICE_BATCH];
+
+    if(lanes == 1 || num > DICE_LOOP_MAX) {
+        for(size_t i = 0; i < lanes; i++) {
+            sums[i] = num + dice_sumFaces((uint32_t)num, (uint32_t)faces);
+        }
+        return;
+    }
+
+    const size_t per_batch = DICE_BATCH / num;
+    while(lanes) {
+        size_t rolls = (lanes < per_batch) ? lanes : per_batch;
+        const uint32_t *face = draws;
+
+        rnd_128_boundedMany(draws, rolls * num, (uint32_t)faces);
+        for(size_t i = 0; i < rolls; i++) {
+            int64_t sum = num;
+            for(int32_t k = 0; k < num; k++) {
+                sum += *face++;
+            }
+            *sums++ = sum;
+        }
+        lanes -= rolls;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Evaluate the bytecode of 'dice' for 'lanes' (at most DICE_LANES)
+ *        rolls at once: each instruction runs over all of them, so plain
+ *        pools draw their faces in batches.
+ */
+static void dice_run(const struct dice *dice, int64_t *out, size_t lanes) {
+    int64_t stack[DICE_STACK][DICE_LANES];
+    const int32_t *op = dice->code,
+                  *end = dice->code + dice->length;
+    int top = 0;
+    size_t i;
+
+    while(op < end) {
+        switch(*op) {
+            case DICE_OP_CONST:
+                for(i = 0; i < lanes; i++) {
+                    stack[top][i] = op[1];
                 }
+                top++;
+                op += 2;
                 break;
-            case 3:
-                if (isdigit(*ptr)) {
-                    val = (val * 10) + *ptr - '0';
-                }
-                else if (*ptr == '+') {
-                    *faces = val;
-                    val = 0;
-                    state = 4;
-                    sign = 1;
-                }
-                else if (*ptr == '-') {
-                    *faces = val;
-                    val = 0;
-                    state = 4;
-                    sign = -1;
-                }
-                else {
-                    goto error;
-                }
+            case DICE_OP_ROLL:
+                dice_sumMany(op[1], op[2], stack[top++], lanes);
+                op += 3;
                 break;
-
-            case 4:
-                if (isdigit(*ptr)) {
-                    val = atoi(ptr);
-                    if (val)
-                        state = 5;
-                }
-                else {
-                    goto error;
+            case DICE_OP_POOL:
+                for(i = 0; i < lanes; i++) {
+                    stack[top][i] = dice_rollPool(op);
                 }
+                top++;
+                op += 6;
                 break;
-
-            case 5:
-                if (isdigit(*ptr)) {
-                    val = (val * 10) + *ptr - '0';
+            case DICE_OP_NEG:
+                for(i = 0; i < lanes; i++) {
+                    stack[top - 1][i] = -stack[top - 1][i];
                 }
-                else {
-                    goto error;
+                op++;
+                break;
+            case DICE_OP_ADD:
+            case DICE_OP_SUB:
+                top--;
+                for(i = 0; i < lanes; i++) {
+                    int64_t term = (*op == DICE_OP_ADD) ? stack[top][i] : -stack[top][i];
+                    stack[top - 1][i] = dice_saturate(stack[top - 1][i] + term);
                 }
+                op++;
                 break;
             default:
-                assert(false); /* impossible state */
-                goto error;
+                assert(false); /* impossible instruction */
+                return;
         }
+    }
+
+    memcpy(out, stack[0], lanes * sizeof(int64_t));
+    return;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+double dice_average(const char *fmt) {
+    const struct dice *dice = dice_compile(fmt);
+    return dice ? dice_averageCompiled(dice) : 0.0;
+}
+
+
+
+/**
+ * @brief The exact mean of a roll, e.g. 10.5 for "3d6".
+ */
+double dice_averageCompiled(const struct dice *dice) {
+    return dicedist_mean(dice);
+}
+
 
-        ptr++;
+
+/**
+ * @brief Free every compiled format within ainur.dice and the registry itself.
+ *        Pointers returned by dice_compile() are invalid afterwards.
+ */
+void dice_close(void) {
+    registry_handle handle = REGISTRY_INVALID_HANDLE;
+
+    while( (handle = registry_next(&ainur.dice, handle)) ) {
+        struct dice *dice = registry_get(&ainur.dice, handle);
+        dicedist_free(dice->dist);
+        free(dice);
     }
 
-    switch (state) {
-        case 0:
-            break;
-        case 1:
-            *bias = val * sign;
-            break;
-        case 2:
-            goto error;
-            break;
-        case 3:
-            *faces = val * sign;
-            break;
-        case 4:
-            *bias = val * sign;
-            break;
-        case 5:
-            *bias = val * sign;
-            break;
-        default:
-            assert(false); /* impossible state */
-            goto error;
+    registry_close(&ainur.dice);
+    return;
+}
+
+
+
+/**
+ * @brief Compile a dice format once; later calls with the same string return
+ *        the cached result.
+ *
+ * @return The compiled format, or NULL if 'fmt' is not a legal format.
+ */
+const struct dice *dice_compile(const char *fmt) {
+    if(!fmt) {
+        dbgprint("dice_compile: formal param 'fmt': %s\n", ERROR_NULL_STRING);
+        return NULL;
     }
 
-    return 0;
+    struct dice *dice = registry_lookup(&ainur.dice, fmt);
+    if(dice) {
+        return dice;
+    }
 
-error:
-    return -1;
+    int32_t code[DICE_CODE_MAX];
+    size_t length;
+    if( dice_parse(fmt, code, &length) ) {
+        return NULL;
+    }
+
+    if( !(dice = malloc(sizeof(struct dice) + length * sizeof(int32_t))) ) {
+        dbgprint("dice_compile: local var 'dice': %s\n", ERROR_MALLOC);
+        return NULL;
+    }
+    dice->dist = NULL;
+    dice->length = length;
+    memcpy(dice->code, code, length * sizeof(int32_t));
+
+    registry_handle handle = registry_insert(&ainur.dice, fmt, dice);
+    if(!handle) {
+        dbgprint("dice_compile: Unable to register dice format: %s\n", fmt);
+        free(dice);
+        return NULL;
+    }
+    dice->tag = registry_tag(&ainur.dice, handle);
+
+    return dice;
 }
 
 
 
-int dice_average(const char *fmt) {
-    int num, faces, bias;
-    dice_parse(fmt, &num, &faces, &bias);
-    return ((faces / 2) + 1) * num + bias;
+/**
+ * @brief Initialize the ainur.dice cache of compiled formats.
+ *
+ * @return DICE_SUCCESS or DICE_FAILURE.
+ */
+int dice_init(void) {
+    if(ainur.dice.buckets) {
+        return DICE_SUCCESS;
+    }
+
+    if( !registry_init(&ainur.dice, 0) ) {
+        dbgprint("dice_init: Unable to allocate memory for ainur.(struct registry dice).\n");
+
+        return DICE_FAILURE;
+    }
+
+    return DICE_SUCCESS;
 }
 
 
 
 int dice_roll(const char *ptr) {
-    int num = 0,
-        faces = 0,
-        bias = 0;
+    const struct dice *dice = dice_compile(ptr);
 
-    if (dice_parse(ptr, &num, &faces, &bias)) {
+    if (!dice) {
         assert(false); /* if uncertain, caller should have checked
                         * first */
         return 0;
     }
 
-    return dice_roll_numeric(num,faces,bias);
+    return dice_rollCompiled(dice);
 }
 
 
 
+int dice_rollCompiled(const struct dice *dice) {
+    int64_t val;
+
+    dice_run(dice, &val, 1);
+    return dice_clamp(val);
+}
+
+
+
+/**
+ * @brief Roll a compiled format 'n' times into 'out', DICE_LANES rolls per
+ *        pass over the bytecode.
+ */
+void dice_rollMany(const struct dice *dice, int *out, size_t n) {
+    int64_t vals[DICE_LANES];
+
+    while(n) {
+        size_t lanes = (n < DICE_LANES) ? n : DICE_LANES;
+
+        dice_run(dice, vals, lanes);
+        for(size_t i = 0; i < lanes; i++) {
+            *out++ = dice_clamp(vals[i]);
+        }
+        n -= lanes;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Roll 'num' dice of 'faces' sides and add 'bias'. Faces are drawn
+ *        without modulo bias from the rnd.c generator; large pools cost the
+ *        same as small ones (see dice_sumFaces()).
+ *
+ * @return The total, clamped to the range of int.
+ */
 int dice_roll_numeric(int num, int faces, int bias) {
-    int val = 0;
-    while (num--) {
-        val += (rand() % faces) + 1;
+    int64_t val = bias;
+
+    if(num > 0 && faces > 0) {
+        val += num + dice_sumFaces((uint32_t)num, (uint32_t)faces);
     }
-    val += bias;
-    return val;
+
+    return dice_clamp(val);
 }
 
 
 
 int dice_valid(const char *fmt) {
-    int num, faces, bias;
     if (!fmt)
         return 0;
-    return dice_parse(fmt, &num, &faces, &bias) ? 0 : 1;
+    return dice_compile(fmt) ? 1 : 0;
 }
@@ -1,10 +1,24 @@
 #ifndef DICE_H
 #define DICE_H
 
-/* A dice roll is specified by a string format. For example, "2d20+6". The
- * legal formats are defined by a regular expression:
+#include <stddef.h>
+#include <stdint.h>
+
+/* A dice roll is specified by a string format. For example, "2d20+6". A
+ * format is a sum of terms, each a number or a pool of dice:
+ *
+ *      format   := [sign] term (sign term)* | ""
+ *      term     := N | [N]dF modifier*
+ *      modifier := "kh" K | "kl" K | "k" K | "!" | "r" R | "ro" R
  *
- *      ([1-9][0-9]*]d[1-9][0-9]*)?([\+\-]?[1-9][0-9]*)?
+ * "kh"/"kl" keep the K highest/lowest dice of the pool ("k" is "kh"), "!"
+ * rolls a die again and adds it whenever it shows F (at most
+ * DICE_EXPLODE_MAX times), "r" rerolls a die until it shows more than R and
+ * "ro" rerolls it once if it shows R or less. Each modifier appears at most
+ * once per pool; pools with modifiers hold at most DICE_POOL_MAX dice, each
+ * with at most DICEDIST_MAX_OUTCOMES values (F, or F times DICE_EXPLODE_MAX + 1
+ * with "!"). Large kept pools roll like any other, but get no exact table:
+ * dicedist answers them by their exact mean and variance.
  *
  * Which means the following are all legal examples:
  *
@@ -12,17 +26,86 @@
  *      "2"
  *      "" (note: returns 0)
  *      "5064d21023902-10909012"
+ *      "4d6kh3"
+ *      "2d6+1d4-2"
+ *      "3d6!r1"
  *
  * The result of the dice roll is returned. If the format is invalid then it
  * will always return 0, but since 0 is a valid response you won't necessarily
  * be able to tell. To check if a format is bad use the separate dice_valid()
  * call, which returns non-zero if the format is ok and 0 otherwise.
  *
+ * Formats are compiled once: dice_compile() turns a format into bytecode,
+ * cached in ainur.dice by format string, and the string calls go through that
+ * cache.
+ */
+
+#define DICE_SUCCESS 1
+#define DICE_FAILURE 0
+
+#define DICE_EXPLODE_MAX 20     //most times one die explodes
+#define DICE_POOL_MAX    1024   //most dice in a pool with modifiers
+#define DICE_STACK       4      //deepest evaluation stack of a format
+
+/**
+ * @enum dice_op
+ *         Instructions of a compiled format, each followed by its operands.
+ *         Terms push their roll, NEG/ADD/SUB combine the top of the stack.
+ * @var DICE_OP_CONST
+ *      k: push k.
+ * @var DICE_OP_ROLL
+ *      num, faces: push the sum of 'num' plain dice.
+ * @var DICE_OP_POOL
+ *      num, faces, flags, reroll, keep: push a pool with modifiers; 'flags'
+ *      are DICE_POOL_* bits.
+ */
+enum dice_op {
+    DICE_OP_CONST,
+    DICE_OP_ROLL,
+    DICE_OP_POOL,
+    DICE_OP_NEG,
+    DICE_OP_ADD,
+    DICE_OP_SUB
+};
+
+#define DICE_POOL_EXPLODE       0x01
+#define DICE_POOL_REROLL        0x02    //until above 'reroll'
+#define DICE_POOL_REROLL_ONCE   0x04
+#define DICE_POOL_KEEP_HIGH     0x08    //the 'keep' highest dice
+#define DICE_POOL_KEEP_LOW      0x10    //the 'keep' lowest dice
+
+struct dicedist;
+
+/**
+ * @struct dice
+ *         A compiled dice format. Owned by the ainur.dice cache; valid until
+ *         dice_close().
+ * @var tag
+ *      The (interned) format string.
+ * @var dist
+ *      Its distribution once dicedist computed it (moments first, the table
+ *      when first needed), else NULL.
+ * @var length
+ *      Number of words of 'code'.
+ * @var code
+ *      The bytecode: dice_op values and their operands.
  */
+struct dice {
+    const char *tag;
+    struct dicedist *dist;
+    size_t length;
+    int32_t code[];
+};
 
-extern int dice_average      (const char *fmt);
-extern int dice_roll         (const char *fmt);
-extern int dice_roll_numeric (int num, int faces, int bias);
-extern int dice_valid        (const char *fmt);
+extern double              dice_average         (const char *fmt);
+extern double              dice_averageCompiled (const struct dice *dice);
+extern void                dice_close           (void);
+extern const struct dice * dice_compile         (const char *fmt);
+extern int                 dice_init            (void);
+extern int                 dice_roll            (const char *fmt);
+extern int                 dice_rollCompiled    (const struct dice *dice);
+extern void                dice_rollMany        (const struct dice *dice, int *out, size_t n);
+extern int                 dice_roll_numeric    (int num, int faces, int bias);
+extern int                 dice_valid           (const char *fmt);
 
 #endif
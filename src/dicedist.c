@@ -0,0 +1,1008 @@
+/**
+ * @file dicedist.c
+ *
+ * @brief Exact probability distributions of compiled dice formats, found by
+ *        running their bytecode over distributions instead of rolls. The sum
+ *        of 'num' dice is the distribution of one die convolved with itself
+ *        'num' times, found by repeated squaring: O(log num) convolutions,
+ *        done directly while one side is short and by FFT beyond. Kept pools
+ *        go through their order statistics, terms are convolved together.
+ *        The result is kept with its dice format, so asking again is a lookup.
+ *
+ *        The mean and variance come from a cheaper first pass, so asking for
+ *        them never builds a table; the table is built when dicedist_get()
+ *        or dicedist_chance() first need it. Formats with more than
+ *        DICEDIST_MAX_OUTCOMES outcomes, or with a kept pool whose order
+ *        statistics would cost more than DICEDIST_KEEP_WORK, get no table;
+ *        dicedist_chance() answers those by the normal approximation, which
+ *        is very close by then.
+ *
+ * Field Overview:
+ *  static:
+ *      dicedist_convolve
+ *      dicedist_die
+ *      dicedist_fft
+ *      dicedist_keep
+ *      dicedist_keepMoments
+ *      dicedist_keepStep
+ *      dicedist_memo
+ *      dicedist_moments
+ *      dicedist_negate
+ *      dicedist_power
+ *      dicedist_summarize
+ *      dicedist_tabulate
+ *  extern:
+ *      dicedist_chance
+ *      dicedist_free
+ *      dicedist_get
+ *      dicedist_mean
+ *      dicedist_variance
+ */
+
+#include <complex.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "dice.h"
+#include "dicedist.h"
+
+#define DICEDIST_DIRECT_MAX 64      //longest short side convolved directly
+#define DICEDIST_KEEP_WORK  2.7e8   //most steps (about keep^3 * values^2) of a kept pool's table
+#define DICEDIST_NEGLIGIBLE 1e-20   //probabilities dropped by dicedist_keepMoments()
+#define DICEDIST_BLOCKS     1024    //blocks of values walked by dicedist_keepMoments()
+#define DICEDIST_FILL       1e-15   //chance of filling a pool within a block that is walked exactly
+
+/**
+ * @struct dicedist_walk
+ *         Shared state of dicedist_keepMoments() and its steps.
+ * @var lf
+ *      lf[i] = ln(i!) for i <= num.
+ * @var binom
+ *      Scratch binomial probabilities, 'keep' of them.
+ * @var fa, fb, fc
+ *      Probability, first and second moment of the pools already full.
+ */
+struct dicedist_walk {
+    double *lf;
+    double *binom;
+    int num;
+    int keep;
+    double fa, fb, fc;
+};
+
+/**
+ * @struct dicedist_term
+ *         A value on the stack while running bytecode: outcomes min to
+ *         min + count - 1, with their table when tabulating and their
+ *         moments when summarizing.
+ */
+struct dicedist_term {
+    int64_t min;
+    int64_t count;
+    double *pmf;
+    double mean;
+    double variance;
+};
+
+
+
+/**
+ * @brief In place radix-2 FFT of 'n' (a power of two) values; 'w' holds
+ *        exp(-2 pi i k / n) for k < n/2. The inverse is left unscaled.
+ */
+static void dicedist_fft(double complex *x, size_t n, const double complex *w, int inverse) {
+    //bit reversal permutation
+    for(size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for(; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j |= bit;
+
+        if(i < j) {
+            double complex t = x[i];
+            x[i] = x[j];
+            x[j] = t;
+        }
+    }
+
+    for(size_t len = 2; len <= n; len <<= 1) {
+        size_t half = len >> 1,
+               step = n / len;
+
+        for(size_t i = 0; i < n; i += len) {
+            for(size_t j = 0; j < half; j++) {
+                double complex t = x[i + j + half] * (inverse ? conj(w[j * step]) : w[j * step]);
+                x[i + j + half] = x[i + j] - t;
+                x[i + j] += t;
+            }
+        }
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Convolve 'a' with 'b' (which may be 'a' itself).
+ *
+ * @return A new array of na + nb - 1 values, or NULL.
+ */
+static double *dicedist_convolve(const double *a, size_t na, const double *b, size_t nb) {
+    size_t nc = na + nb - 1;
+    double *c = calloc(nc, sizeof(double));
+    if(!c) {
+        dbgprint("dicedist_convolve: local var 'c': %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+
+    if(na <= DICEDIST_DIRECT_MAX || nb <= DICEDIST_DIRECT_MAX) {
+        for(size_t i = 0; i < na; i++) {
+            for(size_t j = 0; j < nb; j++) {
+                c[i + j] += a[i] * b[j];
+            }
+        }
+        return c;
+    }
+
+    size_t n = 1;
+    while(n < nc) {
+        n <<= 1;
+    }
+
+    double complex *x = calloc(n + n / 2, sizeof(double complex)),
+                   *w = x + n;
+    if(!x) {
+        dbgprint("dicedist_convolve: local var 'x': %s\n", ERROR_CALLOC);
+        free(c);
+        return NULL;
+    }
+
+    for(size_t k = 0; k < n / 2; k++) {
+        double angle = -2.0 * M_PI * (double)k / (double)n;
+        w[k] = cos(angle) + sin(angle) * I;
+    }
+
+    //one transform carries both real inputs: 'a' real, 'b' imaginary
+    for(size_t i = 0; i < na; i++) {
+        x[i] = a[i];
+    }
+    if(b != a) {
+        for(size_t i = 0; i < nb; i++) {
+            x[i] += b[i] * I;
+        }
+    }
+    dicedist_fft(x, n, w, 0);
+
+    if(b == a) {
+        for(size_t k = 0; k < n; k++) {
+            x[k] *= x[k];
+        }
+    }
+    else {
+        //A(k) B(k) = (Z(k)^2 - conj(Z(-k))^2) / 4i, pairing k with n - k
+        for(size_t k = 0; k <= n / 2; k++) {
+            size_t m = (n - k) & (n - 1);
+            double complex zk = x[k],
+                           zm = x[m];
+
+            x[k] = (zk * zk - conj(zm) * conj(zm)) / (4.0 * I);
+            x[m] = (zm * zm - conj(zk) * conj(zk)) / (4.0 * I);
+        }
+    }
+    dicedist_fft(x, n, w, 1);
+
+    //rounding leaves tiny negatives where the mass vanishes
+    for(size_t i = 0; i < nc; i++) {
+        double v = creal(x[i]) / (double)n;
+        c[i] = (v > 0.0) ? v : 0.0;
+    }
+
+    free(x);
+    return c;
+}
+
+
+
+/**
+ * @brief The distribution of one die of a DICE_OP_POOL instruction, over
+ *        the values *lo to *lo + *count - 1.
+ */
+static double *dicedist_die(const int32_t *op, int64_t *lo, int64_t *count) {
+    const int32_t faces = op[2],
+                  flags = op[3],
+                  below = op[4];
+    const int explosions = (flags & DICE_POOL_EXPLODE) ? DICE_EXPLODE_MAX : 0;
+    double *roll = malloc(((size_t)faces + (size_t)faces * (explosions + 1)) * sizeof(double)),
+           *die = roll + faces;
+    if(!roll) {
+        dbgprint("dicedist_die: local var 'roll': %s\n", ERROR_MALLOC);
+        return NULL;
+    }
+
+    //one roll, rerolls included; roll[f - 1] is P(f)
+    for(int32_t f = 1; f <= faces; f++) {
+        if(flags & DICE_POOL_REROLL) {
+            roll[f - 1] = (f > below) ? 1.0 / (faces - below) : 0.0;
+        }
+        else if(flags & DICE_POOL_REROLL_ONCE) {
+            roll[f - 1] = ((f > below) ? 1.0 : 0.0) / faces + (double)below / faces / faces;
+        }
+        else {
+            roll[f - 1] = 1.0 / faces;
+        }
+    }
+
+    //e explosions then a roll r shows e * faces + r; r < faces unless capped
+    double reach = 1.0;
+    for(int e = 0; e <= explosions; e++) {
+        for(int32_t r = 1; r <= faces; r++) {
+            die[(size_t)e * faces + r - 1] = (r < faces || e == explosions) ? reach * roll[r - 1] : 0.0;
+        }
+        reach *= roll[faces - 1];
+    }
+
+    *lo = (flags & DICE_POOL_REROLL) ? below + 1 : 1;
+    *count = (int64_t)faces * (explosions + 1) - *lo + 1;
+    memmove(roll, die + *lo - 1, (size_t)*count * sizeof(double));
+
+    return roll;
+}
+
+
+
+/**
+ * @brief The distribution of the sum of the 'keep' highest (or lowest) of
+ *        'num' dice distributed as 'die' (values lo to lo + count - 1; 'lo'
+ *        only shifts the result, so it is not needed here).
+ *
+ *        Values are visited from the best down. The state is how many dice
+ *        showed a better value, m < keep, and their sum s; at each value v,
+ *        j of the num - m other dice show v, binomially given they show v or
+ *        worse. Once m + j reaches 'keep' the kept sum is final.
+ *
+ * @return Its table over the sums keep * lo to keep * (lo + count - 1).
+ */
+static double *dicedist_keep(const double *die, int64_t count, int num, int keep, int highest) {
+    const size_t width = (size_t)(keep - 1) * count + 1,     //sums of fewer than 'keep' dice, from 0
+                 total = (size_t)keep * (count - 1) + 1;
+    double *cur = calloc(2 * (size_t)keep * width + total + (num + 1) + (keep + 1), sizeof(double)),
+           *next = cur + (size_t)keep * width,
+           *result = next + (size_t)keep * width,
+           *lf = result + total,        //lf[i] = ln(i!)
+           *binom = lf + num + 1;
+    if(!cur) {
+        dbgprint("dicedist_keep: local var 'cur': %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+
+    for(int i = 0; i <= num; i++) {
+        lf[i] = lgamma(i + 1.0);
+    }
+
+    cur[0] = 1.0;
+    double left = 1.0;  //mass of the values not visited yet
+    for(int64_t step = 0; step < count; step++) {
+        int64_t index = highest ? count - 1 - step : step;
+        double p = die[index];
+        if(p <= 0.0) {
+            continue;
+        }
+        double q = (p < left) ? p / left : 1.0;
+        left -= p;
+
+        memset(next, 0, (size_t)keep * width * sizeof(double));
+        for(int m = 0; m < keep; m++) {
+            int rest = num - m,
+                need = keep - m;
+
+            //P(j of 'rest' show this value) for j < need; the tail fills the pool
+            double below = 0.0;
+            for(int j = 0; j < need && j <= rest; j++) {
+                binom[j] = (q >= 1.0) ? (j == rest) : exp(lf[rest] - lf[j] - lf[rest - j] + j * log(q) + (rest - j) * log1p(-q));
+                below += binom[j];
+            }
+            double tail = (below < 1.0) ? 1.0 - below : 0.0;
+
+            //sums here are of the m dice of 'index' or better, counted from lo
+            for(size_t s = 0; s <= (size_t)m * (count - 1); s++) {
+                double w = cur[(size_t)m * width + s];
+                if(w == 0.0) {
+                    continue;
+                }
+                for(int j = 0; j < need && j <= rest; j++) {
+                    next[(size_t)(m + j) * width + s + (size_t)j * index] += w * binom[j];
+                }
+                result[s + (size_t)need * index] += w * tail;
+            }
+        }
+
+        double *swap = cur;
+        cur = next;
+        next = swap;
+    }
+
+    //the table is handed back in place of the whole block
+    double *table = (cur < next) ? cur : next;
+    memmove(table, result, total * sizeof(double));
+    return table;
+}
+
+
+
+/**
+ * @brief One step of dicedist_keepMoments(): each die not placed yet lands
+ *        here with probability 'q', showing (from the mean of one die) 'mu'
+ *        on average with variance 'var'. The states *first to *last of
+ *        'from' move to 'to', or to the final moments of the walk once the
+ *        pool is full; the range becomes that of 'to' (empty if first > last).
+ *
+ *        A step over several values passes 'fine': a pool that fills within
+ *        it keeps only its best dice, not the average ones, so the states
+ *        that may fill it move to 'fine' instead (widening *fine_first to
+ *        *fine_last), to be walked value by value.
+ */
+static void dicedist_keepStep(struct dicedist_walk *walk, double *from, double *to, int *first, int *last,
+                              double q, double mu, double var, double *fine, int *fine_first, int *fine_last) {
+    const double lq = log(q),
+                 lr = log1p(-q),
+                 ratio = q / (1.0 - q);
+    int lowest = walk->keep,
+        reach = -1;
+
+    for(int m = *first; m <= *last; m++) {
+        double *a = from + 3 * (size_t)m,
+               wa = a[0], wb = a[1], wc = a[2];
+        a[0] = a[1] = a[2] = 0.0;
+        if(wa < DICEDIST_NEGLIGIBLE) {
+            continue;
+        }
+
+        int rest = walk->num - m,
+            need = walk->keep - m;
+        double lambda = rest * q,
+               spread = 12.0 * sqrt(lambda * (1.0 - q)) + 12.0,
+               below = 0.0;
+
+        //P(j of 'rest' land here) for j < need, around the mode
+        int start = (q < 1.0 && lambda > spread) ? (int)(lambda - spread) : 0,
+            end = start;
+        double w = (q >= 1.0) ? (start == rest) : exp(walk->lf[rest] - walk->lf[start] - walk->lf[rest - start] + start * lq + (rest - start) * lr);
+        while(end < need && end <= rest) {
+            walk->binom[end - start] = w;
+            below += w;
+            if(end++ > lambda && w < DICEDIST_NEGLIGIBLE * below) {
+                break;
+            }
+            w = (q >= 1.0) ? (end == rest) : w * (rest - end + 1) / end * ratio;
+        }
+        double tail = (below < 1.0) ? 1.0 - below : 0.0;
+
+        if(fine && tail >= DICEDIST_FILL) {
+            double *f = fine + 3 * (size_t)m;
+            f[0] += wa;
+            f[1] += wb;
+            f[2] += wc;
+            *fine_first = (m < *fine_first) ? m : *fine_first;
+            *fine_last = (m > *fine_last) ? m : *fine_last;
+            continue;
+        }
+
+        for(int j = start; j < end; j++) {
+            double *n = to + 3 * (size_t)(m + j),
+                   d = j * mu,
+                   dd = j * var + d * d;
+            w = walk->binom[j - start];
+
+            n[0] += w * wa;
+            n[1] += w * (wb + d * wa);
+            n[2] += w * (wc + 2.0 * d * wb + dd * wa);
+        }
+        if(end > start) {
+            lowest = (m + start < lowest) ? m + start : lowest;
+            reach = (m + end - 1 > reach) ? m + end - 1 : reach;
+        }
+
+        //the tail fills the pool, with 'need' dice here
+        double d = need * mu,
+               dd = need * var + d * d;
+        walk->fa += tail * wa;
+        walk->fb += tail * (wb + d * wa);
+        walk->fc += tail * (wc + 2.0 * d * wb + dd * wa);
+    }
+
+    *first = lowest;
+    *last = reach;
+    return;
+}
+
+
+
+/**
+ * @brief Mean and variance of the sum of the 'keep' highest (or lowest) of
+ *        'num' dice distributed as 'die' (values 0 to count - 1, see
+ *        dicedist_keep()), without its table.
+ *
+ *        The same walk as dicedist_keep(), but each state m carries the
+ *        probability, first and second moment of the kept sum so far instead
+ *        of a table over sums, and only the binomial terms and states that
+ *        are not negligible are visited. Values are walked in blocks: while
+ *        the pool cannot fill, the dice landing in a block are all kept and
+ *        add its moments, whichever values they show. Sums are taken from
+ *        the mean of one die, so the variance does not cancel.
+ *
+ * @return DICEDIST_SUCCESS or DICEDIST_FAILURE (out of memory).
+ */
+static int dicedist_keepMoments(const double *die, int64_t count, int num, int keep, int highest,
+                                double *mean, double *variance) {
+    double *cur = calloc(12 * (size_t)keep + keep + (num + 1), sizeof(double)),
+           *next = cur + 3 * (size_t)keep,
+           *fine = next + 3 * (size_t)keep,
+           *fine_next = fine + 3 * (size_t)keep,
+           *swap;
+    if(!cur) {
+        dbgprint("dicedist_keepMoments: local var 'cur': %s\n", ERROR_CALLOC);
+        return DICEDIST_FAILURE;
+    }
+
+    struct dicedist_walk walk = { fine_next + 3 * (size_t)keep + keep, fine_next + 3 * (size_t)keep,
+                                  num, keep, 0.0, 0.0, 0.0 };
+    for(int i = 0; i <= num; i++) {
+        walk.lf[i] = lgamma(i + 1.0);
+    }
+
+    double center = 0.0;
+    for(int64_t i = 0; i < count; i++) {
+        center += die[i] * (double)i;
+    }
+
+    double left = 1.0;  //mass of the values not visited yet
+    int first = 0,      //live states
+        last = 0;
+    cur[0] = 1.0;
+
+    for(int64_t from = 0, to; from < count && first <= last; from = to) {
+        double base = (double)(highest ? count - 1 - from : from) - center,
+               p = 0.0, mu = 0.0, var = 0.0;
+
+        //blocks of about equal mass; moments of a die landing in one, about its first value
+        for(to = from; to < count && p < 1.0 / DICEDIST_BLOCKS; to++) {
+            int64_t index = highest ? count - 1 - to : to;
+            double x = (double)index - center - base;
+            p += die[index];
+            mu += die[index] * x;
+            var += die[index] * x * x;
+        }
+        if(p <= 0.0) {
+            continue;
+        }
+        mu /= p;
+        var = (var / p > mu * mu) ? var / p - mu * mu : 0.0;
+
+        int fine_first = keep,
+            fine_last = -1;
+        dicedist_keepStep(&walk, cur, next, &first, &last, (p < left) ? p / left : 1.0, base + mu, var,
+                          (to - from > 1) ? fine : NULL, &fine_first, &fine_last);
+        swap = cur;
+        cur = next;
+        next = swap;
+
+        //the states that may fill the pool in the block, value by value
+        double fine_left = left;
+        for(int64_t step = from; step < to && fine_first <= fine_last; step++) {
+            int64_t index = highest ? count - 1 - step : step;
+            double q = die[index];
+            if(q <= 0.0) {
+                continue;
+            }
+            q = (q < fine_left) ? q / fine_left : 1.0;
+            fine_left -= die[index];
+
+            dicedist_keepStep(&walk, fine, fine_next, &fine_first, &fine_last, q, (double)index - center, 0.0,
+                              NULL, NULL, NULL);
+            swap = fine;
+            fine = fine_next;
+            fine_next = swap;
+        }
+        left -= p;
+
+        //what did not fill it joins the other states
+        for(int m = fine_first; m <= fine_last; m++) {
+            for(int k = 0; k < 3; k++) {
+                cur[3 * (size_t)m + k] += fine[3 * (size_t)m + k];
+                fine[3 * (size_t)m + k] = 0.0;
+            }
+        }
+        if(fine_first <= fine_last) {
+            first = (first <= last && first < fine_first) ? first : fine_first;
+            last = (last > fine_last) ? last : fine_last;
+        }
+    }
+
+    free((cur < next) ? cur : next);
+
+    *mean = walk.fb / walk.fa;
+    *variance = walk.fc / walk.fa - *mean * *mean;
+    *mean += keep * center;
+    if(*variance < 0.0) {
+        *variance = 0.0;
+    }
+    return DICEDIST_SUCCESS;
+}
+
+
+
+/**
+ * @brief Mean and variance of a table of 'count' outcomes from 'min'.
+ */
+static void dicedist_moments(const double *pmf, int64_t min, int64_t count, double *mean, double *variance) {
+    double m = 0.0,
+           v = 0.0;
+
+    for(int64_t i = 0; i < count; i++) {
+        m += pmf[i] * (double)i;
+    }
+    for(int64_t i = 0; i < count; i++) {
+        v += pmf[i] * ((double)i - m) * ((double)i - m);
+    }
+
+    *mean = m + (double)min;
+    *variance = v;
+    return;
+}
+
+
+
+/**
+ * @brief Negate a term: its table reversed.
+ */
+static void dicedist_negate(struct dicedist_term *term) {
+    term->min = -(term->min + term->count - 1);
+    term->mean = -term->mean;
+
+    if(term->pmf) {
+        for(int64_t i = 0, j = term->count - 1; i < j; i++, j--) {
+            double t = term->pmf[i];
+            term->pmf[i] = term->pmf[j];
+            term->pmf[j] = t;
+        }
+    }
+    return;
+}
+
+
+
+/**
+ * @brief The distribution of the sum of 'num' dice distributed as 'die' ('n'
+ *        values), by repeated squaring.
+ *
+ * @return A new array of num * (n - 1) + 1 values, or NULL.
+ */
+static double *dicedist_power(const double *die, size_t n, uint32_t num) {
+    size_t nbase = n,
+           nsum = 0;
+    double *base = malloc(n * sizeof(double)),
+           *sum = NULL;
+    if(!base) {
+        dbgprint("dicedist_power: local var 'base': %s\n", ERROR_MALLOC);
+        return NULL;
+    }
+    memcpy(base, die, n * sizeof(double));
+
+    //'base' holds 2^bit dice
+    for(; num; num >>= 1) {
+        double *next;
+
+        if(num & 1) {
+            if(sum) {
+                next = dicedist_convolve(sum, nsum, base, nbase);
+                free(sum);
+                nsum += nbase - 1;
+            }
+            else {
+                next = malloc(nbase * sizeof(double));
+                if(next) {
+                    memcpy(next, base, nbase * sizeof(double));
+                }
+                nsum = nbase;
+            }
+            if( !(sum = next) ) {
+                break;
+            }
+        }
+
+        if(num > 1) {
+            next = dicedist_convolve(base, nbase, base, nbase);
+            free(base);
+            nbase = 2 * nbase - 1;
+            if( !(base = next) ) {
+                free(sum);
+                return NULL;
+            }
+        }
+    }
+
+    free(base);
+    return sum;
+}
+
+
+
+/**
+ * @brief Run the bytecode of 'dice' over moments: the mean and variance of
+ *        its outcomes, and whether it can be tabulated.
+ *
+ * @return Its distribution without a table (pmf NULL), with 'count' 0 if it
+ *         will never have one, or NULL if memory runs out.
+ */
+static struct dicedist *dicedist_summarize(const struct dice *dice) {
+    struct dicedist_term stack[DICE_STACK];
+    const int32_t *op = dice->code,
+                  *end = dice->code + dice->length;
+    int top = 0,
+        tabulate = 1;
+
+    while(op < end) {
+        struct dicedist_term *term = stack + top;
+        int64_t lo, n;
+        double *die;
+
+        term->pmf = NULL;
+        switch(*op) {
+            case DICE_OP_CONST:
+                term->min = op[1];
+                term->count = 1;
+                term->mean = op[1];
+                term->variance = 0.0;
+                op += 2;
+                break;
+
+            case DICE_OP_ROLL:
+                term->min = op[1];
+                term->count = (int64_t)op[1] * (op[2] - 1) + 1;
+                term->mean = (double)op[1] * (op[2] + 1.0) / 2.0;
+                term->variance = (double)op[1] * ((double)op[2] * op[2] - 1.0) / 12.0;
+                op += 3;
+                break;
+
+            case DICE_OP_POOL:
+                if( !(die = dicedist_die(op, &lo, &n)) ) {
+                    dbgprint("dicedist_summarize: Unable to summarize %s\n", dice->tag);
+                    return NULL;
+                }
+
+                if(op[3] & (DICE_POOL_KEEP_HIGH | DICE_POOL_KEEP_LOW)) {
+                    term->min = lo * op[5];
+                    term->count = (n - 1) * op[5] + 1;
+                    if( !dicedist_keepMoments(die, n, op[1], op[5], op[3] & DICE_POOL_KEEP_HIGH,
+                                              &term->mean, &term->variance) ) {
+                        free(die);
+                        return NULL;
+                    }
+                    term->mean += (double)lo * op[5];
+
+                    if( (double)op[5] * op[5] * op[5] * (double)n * (double)n > DICEDIST_KEEP_WORK ) {
+                        tabulate = 0;
+                    }
+                }
+                else {
+                    dicedist_moments(die, lo, n, &term->mean, &term->variance);
+                    term->min = lo * op[1];
+                    term->count = (n - 1) * op[1] + 1;
+                    term->mean *= op[1];
+                    term->variance *= op[1];
+                }
+                free(die);
+                op += 6;
+                break;
+
+            case DICE_OP_NEG:
+                dicedist_negate(--term);
+                op++;
+                top--;
+                break;
+
+            case DICE_OP_ADD:
+            case DICE_OP_SUB:
+                if(*op == DICE_OP_SUB) {
+                    dicedist_negate(--term);
+                }
+                else {
+                    --term;
+                }
+                struct dicedist_term *sum = term - 1;
+
+                sum->min += term->min;
+                sum->count += term->count - 1;
+                sum->mean += term->mean;
+                sum->variance += term->variance;
+                op++;
+                top -= 2;
+                break;
+        }
+        top++;
+    }
+
+    //terms only grow when summed, so the result is the largest table; outcomes must fit an int
+    struct dicedist_term *term = stack;
+    if( term->count > DICEDIST_MAX_OUTCOMES || term->min < INT_MIN || term->min + term->count - 1 > INT_MAX ) {
+        tabulate = 0;
+    }
+
+    struct dicedist *dist = malloc(sizeof(struct dicedist));
+    if(!dist) {
+        dbgprint("dicedist_summarize: local var 'dist': %s\n", ERROR_MALLOC);
+        return NULL;
+    }
+    dist->min = tabulate ? (int)term->min : 0;
+    dist->count = tabulate ? (size_t)term->count : 0;
+    dist->pmf = NULL;
+    dist->cdf = NULL;
+    dist->mean = term->mean;
+    dist->variance = term->variance;
+
+    return dist;
+}
+
+
+
+/**
+ * @brief Run the bytecode of 'dice' over distributions, filling the table of
+ *        'dist' (from dicedist_summarize(), with a non-zero 'count').
+ *
+ * @return DICEDIST_SUCCESS or DICEDIST_FAILURE (out of memory).
+ */
+static int dicedist_tabulate(const struct dice *dice, struct dicedist *dist) {
+    struct dicedist_term stack[DICE_STACK];
+    const int32_t *op = dice->code,
+                  *end = dice->code + dice->length;
+    int top = 0;
+
+    while(op < end) {
+        struct dicedist_term *term = stack + top;
+        int64_t lo, n;
+        double *die;
+
+        switch(*op) {
+            case DICE_OP_CONST:
+                term->min = op[1];
+                term->count = 1;
+                if( (term->pmf = malloc(sizeof(double))) ) {
+                    term->pmf[0] = 1.0;
+                }
+                op += 2;
+                break;
+
+            case DICE_OP_ROLL:
+                term->min = op[1];
+                term->count = (int64_t)op[1] * (op[2] - 1) + 1;
+                term->pmf = NULL;
+
+                if( (die = malloc(op[2] * sizeof(double))) ) {
+                    for(int32_t i = 0; i < op[2]; i++) {
+                        die[i] = 1.0 / op[2];
+                    }
+                    term->pmf = dicedist_power(die, op[2], (uint32_t)op[1]);
+                    free(die);
+                }
+                op += 3;
+                break;
+
+            case DICE_OP_POOL:
+                term->pmf = NULL;
+                if( !(die = dicedist_die(op, &lo, &n)) ) {
+                    break;
+                }
+
+                if(op[3] & (DICE_POOL_KEEP_HIGH | DICE_POOL_KEEP_LOW)) {
+                    term->min = lo * op[5];
+                    term->count = (n - 1) * op[5] + 1;
+                    term->pmf = dicedist_keep(die, n, op[1], op[5], op[3] & DICE_POOL_KEEP_HIGH);
+                }
+                else {
+                    term->min = lo * op[1];
+                    term->count = (n - 1) * op[1] + 1;
+                    term->pmf = dicedist_power(die, n, (uint32_t)op[1]);
+                }
+                free(die);
+                op += 6;
+                break;
+
+            case DICE_OP_NEG:
+                dicedist_negate(--term);
+                op++;
+                top--;
+                break;
+
+            case DICE_OP_ADD:
+            case DICE_OP_SUB:
+                if(*op == DICE_OP_SUB) {
+                    dicedist_negate(--term);
+                }
+                else {
+                    --term;
+                }
+                struct dicedist_term *sum = term - 1;
+                double *pmf = NULL;
+
+                if(sum->pmf && term->pmf) {
+                    pmf = dicedist_convolve(sum->pmf, sum->count, term->pmf, term->count);
+                }
+                free(sum->pmf);
+                free(term->pmf);
+
+                sum->pmf = pmf;
+                sum->min += term->min;
+                sum->count += term->count - 1;
+                op++;
+                top -= 2;
+                break;
+        }
+        top++;
+
+        if(!stack[top - 1].pmf) {
+            dbgprint("dicedist_tabulate: Unable to compute the distribution of %s\n", dice->tag);
+            while(top--) {
+                free(stack[top].pmf);
+            }
+            return DICEDIST_FAILURE;
+        }
+    }
+
+    //pmf and cdf share one block
+    double *table = malloc(2 * dist->count * sizeof(double));
+    if(!table) {
+        dbgprint("dicedist_tabulate: local var 'table': %s\n", ERROR_MALLOC);
+        free(stack[0].pmf);
+        return DICEDIST_FAILURE;
+    }
+
+    //renormalize away the rounding of the transforms
+    double total = 0.0;
+    for(size_t i = 0; i < dist->count; i++) {
+        total += stack[0].pmf[i];
+    }
+
+    double running = 0.0;
+    dist->pmf = table;
+    dist->cdf = table + dist->count;
+    for(size_t i = 0; i < dist->count; i++) {
+        dist->pmf[i] = stack[0].pmf[i] / total;
+        running += dist->pmf[i];
+        dist->cdf[i] = (running < 1.0) ? running : 1.0;
+    }
+    dist->cdf[dist->count - 1] = 1.0;
+
+    free(stack[0].pmf);
+    return DICEDIST_SUCCESS;
+}
+
+
+
+/**
+ * @brief The distribution of 'dice', computed on first use and kept with it
+ *        until dice_close(). Its moments come first; its table is only
+ *        built when 'table' asks for it.
+ */
+static const struct dicedist *dicedist_memo(const struct dice *dice, int table) {
+    //the cache owns 'dice'; memoizing does not change what it rolls
+    if(!dice->dist) {
+        ((struct dice *)dice)->dist = dicedist_summarize(dice);
+    }
+
+    struct dicedist *dist = dice->dist;
+    if( table && dist && dist->count && !dist->pmf && !dicedist_tabulate(dice, dist) ) {
+        dist->min = 0;
+        dist->count = 0;    //do not try again; answer by approximation
+    }
+
+    return dist;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief The probability that a roll of 'dice' compares to 'k' as 'op' says.
+ *        Exact through dicedist_get(), or by the normal approximation with
+ *        continuity correction for formats too large to tabulate.
+ */
+double dicedist_chance(const struct dice *dice, enum dicedist_op op, int k) {
+    const struct dicedist *dist = dicedist_memo(dice, 1);
+    double below,   //P(X < k)
+           atmost;  //P(X <= k)
+
+    if(!dist) {
+        return 0.0;
+    }
+
+    if(dist->pmf) {
+        int64_t i = (int64_t)k - dist->min;
+
+        below = (i <= 0) ? 0.0 : (i > (int64_t)dist->count) ? 1.0 : dist->cdf[i - 1];
+        atmost = (i < 0) ? 0.0 : (i >= (int64_t)dist->count) ? 1.0 : dist->cdf[i];
+    }
+    else {
+        double sd = sqrt(dist->variance);
+
+        below = 0.5 * erfc(-((double)k - 0.5 - dist->mean) / (sd * M_SQRT2));
+        atmost = 0.5 * erfc(-((double)k + 0.5 - dist->mean) / (sd * M_SQRT2));
+    }
+
+    switch(op) {
+        case DICEDIST_LT:
+            return below;
+        case DICEDIST_LE:
+            return atmost;
+        case DICEDIST_EQ:
+            return atmost - below;
+        case DICEDIST_NE:
+            return 1.0 - (atmost - below);
+        case DICEDIST_GE:
+            return 1.0 - below;
+        case DICEDIST_GT:
+            return 1.0 - atmost;
+    }
+
+    return 0.0;
+}
+
+
+
+void dicedist_free(struct dicedist *dist) {
+    if(dist) {
+        free(dist->pmf);    //'cdf' shares its block
+    }
+    free(dist);
+    return;
+}
+
+
+
+/**
+ * @brief The distribution of 'dice', computed on first use and kept with it
+ *        until dice_close().
+ *
+ * @return The distribution, or NULL for formats with more than
+ *         DICEDIST_MAX_OUTCOMES outcomes or too large a kept pool (or if
+ *         memory runs out).
+ */
+const struct dicedist *dicedist_get(const struct dice *dice) {
+    if(!dice) {
+        dbgprint("dicedist_get: formal param 'dice': %s\n", ERROR_NULL_POINTER);
+        return NULL;
+    }
+
+    const struct dicedist *dist = dicedist_memo(dice, 1);
+    return (dist && dist->pmf) ? dist : NULL;
+}
+
+
+
+/**
+ * @brief The exact mean of a roll of 'dice'. Does not build its table.
+ */
+double dicedist_mean(const struct dice *dice) {
+    const struct dicedist *dist = dicedist_memo(dice, 0);
+    return dist ? dist->mean : 0.0;
+}
+
+
+
+/**
+ * @brief The exact variance of a roll of 'dice'. Does not build its table.
+ */
+double dicedist_variance(const struct dice *dice) {
+    const struct dicedist *dist = dicedist_memo(dice, 0);
+    return dist ? dist->variance : 0.0;
+}
@@ -0,0 +1,67 @@
+/*
+ * dicedist.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef DICEDIST_H
+#define DICEDIST_H
+
+#include <stddef.h>
+
+#include "dice.h"
+
+#define DICEDIST_SUCCESS 1
+#define DICEDIST_FAILURE 0
+
+#define DICEDIST_MAX_OUTCOMES (1 << 18)    //larger distributions are only approximated
+
+/**
+ * @enum dicedist_op
+ *         Comparison of a roll against a target, see dicedist_chance().
+ */
+enum dicedist_op {
+    DICEDIST_LT,
+    DICEDIST_LE,
+    DICEDIST_EQ,
+    DICEDIST_NE,
+    DICEDIST_GE,
+    DICEDIST_GT
+};
+
+/**
+ * @struct dicedist
+ *         The exact distribution of a compiled dice format.
+ * @var min
+ *      Smallest outcome.
+ * @var count
+ *      Number of outcomes: min to min + count - 1; 0 for formats that get no
+ *      table.
+ * @var pmf
+ *      Probability of each outcome; pmf[i] is P(X = min + i). NULL until the
+ *      table is needed, see dicedist_get().
+ * @var cdf
+ *      Running sums of 'pmf'; cdf[i] is P(X <= min + i).
+ * @var mean, variance
+ *      Moments of the outcome.
+ */
+struct dicedist {
+    int min;
+    size_t count;
+    double *pmf;
+    double *cdf;
+    double mean;
+    double variance;
+};
+
+/*
+ * Function declarations.
+ */
+extern double                  dicedist_chance   (const struct dice *dice, enum dicedist_op op, int k);
+extern void                    dicedist_free     (struct dicedist *dist);
+extern const struct dicedist * dicedist_get      (const struct dice *dice);
+extern double                  dicedist_mean     (const struct dice *dice);
+extern double                  dicedist_variance (const struct dice *dice);
+
+#endif /*DICEDIST_H*/
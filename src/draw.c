@@ -2,7 +2,7 @@
  * @file draw.c
  */
 
-#include <SDL/SDL.h>
+#include <SDL2/SDL.h>
 
 #include "draw.h"
 
@@ -12,9 +12,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
+#include <unistd.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <SDL2/SDL_rwops.h>
 
+#include "ainur.h"
 #include "debug.h"
+#include "vfs.h"
 
 
 
@@ -22,17 +29,18 @@
  * @brief Determines if a filename is valid
  *
  * @param filename
- *        Name of a file to test
+ *        Name of a file to test, in the VFS or a path outside of it
  *
  * @return File exists: 1; File does not exist: 0
  */
 int file_exists(const char *filename) {
-    //attempt to open file with name 'filename'
-    FILE *file = fopen(filename, "r");
+    //files in the search roots are known without touching the disk
+    if( vfs_exists(filename) ) {
+        return 1;
+    }
 
-    //if the pointer is valid, return 1, true
-    if(file) {
-        fclose(file);
+    //anything else is checked without opening it
+    if( filename && !access(filename, R_OK) ) {
         return 1;
     }
 
@@ -226,12 +234,10 @@ FILE *file_open(const char *filename, const char *mode) {
 
 
 /**
- * @NOTE: Construction still in process!!!!!!!!
- *
- * @brief Loads a specified file into the Lua API.
+ * @brief Loads a specified file into the Lua API and runs it.
  *
  * @param filename
- *        File to load.
+ *        File to load, in the VFS or a path outside of it.
  *
  * @return 1: successfully loaded; 0: unsuccessfully loaded
  */
@@ -251,17 +257,72 @@ int file_load(const char *filename) {
         return 0;
     }
 
-    /*
-     * Lua load functions go below.
-     */
+    SDL_RWops *rw = vfs_openRW(filename);
+    Sint64 size;
+    char *buffer;
+
+    if(!rw) {
+        return 0;
+    }
+
+    //read the whole script in one go
+    if( (size = SDL_RWsize(rw)) < 0 || !(buffer = malloc(size ? (size_t)size : 1)) ) {
+        dbgprint("file_load() => Unable to read %s.\n", filename);
+
+        SDL_RWclose(rw);
+        return 0;
+    }
+    if( SDL_RWread(rw, buffer, 1, (size_t)size) != (size_t)size ) {
+        dbgprint("file_load() => Unable to read %s: %s\n", filename, SDL_GetError());
+
+        free(buffer);
+        SDL_RWclose(rw);
+        return 0;
+    }
+    SDL_RWclose(rw);
+
+    if( luaL_loadbuffer(ainur.lkernel, buffer, (size_t)size, filename) ||
+        lua_pcall(ainur.lkernel, 0, 0, 0) ) {
+        dbgprint("file_load() => %s\n", lua_tostring(ainur.lkernel, -1));
+
+        lua_pop(ainur.lkernel, 1);
+        free(buffer);
+        return 0;
+    }
 
+    free(buffer);
     return 1;
 }
 
 
 
+/**
+ * @brief Loads a file from a directory into the Lua API and runs it.
+ *
+ * @param directory
+ *        The directory of the file, relative to the VFS search roots.
+ * @param filename
+ *        The name of the file.
+ *
+ * @return 1: successfully loaded; 0: unsuccessfully loaded
+ */
 int file_load_from_directory(const char *directory, const char *filename) {
+    char name[PATH_MAX];
 
+    if(!directory || !filename) {
+        dbgprint("file_load_from_directory() => formal params: %s\n", ERROR_NULL_STRING);
 
-    return 1;
+        return 0;
+    }
+
+    //build the name on the stack; no heap path is needed
+    if( snprintf(name, sizeof(name), "%s%s%s", directory,
+                 (*directory && directory[strlen(directory) - 1] != '/') ? "/" : "",
+                 filename) >= (int)sizeof(name) ) {
+        dbgprint("file_load_from_directory() => Path too long: %s%s\n", directory, filename);
+
+        return 0;
+    }
+
+    return file_load(name);
 }
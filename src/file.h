@@ -21,6 +21,8 @@ char *file_mkpath(const char *directory, const char *filename);
 
 FILE *file_open(const char *filename, const char *mode);
 
+int file_load(const char *filename);
+
 int file_load_from_directory(const char *directory, const char *filename);
 
 #endif /* FILE_H_ */
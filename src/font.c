@@ -17,7 +17,8 @@
 #include "ainur.h"
 #include "color.h"
 #include "debug.h"
-#include "file.h"
+#include "pack.h"
+#include "vfs.h"
 
 
 
@@ -66,7 +67,7 @@ int font_init(void) {
  * @brief Loads a truetype font with a specified size.
  *
  * @param filename
- *        Name of the .ttf file to open
+ *        Name of the .ttf file to open, in the VFS or a path outside of it
  * @param ptsize
  *        Size of the font to display.
  *
@@ -90,14 +91,14 @@ TTF_Font *font_load(const char *filename, int ptsize)
         return NULL;
     }
 
-    //test to see if file exists
-    if( !file_exists(filename) ) {
-        //file_exists will print an error message
+    //open the file once; vfs_openRW will print an error message
+    SDL_RWops *rw = vfs_openRW(filename);
+    if(!rw) {
         return NULL;
     }
 
     TTF_Font *output;
-    output = TTF_OpenFont(filename, ptsize);
+    output = TTF_OpenFontRW(rw, 1, ptsize);     //closes 'rw'
 
     if(!output) {
         #ifdef DEBUGGING
@@ -117,11 +118,14 @@ TTF_Font *font_load(const char *filename, int ptsize)
 
 
 /**
- *
+ * @brief Loads the main font, from the main asset pack if it has one.
  */
 int font_initMain()
 {
-    ainur.font = font_load("VL-Gothic-Regular.ttf", 15);
+    ainur.font = pack_openFont(ainur.pack, "VL-Gothic-Regular.ttf", 15);
+    if( !(ainur.font) ) {
+        ainur.font = font_load("VL-Gothic-Regular.ttf", 15);
+    }
     if( !(ainur.font) ) {
         #ifdef DEBUGGING
         if(debug_getDebugStatus()) {
@@ -0,0 +1,553 @@
+/**
+ * @file fov.c
+ *
+ * @brief Field of view and lighting by symmetric recursive shadowcasting.
+ *        Sight is cast in the eight octants around a viewer, within a radius,
+ *        and the cells seen are kept as a bitmap centered on the viewer: one
+ *        plane per octant, and one with all of them. The casting is symmetric:
+ *        a cell is seen from the viewer exactly when the viewer is seen from
+ *        the cell, walls aside.
+ *
+ *        Octants are only recast when they may have changed: a wall edited
+ *        inside an octant (see fov_invalidate()) dirties that octant only, and
+ *        when the viewer steps one cell, octants that had no wall in sight are
+ *        kept unless the cells entering them hold one. Updates allocate no
+ *        memory, and fov_updateBatch() spreads many viewers over the worker
+ *        pool.
+ *
+ * Field Overview:
+ *  static:
+ *      fov_blocked
+ *      fov_cast
+ *      fov_contains
+ *      fov_floorDiv
+ *      fov_reveal
+ *      fov_scan
+ *      fov_toMap
+ *      fov_toOctant
+ *      fov_updateJob
+ *  extern:
+ *      fov_create
+ *      fov_free
+ *      fov_getBits
+ *      fov_invalidate
+ *      fov_isVisible
+ *      fov_light
+ *      fov_setOrigin
+ *      fov_update
+ *      fov_updateBatch
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "fov.h"
+#include "map.h"
+#include "workers.h"
+
+#define FOV_OCTANTS     8
+#define FOV_ALL         0xff    //every octant, as a bitmask
+
+/**
+ * @struct fov
+ *         Field of view of one viewer.
+ * @var radius, limit
+ *      Sight radius; limit[d] is the last column seen at depth d of an octant,
+ *      so that cells with d * d + c * c <= radius * (radius + 1) are in range.
+ * @var x, y
+ *      Viewer position set by fov_setOrigin().
+ * @var cast_x, cast_y
+ *      Position the planes were cast from.
+ * @var dirty
+ *      Octants to recast, as a bitmask.
+ * @var open
+ *      Octants that held no wall when cast, as a bitmask.
+ * @var planes
+ *      FOV_OCTANTS + 1 bitmaps of side * stride words each: one per octant and
+ *      the union of them. Bit (dx + radius) of row (dy + radius) is the cell
+ *      at (dx, dy) from the viewer.
+ */
+struct fov {
+    const struct map *map;
+    int radius;
+    int side;
+    size_t stride;
+    int x;
+    int y;
+    int cast_x;
+    int cast_y;
+    uint8_t dirty;
+    uint8_t open;
+    uint16_t *limit;
+    uint64_t *planes;
+};
+
+/**
+ * @struct fov_caster
+ *         State of the casting of one octant.
+ */
+struct fov_caster {
+    const struct fov *f;
+    uint64_t *plane;
+    int octant;
+    int open;   //no wall was met
+};
+
+
+
+/**
+ * @brief Floor of a / b, for b > 0.
+ */
+static inline int fov_floorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+
+
+/**
+ * @brief Offset from the viewer of the cell at depth 'd', column 'c' of an
+ *        octant. Octants 2q and 2q + 1 share quadrant q (north, east, south,
+ *        west) and hold its columns <= 0 and >= 0 respectively.
+ */
+static inline void fov_toMap(int octant, int d, int c, int *dx, int *dy) {
+    switch(octant >> 1) {
+    case 0:  *dx = c;  *dy = -d; break;
+    case 1:  *dx = d;  *dy = c;  break;
+    case 2:  *dx = c;  *dy = d;  break;
+    default: *dx = -d; *dy = c;  break;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Inverse of fov_toMap().
+ */
+static inline void fov_toOctant(int octant, int dx, int dy, int *d, int *c) {
+    switch(octant >> 1) {
+    case 0:  *d = -dy; *c = dx; break;
+    case 1:  *d = dx;  *c = dy; break;
+    case 2:  *d = dy;  *c = dx; break;
+    default: *d = -dx; *c = dy; break;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Whether depth 'd', column 'c' is in range of an octant.
+ */
+static inline int fov_contains(const struct fov *f, int octant, int d, int c) {
+    if(d < 0 || d > f->radius) { return 0; }
+
+    return (octant & 1) ? (c >= 0 && c <= f->limit[d]) : (c <= 0 && c >= -f->limit[d]);
+}
+
+
+
+/**
+ * @brief Set the bit of the cell at (dx, dy) from the viewer in a plane.
+ */
+static inline void fov_reveal(const struct fov *f, uint64_t *plane, int dx, int dy) {
+    const unsigned int bit = (unsigned int)(dx + f->radius);
+
+    plane[(size_t)(dy + f->radius) * f->stride + bit / 64] |= (uint64_t)1 << (bit % 64);
+
+    return;
+}
+
+
+
+/**
+ * @brief Cast one row of an octant, between the slopes sn / sd and en / ed
+ *        (column over depth, sd and ed > 0), and recurse into the rows behind
+ *        it. A cell is lit when its center is within the slopes; walls are
+ *        lit whenever any part of them is, so that the casting is symmetric.
+ */
+static void fov_scan(struct fov_caster *caster, int d, int sn, int sd, int en, int ed) {
+    const struct fov *f = caster->f;
+    int c, lo, hi, dx, dy, wall, prev = -1;
+
+    if(d > f->radius) { return; }
+
+    //columns whose centers round into the slopes, ties going outward
+    lo = fov_floorDiv(2 * d * sn + sd, 2 * sd);
+    hi = -fov_floorDiv(ed - 2 * d * en, 2 * ed);
+    if(lo < -f->limit[d]) { lo = -f->limit[d]; }
+    if(hi > f->limit[d]) { hi = f->limit[d]; }
+
+    for(c = lo; c <= hi; c++) {
+        fov_toMap(caster->octant, d, c, &dx, &dy);
+        wall = fov_opaque(f->map, f->cast_x + dx, f->cast_y + dy);
+        if(wall) { caster->open = 0; }
+
+        if( wall || (c * sd >= d * sn && c * ed <= d * en) ) {
+            fov_reveal(f, caster->plane, dx, dy);
+        }
+        if(prev == 1 && !wall) {
+            //the shadow of the walls ends: the row starts again at this cell
+            sn = 2 * c - 1;
+            sd = 2 * d;
+        }
+        if(prev == 0 && wall) {
+            //the open span before this wall goes on behind it
+            fov_scan(caster, d + 1, sn, sd, 2 * c - 1, 2 * d);
+        }
+        prev = wall;
+    }
+    if(prev == 0) {
+        fov_scan(caster, d + 1, sn, sd, en, ed);
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Recast one octant from (f->cast_x, f->cast_y).
+ */
+static void fov_cast(struct fov *f, int octant) {
+    const size_t words = (size_t)f->side * f->stride;
+    struct fov_caster caster = { f, f->planes + (size_t)octant * words, octant, 1 };
+
+    memset(caster.plane, 0, words * sizeof(uint64_t));
+    fov_reveal(f, caster.plane, 0, 0);
+    if(octant & 1) {
+        fov_scan(&caster, 1, 0, 1, 1, 1);
+    }
+    else {
+        fov_scan(&caster, 1, -1, 1, 0, 1);
+    }
+
+    if(caster.open) {
+        f->open |= (uint8_t)(1 << octant);
+    }
+    else {
+        f->open &= (uint8_t)~(1 << octant);
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Whether an octant without walls, cast from (cast_x, cast_y), would
+ *        meet one after the viewer steps by (mx, my). Only the cells that
+ *        step brings into range are checked, a few per depth.
+ */
+static int fov_blocked(const struct fov *f, int octant, int mx, int my) {
+    int md, mc, d, c, lo, hi, next_lo, next_hi, span[4], k, dx, dy;
+
+    fov_toOctant(octant, mx, my, &md, &mc);
+
+    //the cell the viewer left is not known to be clear
+    if( fov_contains(f, octant, -md, -mc) && fov_opaque(f->map, f->cast_x, f->cast_y) ) {
+        return 1;
+    }
+
+    for(d = 1; d <= f->radius; d++) {
+        lo = (octant & 1) ? 0 : -f->limit[d];
+        hi = (octant & 1) ? f->limit[d] : 0;
+
+        //cells c of this row whose (d + md, c + mc) is out of range were not in range before
+        if(d + md < 0 || d + md > f->radius) {
+            span[0] = lo; span[1] = hi;
+            span[2] = 1;  span[3] = 0;
+        }
+        else {
+            next_lo = ((octant & 1) ? 0 : -f->limit[d + md]) - mc;
+            next_hi = ((octant & 1) ? f->limit[d + md] : 0) - mc;
+            span[0] = lo;                                 span[1] = next_lo - 1 < hi ? next_lo - 1 : hi;
+            span[2] = next_hi + 1 > lo ? next_hi + 1 : lo; span[3] = hi;
+            if(span[2] <= span[1]) { span[2] = span[1] + 1; }
+        }
+
+        for(k = 0; k < 4; k += 2) {
+            for(c = span[k]; c <= span[k + 1]; c++) {
+                fov_toMap(octant, d, c, &dx, &dy);
+                if( fov_opaque(f->map, f->x + dx, f->y + dy) ) { return 1; }
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Worker job: update the field of view fovs[index].
+ */
+static void fov_updateJob(void *context, size_t index) {
+    fov_update(((struct fov **)context)[index]);
+    return;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Create a field of view over a map. It is computed by the first
+ *        fov_update(), after fov_setOrigin().
+ *
+ * @param m
+ *        The map; it must outlive the field of view.
+ * @param radius
+ *        Sight radius in cells, at most FOV_MAX_RADIUS.
+ *
+ * @return The field of view, or NULL on failure.
+ */
+struct fov *fov_create(const struct map *m, unsigned int radius) {
+    struct fov *f;
+    int d;
+
+    if(!m) {
+        dbgprint("fov_create: formal param 'm': %s\n", ERROR_NULL_POINTER);
+        return NULL;
+    }
+    if(radius > FOV_MAX_RADIUS) {
+        dbgprint("fov_create: radius %u exceeds %d.\n", radius, FOV_MAX_RADIUS);
+        return NULL;
+    }
+
+    if( !(f = calloc(1, sizeof(struct fov))) ) {
+        dbgprint("fov_create: %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+    f->map = m;
+    f->radius = (int)radius;
+    f->side = 2 * (int)radius + 1;
+    f->stride = ((size_t)f->side + 63) / 64;
+    f->dirty = FOV_ALL;
+
+    if( !(f->limit = malloc((radius + 1) * sizeof(uint16_t))) ||
+        !(f->planes = calloc((FOV_OCTANTS + 1) * (size_t)f->side * f->stride, sizeof(uint64_t))) ) {
+        dbgprint("fov_create: %s\n", ERROR_CALLOC);
+        fov_free(f);
+        return NULL;
+    }
+
+    for(d = 0; d <= f->radius; d++) {
+        f->limit[d] = (uint16_t)sqrt((double)(f->radius * (f->radius + 1) - d * d));
+        if(f->limit[d] > d) { f->limit[d] = (uint16_t)d; }
+    }
+
+    return f;
+}
+
+
+
+/**
+ * @brief Free a field of view.
+ */
+void fov_free(struct fov *f) {
+    if(!f) { return; }
+
+    free(f->limit);
+    free(f->planes);
+    free(f);
+
+    return;
+}
+
+
+
+/**
+ * @brief Retrieve the bitmap of the cells seen, as of the last fov_update().
+ *
+ * @param x, y
+ *        Receive the map cell of bit 0 of row 0.
+ * @param stride
+ *        Receives the number of words per row; there are 2 * radius + 1 rows
+ *        and bits per row.
+ *
+ * @return The bitmap, bit (x % 64) of word (x / 64) being column x of a row.
+ */
+const uint64_t *fov_getBits(const struct fov *f, int *x, int *y, size_t *stride) {
+    if(!f) { return NULL; }
+
+    if(x) { *x = f->cast_x - f->radius; }
+    if(y) { *y = f->cast_y - f->radius; }
+    if(stride) { *stride = f->stride; }
+
+    return f->planes + FOV_OCTANTS * (size_t)f->side * f->stride;
+}
+
+
+
+/**
+ * @brief Tell a field of view that whether cell (x, y) blocks sight changed,
+ *        so that the octants it lies in are recast by the next fov_update().
+ *        Does nothing for cells out of range.
+ */
+void fov_invalidate(struct fov *f, int x, int y) {
+    int octant, d, c;
+
+    if(!f) { return; }
+
+    for(octant = 0; octant < FOV_OCTANTS; octant++) {
+        fov_toOctant(octant, x - f->cast_x, y - f->cast_y, &d, &c);
+        if( fov_contains(f, octant, d, c) ) {
+            f->dirty |= (uint8_t)(1 << octant);
+        }
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Whether cell (x, y) was seen, as of the last fov_update().
+ */
+int fov_isVisible(const struct fov *f, int x, int y) {
+    const uint64_t *bits;
+    int dx, dy;
+
+    if(!f) { return 0; }
+
+    dx = x - f->cast_x + f->radius;
+    dy = y - f->cast_y + f->radius;
+    if( (unsigned int)dx >= (unsigned int)f->side || (unsigned int)dy >= (unsigned int)f->side ) { return 0; }
+
+    bits = f->planes + FOV_OCTANTS * (size_t)f->side * f->stride;
+
+    return (int)((bits[(size_t)dy * f->stride + (unsigned int)dx / 64] >> ((unsigned int)dx % 64)) & 1);
+}
+
+
+
+/**
+ * @brief Add the light of a source seen through a field of view to a light
+ *        map: 'intensity' at the source, fading with the square of the
+ *        distance to nothing past the radius. Sums saturate at 255.
+ *
+ * @param light
+ *        width * height light levels of the cells from (x, y), row by row.
+ */
+void fov_light(const struct fov *f, uint8_t *light, int x, int y, unsigned int width, unsigned int height, unsigned int intensity) {
+    const uint64_t *bits;
+    int x0, y0, x1, y1, i, j, dx, dy, falloff;
+    unsigned int level;
+    uint8_t *cell;
+
+    if(!f || !light) { return; }
+
+    bits = f->planes + FOV_OCTANTS * (size_t)f->side * f->stride;
+    falloff = f->radius * (f->radius + 1) + 1;
+
+    //cells both in the light map and the bitmap
+    x0 = f->cast_x - f->radius > x ? f->cast_x - f->radius : x;
+    y0 = f->cast_y - f->radius > y ? f->cast_y - f->radius : y;
+    x1 = f->cast_x + f->radius < x + (int)width - 1 ? f->cast_x + f->radius : x + (int)width - 1;
+    y1 = f->cast_y + f->radius < y + (int)height - 1 ? f->cast_y + f->radius : y + (int)height - 1;
+
+    for(j = y0; j <= y1; j++) {
+        dy = j - f->cast_y;
+        for(i = x0; i <= x1; i++) {
+            dx = i - f->cast_x;
+            if( !((bits[(size_t)(dy + f->radius) * f->stride + (unsigned int)(dx + f->radius) / 64] >>
+                   ((unsigned int)(dx + f->radius) % 64)) & 1) ) {
+                continue;
+            }
+
+            cell = &light[(size_t)(j - y) * width + (size_t)(i - x)];
+            level = *cell + intensity * (unsigned int)(falloff - dx * dx - dy * dy) / (unsigned int)falloff;
+            *cell = (uint8_t)(level > 255 ? 255 : level);
+        }
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Move the viewer of a field of view; it is recast by the next
+ *        fov_update().
+ */
+void fov_setOrigin(struct fov *f, int x, int y) {
+    if(!f) { return; }
+
+    f->x = x;
+    f->y = y;
+
+    return;
+}
+
+
+
+/**
+ * @brief Recast the octants of a field of view that the viewer's moves and
+ *        fov_invalidate() calls may have changed since the last update.
+ *
+ * @return The number of octants recast.
+ */
+int fov_update(struct fov *f) {
+    int octant, mx, my, recast = 0;
+    size_t i, words;
+    uint64_t *all;
+
+    if(!f) { return 0; }
+    words = (size_t)f->side * f->stride;
+    all = f->planes + FOV_OCTANTS * words;
+
+    if(f->x != f->cast_x || f->y != f->cast_y) {
+        mx = f->x - f->cast_x;
+        my = f->y - f->cast_y;
+        for(octant = 0; octant < FOV_OCTANTS; octant++) {
+            //a wall-free octant looks the same one step away, if no wall steps into it
+            if( abs(mx) > 1 || abs(my) > 1 || !(f->open & (1 << octant)) ||
+                fov_blocked(f, octant, mx, my) ) {
+                f->dirty |= (uint8_t)(1 << octant);
+            }
+        }
+        f->cast_x = f->x;
+        f->cast_y = f->y;
+    }
+
+    for(octant = 0; octant < FOV_OCTANTS; octant++) {
+        if(f->dirty & (1 << octant)) {
+            fov_cast(f, octant);
+            recast++;
+        }
+    }
+    f->dirty = 0;
+
+    if(recast) {
+        for(i = 0; i < words; i++) {
+            all[i] = f->planes[i] | f->planes[words + i] | f->planes[2 * words + i] |
+                     f->planes[3 * words + i] | f->planes[4 * words + i] | f->planes[5 * words + i] |
+                     f->planes[6 * words + i] | f->planes[7 * words + i];
+        }
+    }
+
+    return recast;
+}
+
+
+
+/**
+ * @brief Update many fields of view at once on the worker pool. They may share
+ *        a map, which must not change meanwhile.
+ */
+void fov_updateBatch(struct fov **fovs, size_t count) {
+    if(!fovs || !count) { return; }
+
+    workers_run(fov_updateJob, fovs, count);
+
+    return;
+}
@@ -0,0 +1,45 @@
+/*
+ * fov.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef FOV_H
+#define FOV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+#define FOV_SUCCESS 1
+#define FOV_FAILURE 0
+
+#define FOV_MAX_RADIUS  127
+
+struct fov;
+
+/**
+ * @brief Whether a cell blocks sight: it has a wall, or is outside the map.
+ */
+static inline int fov_opaque(const struct map *m, int x, int y) {
+    if( (unsigned int)x >= m->width || (unsigned int)y >= m->height ) { return 1; }
+
+    return map_getCell(m, (unsigned int)x, (unsigned int)y)->wall != MAP_NONE;
+}
+
+/*
+ * Function declarations.
+ */
+extern struct fov *     fov_create      (const struct map *m, unsigned int radius);
+extern void             fov_free        (struct fov *f);
+extern const uint64_t * fov_getBits     (const struct fov *f, int *x, int *y, size_t *stride);
+extern void             fov_invalidate  (struct fov *f, int x, int y);
+extern int              fov_isVisible   (const struct fov *f, int x, int y);
+extern void             fov_light       (const struct fov *f, uint8_t *light, int x, int y, unsigned int width, unsigned int height, unsigned int intensity);
+extern void             fov_setOrigin   (struct fov *f, int x, int y);
+extern int              fov_update      (struct fov *f);
+extern void             fov_updateBatch (struct fov **fovs, size_t count);
+
+#endif /*FOV_H*/
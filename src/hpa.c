@@ -0,0 +1,862 @@
+/**
+ * @file hpa.c
+ *
+ * @brief Hierarchical pathfinding (HPA*) over map chunks. Every border
+ *        between two chunks is cut into entrances, maximal runs of cells that
+ *        are passable on both sides; each entrance gets a node (or one at each
+ *        end if it is wide) on both sides of the border. Nodes of the same
+ *        chunk are joined by the cost of the shortest path between them inside
+ *        the chunk, and nodes facing each other across a border by one step.
+ *
+ *        hpa_find() connects the start and goal to the nodes of their chunks
+ *        and searches that graph with A*; it returns waypoints, which
+ *        hpa_refine() expands into cells one leg at a time, as an actor walks.
+ *        Paths are near-optimal: they only cross borders at entrance nodes.
+ *        The graph listens to its map, and chunks whose cells changed are
+ *        rebuilt, with their neighbors, by the next hpa_update() or
+ *        hpa_find(); edges are computed on the worker pool.
+ *
+ * Field Overview:
+ *  static:
+ *      hpa_addNode
+ *      hpa_buildEdges
+ *      hpa_buildNodes
+ *      hpa_changed
+ *      hpa_edgesJob
+ *      hpa_heuristic
+ *      hpa_local
+ *      hpa_mark
+ *      hpa_openCells
+ *      hpa_rebuild
+ *      hpa_relax
+ *      hpa_scanBorder
+ *      hpa_scratch
+ *      hpa_twin
+ *  extern:
+ *      hpa_create
+ *      hpa_find
+ *      hpa_free
+ *      hpa_getStats
+ *      hpa_refine
+ *      hpa_update
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "astar.h"
+#include "debug.h"
+#include "hpa.h"
+#include "map.h"
+#include "path.h"
+#include "workers.h"
+
+#define HPA_INFINITY    UINT32_MAX
+#define HPA_CLOSED      0x80000000u     //generation bit of expanded nodes
+#define HPA_START       UINT32_MAX      //parent of the nodes the start connects to
+
+/**
+ * @brief Borders of a chunk, also bits of hpa_chunk.twins and indices of
+ *        the matching moves in astar_dx and astar_dy.
+ */
+enum hpa_side {
+    HPA_NORTH = 0,
+    HPA_EAST  = 1,
+    HPA_SOUTH = 2,
+    HPA_WEST  = 3
+};
+
+/**
+ * @struct hpa_chunk
+ *         Graph nodes of one chunk.
+ */
+struct hpa_chunk {
+    unsigned int count;             //number of nodes
+    uint8_t twins[HPA_MAX_NODES];   //bit s: the node faces a node across border s
+    uint16_t cells[HPA_MAX_NODES];  //chunk cell of each node, (y << MAP_CHUNK_SHIFT) | x
+    uint32_t *dist;                 //count * count costs inside the chunk, or HPA_INFINITY
+};
+
+/**
+ * @struct hpa_state
+ *         A* state of a graph node.
+ */
+struct hpa_state {
+    uint32_t g;
+    uint32_t parent;
+    uint32_t generation;    //search the state belongs to, | HPA_CLOSED once expanded
+};
+
+/**
+ * @struct hpa_scratch
+ *         Memory of the searches inside one chunk; one per thread.
+ */
+struct hpa_scratch {
+    uint8_t open[MAP_CHUNK_CELLS];  //passable cells
+    uint32_t dist[MAP_CHUNK_CELLS]; //costs from the source cell
+    struct astar_heap heap;
+};
+
+/**
+ * @struct hpa
+ *         Abstract graph of a map.
+ * @var chunks, nchunks
+ *      Nodes of every chunk of the map.
+ * @var dirty
+ *      Per chunk: queued in 'work' for rebuilding.
+ * @var work, nwork
+ *      Chunks to rebuild.
+ * @var state, generation
+ *      A* state of every node and current search; allocated on first search.
+ * @var open
+ *      Open list of the graph search.
+ * @var trail, ntrail
+ *      Nodes of the last path, goal first.
+ * @var scratch
+ *      Per-thread chunk search memory, indexed by workers_self().
+ */
+struct hpa {
+    struct map *map;
+    struct hpa_chunk *chunks;
+    size_t nchunks;
+    uint8_t *dirty;
+    uint32_t *work;
+    size_t nwork;
+    struct hpa_state *state;
+    uint32_t generation;
+    struct astar_heap open;
+    uint32_t *trail;
+    size_t ntrail;
+    struct hpa_scratch *scratch[WORKERS_MAX_THREADS + 1];
+    struct hpa_stats stats;
+};
+
+
+
+/**
+ * @brief Retrieve the chunk search memory of the calling thread.
+ *
+ * @return The memory, or NULL if it cannot be allocated.
+ */
+static struct hpa_scratch *hpa_scratch(struct hpa *h) {
+    struct hpa_scratch **scratch = &h->scratch[workers_self()];
+
+    if( !*scratch && !(*scratch = calloc(1, sizeof(struct hpa_scratch))) ) {
+        dbgprint("hpa_scratch: %s\n", ERROR_CALLOC);
+    }
+
+    return *scratch;
+}
+
+
+
+/**
+ * @brief Fill scratch->open with the passable cells of chunk 'c'.
+ */
+static void hpa_openCells(const struct hpa *h, size_t c, struct hpa_scratch *scratch) {
+    const int x0 = (int)((c % h->map->chunks_w) << MAP_CHUNK_SHIFT);
+    const int y0 = (int)((c / h->map->chunks_w) << MAP_CHUNK_SHIFT);
+    unsigned int i;
+
+    for(i = 0; i < MAP_CHUNK_CELLS; i++) {
+        scratch->open[i] = (uint8_t)path_passable(h->map, x0 + (int)(i & MAP_CHUNK_MASK),
+                                                           y0 + (int)(i >> MAP_CHUNK_SHIFT));
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Costs from one cell to every cell of its chunk, moving inside the
+ *        chunk only (Dijkstra over scratch->open), into scratch->dist.
+ *
+ * @return HPA_SUCCESS or HPA_FAILURE.
+ */
+static int hpa_local(struct hpa_scratch *scratch, unsigned int source) {
+    struct astar_entry entry;
+    unsigned int x, y, cell;
+    uint32_t cost;
+    int k, nx, ny;
+
+    memset(scratch->dist, 0xff, sizeof(scratch->dist));
+    scratch->heap.count = 0;
+    if(!scratch->open[source]) { return HPA_SUCCESS; }
+
+    scratch->dist[source] = 0;
+    if( !astar_heapPush(&scratch->heap, 0, 0, source) ) { return HPA_FAILURE; }
+
+    while(scratch->heap.count) {
+        entry = astar_heapPop(&scratch->heap);
+        if(entry.g != scratch->dist[entry.id]) { continue; }   //stale
+
+        x = entry.id & MAP_CHUNK_MASK;
+        y = entry.id >> MAP_CHUNK_SHIFT;
+        for(k = 0; k < 8; k++) {
+            nx = (int)x + astar_dx[k];
+            ny = (int)y + astar_dy[k];
+            if( (unsigned int)nx >= MAP_CHUNK_SIZE || (unsigned int)ny >= MAP_CHUNK_SIZE ) { continue; }
+
+            cell = ((unsigned int)ny << MAP_CHUNK_SHIFT) | (unsigned int)nx;
+            if( !scratch->open[cell] ||
+                (k >= 4 && (!scratch->open[(y << MAP_CHUNK_SHIFT) | (unsigned int)nx] ||
+                            !scratch->open[((unsigned int)ny << MAP_CHUNK_SHIFT) | x])) ) {
+                continue;
+            }
+
+            cost = entry.g + (k < 4 ? PATH_COST_STRAIGHT : PATH_COST_DIAGONAL);
+            if(cost < scratch->dist[cell]) {
+                if( !astar_heapPush(&scratch->heap, cost, cost, cell) ) { return HPA_FAILURE; }
+                scratch->dist[cell] = cost;
+            }
+        }
+    }
+
+    return HPA_SUCCESS;
+}
+
+
+
+/**
+ * @brief Add a node at a chunk cell facing a node across border 'side'; a cell
+ *        on two borders (a corner) gets one node facing both ways.
+ */
+static void hpa_addNode(struct hpa_chunk *chunk, unsigned int cell, enum hpa_side side) {
+    unsigned int i;
+
+    for(i = 0; i < chunk->count; i++) {
+        if(chunk->cells[i] == cell) {
+            chunk->twins[i] |= (uint8_t)(1 << side);
+            return;
+        }
+    }
+
+    //cannot overflow: a border of MAP_CHUNK_SIZE cells has at most MAP_CHUNK_SIZE / 2 entrances
+    chunk->cells[chunk->count] = (uint16_t)cell;
+    chunk->twins[chunk->count] = (uint8_t)(1 << side);
+    chunk->count++;
+
+    return;
+}
+
+
+
+/**
+ * @brief Find the entrances of one border of chunk 'c' and add their nodes on
+ *        this side. The chunk across the border finds the same entrances, so
+ *        the nodes of both sides face each other.
+ */
+static void hpa_scanBorder(struct hpa *h, size_t c, enum hpa_side side) {
+    const int x0 = (int)((c % h->map->chunks_w) << MAP_CHUNK_SHIFT);
+    const int y0 = (int)((c / h->map->chunks_w) << MAP_CHUNK_SHIFT);
+    unsigned int k, start = 0, run = 0, cells[2], n, i;
+    int x, y, open;
+
+    for(k = 0; k <= MAP_CHUNK_SIZE; k++) {
+        open = 0;
+        if(k < MAP_CHUNK_SIZE) {
+            //(x, y): border cell of this chunk, from which 'side' is crossed
+            x = side == HPA_EAST ? (int)MAP_CHUNK_MASK : side == HPA_WEST ? 0 : (int)k;
+            y = side == HPA_SOUTH ? (int)MAP_CHUNK_MASK : side == HPA_NORTH ? 0 : (int)k;
+            open = path_passable(h->map, x0 + x, y0 + y) &&
+                   path_passable(h->map, x0 + x + astar_dx[side], y0 + y + astar_dy[side]);
+        }
+
+        if(open) {
+            if(!run++) { start = k; }
+            continue;
+        }
+        if(!run) { continue; }
+
+        //an entrance [start, start + run): one node in the middle, or one at each end
+        n = 0;
+        if(run < HPA_RUN_SPLIT) {
+            cells[n++] = start + (run - 1) / 2;
+        }
+        else {
+            cells[n++] = start;
+            cells[n++] = start + run - 1;
+        }
+        for(i = 0; i < n; i++) {
+            x = side == HPA_EAST ? (int)MAP_CHUNK_MASK : side == HPA_WEST ? 0 : (int)cells[i];
+            y = side == HPA_SOUTH ? (int)MAP_CHUNK_MASK : side == HPA_NORTH ? 0 : (int)cells[i];
+            hpa_addNode(&h->chunks[c], ((unsigned int)y << MAP_CHUNK_SHIFT) | (unsigned int)x, side);
+        }
+        run = 0;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Recompute the nodes of chunk 'c'; its edges are dropped.
+ */
+static void hpa_buildNodes(struct hpa *h, size_t c) {
+    struct hpa_chunk *chunk = &h->chunks[c];
+    const unsigned int cx = (unsigned int)(c % h->map->chunks_w), cy = (unsigned int)(c / h->map->chunks_w);
+
+    free(chunk->dist);
+    chunk->dist = NULL;
+    chunk->count = 0;
+
+    if(cy > 0) { hpa_scanBorder(h, c, HPA_NORTH); }
+    if(cx + 1 < h->map->chunks_w) { hpa_scanBorder(h, c, HPA_EAST); }
+    if(cy + 1 < h->map->chunks_h) { hpa_scanBorder(h, c, HPA_SOUTH); }
+    if(cx > 0) { hpa_scanBorder(h, c, HPA_WEST); }
+
+    return;
+}
+
+
+
+/**
+ * @brief Compute the edges of chunk 'c': the cost between every pair of its
+ *        nodes, moving inside the chunk.
+ *
+ * @return HPA_SUCCESS or HPA_FAILURE.
+ */
+static int hpa_buildEdges(struct hpa *h, size_t c, struct hpa_scratch *scratch) {
+    struct hpa_chunk *chunk = &h->chunks[c];
+    unsigned int i, j;
+
+    if(!chunk->count) { return HPA_SUCCESS; }
+
+    if( !(chunk->dist = malloc(chunk->count * chunk->count * sizeof(uint32_t))) ) {
+        dbgprint("hpa_buildEdges: %s\n", ERROR_MALLOC);
+        chunk->count = 0;   //the chunk cannot be crossed until it is rebuilt
+        return HPA_FAILURE;
+    }
+
+    hpa_openCells(h, c, scratch);
+    for(i = 0; i < chunk->count; i++) {
+        if( !hpa_local(scratch, chunk->cells[i]) ) {
+            memset(scratch->dist, 0xff, sizeof(scratch->dist));
+        }
+        for(j = 0; j < chunk->count; j++) {
+            chunk->dist[i * chunk->count + j] = scratch->dist[chunk->cells[j]];
+        }
+    }
+
+    return HPA_SUCCESS;
+}
+
+
+
+/**
+ * @brief Worker job: compute the edges of chunk h->work[index].
+ */
+static void hpa_edgesJob(void *context, size_t index) {
+    struct hpa *h = context;
+    struct hpa_scratch *scratch = hpa_scratch(h);
+
+    if(scratch) {
+        hpa_buildEdges(h, h->work[index], scratch);
+    }
+    else {
+        h->chunks[h->work[index]].count = 0;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Queue chunk 'c' for rebuilding.
+ */
+static inline void hpa_mark(struct hpa *h, size_t c) {
+    if(!h->dirty[c]) {
+        h->dirty[c] = 1;
+        h->work[h->nwork++] = (uint32_t)c;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Map listener: queue the chunk of a changed cell.
+ */
+static void hpa_changed(struct map *m, unsigned int x, unsigned int y, void *context) {
+    hpa_mark(context, (size_t)(y >> MAP_CHUNK_SHIFT) * m->chunks_w + (x >> MAP_CHUNK_SHIFT));
+    return;
+}
+
+
+
+/**
+ * @brief Rebuild the nodes, then the edges, of every queued chunk.
+ */
+static void hpa_rebuild(struct hpa *h) {
+    struct hpa_chunk *chunk;
+    size_t i, j;
+
+    for(i = 0; i < h->nwork; i++) {
+        chunk = &h->chunks[h->work[i]];
+        h->stats.nodes -= chunk->count;
+        for(j = 0; chunk->dist && j < (size_t)chunk->count * chunk->count; j++) {
+            h->stats.edges -= chunk->dist[j] != HPA_INFINITY && j % (chunk->count + 1);
+        }
+        hpa_buildNodes(h, h->work[i]);
+    }
+
+    workers_run(hpa_edgesJob, h, h->nwork);
+
+    for(i = 0; i < h->nwork; i++) {
+        chunk = &h->chunks[h->work[i]];
+        h->stats.nodes += chunk->count;
+        for(j = 0; chunk->dist && j < (size_t)chunk->count * chunk->count; j++) {
+            h->stats.edges += chunk->dist[j] != HPA_INFINITY && j % (chunk->count + 1);
+        }
+        h->dirty[h->work[i]] = 0;
+    }
+
+    h->stats.rebuilt += h->nwork;
+    h->nwork = 0;
+
+    return;
+}
+
+
+
+/**
+ * @brief Find the node facing node 'i' of chunk 'c' across border 'side'.
+ *
+ * @return Its graph id, or HPA_INFINITY if there is none.
+ */
+static uint32_t hpa_twin(const struct hpa *h, size_t c, unsigned int i, enum hpa_side side) {
+    const struct hpa_chunk *chunk = &h->chunks[c];
+    unsigned int cell = chunk->cells[i], j;
+    size_t other;
+
+    //the facing cell is on the opposite border of the next chunk
+    switch(side) {
+    case HPA_NORTH: other = c - h->map->chunks_w; cell |= MAP_CHUNK_MASK << MAP_CHUNK_SHIFT; break;
+    case HPA_EAST:  other = c + 1;                cell &= ~MAP_CHUNK_MASK;                  break;
+    case HPA_SOUTH: other = c + h->map->chunks_w; cell &= MAP_CHUNK_MASK;                   break;
+    default:        other = c - 1;                cell |= MAP_CHUNK_MASK;                   break;
+    }
+
+    for(j = 0; j < h->chunks[other].count; j++) {
+        if(h->chunks[other].cells[j] == cell) {
+            return (uint32_t)(other * HPA_MAX_NODES + j);
+        }
+    }
+
+    return HPA_INFINITY;
+}
+
+
+
+/**
+ * @brief Octile estimate from graph node 'id' to (gx, gy).
+ */
+static inline uint32_t hpa_heuristic(const struct hpa *h, uint32_t id, int gx, int gy) {
+    size_t c = id / HPA_MAX_NODES;
+    unsigned int cell = h->chunks[c].cells[id % HPA_MAX_NODES];
+    int dx = abs((int)(((c % h->map->chunks_w) << MAP_CHUNK_SHIFT) + (cell & MAP_CHUNK_MASK)) - gx);
+    int dy = abs((int)(((c / h->map->chunks_w) << MAP_CHUNK_SHIFT) + (cell >> MAP_CHUNK_SHIFT)) - gy);
+
+    return dx > dy ? (uint32_t)(PATH_COST_STRAIGHT * dx + (PATH_COST_DIAGONAL - PATH_COST_STRAIGHT) * dy)
+                   : (uint32_t)(PATH_COST_STRAIGHT * dy + (PATH_COST_DIAGONAL - PATH_COST_STRAIGHT) * dx);
+}
+
+
+
+/**
+ * @brief Reach graph node 'id' with cost 'g' from 'parent', if that is better.
+ *
+ * @return HPA_SUCCESS or HPA_FAILURE.
+ */
+static int hpa_relax(struct hpa *h, uint32_t id, uint32_t g, uint32_t parent, int gx, int gy) {
+    struct hpa_state *state = &h->state[id];
+
+    if(state->generation == (h->generation | HPA_CLOSED)) { return HPA_SUCCESS; }
+    if(state->generation == h->generation && g >= state->g) { return HPA_SUCCESS; }
+
+    state->g = g;
+    state->parent = parent;
+    state->generation = h->generation;
+
+    return astar_heapPush(&h->open, g + hpa_heuristic(h, id, gx, gy), g, id);
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Build the abstract graph of a map and keep it up to date as its
+ *        cells change.
+ *
+ * @param m
+ *        The map; it must outlive the graph.
+ *
+ * @return The graph, or NULL on failure.
+ */
+struct hpa *hpa_create(struct map *m) {
+    struct hpa *h;
+    size_t c;
+
+    if(!m) {
+        dbgprint("hpa_create: formal param 'm': %s\n", ERROR_NULL_POINTER);
+        return NULL;
+    }
+
+    if( !(h = calloc(1, sizeof(struct hpa))) ) {
+        dbgprint("hpa_create: %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+    h->map = m;
+    h->nchunks = (size_t)m->chunks_w * m->chunks_h;
+
+    if( h->nchunks * HPA_MAX_NODES >= HPA_START ||
+        !(h->chunks = calloc(h->nchunks + 1, sizeof(struct hpa_chunk))) ||
+        !(h->dirty = calloc(h->nchunks + 1, sizeof(uint8_t))) ||
+        !(h->work = malloc((h->nchunks + 1) * sizeof(uint32_t))) ||
+        !map_addListener(m, hpa_changed, h) ) {
+        dbgprint("hpa_create: Unable to build the graph of map %s.\n", m->tag);
+
+        free(h->chunks);
+        free(h->dirty);
+        free(h->work);
+        free(h);
+        return NULL;
+    }
+
+    for(c = 0; c < h->nchunks; c++) {
+        hpa_mark(h, c);
+    }
+    hpa_rebuild(h);
+
+    return h;
+}
+
+
+
+/**
+ * @brief Find a path between two cells on the abstract graph.
+ *
+ * @param waypoints
+ *        Receives the start, the entrance cells crossed and the goal; each
+ *        leg can be expanded with hpa_refine(). path->cost is the cost of the
+ *        whole path.
+ *
+ * @return HPA_SUCCESS, or HPA_FAILURE if there is no path.
+ */
+int hpa_find(struct hpa *h, struct path_point start, struct path_point goal, struct path *waypoints) {
+    const unsigned int w = h ? h->map->chunks_w : 0;
+    uint32_t goal_dist[HPA_MAX_NODES], best = HPA_INFINITY, last = HPA_START, id, d, *trail;
+    struct hpa_scratch *scratch;
+    struct hpa_chunk *chunk;
+    struct path_point *points;
+    struct astar_entry entry;
+    struct hpa_state *state;
+    size_t c, sc, gc, n;
+    unsigned int i, j, local;
+    int side;
+
+    if(!h || !waypoints) { return HPA_FAILURE; }
+    waypoints->length = 0;
+    waypoints->cost = 0;
+
+    if( !path_passable(h->map, start.x, start.y) || !path_passable(h->map, goal.x, goal.y) ) {
+        return HPA_FAILURE;
+    }
+
+    hpa_update(h);
+
+    if( !h->state && !(h->state = calloc(h->nchunks * HPA_MAX_NODES, sizeof(struct hpa_state))) ) {
+        dbgprint("hpa_find: %s\n", ERROR_CALLOC);
+        return HPA_FAILURE;
+    }
+    if( ++h->generation == HPA_CLOSED ) {
+        memset(h->state, 0, h->nchunks * HPA_MAX_NODES * sizeof(struct hpa_state));
+        h->generation = 1;
+    }
+    h->open.count = 0;
+    h->stats.expanded = 0;
+
+    if( !(scratch = hpa_scratch(h)) ) { return HPA_FAILURE; }
+    sc = (size_t)(start.y >> MAP_CHUNK_SHIFT) * w + (size_t)(start.x >> MAP_CHUNK_SHIFT);
+    gc = (size_t)(goal.y >> MAP_CHUNK_SHIFT) * w + (size_t)(goal.x >> MAP_CHUNK_SHIFT);
+
+    //costs from the goal's entrances to the goal
+    hpa_openCells(h, gc, scratch);
+    if( !hpa_local(scratch, ((unsigned int)(goal.y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | (goal.x & MAP_CHUNK_MASK)) ) {
+        return HPA_FAILURE;
+    }
+    for(j = 0; j < h->chunks[gc].count; j++) {
+        goal_dist[j] = scratch->dist[h->chunks[gc].cells[j]];
+    }
+
+    //costs from the start to its entrances, and to the goal if it is in the same chunk
+    if(sc != gc) {
+        hpa_openCells(h, sc, scratch);
+    }
+    local = ((unsigned int)(start.y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | (start.x & MAP_CHUNK_MASK);
+    if( !hpa_local(scratch, local) ) { return HPA_FAILURE; }
+    if(sc == gc) {
+        best = scratch->dist[((unsigned int)(goal.y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | (goal.x & MAP_CHUNK_MASK)];
+    }
+    for(j = 0; j < h->chunks[sc].count; j++) {
+        if( (d = scratch->dist[h->chunks[sc].cells[j]]) != HPA_INFINITY &&
+            !hpa_relax(h, (uint32_t)(sc * HPA_MAX_NODES + j), d, HPA_START, goal.x, goal.y) ) {
+            return HPA_FAILURE;
+        }
+    }
+
+    while(h->open.count) {
+        entry = astar_heapPop(&h->open);
+        if(entry.f >= best) { break; }  //nothing left can beat the best path
+
+        state = &h->state[entry.id];
+        if(state->generation != h->generation || entry.g != state->g) { continue; }    //stale
+        state->generation |= HPA_CLOSED;
+        h->stats.expanded++;
+
+        c = entry.id / HPA_MAX_NODES;
+        i = entry.id % HPA_MAX_NODES;
+        chunk = &h->chunks[c];
+
+        if(c == gc && goal_dist[i] != HPA_INFINITY && entry.g + goal_dist[i] < best) {
+            best = entry.g + goal_dist[i];
+            last = entry.id;
+        }
+
+        for(j = 0; j < chunk->count; j++) {
+            if( j != i && (d = chunk->dist[i * chunk->count + j]) != HPA_INFINITY &&
+                !hpa_relax(h, (uint32_t)(c * HPA_MAX_NODES + j), entry.g + d, entry.id, goal.x, goal.y) ) {
+                return HPA_FAILURE;
+            }
+        }
+        for(side = HPA_NORTH; side <= HPA_WEST; side++) {
+            if( (chunk->twins[i] & (1 << side)) &&
+                (id = hpa_twin(h, c, i, (enum hpa_side)side)) != HPA_INFINITY &&
+                !hpa_relax(h, id, entry.g + PATH_COST_STRAIGHT, entry.id, goal.x, goal.y) ) {
+                return HPA_FAILURE;
+            }
+        }
+    }
+
+    if(best == HPA_INFINITY) { return HPA_FAILURE; }
+
+    //nodes of the path, goal first
+    for(n = 0, id = last; id != HPA_START; id = h->state[id].parent, n++) {
+        if(n == h->ntrail) {
+            if( !(trail = realloc(h->trail, (n ? n * 2 : 64) * sizeof(uint32_t))) ) {
+                dbgprint("hpa_find: %s\n", ERROR_REALLOC);
+                return HPA_FAILURE;
+            }
+            h->trail = trail;
+            h->ntrail = n ? n * 2 : 64;
+        }
+        h->trail[n] = id;
+    }
+
+    if(n + 2 > waypoints->capacity) {
+        if( !(points = realloc(waypoints->points, (n + 2) * sizeof(struct path_point))) ) {
+            dbgprint("hpa_find: %s\n", ERROR_REALLOC);
+            return HPA_FAILURE;
+        }
+        waypoints->points = points;
+        waypoints->capacity = n + 2;
+    }
+
+    waypoints->points[waypoints->length++] = start;
+    while(n--) {
+        c = h->trail[n] / HPA_MAX_NODES;
+        local = h->chunks[c].cells[h->trail[n] % HPA_MAX_NODES];
+        points = &waypoints->points[waypoints->length];
+        points->x = (int)(((c % w) << MAP_CHUNK_SHIFT) + (local & MAP_CHUNK_MASK));
+        points->y = (int)(((c / w) << MAP_CHUNK_SHIFT) + (local >> MAP_CHUNK_SHIFT));
+        if(points->x != points[-1].x || points->y != points[-1].y) {
+            waypoints->length++;
+        }
+    }
+    points = &waypoints->points[waypoints->length - 1];
+    if(points->x != goal.x || points->y != goal.y) {
+        waypoints->points[waypoints->length++] = goal;
+    }
+    waypoints->cost = best;
+
+    return HPA_SUCCESS;
+}
+
+
+
+/**
+ * @brief Free a graph and stop listening to its map.
+ */
+void hpa_free(struct hpa *h) {
+    size_t c;
+    int i;
+
+    if(!h) { return; }
+
+    map_removeListener(h->map, hpa_changed, h);
+
+    for(c = 0; c < h->nchunks; c++) {
+        free(h->chunks[c].dist);
+    }
+    for(i = 0; i <= WORKERS_MAX_THREADS; i++) {
+        if(h->scratch[i]) {
+            free(h->scratch[i]->heap.entries);
+            free(h->scratch[i]);
+        }
+    }
+    free(h->chunks);
+    free(h->dirty);
+    free(h->work);
+    free(h->state);
+    free(h->open.entries);
+    free(h->trail);
+    free(h);
+
+    return;
+}
+
+
+
+/**
+ * @brief Retrieve the counters of a graph.
+ */
+void hpa_getStats(const struct hpa *h, struct hpa_stats *stats) {
+    if(!stats) { return; }
+
+    if(h) {
+        *stats = h->stats;
+    }
+    else {
+        memset(stats, 0, sizeof(struct hpa_stats));
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Expand one leg of hpa_find() waypoints into cells: a shortest path
+ *        inside their chunk, or a single step across a border.
+ *
+ * @param path
+ *        Receives every cell from 'from' to 'to'; its buffer is reused.
+ *
+ * @return HPA_SUCCESS, or HPA_FAILURE if the cells are not a leg.
+ */
+int hpa_refine(struct hpa *h, struct path_point from, struct path_point to, struct path *path) {
+    const int x0 = from.x & ~(int)MAP_CHUNK_MASK, y0 = from.y & ~(int)MAP_CHUNK_MASK;
+    struct hpa_scratch *scratch;
+    struct path_point *points, swap;
+    unsigned int cell, x, y, next = 0;
+    size_t length = 0, i;
+    int k, nx, ny;
+
+    if(!h || !path) { return HPA_FAILURE; }
+    path->length = 0;
+    path->cost = 0;
+
+    if(path->capacity < MAP_CHUNK_CELLS) {
+        if( !(points = realloc(path->points, MAP_CHUNK_CELLS * sizeof(struct path_point))) ) {
+            dbgprint("hpa_refine: %s\n", ERROR_REALLOC);
+            return HPA_FAILURE;
+        }
+        path->points = points;
+        path->capacity = MAP_CHUNK_CELLS;
+    }
+
+    //a step across a border
+    if( (to.x & ~(int)MAP_CHUNK_MASK) != x0 || (to.y & ~(int)MAP_CHUNK_MASK) != y0 ) {
+        if( abs(to.x - from.x) + abs(to.y - from.y) != 1 ||
+            !path_passable(h->map, from.x, from.y) || !path_passable(h->map, to.x, to.y) ) {
+            return HPA_FAILURE;
+        }
+        path->points[0] = from;
+        path->points[1] = to;
+        path->length = 2;
+        path->cost = PATH_COST_STRAIGHT;
+        return HPA_SUCCESS;
+    }
+
+    if( !(scratch = hpa_scratch(h)) ) { return HPA_FAILURE; }
+    hpa_openCells(h, (size_t)(y0 >> MAP_CHUNK_SHIFT) * h->map->chunks_w + (size_t)(x0 >> MAP_CHUNK_SHIFT), scratch);
+    if( !hpa_local(scratch, ((unsigned int)(from.y - y0) << MAP_CHUNK_SHIFT) | (unsigned int)(from.x - x0)) ) {
+        return HPA_FAILURE;
+    }
+
+    cell = ((unsigned int)(to.y - y0) << MAP_CHUNK_SHIFT) | (unsigned int)(to.x - x0);
+    if(scratch->dist[cell] == HPA_INFINITY) { return HPA_FAILURE; }
+    path->cost = scratch->dist[cell];
+
+    //walk down the costs from 'to' back to 'from'
+    for(;;) {
+        x = cell & MAP_CHUNK_MASK;
+        y = cell >> MAP_CHUNK_SHIFT;
+        path->points[length].x = x0 + (int)x;
+        path->points[length].y = y0 + (int)y;
+        length++;
+        if(!scratch->dist[cell]) { break; }
+
+        for(k = 0; k < 8; k++) {
+            nx = (int)x + astar_dx[k];
+            ny = (int)y + astar_dy[k];
+            if( (unsigned int)nx >= MAP_CHUNK_SIZE || (unsigned int)ny >= MAP_CHUNK_SIZE ) { continue; }
+
+            next = ((unsigned int)ny << MAP_CHUNK_SHIFT) | (unsigned int)nx;
+            if( scratch->dist[next] != HPA_INFINITY &&
+                scratch->dist[next] + (k < 4 ? PATH_COST_STRAIGHT : PATH_COST_DIAGONAL) == scratch->dist[cell] &&
+                (k < 4 || (scratch->open[(y << MAP_CHUNK_SHIFT) | (unsigned int)nx] &&
+                           scratch->open[((unsigned int)ny << MAP_CHUNK_SHIFT) | x])) ) {
+                break;
+            }
+        }
+        cell = next;
+    }
+
+    for(i = 0; i < length / 2; i++) {
+        swap = path->points[i];
+        path->points[i] = path->points[length - 1 - i];
+        path->points[length - 1 - i] = swap;
+    }
+    path->length = length;
+
+    return HPA_SUCCESS;
+}
+
+
+
+/**
+ * @brief Rebuild the chunks whose cells changed, and their neighbors, whose
+ *        entrances share the changed borders. Called by hpa_find().
+ *
+ * @return The number of chunks rebuilt.
+ */
+size_t hpa_update(struct hpa *h) {
+    size_t i, n, c, rebuilt;
+    unsigned int w;
+
+    if(!h || !h->nwork) { return 0; }
+
+    w = h->map->chunks_w;
+    for(i = 0, n = h->nwork; i < n; i++) {
+        c = h->work[i];
+        if(c >= w) { hpa_mark(h, c - w); }
+        if(c % w + 1 < w) { hpa_mark(h, c + 1); }
+        if(c + w < h->nchunks) { hpa_mark(h, c + w); }
+        if(c % w) { hpa_mark(h, c - 1); }
+    }
+
+    rebuilt = h->nwork;
+    hpa_rebuild(h);
+
+    return rebuilt;
+}
@@ -0,0 +1,54 @@
+/*
+ * hpa.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef HPA_H
+#define HPA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+#include "path.h"
+
+#define HPA_SUCCESS 1
+#define HPA_FAILURE 0
+
+#define HPA_MAX_NODES   64  //entrance cells per chunk; 16 per border at most
+#define HPA_RUN_SPLIT   6   //entrances at least this wide get a node at each end
+
+struct hpa;
+
+/**
+ * @struct hpa_stats
+ *         Counters of an abstract graph, see hpa_getStats().
+ * @var nodes
+ *      Entrance cells in the graph.
+ * @var edges
+ *      Reachable pairs of entrances inside the same chunk.
+ * @var rebuilt
+ *      Chunks whose entrances and edges were recomputed, since creation.
+ * @var expanded
+ *      Graph nodes expanded by the last hpa_find().
+ */
+struct hpa_stats {
+    size_t nodes;
+    size_t edges;
+    unsigned long rebuilt;
+    size_t expanded;
+};
+
+/*
+ * Function declarations.
+ */
+extern struct hpa * hpa_create   (struct map *m);
+extern int          hpa_find     (struct hpa *h, struct path_point start, struct path_point goal, struct path *waypoints);
+extern void         hpa_free     (struct hpa *h);
+extern void         hpa_getStats (const struct hpa *h, struct hpa_stats *stats);
+extern int          hpa_refine   (struct hpa *h, struct path_point from, struct path_point to, struct path *path);
+extern size_t       hpa_update   (struct hpa *h);
+
+#endif /*HPA_H*/
@@ -3,74 +3,415 @@
  *
  *     Created on: 21 April 2015
  *         Author: oceaquaris
- *  Last Modified: 26 May 2017
+ *  Last Modified: 17 October 2026
+ *
+ * Every decoded file is stored once, as a reference counted struct
+ * image_source keyed by its canonical path. A struct image is a tag that
+ * refers to a source, so loading the same file under several tags only
+ * creates cheap aliases.
+ *
+ * Decoded sources are kept on a least-recently-used list. When a pixel budget
+ * is set, the least recently used surfaces are dropped to stay within it and
+ * decoded again the next time image_getSurface() asks for them. In lazy mode
+ * image_load() only registers the file and decodes nothing. Surfaces that do
+ * not come from a file (see image_create_fromSurface()) are pinned instead.
  *
  * Field Overview:
  *  static:
- *      image_compare_bsearch
- *      image_compare_qsort
+ *      image_sources
+ *      image_residency
+ *      image_canonicalPath
+ *      image_convertSDL_Surface
+ *      image_decodeJob
+ *      image_register
+ *      image_source_create
+ *      image_source_evict
+ *      image_source_release
+ *      image_source_resident
+ *      image_source_touch
  *  extern:
- *      image_bsearch
+ *      image_alias
  *      image_close
+ *      image_create_anonymous
+ *      image_create_fromSurface
+ *      image_dropTexture
+ *      image_dropTextures
  *      image_dump
  *      image_dumpAll
  *      image_free
  *      image_freeAll
  *      image_freeTag
+ *      image_get
+ *      image_getStats
+ *      image_getSurface
+ *      image_handle
  *      image_init
  *      image_load
+ *      image_loadBatch
+ *      image_loadMultiple
  *      image_loadSDL_Surface
+ *      image_lookup
  *      image_numLoaded
- *      image_qsort
+ *      image_numSources
+ *      image_resetStats
+ *      image_setBudget
+ *      image_setLazy
  */
 
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ainur.h"
 #include "debug.h"
 #include "image.h"
-#include "file.h"
+#include "intern.h"
+#include "registry.h"
+#include "render.h"
+#include "vfs.h"
+#include "workers.h"
+
+
+
+/**
+ * @struct image_batch
+ *         Shared state of one image_loadBatch() call.
+ * @var paths
+ *      Canonical paths of the files to decode (NULL: nothing to decode).
+ * @var surfaces
+ *      Output: converted surface of each file, or NULL on failure.
+ * @var format
+ *      Pixel format every surface is converted to.
+ */
+struct image_batch {
+    const char **paths;
+    SDL_Surface **surfaces;
+    const SDL_PixelFormat *format;
+};
+
+/* Every struct image_source, indexed by canonical path. */
+static struct registry image_sources = { 0 };
+
+/* Sources of anonymous images (see image_create_anonymous()), which have no
+ * path; pinned, so linked through their otherwise unused LRU links. */
+static struct image_source *image_anonymous = NULL;
+
+/**
+ * @brief Residency state.
+ * @var lazy
+ *      Whether image_load() defers decoding to the first image_getSurface().
+ * @var head
+ *      Most recently used resident source.
+ * @var tail
+ *      Least recently used resident source.
+ * @var stats
+ *      Counters and budget reported by image_getStats().
+ */
+static struct {
+    int lazy;
+    struct image_source *head;
+    struct image_source *tail;
+    struct image_stats stats;
+} image_residency = { 0, NULL, NULL, { 0, 0, 0, 0, 0 } };
 
 
 
 /**
- * @brief Wrapper function that performs a comparison on a key and the tag
- *        of a struct image *.
+ * @brief Resolve the canonical path of a file.
  *
- * @param pkey
- *        A pointer to a (char *) to be compared (the key).
- * @param pelem
- *        A pointer to a (struct image *) to be compared (the element).
+ * @param filename
+ *        Name of the file in the VFS, or a path outside of it.
  *
- * @return < 0: pkey has a lower 'tag' string value than pelem.
- *         = 0: pkey and pelem have the same 'tag' label.
- *         > 0: pkey has a higher 'tag' string value than pelem.
+ * @return The interned canonical path, or NULL if the file does not exist.
  */
-static int image_compare_bsearch(const void *pkey, const void *pelem) {
-    return strcmp( ((char *)pkey), ((struct image **)pelem)[0]->tag );
+static const char *image_canonicalPath(const char *filename) {
+    char buffer[PATH_MAX];
+    const char *path;
+
+    //files in the search roots resolve without touching the disk
+    if( (path = vfs_resolve(filename)) ) {
+        return path;
+    }
+
+    if( !realpath(filename, buffer) ) {
+        return NULL;
+    }
+
+    return intern_string(buffer);
 }
 
 
 
 /**
- * @brief Wrapper function that performs a comparison on the 'tag' strings
- *        in two struct image *'s.
+ * @brief Convert a freshly decoded surface to the engine's pixel format.
  *
- * @param p1
- *        A pointer to a (char *) to be compared (the key).
- * @param p2
- *        A pointer to a (struct image *) to be compared (the element).
+ * @param temp
+ *        Decoded surface; always SDL_FreeSurface()ed by this function.
+ * @param format
+ *        Target pixel format.
  *
- * @return < 0: p1 has a lower 'tag' string value than p2.
- *         = 0: p1 and p2 have the same 'tag' label.
- *         > 0: p1 has a higher 'tag' string value than p2.
+ * @return The converted surface, or NULL on failure.
+ * @note Safe to call from worker threads.
+ */
+static SDL_Surface *image_convertSDL_Surface(SDL_Surface *temp, const SDL_PixelFormat *format) {
+    /*SDL_SetColorKey(temp,
+                    SDL_TRUE,
+                    SDL_MapRGB(temp->format, 0, 0, 0)   ); // Make the background transparent */
+
+    SDL_Surface *output = SDL_ConvertSurface(temp, format, 0);
+
+    SDL_FreeSurface(temp);  //Free our temporary variable
+    return output;
+}
+
+
+
+/**
+ * @brief Worker job: decode and convert one file of an image batch.
+ * @note Runs on worker threads; errors are reported by image_loadBatch().
+ */
+static void image_decodeJob(void *context, size_t index) {
+    struct image_batch *batch = context;
+    SDL_Surface *temp;
+
+    if( !batch->paths[index] || !(temp = IMG_Load_RW(SDL_RWFromFile(batch->paths[index], "rb"), 1)) ) {
+        batch->surfaces[index] = NULL;
+        return;
+    }
+
+    batch->surfaces[index] = image_convertSDL_Surface(temp, batch->format);
+    return;
+}
+
+
+
+/**
+ * @brief Free the pixels of a resident source and unlink it from the LRU list.
+ */
+static void image_source_evict(struct image_source *source) {
+    if(!source->surface) { return; }
+
+    //pinned sources are neither linked nor budgeted
+    if(source->pinned) {
+        SDL_FreeSurface(source->surface);
+        source->surface = NULL;
+        return;
+    }
+
+    if(source->lru_prev) {
+        source->lru_prev->lru_next = source->lru_next;
+    }
+    else {
+        image_residency.head = source->lru_next;
+    }
+    if(source->lru_next) {
+        source->lru_next->lru_prev = source->lru_prev;
+    }
+    else {
+        image_residency.tail = source->lru_prev;
+    }
+    source->lru_prev = source->lru_next = NULL;
+
+    SDL_FreeSurface(source->surface);
+    source->surface = NULL;
+    image_residency.stats.resident -= source->bytes;
+    source->bytes = 0;
+
+    return;
+}
+
+
+
+/**
+ * @brief Drop one reference to a source; the pixels are freed with the last one.
  */
-static int image_compare_qsort(const void *p1, const void *p2) {
-    return strcmp( (*((struct image **)p1))->tag, (*((struct image **)p2))->tag );
+static void image_source_release(struct image_source *source) {
+    if(!source || (source->refs && --source->refs)) {
+        return;
+    }
+
+    if(source->path) {
+        registry_remove(&image_sources, source->handle);
+    }
+    else {
+        if(source->lru_prev) {
+            source->lru_prev->lru_next = source->lru_next;
+        }
+        else {
+            image_anonymous = source->lru_next;
+        }
+        if(source->lru_next) {
+            source->lru_next->lru_prev = source->lru_prev;
+        }
+    }
+    image_source_evict(source);
+    if(source->texture) {
+        SDL_DestroyTexture(source->texture);
+    }
+    free(source);
+
+    return;
+}
+
+
+
+/**
+ * @brief Move a resident source to the front of the LRU list.
+ */
+static void image_source_touch(struct image_source *source) {
+    if(image_residency.head == source) { return; }
+
+    //unlink (a source that was just made resident is not linked yet)
+    if(source->lru_prev) {
+        source->lru_prev->lru_next = source->lru_next;
+        if(source->lru_next) {
+            source->lru_next->lru_prev = source->lru_prev;
+        }
+        else {
+            image_residency.tail = source->lru_prev;
+        }
+    }
+
+    source->lru_prev = NULL;
+    source->lru_next = image_residency.head;
+    if(image_residency.head) {
+        image_residency.head->lru_prev = source;
+    }
+    image_residency.head = source;
+    if(!image_residency.tail) {
+        image_residency.tail = source;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Make 'surface' the resident pixels of 'source', then evict the least
+ *        recently used surfaces until the budget is met again.
+ */
+static void image_source_resident(struct image_source *source, SDL_Surface *surface) {
+    source->surface = surface;
+    source->bytes = (size_t)surface->pitch * surface->h;
+    image_residency.stats.resident += source->bytes;
+    image_source_touch(source);
+
+    //never evict the source we were asked for
+    while( image_residency.stats.budget &&
+           image_residency.stats.resident > image_residency.stats.budget &&
+           image_residency.tail != source ) {
+        image_source_evict(image_residency.tail);
+        image_residency.stats.evictions++;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Create a source for a decoded surface and register it by path.
+ *
+ * @param path
+ *        Interned canonical path of the file, or NULL for the unregistered
+ *        source of an anonymous image.
+ * @param surface
+ *        Decoded surface, or NULL to defer decoding; freed by this function
+ *        on failure.
+ *
+ * @return The new source with a reference count of 0, or NULL on failure.
+ */
+static struct image_source *image_source_create(const char *path, SDL_Surface *surface) {
+    struct image_source *source;
+
+    if( !(source = malloc(sizeof(struct image_source))) ) {
+        dbgprint("image_source_create: Unable to allocate source for %s: %s\n", path, ERROR_MALLOC);
+
+        SDL_FreeSurface(surface);
+        return NULL;
+    }
+
+    source->surface = NULL;
+    source->path = path;
+    source->refs = 0;
+    source->bytes = 0;
+    source->lru_prev = source->lru_next = NULL;
+    source->pinned = 0;
+    source->texture = NULL;
+
+    if(!path) {
+        source->handle = REGISTRY_INVALID_HANDLE;
+        source->lru_next = image_anonymous;
+        if(image_anonymous) {
+            image_anonymous->lru_prev = source;
+        }
+        image_anonymous = source;
+    }
+    else if( !(source->handle = registry_insert(&image_sources, path, source)) ) {
+        dbgprint("image_source_create: Unable to register source %s.\n", path);
+
+        SDL_FreeSurface(surface);
+        free(source);
+        return NULL;
+    }
+
+    if(surface) {
+        image_source_resident(source, surface);
+    }
+
+    return source;
+}
+
+
+
+/**
+ * @brief Create a new struct image that refers to 'source' and register it
+ *        under 'tag'.
+ *
+ * @param source
+ *        Source of the image; gains a reference on success.
+ * @param filename
+ *        File name the image was requested with.
+ * @param tag
+ *        Unique tag of the image.
+ *
+ * @return The registered image, or NULL on failure (an unreferenced source
+ *         is freed).
+ */
+static struct image *image_register(struct image_source *source, const char *filename, const char *tag) {
+    struct image *load = NULL;
+
+    source->refs++;     //hold the source while we build the image
+
+    //attempt to allocate memory for the struct image
+    if( !(load = malloc( sizeof(struct image) ))  ) {
+        dbgprint("image_register: Unable to allocate enough memory for new struct image: %s.\n", tag);
+
+        image_source_release(source);
+        return load; //aka NULL
+    }
+
+    load->source = source;
+    load->tag = NULL;
+    load->filename = intern_string(filename);   //aliases share one copy
+    load->handle = REGISTRY_INVALID_HANDLE;
+
+    //register the image; the registry interns 'tag'
+    if( !load->filename || !(load->handle = registry_insert(&ainur.images, tag, load)) ) {
+        dbgprint("image_register: Unable to register image %s in ainur.(struct registry images).\n", tag);
+
+        image_free(load);   //free up memory
+        return NULL;
+    }
+    load->tag = registry_tag(&ainur.images, load->handle);
+
+    return load;
 }
 
 
@@ -82,20 +423,26 @@ static int image_compare_qsort(const void *p1, const void *p2) {
 
 
 /**
- * @brief A wrapper function to perform a binary search on 'images' in the ainur engine.
- *        Retrieve an element, if one exists, that has the 'tag', 'tag' within it.
+ * @brief Register an existing image under another tag. The alias shares the
+ *        pixels of the original image.
+ *
  * @param tag
- *        The 'tag' of the (struct image *) to search for.
- * @return A pointer to the array position with the correct 'tag', or NULL (no match).
+ *        Tag of a loaded image.
+ * @param alias
+ *        New, unique tag.
+ *
+ * @return The new image, or NULL on failure.
  */
-struct image **image_bsearch(const char *tag) {
-    if(!ainur.images) { return NULL; }  //make sure 'images' isn't NULL
+struct image *image_alias(const char *tag, const char *alias) {
+    struct image *image = image_lookup(tag);
+
+    if(!image || !alias) {
+        dbgprint("image_alias: Unable to alias image \"%s\" as \"%s\".\n", tag, alias);
+
+        return NULL;
+    }
 
-    return (struct image **)bsearch( tag,
-                                     ainur.images,
-                                     image_numLoaded(),
-                                     sizeof(struct image *),
-                                     image_compare_bsearch );
+    return image_register(image->source, image->filename, alias);
 }
 
 
@@ -113,6 +460,141 @@ void image_close(void) {
 
 
 
+/**
+ * @brief Wrap a surface in an image that is not registered: it has no tag,
+ *        cannot be looked up or aliased and is not listed by image_dumpAll(),
+ *        but draws like any other (e.g. render caches owned by one module).
+ *
+ * @param surface
+ *        The pixels; owned by the image from now on, and SDL_FreeSurface()ed
+ *        by image_free() (also on failure).
+ *
+ * @return The image, or NULL on failure.
+ * @note The source is pinned, as with image_create_fromSurface().
+ */
+struct image *image_create_anonymous(SDL_Surface *surface) {
+    struct image_source *source;
+    struct image *image;
+
+    if(!surface) {
+        dbgprint("image_create_anonymous: formal param 'surface': %s\n", ERROR_NULL_SDL_SURFACE);
+
+        return NULL;
+    }
+
+    if( !(source = image_source_create(NULL, NULL)) ) {
+        SDL_FreeSurface(surface);
+        return NULL;
+    }
+    source->pinned = 1;
+    source->surface = surface;
+
+    if( !(image = malloc(sizeof(struct image))) ) {
+        dbgprint("image_create_anonymous: local var 'image': %s\n", ERROR_MALLOC);
+
+        image_source_release(source);
+        return NULL;
+    }
+    source->refs++;
+    image->source = source;
+    image->tag = NULL;
+    image->filename = NULL;
+    image->handle = REGISTRY_INVALID_HANDLE;
+
+    return image;
+}
+
+
+
+/**
+ * @brief Register a surface that does not come from an image file, such as
+ *        pixels mapped from an asset pack, under 'tag'.
+ *
+ * @param surface
+ *        The pixels; owned by the image from now on, and SDL_FreeSurface()ed
+ *        with the last image that refers to them (also on failure).
+ * @param name
+ *        Unique name of the pixels; takes the place of the canonical path.
+ * @param tag
+ *        Unique tag of the image.
+ *
+ * @return The registered image, or NULL on failure.
+ * @note The source is pinned: it is never evicted, since there is no file
+ *       to decode it from again.
+ */
+struct image *image_create_fromSurface(SDL_Surface *surface, const char *name, const char *tag) {
+    struct image_source *source;
+    const char *path;
+
+    if(!surface || !name || !tag) {
+        dbgprint("image_create_fromSurface: formal params 'surface', 'name' and 'tag' must be non-NULL.\n");
+
+        SDL_FreeSurface(surface);
+        return NULL;
+    }
+
+    if( image_handle(tag) || registry_find(&image_sources, name) ) {
+        dbgprint("image_create_fromSurface: Unable to register %s: 'tag' \"%s\" or 'name' is not unique.\n",
+                 name, tag);
+
+        SDL_FreeSurface(surface);
+        return NULL;
+    }
+
+    if( !(path = intern_string(name)) || !(source = image_source_create(path, NULL)) ) {
+        SDL_FreeSurface(surface);
+        return NULL;
+    }
+    source->pinned = 1;
+    source->surface = surface;
+
+    return image_register(source, name, tag);
+}
+
+
+
+/**
+ * @brief Destroy the texture of an image's source, e.g. after its pixels were
+ *        changed; it is uploaded again on its next use.
+ */
+void image_dropTexture(struct image *image) {
+    if(image && image->source->texture) {
+        SDL_DestroyTexture(image->source->texture);
+        image->source->texture = NULL;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Destroy the textures of every source; they are uploaded again on
+ *        their next use. Called before the renderer goes away.
+ */
+void image_dropTextures(void) {
+    registry_handle handle = REGISTRY_INVALID_HANDLE;
+    struct image_source *source;
+
+    while( (handle = registry_next(&image_sources, handle)) ) {
+        source = registry_get(&image_sources, handle);
+        if(source->texture) {
+            SDL_DestroyTexture(source->texture);
+            source->texture = NULL;
+        }
+    }
+    for(source = image_anonymous; source; source = source->lru_next) {
+        if(source->texture) {
+            SDL_DestroyTexture(source->texture);
+            source->texture = NULL;
+        }
+    }
+
+    return;
+}
+
+
+
 /**
  * @brief Dump information about an image to a file.
  *
@@ -126,11 +608,15 @@ int image_dump(FILE *stream, struct image *image) {
                    "struct image *: %p\n"\
                    "    tag = %s\n"\
                    "    surface = %p\n"\
-                   "    filename = %s\n",
+                   "    filename = %s\n"\
+                   "    path = %s\n"\
+                   "    refs = %u\n",
                    image,
                    image->tag,
-                   image->surface,
-                   image->filename);
+                   image->source->surface,
+                   image->filename,
+                   image->source->path,
+                   image->source->refs);
 }
 
 
@@ -144,24 +630,34 @@ int image_dump(FILE *stream, struct image *image) {
  * @return The total number of characters written (similar to fprintf).
  */
 int image_dumpAll(FILE *stream) {
-    register int sum = 0, i;
-    size_t len = image_numLoaded();
+    register int sum = 0;
+    registry_handle handle = REGISTRY_INVALID_HANDLE;
+    struct image *image;
 
-    sum += fprintf(stream, "struct image **: %p\n"\
+    sum += fprintf(stream, "struct registry: %p\n"\
                            "  length = %lu\n"\
-                           "  contents = {\n", ainur.images, len);
-    for(i = 0; i < len; i++) {
+                           "  sources = %lu\n"\
+                           "  contents = {\n", &ainur.images, image_numLoaded(), image_numSources());
+    while( (handle = registry_next(&ainur.images, handle)) ) {
+        image = registry_get(&ainur.images, handle);
         sum += fprintf(stream,
                        "    struct image *: %p\n"\
                        "        tag = \"%s\"\n"\
                        "        surface = %p\n"\
                        "        filename = \"%s\"\n",
-                       ainur.images[i],
-                       ainur.images[i]->tag,
-                       ainur.images[i]->surface,
-                       ainur.images[i]->filename);
+                       image,
+                       image->tag,
+                       image->source->surface,
+                       image->filename);
     }
-    sum += fprintf(stream, "    %p\n}\n", NULL);
+    sum += fprintf(stream, "}\n"\
+                           "  resident = %lu / %lu bytes\n"\
+                           "  hits = %lu, misses = %lu, evictions = %lu\n",
+                   (unsigned long)image_residency.stats.resident,
+                   (unsigned long)image_residency.stats.budget,
+                   image_residency.stats.hits,
+                   image_residency.stats.misses,
+                   image_residency.stats.evictions);
 
     return sum;
 }
@@ -169,7 +665,8 @@ int image_dumpAll(FILE *stream) {
 
 
 /**
- * @brief Free an image struct.
+ * @brief Free an image struct. The pixels are freed along with the last
+ *        image that refers to them.
  *
  * @param image
  *        Pointer to image struct to free.
@@ -177,15 +674,13 @@ int image_dumpAll(FILE *stream) {
 void image_free(struct image *image) {
     if( !image ) { return; }    //check to see if our image is valid
 
-    //free elements if available
-    if( image->tag ) {
-        free(image->tag);
-    }
-    if( image->filename ) {
-        free(image->filename);
-    }
-    SDL_FreeSurface(image->surface);
+    //unregister the image; O(1) through its handle
+    registry_remove(&ainur.images, image->handle);
+
+    //'tag' and 'filename' are interned and not ours to free
+    image_source_release(image->source);
 
+    free(image);
     return;
 }
 
@@ -195,14 +690,14 @@ void image_free(struct image *image) {
  * @brief Free all images in the ainur engine.
  */
 void image_freeAll(void) {
-    if(!ainur.images) { return; } //test to see if 'images' is valid
+    registry_handle handle = REGISTRY_INVALID_HANDLE;
 
-    size_t len;
-    for(len = image_numLoaded(); len > 0; len--) {
-        image_free(ainur.images[len-1]);
+    while( (handle = registry_next(&ainur.images, handle)) ) {
+        image_free(registry_get(&ainur.images, handle));
     }
 
-    free(ainur.images);
+    registry_close(&ainur.images);
+    registry_close(&image_sources);
     return;
 }
 
@@ -214,31 +709,95 @@ void image_freeAll(void) {
  *        Tag of the image struct to free.
  */
 void image_freeTag(const char *tag) {
-    struct image **image;
+    //if tag is null or tag image is not found, image_free() does nothing
+    image_free(image_lookup(tag));
+    return;
+}
+
+
+
+/**
+ * @brief Retrieve a loaded image through its registry handle.
+ *
+ * @param handle
+ *        Handle returned by image_handle() or stored in image->handle.
+ *
+ * @return The image, or NULL if the handle is stale or invalid.
+ */
+struct image *image_get(registry_handle handle) {
+    return registry_get(&ainur.images, handle);
+}
 
-    //if tag is null or tag image is not found
-    if(!tag || !(image = image_bsearch(tag)) ) {
-        return;//do nothing
+
+
+/**
+ * @brief Retrieve the residency counters.
+ *
+ * @param stats
+ *        Filled with the current counters and budget.
+ */
+void image_getStats(struct image_stats *stats) {
+    if(stats) {
+        *stats = image_residency.stats;
     }
+    return;
+}
 
-    size_t length = image_numLoaded();     //find the number of elements in 'images'
 
-    image_free(image[0]);   //free the image that we found.
 
-    image[0] = ainur.images[length - 1];  //copy a reference to the last image in 'images' where our freed image was.
-    ainur.images[length - 1] = NULL;      //make the last reference in 'images' NULL
+/**
+ * @brief Retrieve the pixels of an image, decoding the file if it is not
+ *        resident, and mark them as most recently used.
+ *
+ * @param image
+ *        The image.
+ *
+ * @return The SDL_Surface shared by every alias of the image's file, or NULL
+ *         if the file can no longer be decoded.
+ * @note The surface is owned by the image; do not SDL_FreeSurface() it. When
+ *       a budget is set, the surface of another image may be evicted by a
+ *       later call that has to decode, so do not hold on to it across calls.
+ */
+SDL_Surface *image_getSurface(struct image *image) {
+    if(!image) { return NULL; }
 
-    //attempt to resize the 'images' array
-    if( !( ainur.images = realloc(ainur.images, length * (sizeof(struct image *)) ) ) ) {
-        dbgprint("image_freeTag:\n"\
-                 "    Unable to reallocate enough memory to resize static struct images **images.\n");
+    struct image_source *source = image->source;
 
-        image_freeAll(); //free up memory
-        return;
+    if(source->surface) {
+        image_residency.stats.hits++;
+        if(!source->pinned) {
+            image_source_touch(source);
+        }
+
+        return source->surface;
     }
 
-    image_qsort();  //resort the list
-    return;
+    image_residency.stats.misses++;
+
+    SDL_Surface *surface = image_loadSDL_Surface(source->path);
+    if(!surface) {
+        dbgprint("image_getSurface: Unable to decode %s for image %s.\n", source->path, image->tag);
+
+        return NULL;
+    }
+
+    image_source_resident(source, surface);
+    return surface;
+}
+
+
+
+/**
+ * @brief Retrieve the registry handle of a loaded image. Hot code should hold
+ *        on to the handle instead of searching by tag every time.
+ *
+ * @param tag
+ *        The 'tag' of the image.
+ *
+ * @return The handle, or REGISTRY_INVALID_HANDLE (no match).
+ */
+registry_handle image_handle(const char *tag) {
+    return registry_find(&ainur.images, tag);
 }
 
 
@@ -261,16 +820,13 @@ int image_init(void) {
         exit(EXIT_FAILURE); //close program and free everything.
     }
 
-    //attempt to allocate memory for the 'images' array
-    if( !(ainur.images = malloc(sizeof(struct image *))) ) {
-        dbgprint("image_init: IMG_Init error: Unable to allocate memory for struct tile **tiles.\n");
+    //attempt to allocate memory for the 'images' and source registries
+    if( !registry_init(&ainur.images, 0) || !registry_init(&image_sources, 0) ) {
+        dbgprint("image_init: Unable to allocate memory for ainur.(struct registry images).\n");
 
         exit(EXIT_FAILURE); //close program and free everything.
     }
 
-    //make the first element in the 'images' array to be a NULL terminator
-    ainur.images[0] = NULL;
-
     return IMAGE_SUCCESS; //success
 }
 
@@ -279,7 +835,9 @@ int image_init(void) {
 /**
  * @brief Load an image as an SDL_Surface from a 'filename' and stash it into an
  *        image struct. Stash the image struct into the 'images' variable in the
- *        ainur engine.
+ *        ainur engine. A file that is already loaded is not decoded again;
+ *        the new image shares its pixels. In lazy mode the file is only
+ *        registered; it is decoded by the first image_getSurface().
  * @param filename
  *        Name/path of the file to load.
  * @param tag
@@ -297,101 +855,171 @@ struct image *image_load(const char *filename, const char *tag) {
         return NULL;
     }
 
-    //check to see if the file exists
-    if(!file_exists(filename)) {
+    //'tag' must be unique!
+    if( image_handle(tag) ) {
         dbgprint("image_load: Unable to load image: %s.\n"\
-                 "            %s\n", filename, ERROR_NO_FILE);
+                 "            Associated tag, \"%s\", is not unique.\n",
+                 filename, tag);
 
         return NULL;
     }
 
-    //'tag' must be unique!
-    if( image_bsearch(tag) ) {
+    //first, find the canonical path; this checks that the file exists
+    const char *path = image_canonicalPath(filename);
+    if(!path) {
         dbgprint("image_load: Unable to load image: %s.\n"\
-                 "            Associated tag, \"%s\", is not unique.\n",
-                 filename, tag);
+                 "            %s\n", filename, ERROR_NO_FILE);
 
         return NULL;
     }
 
-    //first, attempt to load an SDL_Surface.
-    SDL_Surface *surface = image_loadSDL_Surface(filename);
-    if(!surface) {
-        dbgprint("image_load: Unable to load image: %s.\n", filename);
+    //second, reuse the decoded file or decode it now
+    struct image_source *source = registry_lookup(&image_sources, path);
+    if(!source) {
+        SDL_Surface *surface = image_residency.lazy ? NULL : image_loadSDL_Surface(path);
+        if( (!surface && !image_residency.lazy) || !(source = image_source_create(path, surface)) ) {
+            dbgprint("image_load: Unable to load image: %s.\n", filename);
 
-        return NULL;
+            return NULL;
+        }
     }
 
-    //second, attempt to create a new struct image.
-    struct image *load = NULL;
+    //third, wrap it in a new struct image and register it.
+    return image_register(source, filename, tag);
+}
 
-    //attempt to allocate memory for the struct image
-    if( !(load = malloc( sizeof(struct image) ))  ) {
-        dbgprint("image_load: Unable to allocate enough memory for new struct image: %s.\n", tag);
 
-        return load; //aka NULL
-    }
 
-    //set the surface inside the image struct
-    load->surface = surface;
+/**
+ * @brief Load many images at once. Every distinct file that is not loaded
+ *        yet is decoded and converted in parallel on the worker pool (unless
+ *        in lazy mode), then every image is inserted into ainur.images in a
+ *        single registry commit.
+ *
+ * @param filenames
+ *        Array of 'count' names/paths of files to load.
+ * @param tags
+ *        Array of 'count' tags; tags must be unique among themselves and
+ *        among the images already loaded.
+ * @param count
+ *        Number of filename/tag pairs.
+ *
+ * @return The number of images loaded and registered. Pairs that fail are
+ *         reported and skipped.
+ */
+size_t image_loadBatch(const char **filenames, const char **tags, size_t count) {
+    if(!filenames || !tags || !count) {
+        return 0;
+    }
 
-    //'length' will store the lengths of 'tag' and 'filename'
-    size_t length = strlen(tag);
+    struct image_batch batch;
+    struct registry seen, pending;
+    struct image_source *source;
+    const char **paths;
+    size_t i, first, loaded = 0;
 
-    //attempt to allocate memory for the (char *) field 'tag' in the struct image
-    if ( !(load->tag = malloc( sizeof(char) * (length + 1) )) ) {
-        dbgprint("image_load: Unable to allocate enough memory for (%s)->tag.\n", tag);
+    if( !(paths = malloc(count * sizeof(const char *))) ||
+        !(batch.paths = malloc(count * sizeof(const char *))) ||
+        !(batch.surfaces = calloc(count, sizeof(SDL_Surface *))) ) {
+        dbgprint("image_loadBatch: Unable to allocate batch buffers: %s\n", ERROR_MALLOC);
 
-        image_free(load);   //free up memory
-        return NULL;
+        if(paths) {
+            free(batch.paths);
+        }
+        free(paths);
+        return 0;
+    }
+    if( !registry_init(&seen, count) || !registry_init(&pending, count) ) {
+        registry_close(&seen);
+        free(batch.surfaces);
+        free(batch.paths);
+        free(paths);
+        return 0;
     }
 
-    //copy 'tag' to load->tag
-    memcpy( load->tag, tag, sizeof(char) * (length + 1) );
+    /* first, weed out bad pairs on this thread and pick one decode per file
+     * that is not loaded yet; 'pending' maps a path to its first index */
+    for(i = 0; i < count; i++) {
+        paths[i] = NULL;
+        batch.paths[i] = NULL;
 
-    //reassign the length to that of 'filename'
-    length = strlen(filename);
+        if(!filenames[i] || !tags[i]) {
+            dbgprint("image_loadBatch: An image pair contains a NULL\n"\
+                     "    filename = %s\n"\
+                     "    tag = %s\n"\
+                     "    Skipping pair.\n", filenames[i], tags[i]);
+            continue;
+        }
+        if( image_handle(tags[i]) || !registry_insert(&seen, tags[i], (void *)tags[i]) ) {
+            dbgprint("image_loadBatch: 'tag' \"%s\" is not unique.\n"\
+                     "    Skipping pair: \"%s\", \"%s\"\n",
+                     tags[i], filenames[i], tags[i]);
+            continue;
+        }
+        if( !(paths[i] = image_canonicalPath(filenames[i])) ) {
+            dbgprint("image_loadBatch: %s: %s\n"\
+                     "    Skipping pair: \"%s\", \"%s\"\n",
+                     filenames[i], ERROR_NO_FILE, filenames[i], tags[i]);
+            continue;
+        }
 
-    //attempt to allocate memory for the (char *) field 'filename' in the struct image
-    if( !(load->filename = malloc( sizeof(char) * (length + 1) )) ) {
-        dbgprint("image_load: Unable to allocate enough memory for (%s)->filename.\n", tag);
+        if( !registry_find(&image_sources, paths[i]) &&
+            registry_insert(&pending, paths[i], &paths[i]) ) {
+            batch.paths[i] = paths[i];
+        }
+    }
+    registry_close(&seen);
 
-        image_free(load);   //free up memory
-        return NULL;
+    //second, decode and convert in parallel; the pixel format is fetched here
+    if(!image_residency.lazy) {
+        batch.format = render_pixelFormat();
+        workers_run(image_decodeJob, &batch, count);
     }
 
-    //copy 'filename' to load->filename
-    memcpy( load->filename, filename, sizeof(char) * (length + 1) );
+    //third, commit every image to ainur.images with a single table resize
+    registry_reserve(&ainur.images, count);
+    registry_reserve(&image_sources, registry_count(&pending));
+    for(i = 0; i < count; i++) {
+        if(!paths[i]) { continue; }
 
-    //third, attempt to extend the length of the statically allocated struct image **images
-    int numloads = image_numLoaded();
-    if ( !( ainur.images = realloc(ainur.images, (numloads + 2) * (sizeof(struct image *) ) ) ) ) {
-        dbgprint("image_load: Unable to reallocate enough memory to resize ainur.(struct images **images).\n");
+        //the first pair naming a file owns its decode
+        first = batch.paths[i] ? (const char **)registry_lookup(&pending, paths[i]) - paths : count;
+        if(first == i && (batch.surfaces[i] || image_residency.lazy)) {
+            image_source_create(paths[i], batch.surfaces[i]);
+        }
 
-        free(load); //free up memory
-        return NULL;
-    }
+        if( !(source = registry_lookup(&image_sources, paths[i])) ) {
+            dbgprint("image_loadBatch: Unable to load image: %s.\n", filenames[i]);
+            continue;
+        }
 
-    ainur.images[numloads] = load;        //insert new image into array
-    ainur.images[numloads + 1] = NULL;    //attach new NULL terminator
+        if( image_register(source, filenames[i], tags[i]) ) {
+            loaded++;
+        }
+    }
 
-    image_qsort();  //sort the array for future use.
+    registry_close(&pending);
+    free(batch.surfaces);
+    free(batch.paths);
+    free(paths);
 
-    return load;    //return a pointer to the newly created and archived struct image.
+    return loaded;
 }
 
 
 
 /**
- * @brief Loads multiple images with their tags.
+ * @brief Loads multiple images with their tags (see image_loadBatch()).
  *
  * @param argc
  *        Argument count, must be divisible by 2 or function will terminate.
  * @param ...
  *        Variable args list. Input pair format is filename, tag, ...
+ *
+ * @return The number of images loaded.
  */
-int image_loadMultiple(unsigned int argc, ...) {
-    if(!(argc % 2)) { //if argc is not divisible by zero
+size_t image_loadMultiple(unsigned int argc, ...) {
+    if(argc % 2) { //if argc is not divisible by two
         dbgprint("image_loadMultiple: formal param 'argc' is not divisible by 2.\n"\
                  "    'argc' must be divisible by 2.\n"\
                  "    argc = %u\n"
@@ -400,47 +1028,26 @@ int image_loadMultiple(unsigned int argc, ...) {
         return 0;
     }
 
+    size_t i, pairs = argc / 2, loaded;
+    const char **filenames;
+
+    //one block: filenames in the first half, tags in the second
+    if( !pairs || !(filenames = malloc(argc * sizeof(const char *))) ) {
+        return 0;
+    }
+
     va_list args;
     va_start(args, argc);
-
-    int i, pairs = argc / 2;
-    char *filename, *tag;
     for(i = 0; i < pairs; i++) {
-        filename = va_arg(args, char *);
-        tag = va_arg(args, char *);
-
-        /*
-        if(!filename || !tag) {
-            dbgprint("image_loadMultiple: An image pair contains a NULL\n"\
-                     "    filename = %s\n"\
-                     "    tag = %s\n"\
-                     "    Skipping pair.", filename, tag);
-
-            continue;
-        }
-
-        if(!file_exists(filename)) {
-            dbgprint("image_loadMultiple: %s: %s\n"\
-                     "    Skipping pair: \"%s\", \"%s\"\n",
-                     filename, ERROR_NO_FILE,
-                     filename, tag);
-
-            continue;
-        }
-
-        if(image_bsearch(tag)) {
-            dbgprint("image_loadMultiple: 'tag' \"%s\" is not unique.\n"\
-                     "    Skipping pair: \"%s\", \"%s\"\n",
-                     tag, filename, tag);
-
-            continue
-        }
-        */
-        image_load(filename, tag);
+        filenames[i] = va_arg(args, const char *);
+        filenames[pairs + i] = va_arg(args, const char *);
     }
     va_end(args);
 
-    return pairs;
+    loaded = image_loadBatch(filenames, filenames + pairs, pairs);
+
+    free(filenames);
+    return loaded;
 }
 
 
@@ -451,20 +1058,22 @@ int image_loadMultiple(unsigned int argc, ...) {
  *          filename is valid
  *
  * @param filename
- *        Path to the file/file name
+ *        Name of the file in the VFS, or a path outside of it.
  *
  * @return An SDL_Surface with the loaded pixels.
  *
  * @note As always, output SDL_Surface needs to be SDL_FreeSurface()ed.
  */
 SDL_Surface *image_loadSDL_Surface(const char *filename) {
-    if( !file_exists(filename) ) {
+    SDL_RWops *rw = vfs_openRW(filename);   //the only time the file is opened
+
+    if(!rw) {
         dbgprint("image_loadSDL_Surface: formal param 'filename'(%s): %s\n", filename, ERROR_NO_FILE);
 
         return NULL;
     }
 
-    SDL_Surface *temp = IMG_Load(filename);     //Load an SDL_Surface using the filename given.
+    SDL_Surface *temp = IMG_Load_RW(rw, 1);     //Load an SDL_Surface; closes 'rw'
 
     if(!temp) {
         dbgprint("image_loadSDL_Surface: IMG_Load error: %s\n", IMG_GetError());
@@ -472,50 +1081,95 @@ SDL_Surface *image_loadSDL_Surface(const char *filename) {
         return temp;    //aka NULL
     }
 
-    SDL_Surface *output = NULL;    //Declare an SDL_Surface (for output by function)
-
-    /*SDL_SetColorKey(temp,
-                    SDL_TRUE,
-                    SDL_MapRGB(temp->format, 0, 0, 0)   ); // Make the background transparent */
-
-    /*output = SDL_ConvertSurfaceFormat(temp,
-                                      SDL_PIXELTYPE_UNKNOWN,
-                                      0 ); *//* Convert the image to the screen's native format */
-
-    output = SDL_ConvertSurface(temp, SDL_GetWindowSurface(ainur.screen)->format, 0);
+    //Convert the image to the render backend's native format
+    SDL_Surface *output = image_convertSDL_Surface(temp, render_pixelFormat());
 
     if(!output) {
         dbgprint("image_loadSDL_Surface: local var 'output': %s\n"\
                  "            SDL error: %s\n", ERROR_NULL_SDL_SURFACE, SDL_GetError() );
-
-        return output;  //aka NULL
     }
 
-    SDL_FreeSurface(temp);  //Free our temporary variable
-
     return output;
 }
 
 
 
+/**
+ * @brief Retrieve a loaded image by its tag.
+ *
+ * @param tag
+ *        The 'tag' of the (struct image *) to search for.
+ *
+ * @return The image with the correct 'tag', or NULL (no match).
+ */
+struct image *image_lookup(const char *tag) {
+    return registry_lookup(&ainur.images, tag);
+}
+
+
+
 /**
  * @brief Determines the number of images currently loaded in the engine.
  *
- * @return The length of ainur.(struct image **images).
+ * @return The number of images in ainur.(struct registry images).
  */
 size_t image_numLoaded(void) {
-    size_t i;
-    for(i = 0; ainur.images[i]; i++);
-    return i;
+    return registry_count(&ainur.images);
+}
+
+
+
+/**
+ * @brief Determines the number of distinct files currently decoded.
+ *
+ * @return The number of image sources; never more than image_numLoaded().
+ */
+size_t image_numSources(void) {
+    return registry_count(&image_sources);
+}
+
+
+
+/**
+ * @brief Reset the hit, miss and eviction counters.
+ */
+void image_resetStats(void) {
+    image_residency.stats.hits = 0;
+    image_residency.stats.misses = 0;
+    image_residency.stats.evictions = 0;
+    return;
 }
 
 
 
 /**
- * @brief A wrapper function to sort the elements in the ainur.(struct image **images).
+ * @brief Set the budget of decoded pixel bytes. Least recently used surfaces
+ *        are evicted to stay within it.
+ *
+ * @param bytes
+ *        The budget; 0 means unlimited.
+ */
+void image_setBudget(size_t bytes) {
+    image_residency.stats.budget = bytes;
+
+    while( bytes && image_residency.stats.resident > bytes && image_residency.tail ) {
+        image_source_evict(image_residency.tail);
+        image_residency.stats.evictions++;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Choose whether image_load() decodes files immediately (the default)
+ *        or only registers them and decodes on first use.
+ *
+ * @param lazy
+ *        Non-zero to defer decoding.
  */
-void image_qsort(void) {
-    if(!ainur.images) { return; }
-    qsort( ainur.images, image_numLoaded(), sizeof(struct image *), image_compare_qsort );
+void image_setLazy(int lazy) {
+    image_residency.lazy = lazy;
     return;
 }
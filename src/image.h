@@ -11,39 +11,121 @@
 #include <stdio.h>
 #include <SDL2/SDL.h>
 
+#include "registry.h"
+
 #define IMAGE_SUCCESS   1
 #define IMAGE_FAILURE   0
 
+/**
+ * @struct image_source
+ *         A file, shared by every image loaded from it.
+ * @var surface
+ *      An SDL_Surface that contains the pixels, or NULL while the file is
+ *      not resident (see image_setLazy()).
+ * @var path
+ *      The interned canonical path of the file; used to find duplicates.
+ *      NULL for the source of an anonymous image, which is not registered.
+ * @var refs
+ *      Number of images that refer to this source.
+ * @var handle
+ *      Handle of this source in the source registry, or
+ *      REGISTRY_INVALID_HANDLE if it is anonymous.
+ * @var bytes
+ *      Pixel bytes held by 'surface' while it is resident.
+ * @var lru_prev
+ *      More recently used resident source.
+ * @var lru_next
+ *      Less recently used resident source.
+ * @var pinned
+ *      Whether 'surface' cannot be decoded again from 'path' (packed or
+ *      generated pixels). Pinned sources are never evicted and are not
+ *      counted against the budget.
+ * @var texture
+ *      Texture uploaded by the texture render backends (see render.h), or NULL.
+ *      It outlives evictions of 'surface'.
+ */
+struct image_source {
+    SDL_Surface *surface;
+    const char *path;
+    unsigned int refs;
+    registry_handle handle;
+    size_t bytes;
+    struct image_source *lru_prev;
+    struct image_source *lru_next;
+    int pinned;
+    SDL_Texture *texture;
+};
+
+/**
+ * @struct image_stats
+ *         Residency counters, see image_getStats().
+ * @var hits
+ *      Surface requests served by a resident surface.
+ * @var misses
+ *      Surface requests that had to decode the file.
+ * @var evictions
+ *      Surfaces dropped to stay within the budget.
+ * @var resident
+ *      Pixel bytes currently decoded.
+ * @var budget
+ *      Configured budget in pixel bytes (0: unlimited).
+ */
+struct image_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    size_t resident;
+    size_t budget;
+};
+
 /**
  * @struct image
  *         Represents a loaded image.
- * @var surface
- *      An SDL_Surface that contains the image.
+ * @var source
+ *      The decoded file; shared with every other tag loaded from the same file.
  * @var tag
- *      The tag under which this image is listed; used for sorting, finding.
+ *      The interned tag under which this image is listed; used for finding.
+ *      NULL for anonymous images (see image_create_anonymous()).
  * @var filename
- *      The filename from which the image was derived (may be used for save/load files).
+ *      The interned filename from which the image was derived (may be used for save/load files).
+ * @var handle
+ *      Handle of this image in ainur.images (REGISTRY_INVALID_HANDLE if unregistered).
  */
 struct image {
-    SDL_Surface *surface;
-    char *tag;
-    char *filename;
+    struct image_source *source;
+    const char *tag;
+    const char *filename;
+    registry_handle handle;
 };
 
 /*
  * Function declarations.
  */
-extern struct image ** image_bsearch         (const char *tag);
-extern void            image_close           (void);
-extern int             image_dump            (FILE *stream, struct image *image);
-extern int             image_dumpAll         (FILE *stream);
-extern void            image_free            (struct image *image);
-extern void            image_freeAll         (void);
-extern void            image_freeTag         (const char *tag);
-extern int             image_init            (void);
-extern struct image *  image_load            (const char *filename, const char *tag);
-extern SDL_Surface *   image_loadSDL_Surface (const char *filename);
-extern size_t          image_numLoaded       (void);
-extern void            image_qsort           (void);
+extern struct image *  image_alias              (const char *tag, const char *alias);
+extern void            image_close              (void);
+extern struct image *  image_create_anonymous   (SDL_Surface *surface);
+extern struct image *  image_create_fromSurface (SDL_Surface *surface, const char *name, const char *tag);
+extern void            image_dropTexture        (struct image *image);
+extern void            image_dropTextures       (void);
+extern int             image_dump               (FILE *stream, struct image *image);
+extern int             image_dumpAll            (FILE *stream);
+extern void            image_free               (struct image *image);
+extern void            image_freeAll            (void);
+extern void            image_freeTag            (const char *tag);
+extern struct image *  image_get                (registry_handle handle);
+extern void            image_getStats           (struct image_stats *stats);
+extern SDL_Surface *   image_getSurface         (struct image *image);
+extern registry_handle image_handle             (const char *tag);
+extern int             image_init               (void);
+extern struct image *  image_load               (const char *filename, const char *tag);
+extern size_t          image_loadBatch          (const char **filenames, const char **tags, size_t count);
+extern size_t          image_loadMultiple       (unsigned int argc, ...);
+extern SDL_Surface *   image_loadSDL_Surface    (const char *filename);
+extern struct image *  image_lookup             (const char *tag);
+extern size_t          image_numLoaded          (void);
+extern size_t          image_numSources         (void);
+extern void            image_resetStats         (void);
+extern void            image_setBudget          (size_t bytes);
+extern void            image_setLazy            (int lazy);
 
 #endif /* IMAGE_H_ */
@@ -0,0 +1,268 @@
+/*
+ * intern.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief A pool of unique, immutable strings. Every distinct string is stored
+ *        exactly once, so interned strings can be compared by pointer and
+ *        never need to be free()ed individually.
+ *
+ * Field Overview:
+ *  static:
+ *      intern_arena
+ *      intern_table
+ *      intern_copy
+ *      intern_grow
+ *      intern_probe
+ *  extern:
+ *      intern_close
+ *      intern_find
+ *      intern_hash
+ *      intern_init
+ *      intern_string
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "intern.h"
+
+#define INTERN_ARENA_SIZE       8192    //bytes per arena block
+#define INTERN_INITIAL_BUCKETS  256     //must be a power of two
+
+
+
+/**
+ * @struct intern_block
+ *         A block of arena memory that holds interned strings back to back.
+ */
+struct intern_block {
+    struct intern_block *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+/**
+ * @struct intern_bucket
+ *         One slot of the open addressing table.
+ */
+struct intern_bucket {
+    const char *str;    //NULL if the slot is empty
+    uint32_t hash;
+};
+
+static struct intern_block *intern_arena = NULL;
+
+static struct {
+    struct intern_bucket *buckets;
+    size_t size;        //number of buckets (power of two)
+    size_t count;       //number of strings stored
+} intern_table = { NULL, 0, 0 };
+
+
+
+/**
+ * @brief Copy a string into the arena.
+ *
+ * @param str
+ *        String to copy.
+ * @param length
+ *        Length of 'str', excluding the NULL terminator.
+ *
+ * @return A pointer to the arena copy, or NULL on allocation failure.
+ */
+static const char *intern_copy(const char *str, size_t length) {
+    size_t need = length + 1;
+
+    if( !intern_arena || intern_arena->size - intern_arena->used < need ) {
+        size_t size = (need > INTERN_ARENA_SIZE) ? need : INTERN_ARENA_SIZE;
+        struct intern_block *block;
+
+        if( !(block = malloc(sizeof(struct intern_block) + size)) ) {
+            dbgprint("intern_copy: local var 'block': %s\n", ERROR_MALLOC);
+
+            return NULL;
+        }
+        block->next = intern_arena;
+        block->used = 0;
+        block->size = size;
+        intern_arena = block;
+    }
+
+    char *output = intern_arena->data + intern_arena->used;
+    memcpy(output, str, need);
+    intern_arena->used += need;
+
+    return output;
+}
+
+
+
+/**
+ * @brief Double the number of buckets in the table and rehash every string.
+ *
+ * @return INTERN_SUCCESS or INTERN_FAILURE.
+ */
+static int intern_grow(void) {
+    size_t size = intern_table.size ? intern_table.size * 2 : INTERN_INITIAL_BUCKETS;
+    struct intern_bucket *buckets;
+
+    if( !(buckets = calloc(size, sizeof(struct intern_bucket))) ) {
+        dbgprint("intern_grow: local var 'buckets': %s\n", ERROR_CALLOC);
+
+        return INTERN_FAILURE;
+    }
+
+    size_t i, j;
+    for(i = 0; i < intern_table.size; i++) {
+        if(!intern_table.buckets[i].str) { continue; }
+
+        for(j = intern_table.buckets[i].hash & (size - 1); buckets[j].str; j = (j + 1) & (size - 1));
+        buckets[j] = intern_table.buckets[i];
+    }
+
+    free(intern_table.buckets);
+    intern_table.buckets = buckets;
+    intern_table.size = size;
+
+    return INTERN_SUCCESS;
+}
+
+
+
+/**
+ * @brief Find the bucket holding 'str', or the empty bucket where it belongs.
+ */
+static struct intern_bucket *intern_probe(const char *str, uint32_t hash) {
+    size_t mask = intern_table.size - 1, i;
+
+    for(i = hash & mask; intern_table.buckets[i].str; i = (i + 1) & mask) {
+        if( intern_table.buckets[i].hash == hash && !strcmp(intern_table.buckets[i].str, str) ) {
+            break;
+        }
+    }
+
+    return &intern_table.buckets[i];
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Free every interned string and the table itself.
+ * @note All pointers handed out by intern_string() become invalid.
+ */
+void intern_close(void) {
+    struct intern_block *block;
+
+    while( (block = intern_arena) ) {
+        intern_arena = block->next;
+        free(block);
+    }
+
+    free(intern_table.buckets);
+    intern_table.buckets = NULL;
+    intern_table.size = 0;
+    intern_table.count = 0;
+    return;
+}
+
+
+
+/**
+ * @brief Look up the interned copy of a string without inserting it.
+ *
+ * @param str
+ *        String to look up.
+ *
+ * @return The interned copy of 'str', or NULL if 'str' was never interned.
+ */
+const char *intern_find(const char *str) {
+    if(!str || !intern_table.buckets) { return NULL; }
+
+    return intern_probe(str, intern_hash(str))->str;
+}
+
+
+
+/**
+ * @brief Hash a string (32-bit FNV-1a).
+ *
+ * @param str
+ *        String to hash.
+ *
+ * @return The hash of 'str'.
+ */
+uint32_t intern_hash(const char *str) {
+    uint32_t hash = 2166136261u;
+
+    while(*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+
+/**
+ * @brief Allocate the intern table.
+ *
+ * @return INTERN_SUCCESS or INTERN_FAILURE.
+ */
+int intern_init(void) {
+    if(intern_table.buckets) {
+        return INTERN_SUCCESS;
+    }
+
+    return intern_grow();
+}
+
+
+
+/**
+ * @brief Intern a string.
+ *
+ * @param str
+ *        String to intern.
+ *
+ * @return The unique, pool-owned copy of 'str', or NULL on failure.
+ * @note Returned string must NOT be free()ed; it lives until intern_close().
+ */
+const char *intern_string(const char *str) {
+    if(!str) {
+        dbgprint("intern_string: formal param 'str': %s\n", ERROR_NULL_STRING);
+
+        return NULL;
+    }
+
+    //keep the load factor at or below one half
+    if( (intern_table.count + 1) * 2 > intern_table.size && !intern_grow() ) {
+        return NULL;
+    }
+
+    uint32_t hash = intern_hash(str);
+    struct intern_bucket *bucket = intern_probe(str, hash);
+
+    if(bucket->str) {
+        return bucket->str;     //already interned
+    }
+
+    if( !(bucket->str = intern_copy(str, strlen(str))) ) {
+        return NULL;
+    }
+    bucket->hash = hash;
+    intern_table.count++;
+
+    return bucket->str;
+}
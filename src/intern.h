@@ -0,0 +1,25 @@
+/*
+ * intern.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+
+#define INTERN_SUCCESS  1
+#define INTERN_FAILURE  0
+
+/*
+ * Function declarations.
+ */
+extern void         intern_close  (void);
+extern const char * intern_find   (const char *str);
+extern uint32_t     intern_hash   (const char *str);
+extern int          intern_init   (void);
+extern const char * intern_string (const char *str);
+
+#endif /*INTERN_H*/
@@ -1,5 +1,5 @@
 /*
- * lkernel_image.c
+ * lkernel_dice.c
  *
  *     Created on: 9 July 2017
  *         Author: oceaquaris
@@ -8,35 +8,70 @@
  * Field Overview:
  *  Static:
  *      lkernel_dice_average
+ *      lkernel_dice_chance
+ *      lkernel_dice_check
+ *      lkernel_dice_compile
+ *      lkernel_dice_compiled_average
+ *      lkernel_dice_compiled_roll
+ *      lkernel_dice_compiled_tostring
+ *      lkernel_dice_pmf
+ *      lkernel_dice_pushMany
  *      lkernel_dice_roll
+ *      lkernel_dice_rollMany
  *      lkernel_dice_roll_numeric
+ *      lkernel_dice_toDice
  *      lkernel_dice_valid
  *  Extern:
- *      lkernel_image_init
+ *      lkernel_dice_init
  */
 
+#include <string.h>
 #include <lauxlib.h>
 #include <lua.h>
 
 #include "dice.h"
+#include "dicedist.h"
 #include "lkernel.h"
 #include "lkernel_dice.h"
 
+#define LKERNEL_DICE_META "ainur.dice"  //metatable of compiled formats
+#define LKERNEL_DICE_BATCH 256          //results rolled at a time by rollMany
+
 
 
 static int lkernel_dice_average(lua_State *L);
+static int lkernel_dice_chance(lua_State *L);
+static int lkernel_dice_compile(lua_State *L);
+static int lkernel_dice_pmf(lua_State *L);
 static int lkernel_dice_roll(lua_State *L);
+static int lkernel_dice_rollMany(lua_State *L);
 //probably will remove lkernel_dice_roll_numeric and use lkernel_dice_roll instead
 static int lkernel_dice_roll_numeric(lua_State *L);
 static int lkernel_dice_valid(lua_State *L);
 static const luaL_Reg lkernel_dice_functions[] = {
     {"average", lkernel_dice_average},
+    {"chance", lkernel_dice_chance},
+    {"compile", lkernel_dice_compile},
+    {"pmf", lkernel_dice_pmf},
     {"roll", lkernel_dice_roll},
+    {"rollMany", lkernel_dice_rollMany},
     {"rollNumeric", lkernel_dice_roll_numeric},
     {"valid", lkernel_dice_valid},
     {NULL, NULL}
 };
 
+static int lkernel_dice_compiled_average(lua_State *L);
+static int lkernel_dice_compiled_roll(lua_State *L);
+static int lkernel_dice_compiled_tostring(lua_State *L);
+static const luaL_Reg lkernel_dice_methods[] = {
+    {"average", lkernel_dice_compiled_average},
+    {"chance", lkernel_dice_chance},
+    {"pmf", lkernel_dice_pmf},
+    {"roll", lkernel_dice_compiled_roll},
+    {"rollMany", lkernel_dice_rollMany},
+    {NULL, NULL}
+};
+
 
 
 static int lkernel_dice_average(lua_State *L) {
@@ -51,6 +86,175 @@ static int lkernel_dice_average(lua_State *L) {
 
 
 
+/**
+ * @brief The compiled format held by the userdata at 'index', or a Lua error.
+ */
+static const struct dice *lkernel_dice_check(lua_State *L, int index) {
+    return *(const struct dice **)luaL_checkudata(L, index, LKERNEL_DICE_META);
+}
+
+
+
+/**
+ * @brief The compiled format at 'index', given as a handle or a format string;
+ *        a Lua error if it is neither.
+ */
+static const struct dice *lkernel_dice_toDice(lua_State *L, int index) {
+    const struct dice *dice = lua_isuserdata(L, index) ? lkernel_dice_check(L, index)
+                                                       : dice_compile(luaL_checkstring(L, index));
+    if(!dice) {
+        LKERNEL_INVALID_PARAMETER(L);
+    }
+    return dice;
+}
+
+
+
+/**
+ * dice.chance(fmt, op, k)
+ * handle:chance(op, k)
+ *
+ * The exact probability that a roll compares to 'k' as 'op' ("<", "<=",
+ * "==", "~=", ">=" or ">") says.
+ */
+static int lkernel_dice_chance(lua_State *L) {
+    static const char *ops[] = { "<", "<=", "==", "~=", ">=", ">", NULL };
+    static const enum dicedist_op codes[] = {
+        DICEDIST_LT, DICEDIST_LE, DICEDIST_EQ, DICEDIST_NE, DICEDIST_GE, DICEDIST_GT
+    };
+    const struct dice *dice = lkernel_dice_toDice(L, 1);
+    const char *op = luaL_checkstring(L, 2);
+    int k = luaL_checkinteger(L, 3);
+
+    for(int i = 0; ops[i]; i++) {
+        if( !strcmp(op, ops[i]) ) {
+            lua_pushnumber(L, dicedist_chance(dice, codes[i], k));
+            return 1;
+        }
+    }
+
+    LKERNEL_INVALID_PARAMETER(L);
+    return 0;
+}
+
+
+
+/**
+ * dice.compile(fmt)
+ *
+ * Returns a handle with :roll() and :average() methods, or nil if 'fmt' is
+ * not a legal format. The handle points into the C cache; it holds no memory.
+ */
+static int lkernel_dice_compile(lua_State *L) {
+    const char *fmt = luaL_checkstring(L, 1);
+    const struct dice *dice = dice_compile(fmt);
+
+    if(!dice) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    const struct dice **handle = lua_newuserdata(L, sizeof(const struct dice *));
+    *handle = dice;
+    luaL_getmetatable(L, LKERNEL_DICE_META);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+
+
+static int lkernel_dice_compiled_average(lua_State *L) {
+    lua_pushnumber(L, dice_averageCompiled(lkernel_dice_check(L, 1)));
+    return 1;
+}
+
+
+
+static int lkernel_dice_compiled_roll(lua_State *L) {
+    lua_pushnumber(L, dice_rollCompiled(lkernel_dice_check(L, 1)));
+    return 1;
+}
+
+
+
+static int lkernel_dice_compiled_tostring(lua_State *L) {
+    lua_pushstring(L, lkernel_dice_check(L, 1)->tag);
+    return 1;
+}
+
+
+
+/**
+ * dice.pmf(fmt)
+ * handle:pmf()
+ *
+ * Returns a table of the probability of each outcome, indexed by outcome,
+ * then the mean and the variance; nil for formats with too many outcomes.
+ */
+static int lkernel_dice_pmf(lua_State *L) {
+    const struct dicedist *dist = dicedist_get(lkernel_dice_toDice(L, 1));
+
+    if(!dist) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_createtable(L, (dist->min >= 1) ? (int)dist->count : 0, 0);
+    for(size_t i = 0; i < dist->count; i++) {
+        lua_pushnumber(L, dist->pmf[i]);
+        lua_rawseti(L, -2, dist->min + (int)i);
+    }
+    lua_pushnumber(L, dist->mean);
+    lua_pushnumber(L, dist->variance);
+
+    return 3;
+}
+
+
+
+/**
+ * @brief Push a table of 'n' rolls of 'dice', filled a batch at a time.
+ */
+static void lkernel_dice_pushMany(lua_State *L, const struct dice *dice, int n) {
+    int results[LKERNEL_DICE_BATCH];
+
+    lua_createtable(L, n, 0);
+    for(int index = 0; index < n; ) {
+        int count = (n - index < LKERNEL_DICE_BATCH) ? n - index : LKERNEL_DICE_BATCH;
+
+        dice_rollMany(dice, results, (size_t)count);
+        for(int i = 0; i < count; i++) {
+            lua_pushnumber(L, results[i]);
+            lua_rawseti(L, -2, ++index);
+        }
+    }
+    return;
+}
+
+
+
+/**
+ * dice.rollMany(fmt, n)
+ * handle:rollMany(n)
+ *
+ * Returns an array of 'n' rolls; one call however many rolls.
+ */
+static int lkernel_dice_rollMany(lua_State *L) {
+    const struct dice *dice = lkernel_dice_toDice(L, 1);
+    int n = luaL_checkinteger(L, 2);
+
+    if(n < 0) {
+        LKERNEL_INVALID_PARAMETER(L);
+        return 0;
+    }
+
+    lkernel_dice_pushMany(L, dice, n);
+    return 1;
+}
+
+
+
 /**
  * 
  * dice.roll()
@@ -111,6 +315,15 @@ static int lkernel_dice_valid(lua_State *L) {
 
 
 int lkernel_dice_init(lua_State *L) {
+    //metatable of compiled formats: methods through __index
+    luaL_newmetatable(L, LKERNEL_DICE_META);
+    lua_newtable(L);
+    luaL_openlib(L, NULL, lkernel_dice_methods, 0);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, lkernel_dice_compiled_tostring);
+    lua_setfield(L, -2, "__tostring");
+    lua_pop(L, 1);
+
     luaL_openlib(L, "dice", lkernel_dice_functions, 0);
     return 1;
 }
@@ -1,5 +1,5 @@
-#ifndef LKERNEL_IMAGE_H
-#define LKERNEL_IMAGE_H
+#ifndef LKERNEL_DICE_H
+#define LKERNEL_DICE_H
 
 extern int lkernel_dice_init(lua_State *L);
 
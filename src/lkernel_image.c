@@ -7,7 +7,11 @@
  *
  * Field Overview:
  *  Static:
+ *      lkernel_image_buildAtlas
  *      lkernel_image_load
+ *      lkernel_image_setBudget
+ *      lkernel_image_setLazy
+ *      lkernel_image_stats
  *  Extern:
  *      lkernel_image_init
  */
@@ -15,15 +19,54 @@
 #include <lauxlib.h>
 #include <lua.h>
 
+#include "atlas.h"
 #include "image.h"
 #include "lkernel_image.h"
 
+static int lkernel_image_buildAtlas(lua_State *L);
 static int lkernel_image_load(lua_State *L);
+static int lkernel_image_setBudget(lua_State *L);
+static int lkernel_image_setLazy(lua_State *L);
+static int lkernel_image_stats(lua_State *L);
 static const luaL_Reg lkernel_image_functions[] = {
+    {"buildAtlas", lkernel_image_buildAtlas},
     {"load", lkernel_image_load},
+    {"setBudget", lkernel_image_setBudget},
+    {"setLazy", lkernel_image_setLazy},
+    {"stats", lkernel_image_stats},
     {NULL, NULL}
 };
 
+/**
+ * image.buildAtlas([page_size [, padding]]) => { pages =, tiles =, regions =, skipped =, efficiency = }
+ *                                             or nil on failure
+ */
+static int lkernel_image_buildAtlas(lua_State *L) {
+    struct atlas_stats stats;
+
+    if( !atlas_build((int)luaL_optinteger(L, 1, 0), (int)luaL_optinteger(L, 2, 0)) ) {
+        lua_pushnil(L);
+        return 1;
+    }
+    atlas_getStats(&stats);
+
+    lua_createtable(L, 0, 5);
+    lua_pushnumber(L, stats.pages);
+    lua_setfield(L, -2, "pages");
+    lua_pushnumber(L, stats.tiles);
+    lua_setfield(L, -2, "tiles");
+    lua_pushnumber(L, stats.regions);
+    lua_setfield(L, -2, "regions");
+    lua_pushnumber(L, stats.skipped);
+    lua_setfield(L, -2, "skipped");
+    lua_pushnumber(L, stats.efficiency);
+    lua_setfield(L, -2, "efficiency");
+
+    return 1;
+}
+
+
+
 static int lkernel_image_load(lua_State *L) {
     //pointers to the image filename and the tag associated with the image
     const char *filename = NULL,
@@ -39,6 +82,52 @@ static int lkernel_image_load(lua_State *L) {
 
 
 
+/**
+ * image.setBudget(bytes)
+ */
+static int lkernel_image_setBudget(lua_State *L) {
+    lua_Integer bytes = luaL_checkinteger(L, 1);
+
+    image_setBudget(bytes > 0 ? (size_t)bytes : 0);
+    return 0;
+}
+
+
+
+/**
+ * image.setLazy(lazy)
+ */
+static int lkernel_image_setLazy(lua_State *L) {
+    image_setLazy(lua_toboolean(L, 1));
+    return 0;
+}
+
+
+
+/**
+ * image.stats() => { hits =, misses =, evictions =, resident =, budget = }
+ */
+static int lkernel_image_stats(lua_State *L) {
+    struct image_stats stats;
+    image_getStats(&stats);
+
+    lua_createtable(L, 0, 5);
+    lua_pushnumber(L, stats.hits);
+    lua_setfield(L, -2, "hits");
+    lua_pushnumber(L, stats.misses);
+    lua_setfield(L, -2, "misses");
+    lua_pushnumber(L, stats.evictions);
+    lua_setfield(L, -2, "evictions");
+    lua_pushnumber(L, stats.resident);
+    lua_setfield(L, -2, "resident");
+    lua_pushnumber(L, stats.budget);
+    lua_setfield(L, -2, "budget");
+
+    return 1;
+}
+
+
+
 int lkernel_image_init(lua_State *L) {
     luaL_openlib(L, "image", lkernel_image_functions, 0);
     return 1;
@@ -1,9 +1,137 @@
-
-#include "map.h"
+/**
+ * @file map.c
+ *
+ * @brief Chunked map storage. Cells are grouped into MAP_CHUNK_SIZE square
+ *        chunks, each a single 4 KiB block, so neighbors are usually in the
+ *        same block and a whole chunk can be walked linearly. Chunks are only
+ *        allocated once a cell in them is set and are freed when their last
+ *        cell is cleared, so empty regions cost one pointer per chunk.
+ *
+ * Field Overview:
+ *  static:
+ *      map_isUsed
+ *  extern:
+ *      map_emptyCell
+ *      map_addListener
+ *      map_create
+ *      map_createNewMap
+ *      map_freeMap
+ *      map_removeListener
+ *      map_setCell
+ *      map_setChunk
+ *      map_touchChunk
+ */
 
 #include <stdlib.h>
 #include <string.h>
 
+#include "debug.h"
+#include "map.h"
+#include "mapfile.h"
+
+const struct map_cell map_emptyCell = { MAP_NONE, MAP_NONE };
+
+
+
+/**
+ * @brief Whether a cell has a non-empty layer.
+ */
+static inline int map_isUsed(const struct map_cell *cell) {
+    return cell->floor != MAP_NONE || cell->wall != MAP_NONE;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Have a function called whenever a cell of a map changes.
+ *
+ * @param changed
+ *        The function; it must not add or remove listeners.
+ * @param context
+ *        Passed to 'changed'.
+ *
+ * @return MAP_SUCCESS, or MAP_FAILURE if the map has MAP_MAX_LISTENERS.
+ */
+int map_addListener(struct map *m, map_listener changed, void *context) {
+    if(!m || !changed || m->nlisteners == MAP_MAX_LISTENERS) {
+        dbgprint("map_addListener: Unable to add a listener to map %s.\n", m ? m->tag : "(null)");
+        return MAP_FAILURE;
+    }
+
+    m->listeners[m->nlisteners].changed = changed;
+    m->listeners[m->nlisteners].context = context;
+    m->nlisteners++;
+
+    return MAP_SUCCESS;
+}
+
+
+
+/**
+ * @brief Create an empty map. No chunk is allocated.
+ *
+ * @param tag
+ *        Name of the map (copied).
+ * @param height
+ *        Height, in cells.
+ * @param width
+ *        Width, in cells.
+ *
+ * @return The map, or NULL on failure.
+ */
+struct map *map_create(const char *tag, unsigned int height, unsigned int width) {
+    struct map *output;
+
+    if(!tag) {
+        dbgprint("map_create: %s\n", ERROR_NULL_STRING);
+        return NULL;
+    }
+
+    if( !(output = calloc(1, sizeof(struct map))) ) {
+        dbgprint("map_create: %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+
+    output->height = height;
+    output->width = width;
+    output->chunks_h = (height + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+    output->chunks_w = (width + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+
+    //one spare slot so that an empty map never calls calloc(0)
+    if( !(output->tag = strdup(tag)) ||
+        !(output->chunks = calloc((size_t)output->chunks_w * output->chunks_h + 1, sizeof(struct map_chunk *))) ) {
+        dbgprint("map_create: Unable to create map %s: %s\n", tag, ERROR_CALLOC);
+
+        map_freeMap(output);
+        return NULL;
+    }
+
+    return output;
+}
+
+
+
+/**
+ * @brief Create a map from rows of floor palette indices, one character per
+ *        cell. Rows shorter than 'width' leave the rest of the row empty.
+ *
+ * @param tag
+ *        Name of the map (copied).
+ * @param height
+ *        Number of rows in 'floor'.
+ * @param width
+ *        Width, in cells.
+ * @param floor
+ *        'height' NUL terminated rows; '\0' and ' ' leave a cell empty.
+ *
+ * @return The map, or NULL on failure.
+ */
 struct map *map_createNewMap(const char *tag,
                              unsigned int height,
                              unsigned int width,
@@ -15,32 +143,225 @@ struct map *map_createNewMap(const char *tag,
             )
 {
     struct map *output;
-    output = (struct map *)malloc(sizeof(struct map));
-    
-    //populate output->tag
-    int size = sizeof(char) * strlen(tag);
-    output->tag = (char *)malloc( size );
-    memcpy(output->tag, tag, size);
-    
-    //populate height and width
-    output->height = height;
-    output->width = width;
-    
-    //populate output->floor
-    char **tempfloor;
-    tempfloor = (char **)malloc(sizeof(char *) * height);
-    int i;
-    for(i = 0; i < height; i++) {
-        int msize = sizeof(char) * strlen(floor[i]);
-        tempfloor[i] = (char *)malloc( msize );
-        memcpy(tempfloor[i], floor[i], msize);
+    unsigned int x, y;
+
+    if( !floor || !(output = map_create(tag, height, width)) ) {
+        return NULL;
+    }
+
+    for(y = 0; y < height; y++) {
+        for(x = 0; x < width && floor[y] && floor[y][x]; x++) {
+            if( floor[y][x] != ' ' &&
+                !map_setCell(output, x, y, (unsigned char)floor[y][x], MAP_NONE) ) {
+                map_freeMap(output);
+                return NULL;
+            }
+        }
     }
-    output->floor = tempfloor;
-    
+
     return output;
 }
 
+
+
+/**
+ * @brief Free a map and all of its chunks. A streamed map writes its
+ *        modified chunks back first.
+ */
 void map_freeMap(struct map *m)
 {
-    
-}
\ No newline at end of file
+    size_t i;
+
+    if(!m) { return; }
+
+    if(m->stream) {
+        mapfile_close(m);
+    }
+
+    if(m->chunks) {
+        for(i = 0; i < (size_t)m->chunks_w * m->chunks_h; i++) {
+            free(m->chunks[i]);
+        }
+        free(m->chunks);
+    }
+    free(m->tag);
+    free(m);
+
+    return;
+}
+
+
+
+/**
+ * @brief Stop calling a function added with map_addListener().
+ */
+void map_removeListener(struct map *m, map_listener changed, void *context) {
+    int i;
+
+    if(!m) { return; }
+
+    for(i = 0; i < m->nlisteners; i++) {
+        if(m->listeners[i].changed == changed && m->listeners[i].context == context) {
+            m->nlisteners--;
+            m->listeners[i] = m->listeners[m->nlisteners];
+            break;
+        }
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Set both layers of a cell. Allocates the cell's chunk if needed and
+ *        frees it when its last cell becomes empty (streamed maps keep it, so
+ *        that the empty chunk is written back). Listeners are told about
+ *        cells that actually change.
+ *
+ * @return MAP_SUCCESS, or MAP_FAILURE if (x, y) is outside the map or the
+ *         chunk cannot be allocated.
+ */
+int map_setCell(struct map *m, unsigned int x, unsigned int y, uint16_t floor, uint16_t wall) {
+    struct map_chunk *chunk, **slot;
+    struct map_cell *cell;
+    int i;
+
+    if(!m || x >= m->width || y >= m->height) { return MAP_FAILURE; }
+
+    slot = &m->chunks[(size_t)(y >> MAP_CHUNK_SHIFT) * m->chunks_w + (x >> MAP_CHUNK_SHIFT)];
+    if(!*slot) {
+        //a streamed chunk that is not loaded may still hold cells in the file
+        if(!m->stream && floor == MAP_NONE && wall == MAP_NONE) {
+            return MAP_SUCCESS;     //already empty
+        }
+        if( !map_touchChunk(m, x >> MAP_CHUNK_SHIFT, y >> MAP_CHUNK_SHIFT) ) {
+            return MAP_FAILURE;
+        }
+    }
+    chunk = *slot;
+    cell = &chunk->cells[((y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | (x & MAP_CHUNK_MASK)];
+
+    if(cell->floor == floor && cell->wall == wall) {
+        return MAP_SUCCESS;
+    }
+
+    chunk->used -= map_isUsed(cell);
+    cell->floor = floor;
+    cell->wall = wall;
+    chunk->used += map_isUsed(cell);
+    chunk->flags |= MAP_CHUNK_DIRTY;
+
+    if(!chunk->used && !m->stream) {
+        free(chunk);
+        *slot = NULL;
+        m->allocated--;
+    }
+
+    for(i = 0; i < m->nlisteners; i++) {
+        m->listeners[i].changed(m, x, y, m->listeners[i].context);
+    }
+
+    return MAP_SUCCESS;
+}
+
+
+
+/**
+ * @brief Overwrite every cell of chunk (cx, cy), as map_setCell() would one
+ *        by one: listeners are told of the cells that changed. Cells of the
+ *        chunk outside the map are left empty.
+ *
+ * @param cells
+ *        MAP_CHUNK_CELLS cells, row-major.
+ *
+ * @return MAP_SUCCESS, or MAP_FAILURE if the chunk is outside the map or
+ *         cannot be allocated.
+ */
+int map_setChunk(struct map *m, unsigned int cx, unsigned int cy, const struct map_cell *cells) {
+    uint64_t changed[MAP_CHUNK_CELLS / 64] = { 0 };
+    struct map_chunk *chunk, **slot;
+    unsigned int i, x, y, w, h;
+    int k;
+
+    if(!m || !cells || cx >= m->chunks_w || cy >= m->chunks_h) { return MAP_FAILURE; }
+
+    w = m->width - (cx << MAP_CHUNK_SHIFT) < MAP_CHUNK_SIZE ? m->width - (cx << MAP_CHUNK_SHIFT) : MAP_CHUNK_SIZE;
+    h = m->height - (cy << MAP_CHUNK_SHIFT) < MAP_CHUNK_SIZE ? m->height - (cy << MAP_CHUNK_SHIFT) : MAP_CHUNK_SIZE;
+
+    slot = &m->chunks[(size_t)cy * m->chunks_w + cx];
+    if(!*slot) {
+        for(i = 0; !m->stream && i < MAP_CHUNK_CELLS && !map_isUsed(&cells[i]); i++);
+        if(i == MAP_CHUNK_CELLS) {
+            return MAP_SUCCESS;     //already empty
+        }
+        if( !map_touchChunk(m, cx, cy) ) {
+            return MAP_FAILURE;
+        }
+    }
+    chunk = *slot;
+
+    for(y = 0; y < h; y++) {
+        for(x = 0; x < w; x++) {
+            i = (y << MAP_CHUNK_SHIFT) | x;
+            if(chunk->cells[i].floor == cells[i].floor && chunk->cells[i].wall == cells[i].wall) { continue; }
+
+            chunk->used -= map_isUsed(&chunk->cells[i]);
+            chunk->cells[i] = cells[i];
+            chunk->used += map_isUsed(&chunk->cells[i]);
+            changed[i / 64] |= (uint64_t)1 << (i % 64);
+        }
+    }
+
+    for(i = 0; i < MAP_CHUNK_CELLS / 64 && !changed[i]; i++);
+    if(i == MAP_CHUNK_CELLS / 64) {
+        return MAP_SUCCESS;
+    }
+    chunk->flags |= MAP_CHUNK_DIRTY;
+
+    if(!chunk->used && !m->stream) {
+        free(chunk);
+        *slot = NULL;
+        m->allocated--;
+    }
+
+    for(i = 0; i < MAP_CHUNK_CELLS && m->nlisteners; i++) {
+        if( !(changed[i / 64] & ((uint64_t)1 << (i % 64))) ) { continue; }
+        for(k = 0; k < m->nlisteners; k++) {
+            m->listeners[k].changed(m, (cx << MAP_CHUNK_SHIFT) | (i & MAP_CHUNK_MASK),
+                                    (cy << MAP_CHUNK_SHIFT) | (i >> MAP_CHUNK_SHIFT), m->listeners[k].context);
+        }
+    }
+
+    return MAP_SUCCESS;
+}
+
+
+
+/**
+ * @brief Retrieve chunk (cx, cy) of a map, allocating it (empty) if needed.
+ *        An empty chunk allocated here is kept until a cell of it is cleared
+ *        with map_setCell(). Streamed maps load the chunk from their file.
+ *
+ * @return The chunk, or NULL if it is outside the map or cannot be allocated.
+ */
+struct map_chunk *map_touchChunk(struct map *m, unsigned int cx, unsigned int cy) {
+    struct map_chunk **slot;
+
+    if(!m || cx >= m->chunks_w || cy >= m->chunks_h) { return NULL; }
+
+    slot = &m->chunks[(size_t)cy * m->chunks_w + cx];
+    if(!*slot && m->stream) {
+        return mapfile_load(m, cx, cy);
+    }
+    if(!*slot) {
+        if( !(*slot = calloc(1, sizeof(struct map_chunk))) ) {
+            dbgprint("map_touchChunk: Unable to allocate chunk (%u, %u) of map %s: %s\n",
+                     cx, cy, m->tag, ERROR_CALLOC);
+            return NULL;
+        }
+        m->allocated++;
+    }
+
+    return *slot;
+}
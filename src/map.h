@@ -1,16 +1,132 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include <stddef.h>
+#include <stdint.h>
 
+#define MAP_SUCCESS 1
+#define MAP_FAILURE 0
+
+/* Maps are cut into square chunks of MAP_CHUNK_SIZE x MAP_CHUNK_SIZE cells. */
+#define MAP_CHUNK_SHIFT  5
+#define MAP_CHUNK_SIZE   (1u << MAP_CHUNK_SHIFT)
+#define MAP_CHUNK_MASK   (MAP_CHUNK_SIZE - 1)
+#define MAP_CHUNK_CELLS  (MAP_CHUNK_SIZE * MAP_CHUNK_SIZE)
+
+#define MAP_NONE 0      //palette index of an empty layer
+
+/**
+ * @brief Layers of a cell, drawn in this order.
+ */
+enum map_layer {
+    MAP_FLOOR = 0,
+    MAP_WALL  = 1,
+    MAP_LAYERS
+};
+
+#define MAP_CHUNK_DIRTY 0x1     //changed since it was loaded or last written back
+
+#define MAP_MAX_LISTENERS 8
+
+struct map;
+struct mapfile;
+
+/* Called after a cell of a map was changed by map_setCell(). */
+typedef void (*map_listener)(struct map *m, unsigned int x, unsigned int y, void *context);
+
+/**
+ * @struct map_cell
+ *
+ * @brief One cell: a palette index per layer, MAP_NONE if the layer is empty.
+ */
+struct map_cell {
+    uint16_t floor;
+    uint16_t wall;
+};
+
+/**
+ * @struct map_chunk
+ *
+ * @brief MAP_CHUNK_SIZE x MAP_CHUNK_SIZE cells, row-major, in one block.
+ */
+struct map_chunk {
+    struct map_cell cells[MAP_CHUNK_CELLS];
+    unsigned int used;  //cells with a non-empty layer; the chunk is freed at 0
+    unsigned int flags; //MAP_CHUNK_* flags
+    uint32_t stamp;     //last frame a streamed chunk was focused on, see mapfile_focus()
+};
+
+/**
+ * @struct map
+ *
+ * @brief A grid of cells, stored sparsely: chunks holding no cell are NULL
+ *        in 'chunks' and cost a pointer each. For maps opened with
+ *        mapfile_open(), NULL also means "not loaded".
+ */
 struct map {
     char *tag;
-    unsigned int height;
-    unsigned int width;
+    unsigned int height;    //in cells
+    unsigned int width;     //in cells
+    unsigned int chunks_h;  //chunks per column
+    unsigned int chunks_w;  //chunks per row
+    struct map_chunk **chunks; //chunks_w * chunks_h chunks, row-major, or NULL
+    size_t allocated;       //chunks that are not NULL
+    struct mapfile *stream; //file the chunks are streamed from, or NULL
+    struct {
+        map_listener changed;
+        void *context;
+    } listeners[MAP_MAX_LISTENERS]; //see map_addListener()
+    int nlisteners;
     //struct palette *paint_palette;
-    char **floor;
-    //char **wall;
     //int spawnc;
     //struct spawnable_item *items;
 };
 
-#endif /*MAP_H*/
\ No newline at end of file
+/* Cell returned for empty chunks and coordinates outside the map. */
+extern const struct map_cell map_emptyCell;
+
+/*
+ * Function declarations.
+ */
+extern int                map_addListener    (struct map *m, map_listener changed, void *context);
+extern struct map *       map_create         (const char *tag, unsigned int height, unsigned int width);
+extern struct map *       map_createNewMap   (const char *tag, unsigned int height, unsigned int width, const char **floor);
+extern void               map_freeMap        (struct map *m);
+extern void               map_removeListener (struct map *m, map_listener changed, void *context);
+extern int                map_setCell        (struct map *m, unsigned int x, unsigned int y, uint16_t floor, uint16_t wall);
+extern int                map_setChunk       (struct map *m, unsigned int cx, unsigned int cy, const struct map_cell *cells);
+extern struct map_chunk * map_touchChunk     (struct map *m, unsigned int cx, unsigned int cy);
+
+/**
+ * @brief Retrieve chunk (cx, cy) of a map.
+ *
+ * @return The chunk, or NULL if it is empty or outside the map.
+ */
+static inline struct map_chunk *map_getChunk(const struct map *m, unsigned int cx, unsigned int cy) {
+    if(cx >= m->chunks_w || cy >= m->chunks_h) { return NULL; }
+    return m->chunks[(size_t)cy * m->chunks_w + cx];
+}
+
+/**
+ * @brief Retrieve cell (x, y) of a map. Never NULL: empty cells and
+ *        coordinates outside the map give &map_emptyCell.
+ */
+static inline const struct map_cell *map_getCell(const struct map *m, unsigned int x, unsigned int y) {
+    struct map_chunk *chunk;
+
+    if(x >= m->width || y >= m->height ||
+       !(chunk = m->chunks[(size_t)(y >> MAP_CHUNK_SHIFT) * m->chunks_w + (x >> MAP_CHUNK_SHIFT)])) {
+        return &map_emptyCell;
+    }
+
+    return &chunk->cells[((y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | (x & MAP_CHUNK_MASK)];
+}
+
+/**
+ * @brief Retrieve one layer of a cell.
+ */
+static inline uint16_t map_getLayer(const struct map_cell *cell, enum map_layer layer) {
+    return layer == MAP_WALL ? cell->wall : cell->floor;
+}
+
+#endif /*MAP_H*/
@@ -0,0 +1,582 @@
+/**
+ * @file mapfile.c
+ *
+ * @brief Streamed maps. A map file (see mapfile.h) is mapped into memory and
+ *        opened in constant time: only its header is read. Chunks are copied
+ *        out of the mapping when something needs them (mapfile_focus() around
+ *        the viewport or actors, or a write through map_touchChunk()), and
+ *        mapfile_trim() evicts the least recently focused ones once more than
+ *        the memory budget is resident. Modified chunks are copied back into
+ *        the mapping when they are evicted and flushed with msync(MS_ASYNC),
+ *        which leaves the disk write to the kernel, in the background.
+ *
+ * Field Overview:
+ *  static:
+ *      mapfile_compare
+ *      mapfile_grow
+ *      mapfile_header
+ *      mapfile_index
+ *      mapfile_validate
+ *      mapfile_write
+ *  extern:
+ *      mapfile_close
+ *      mapfile_focus
+ *      mapfile_getStats
+ *      mapfile_load
+ *      mapfile_open
+ *      mapfile_save
+ *      mapfile_sync
+ *      mapfile_trim
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "map.h"
+#include "mapfile.h"
+
+#define MAPFILE_GROW_SLOTS 64   //slots added to the file at a time
+
+/**
+ * @struct mapfile_resident
+ *         A chunk in memory: its index in the map and a copy of its stamp.
+ */
+struct mapfile_resident {
+    uint32_t stamp;
+    size_t index;
+};
+
+/**
+ * @struct mapfile
+ *         Streaming state of a map.
+ * @var fd
+ *      Descriptor of the file, kept open to grow it.
+ * @var base
+ *      Mapping of the whole file.
+ * @var size
+ *      Size of the mapping and of the file.
+ * @var tick
+ *      Current frame; chunks focused on during it are not evicted.
+ * @var resident
+ *      Chunks in memory.
+ * @var capacity
+ *      Length of 'resident'.
+ * @var stats
+ *      Counters; stats.resident is the length of 'resident' in use.
+ */
+struct mapfile {
+    int fd;
+    unsigned char *base;
+    size_t size;
+    uint32_t tick;
+    struct mapfile_resident *resident;
+    size_t capacity;
+    struct mapfile_stats stats;
+};
+
+
+
+/**
+ * @brief Order residents by stamp, oldest first.
+ */
+static int mapfile_compare(const void *a, const void *b) {
+    uint32_t x = ((const struct mapfile_resident *)a)->stamp;
+    uint32_t y = ((const struct mapfile_resident *)b)->stamp;
+
+    return (x > y) - (x < y);
+}
+
+
+
+/**
+ * @brief Retrieve the header of a streamed map's file.
+ */
+static inline struct mapfile_header *mapfile_header(const struct mapfile *file) {
+    return (struct mapfile_header *)file->base;
+}
+
+
+
+/**
+ * @brief Retrieve the chunk index of a streamed map's file.
+ */
+static inline uint32_t *mapfile_index(const struct mapfile *file) {
+    return (uint32_t *)(file->base + mapfile_header(file)->index);
+}
+
+
+
+/**
+ * @brief Make room for MAPFILE_GROW_SLOTS more slots at the end of the file
+ *        and map it again. Pointers into the old mapping become invalid.
+ *
+ * @return MAPFILE_SUCCESS or MAPFILE_FAILURE (the old mapping is kept).
+ */
+static int mapfile_grow(struct mapfile *file) {
+    size_t size = file->size + MAPFILE_GROW_SLOTS * MAPFILE_SLOT;
+    void *base;
+
+    if( ftruncate(file->fd, (off_t)size) ||
+        (base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0)) == MAP_FAILED ) {
+        dbgprint("mapfile_grow: Unable to grow map file to %lu bytes: %s\n",
+                 (unsigned long)size, strerror(errno));
+        return MAPFILE_FAILURE;
+    }
+
+    munmap(file->base, file->size);
+    file->base = base;
+    file->size = size;
+
+    return MAPFILE_SUCCESS;
+}
+
+
+
+/**
+ * @brief Check the header of a mapped file. The index is checked entry by
+ *        entry when chunks are loaded, so that opening stays constant time.
+ *
+ * @return MAPFILE_SUCCESS or MAPFILE_FAILURE.
+ */
+static int mapfile_validate(const struct mapfile *file) {
+    const struct mapfile_header *header = mapfile_header(file);
+    uint64_t chunks;
+
+    if( file->size < sizeof(struct mapfile_header) ||
+        memcmp(header->magic, MAPFILE_MAGIC, MAPFILE_MAGIC_LENGTH) ||
+        header->version != MAPFILE_VERSION ) {
+        return MAPFILE_FAILURE;
+    }
+
+    chunks = (uint64_t)((header->width + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT) *
+             ((header->height + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT);
+
+    if( header->index < sizeof(struct mapfile_header) ||
+        header->index % sizeof(uint32_t) ||
+        header->data % MAPFILE_ALIGN ||
+        header->data < header->index + chunks * sizeof(uint32_t) ||
+        header->data + (uint64_t)header->slots * MAPFILE_SLOT > file->size ) {
+        return MAPFILE_FAILURE;
+    }
+
+    return MAPFILE_SUCCESS;
+}
+
+
+
+/**
+ * @brief Copy chunk 'i' of a streamed map back into the file if it was
+ *        modified, giving it a slot if it had none, and start writing it out.
+ *
+ * @return MAPFILE_SUCCESS or MAPFILE_FAILURE.
+ */
+static int mapfile_write(struct map *m, size_t i) {
+    struct mapfile *file = m->stream;
+    struct map_chunk *chunk = m->chunks[i];
+    struct mapfile_header *header;
+    unsigned char *slot;
+    uintptr_t page, start;
+
+    if( !(chunk->flags & MAP_CHUNK_DIRTY) ) {
+        return MAPFILE_SUCCESS;
+    }
+
+    if(!mapfile_index(file)[i]) {
+        if(!chunk->used) {
+            chunk->flags &= ~MAP_CHUNK_DIRTY;   //still empty on disk
+            return MAPFILE_SUCCESS;
+        }
+
+        header = mapfile_header(file);
+        if( header->data + (uint64_t)(header->slots + 1) * MAPFILE_SLOT > file->size &&
+            !mapfile_grow(file) ) {
+            return MAPFILE_FAILURE;
+        }
+
+        header = mapfile_header(file);  //the file may have been mapped again
+        mapfile_index(file)[i] = ++header->slots;
+    }
+
+    header = mapfile_header(file);
+    slot = file->base + header->data + (uint64_t)(mapfile_index(file)[i] - 1) * MAPFILE_SLOT;
+    memcpy(slot, chunk->cells, MAPFILE_SLOT);
+
+    //msync() wants page aligned addresses, and pages may be larger than slots
+    page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    start = (uintptr_t)slot & ~(page - 1);
+    msync((void *)start, (uintptr_t)slot + MAPFILE_SLOT - start, MS_ASYNC);
+
+    chunk->flags &= ~MAP_CHUNK_DIRTY;
+    file->stats.writes++;
+
+    return MAPFILE_SUCCESS;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Stop streaming a map: write its modified chunks back and unmap the
+ *        file. Called by map_freeMap(); the map keeps its resident chunks.
+ */
+void mapfile_close(struct map *m) {
+    struct mapfile *file;
+
+    if(!m || !(file = m->stream)) { return; }
+
+    mapfile_sync(m);
+
+    munmap(file->base, file->size);
+    close(file->fd);
+    free(file->resident);
+    free(file);
+    m->stream = NULL;
+
+    return;
+}
+
+
+
+/**
+ * @brief Load every chunk that intersects a rectangle of cells and protect
+ *        them from eviction until the next mapfile_trim(). Call it for the
+ *        viewport and around every active actor, once per frame.
+ *
+ * @param x, y
+ *        Top left cell of the rectangle; may be outside the map.
+ * @param width, height
+ *        Size of the rectangle, in cells.
+ *
+ * @return The number of chunks loaded.
+ */
+size_t mapfile_focus(struct map *m, int x, int y, unsigned int width, unsigned int height) {
+    long cx0, cy0, cx1, cy1, cx, cy;
+    struct map_chunk *chunk;
+    size_t loaded = 0;
+
+    if(!m || !m->stream || !width || !height) { return 0; }
+
+    //clamp to the map, in chunks
+    cx0 = x < 0 ? 0 : (long)x >> MAP_CHUNK_SHIFT;
+    cy0 = y < 0 ? 0 : (long)y >> MAP_CHUNK_SHIFT;
+    cx1 = ((long)x + (long)width - 1) >> MAP_CHUNK_SHIFT;
+    cy1 = ((long)y + (long)height - 1) >> MAP_CHUNK_SHIFT;
+    if(cx1 >= (long)m->chunks_w) { cx1 = (long)m->chunks_w - 1; }
+    if(cy1 >= (long)m->chunks_h) { cy1 = (long)m->chunks_h - 1; }
+
+    for(cy = cy0; cy <= cy1; cy++) {
+        for(cx = cx0; cx <= cx1; cx++) {
+            if( !(chunk = m->chunks[(size_t)cy * m->chunks_w + (size_t)cx]) ) {
+                if( !(chunk = mapfile_load(m, (unsigned int)cx, (unsigned int)cy)) ) {
+                    continue;
+                }
+                loaded++;
+            }
+            chunk->stamp = m->stream->tick;
+        }
+    }
+
+    return loaded;
+}
+
+
+
+/**
+ * @brief Retrieve the counters of a streamed map.
+ */
+void mapfile_getStats(const struct map *m, struct mapfile_stats *stats) {
+    if(!stats) { return; }
+
+    if(m && m->stream) {
+        *stats = m->stream->stats;
+    }
+    else {
+        memset(stats, 0, sizeof(struct mapfile_stats));
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Bring chunk (cx, cy) of a streamed map into memory. Chunks that are
+ *        empty in the file are allocated empty.
+ *
+ * @return The chunk, or NULL on failure.
+ */
+struct map_chunk *mapfile_load(struct map *m, unsigned int cx, unsigned int cy) {
+    struct mapfile *file;
+    struct mapfile_header *header;
+    struct mapfile_resident *resident;
+    struct map_chunk *chunk;
+    size_t i, capacity;
+    uint32_t slot;
+
+    if(!m || !(file = m->stream) || cx >= m->chunks_w || cy >= m->chunks_h) { return NULL; }
+
+    i = (size_t)cy * m->chunks_w + cx;
+    if(m->chunks[i]) {
+        return m->chunks[i];
+    }
+
+    if(file->stats.resident == file->capacity) {
+        capacity = file->capacity ? file->capacity * 2 : file->stats.budget + 1;
+        if( !(resident = realloc(file->resident, capacity * sizeof(struct mapfile_resident))) ) {
+            dbgprint("mapfile_load: %s\n", ERROR_REALLOC);
+            return NULL;
+        }
+        file->resident = resident;
+        file->capacity = capacity;
+    }
+
+    if( !(chunk = calloc(1, sizeof(struct map_chunk))) ) {
+        dbgprint("mapfile_load: Unable to load chunk (%u, %u) of map %s: %s\n",
+                 cx, cy, m->tag, ERROR_CALLOC);
+        return NULL;
+    }
+
+    header = mapfile_header(file);
+    if( (slot = mapfile_index(file)[i]) ) {
+        if(slot > header->slots) {
+            dbgprint("mapfile_load: Chunk (%u, %u) of map %s has a bad slot; loading it empty.\n",
+                     cx, cy, m->tag);
+        }
+        else {
+            memcpy(chunk->cells, file->base + header->data + (uint64_t)(slot - 1) * MAPFILE_SLOT, MAPFILE_SLOT);
+            for(slot = 0; slot < MAP_CHUNK_CELLS; slot++) {
+                chunk->used += chunk->cells[slot].floor != MAP_NONE || chunk->cells[slot].wall != MAP_NONE;
+            }
+            file->stats.loads++;
+        }
+    }
+    chunk->stamp = file->tick;
+
+    m->chunks[i] = chunk;
+    m->allocated++;
+    file->resident[file->stats.resident].index = i;
+    file->stats.resident++;
+
+    return chunk;
+}
+
+
+
+/**
+ * @brief Open a map file for streaming. Only the header is read; chunks are
+ *        loaded by mapfile_focus() and map_touchChunk().
+ *
+ * @param filename
+ *        The map file, opened for reading and writing.
+ * @param budget
+ *        Memory, in bytes, that mapfile_trim() keeps resident chunks under
+ *        (at least one chunk is kept).
+ *
+ * @return The map, tagged with 'filename', or NULL on failure.
+ */
+struct map *mapfile_open(const char *filename, size_t budget) {
+    struct mapfile *file;
+    struct stat info;
+    struct map *m;
+    void *base;
+    int fd;
+
+    if(!filename) {
+        dbgprint("mapfile_open: formal param 'filename': %s\n", ERROR_NULL_STRING);
+        return NULL;
+    }
+
+    if( (fd = open(filename, O_RDWR)) < 0 ) {
+        dbgprint("mapfile_open: %s: %s\n", filename, errno == ENOENT ? ERROR_NO_FILE : strerror(errno));
+        return NULL;
+    }
+
+    if( fstat(fd, &info) || (size_t)info.st_size < sizeof(struct mapfile_header) ||
+        (base = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED ) {
+        dbgprint("mapfile_open: %s is not a map file.\n", filename);
+
+        close(fd);
+        return NULL;
+    }
+
+    if( !(file = calloc(1, sizeof(struct mapfile))) ) {
+        dbgprint("mapfile_open: %s\n", ERROR_CALLOC);
+
+        munmap(base, (size_t)info.st_size);
+        close(fd);
+        return NULL;
+    }
+    file->fd = fd;
+    file->base = base;
+    file->size = (size_t)info.st_size;
+    file->stats.budget = budget / sizeof(struct map_chunk) ? budget / sizeof(struct map_chunk) : 1;
+
+    if( !mapfile_validate(file) ||
+        !(m = map_create(filename, mapfile_header(file)->height, mapfile_header(file)->width)) ) {
+        dbgprint("mapfile_open: %s is not a map file.\n", filename);
+
+        munmap(file->base, file->size);
+        close(fd);
+        free(file);
+        return NULL;
+    }
+    m->stream = file;
+
+    return m;
+}
+
+
+
+/**
+ * @brief Write an in-memory map to a new map file. Streamed maps are written
+ *        back with mapfile_sync() instead.
+ *
+ * @return MAPFILE_SUCCESS or MAPFILE_FAILURE.
+ */
+int mapfile_save(const struct map *m, const char *filename) {
+    static const unsigned char padding[MAPFILE_ALIGN];
+    struct mapfile_header header;
+    size_t i, chunks;
+    uint32_t *index;
+    FILE *stream;
+    int status = MAPFILE_SUCCESS;
+
+    if(!m || !filename || m->stream) {
+        dbgprint("mapfile_save: Unable to save map %s.\n", m ? m->tag : "(null)");
+        return MAPFILE_FAILURE;
+    }
+
+    chunks = (size_t)m->chunks_w * m->chunks_h;
+    if( !(index = calloc(chunks + 1, sizeof(uint32_t))) ) {
+        dbgprint("mapfile_save: %s\n", ERROR_CALLOC);
+        return MAPFILE_FAILURE;
+    }
+
+    memset(&header, 0, sizeof(struct mapfile_header));
+    memcpy(header.magic, MAPFILE_MAGIC, MAPFILE_MAGIC_LENGTH);
+    header.version = MAPFILE_VERSION;
+    header.width = m->width;
+    header.height = m->height;
+    header.index = sizeof(struct mapfile_header);
+    header.data = (header.index + chunks * sizeof(uint32_t) + MAPFILE_ALIGN - 1) & ~(uint64_t)(MAPFILE_ALIGN - 1);
+
+    for(i = 0; i < chunks; i++) {
+        if(m->chunks[i] && m->chunks[i]->used) {
+            index[i] = ++header.slots;
+        }
+    }
+
+    if( !(stream = fopen(filename, "wb")) ) {
+        dbgprint("mapfile_save: %s: %s\n", filename, strerror(errno));
+        free(index);
+        return MAPFILE_FAILURE;
+    }
+
+    if( fwrite(&header, sizeof(struct mapfile_header), 1, stream) != 1 ||
+        fwrite(index, sizeof(uint32_t), chunks, stream) != chunks ||
+        fwrite(padding, 1, header.data - header.index - chunks * sizeof(uint32_t), stream) !=
+            header.data - header.index - chunks * sizeof(uint32_t) ) {
+        status = MAPFILE_FAILURE;
+    }
+    for(i = 0; status && i < chunks; i++) {
+        if( index[i] && fwrite(m->chunks[i]->cells, MAPFILE_SLOT, 1, stream) != 1 ) {
+            status = MAPFILE_FAILURE;
+        }
+    }
+
+    if( fclose(stream) || !status ) {
+        dbgprint("mapfile_save: Unable to write %s: %s\n", filename, strerror(errno));
+        status = MAPFILE_FAILURE;
+    }
+
+    free(index);
+    return status;
+}
+
+
+
+/**
+ * @brief Write every modified chunk of a streamed map back and wait until the
+ *        file is on disk.
+ *
+ * @return MAPFILE_SUCCESS or MAPFILE_FAILURE.
+ */
+int mapfile_sync(struct map *m) {
+    struct mapfile *file;
+    int status = MAPFILE_SUCCESS;
+    size_t i;
+
+    if(!m || !(file = m->stream)) { return MAPFILE_FAILURE; }
+
+    for(i = 0; i < file->stats.resident; i++) {
+        if( !mapfile_write(m, file->resident[i].index) ) {
+            status = MAPFILE_FAILURE;
+        }
+    }
+
+    if( msync(file->base, file->size, MS_SYNC) ) {
+        dbgprint("mapfile_sync: %s: %s\n", m->tag, strerror(errno));
+        status = MAPFILE_FAILURE;
+    }
+
+    return status;
+}
+
+
+
+/**
+ * @brief End a frame of a streamed map: evict the least recently focused
+ *        chunks until the budget is met, writing modified ones back. Chunks
+ *        focused on during this frame are never evicted, so the budget may be
+ *        exceeded if the focus is larger than it.
+ *
+ * @return The number of chunks evicted.
+ */
+size_t mapfile_trim(struct map *m) {
+    struct mapfile *file;
+    struct map_chunk *chunk;
+    size_t i, kept, evicted = 0;
+
+    if(!m || !(file = m->stream)) { return 0; }
+
+    if(file->stats.resident > file->stats.budget) {
+        for(i = 0; i < file->stats.resident; i++) {
+            file->resident[i].stamp = m->chunks[file->resident[i].index]->stamp;
+        }
+        qsort(file->resident, file->stats.resident, sizeof(struct mapfile_resident), mapfile_compare);
+
+        for(i = 0, kept = 0; i < file->stats.resident; i++) {
+            chunk = m->chunks[file->resident[i].index];
+
+            if( file->stats.resident - evicted > file->stats.budget &&
+                chunk->stamp != file->tick &&
+                mapfile_write(m, file->resident[i].index) ) {
+                free(chunk);
+                m->chunks[file->resident[i].index] = NULL;
+                m->allocated--;
+                evicted++;
+            }
+            else {
+                file->resident[kept++] = file->resident[i];
+            }
+        }
+
+        file->stats.resident = kept;
+        file->stats.evictions += evicted;
+    }
+
+    file->tick++;
+    return evicted;
+}
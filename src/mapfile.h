@@ -0,0 +1,97 @@
+/*
+ * mapfile.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+#define MAPFILE_SUCCESS 1
+#define MAPFILE_FAILURE 0
+
+/* File layout (native byte order):
+ *
+ *     struct mapfile_header
+ *     uint32_t index[chunks_w * chunks_h], row-major: slot + 1, or 0 if the
+ *                                         chunk is empty
+ *     chunk slots, from offset 'data' (a multiple of MAPFILE_ALIGN), each
+ *     MAPFILE_SLOT bytes: the chunk's cells, row-major
+ *
+ * Chunks that become non-empty while a map is streamed get new slots at the
+ * end of the file. */
+#define MAPFILE_MAGIC           "AINURMAP"
+#define MAPFILE_MAGIC_LENGTH    8
+#define MAPFILE_VERSION         1
+#define MAPFILE_ALIGN           4096
+#define MAPFILE_SLOT            (MAP_CHUNK_CELLS * sizeof(struct map_cell))
+
+/**
+ * @struct mapfile_header
+ *         First bytes of a map file.
+ * @var magic
+ *      MAPFILE_MAGIC, without a terminating NUL.
+ * @var version
+ *      MAPFILE_VERSION of the code that wrote the file.
+ * @var width
+ *      Width of the map, in cells.
+ * @var height
+ *      Height of the map, in cells.
+ * @var slots
+ *      Number of chunk slots in use.
+ * @var index
+ *      File offset of the chunk index.
+ * @var data
+ *      File offset of slot 0.
+ */
+struct mapfile_header {
+    char magic[MAPFILE_MAGIC_LENGTH];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t slots;
+    uint64_t index;
+    uint64_t data;
+};
+
+/**
+ * @struct mapfile_stats
+ *         Counters of a streamed map, see mapfile_getStats().
+ * @var resident
+ *      Chunks in memory.
+ * @var budget
+ *      Chunks allowed in memory after mapfile_trim().
+ * @var loads
+ *      Chunks read from the file.
+ * @var evictions
+ *      Chunks dropped by mapfile_trim().
+ * @var writes
+ *      Chunks written back to the file.
+ */
+struct mapfile_stats {
+    size_t resident;
+    size_t budget;
+    unsigned long loads;
+    unsigned long evictions;
+    unsigned long writes;
+};
+
+/*
+ * Function declarations.
+ */
+extern void                mapfile_close    (struct map *m);
+extern size_t              mapfile_focus    (struct map *m, int x, int y, unsigned int width, unsigned int height);
+extern void                mapfile_getStats (const struct map *m, struct mapfile_stats *stats);
+extern struct map_chunk *  mapfile_load     (struct map *m, unsigned int cx, unsigned int cy);
+extern struct map *        mapfile_open     (const char *filename, size_t budget);
+extern int                 mapfile_save     (const struct map *m, const char *filename);
+extern int                 mapfile_sync     (struct map *m);
+extern size_t              mapfile_trim     (struct map *m);
+
+#endif /*MAPFILE_H*/
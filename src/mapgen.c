@@ -0,0 +1,408 @@
+/**
+ * @file mapgen.c
+ *
+ * @brief Procedural map generation, one chunk at a time on the worker pool.
+ *        Each chunk is either rooms, laid out by binary space partitioning and
+ *        joined by corridors, or a cave grown by a cellular automaton. Chunks
+ *        are walled in, but for a door in the middle of every border they
+ *        share with a neighbor, from which a corridor leads inside; since
+ *        every door is joined to every other of its chunk, the whole map is
+ *        connected.
+ *
+ *        Chunk i draws from its own random stream, the seed's stream jumped i
+ *        times (see rnd_128_jumpState()), and door positions are hashed from
+ *        the seed and their border, so that both chunks of a border agree on
+ *        them without talking. The map thus only depends on the seed and its
+ *        size, whichever threads generated which chunks.
+ *
+ * Field Overview:
+ *  static:
+ *      mapgen_below
+ *      mapgen_bsp
+ *      mapgen_carve
+ *      mapgen_cave
+ *      mapgen_chunkJob
+ *      mapgen_door
+ *      mapgen_extent
+ *      mapgen_hash
+ *  extern:
+ *      mapgen_generate
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "map.h"
+#include "mapgen.h"
+#include "path.h"
+#include "rnd.h"
+#include "workers.h"
+
+#define MAPGEN_WAVE     256 //chunks generated in parallel before being written to the map
+#define MAPGEN_LEAF     8   //smallest side of a room partition
+#define MAPGEN_FILL     45  //percentage of rock a cave starts with
+#define MAPGEN_STEPS    4   //cellular automaton steps growing a cave
+
+/**
+ * @brief Borders of a chunk.
+ */
+enum mapgen_side {
+    MAPGEN_NORTH,
+    MAPGEN_EAST,
+    MAPGEN_SOUTH,
+    MAPGEN_WEST
+};
+
+/**
+ * @struct mapgen_chunk
+ *         A chunk being generated.
+ */
+struct mapgen_chunk {
+    uint8_t rock[MAP_CHUNK_CELLS];  //row-major, 1 for rock
+    int w;                          //cells of the chunk on the map
+    int h;
+    struct rnd_128 *rnd;
+};
+
+/**
+ * @struct mapgen_job
+ *         A wave of chunks generated in parallel.
+ */
+struct mapgen_job {
+    struct map *map;
+    const struct mapgen_params *params;
+    size_t first;                   //index of the first chunk of the wave
+    struct rnd_128 *streams;        //random stream of each chunk of the wave
+    struct map_cell (*cells)[MAP_CHUNK_CELLS];
+};
+
+
+
+/**
+ * @brief Mix the bits of a value (the splitmix64 finalizer).
+ */
+static inline uint64_t mapgen_hash(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+
+    return x ^ (x >> 31);
+}
+
+
+
+/**
+ * @brief A random integer in [0, n).
+ */
+static inline int mapgen_below(struct rnd_128 *rnd, int n) {
+    return (int)(((rnd_128_nextState(rnd) >> 32) * (uint64_t)n) >> 32);
+}
+
+
+
+/**
+ * @brief Size of the part of chunk (cx, cy) that is on the map.
+ */
+static void mapgen_extent(const struct map *m, unsigned int cx, unsigned int cy, int *w, int *h) {
+    const unsigned int x = cx << MAP_CHUNK_SHIFT, y = cy << MAP_CHUNK_SHIFT;
+
+    *w = (int)(m->width - x < MAP_CHUNK_SIZE ? m->width - x : MAP_CHUNK_SIZE);
+    *h = (int)(m->height - y < MAP_CHUNK_SIZE ? m->height - y : MAP_CHUNK_SIZE);
+
+    return;
+}
+
+
+
+/**
+ * @brief Position of the door on one border of chunk (cx, cy), along the
+ *        border; the chunk across computes the same one.
+ *
+ * @return The position, or -1 if the border has no door.
+ */
+static int mapgen_door(const struct map *m, uint64_t seed, unsigned int cx, unsigned int cy, enum mapgen_side side) {
+    int w0, h0, w1, h1, length;
+    uint64_t border;
+
+    //name the border after the chunk west or north of it
+    switch(side) {
+    case MAPGEN_NORTH: if(!cy) { return -1; } cy--; break;
+    case MAPGEN_WEST:  if(!cx) { return -1; } cx--; break;
+    default: break;
+    }
+    if( (side == MAPGEN_EAST || side == MAPGEN_WEST) ? cx + 1 >= m->chunks_w : cy + 1 >= m->chunks_h ) {
+        return -1;
+    }
+
+    mapgen_extent(m, cx, cy, &w0, &h0);
+    if(side == MAPGEN_EAST || side == MAPGEN_WEST) {
+        mapgen_extent(m, cx + 1, cy, &w1, &h1);
+        length = h0;
+    }
+    else {
+        mapgen_extent(m, cx, cy + 1, &w1, &h1);
+        length = w0;
+    }
+    if(w0 < MAPGEN_MIN_SIDE || h0 < MAPGEN_MIN_SIDE || w1 < MAPGEN_MIN_SIDE || h1 < MAPGEN_MIN_SIDE) {
+        return -1;
+    }
+
+    border = ((uint64_t)cy * m->chunks_w + cx) * 2 + (side == MAPGEN_NORTH || side == MAPGEN_SOUTH);
+
+    //off the corners, so that the corridor behind runs inside the chunk walls
+    return 2 + (int)(mapgen_hash(seed ^ mapgen_hash(border)) % (uint64_t)(length - 4));
+}
+
+
+
+/**
+ * @brief Carve an L-shaped corridor between two cells of a chunk, turning at
+ *        a random end.
+ */
+static void mapgen_carve(struct mapgen_chunk *chunk, struct path_point a, struct path_point b) {
+    const int horizontal_first = mapgen_below(chunk->rnd, 2);
+    int leg;
+
+    chunk->rock[(a.y << MAP_CHUNK_SHIFT) | a.x] = 0;
+    for(leg = 0; leg < 2; leg++) {
+        if(leg == horizontal_first) {
+            while(a.y != b.y) {
+                a.y += b.y > a.y ? 1 : -1;
+                chunk->rock[(a.y << MAP_CHUNK_SHIFT) | a.x] = 0;
+            }
+        }
+        else {
+            while(a.x != b.x) {
+                a.x += b.x > a.x ? 1 : -1;
+                chunk->rock[(a.y << MAP_CHUNK_SHIFT) | a.x] = 0;
+            }
+        }
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Lay out rooms in the rectangle of 'w' by 'h' cells from (x, y),
+ *        cutting it in two until the parts are too small to cut, with a room
+ *        in each part and a corridor between the two parts of every cut.
+ *
+ * @return The center of one of the rooms.
+ */
+static struct path_point mapgen_bsp(struct mapgen_chunk *chunk, int x, int y, int w, int h) {
+    struct path_point a, b;
+    int cut, split, rw, rh, rx, ry, i;
+
+    split = w >= 2 * MAPGEN_LEAF;    //1: cut across x, 2: across y
+    if( h >= 2 * MAPGEN_LEAF && (!split || h > w || (h == w && mapgen_below(chunk->rnd, 2))) ) {
+        split = 2;
+    }
+
+    //parts that could still be cut are sometimes kept whole, for larger rooms
+    if( !split || (w < 3 * MAPGEN_LEAF && h < 3 * MAPGEN_LEAF && !mapgen_below(chunk->rnd, 4)) ) {
+        rw = 3 + mapgen_below(chunk->rnd, w - 4);
+        rh = 3 + mapgen_below(chunk->rnd, h - 4);
+        rx = x + 1 + mapgen_below(chunk->rnd, w - 1 - rw);
+        ry = y + 1 + mapgen_below(chunk->rnd, h - 1 - rh);
+        for(i = 0; i < rw * rh; i++) {
+            chunk->rock[((ry + i / rw) << MAP_CHUNK_SHIFT) | (rx + i % rw)] = 0;
+        }
+        a.x = rx + rw / 2;
+        a.y = ry + rh / 2;
+        return a;
+    }
+
+    if(split == 1) {
+        cut = MAPGEN_LEAF + mapgen_below(chunk->rnd, w - 2 * MAPGEN_LEAF + 1);
+        a = mapgen_bsp(chunk, x, y, cut, h);
+        b = mapgen_bsp(chunk, x + cut, y, w - cut, h);
+    }
+    else {
+        cut = MAPGEN_LEAF + mapgen_below(chunk->rnd, h - 2 * MAPGEN_LEAF + 1);
+        a = mapgen_bsp(chunk, x, y, w, cut);
+        b = mapgen_bsp(chunk, x, y + cut, w, h - cut);
+    }
+    mapgen_carve(chunk, a, b);
+
+    return mapgen_below(chunk->rnd, 2) ? a : b;
+}
+
+
+
+/**
+ * @brief Grow a cave inside the chunk walls: random rock, smoothed by the
+ *        rule that a cell becomes rock when at least 5 of the 9 cells around
+ *        it (itself included) are.
+ */
+static void mapgen_cave(struct mapgen_chunk *chunk) {
+    uint8_t next[MAP_CHUNK_CELLS];
+    int x, y, i, j, step, walls;
+
+    for(y = 1; y < chunk->h - 1; y++) {
+        for(x = 1; x < chunk->w - 1; x++) {
+            chunk->rock[(y << MAP_CHUNK_SHIFT) | x] = mapgen_below(chunk->rnd, 100) < MAPGEN_FILL;
+        }
+    }
+
+    for(step = 0; step < MAPGEN_STEPS; step++) {
+        memcpy(next, chunk->rock, sizeof(next));
+        for(y = 1; y < chunk->h - 1; y++) {
+            for(x = 1; x < chunk->w - 1; x++) {
+                for(walls = 0, j = -1; j <= 1; j++) {
+                    for(i = -1; i <= 1; i++) {
+                        walls += chunk->rock[((y + j) << MAP_CHUNK_SHIFT) | (x + i)];
+                    }
+                }
+                next[(y << MAP_CHUNK_SHIFT) | x] = walls >= 5;
+            }
+        }
+        memcpy(chunk->rock, next, sizeof(next));
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Worker job: generate chunk job->first + index.
+ */
+static void mapgen_chunkJob(void *context, size_t index) {
+    struct mapgen_job *job = context;
+    const struct map *m = job->map;
+    const size_t c = job->first + index;
+    const unsigned int cx = (unsigned int)(c % m->chunks_w), cy = (unsigned int)(c / m->chunks_w);
+    struct map_cell *cells = job->cells[index];
+    uint16_t stack[MAP_CHUNK_CELLS];
+    struct mapgen_chunk chunk;
+    struct path_point center, door, inside;
+    int side, at, i, n, x, y, k, cave;
+
+    chunk.rnd = &job->streams[index];
+    mapgen_extent(m, cx, cy, &chunk.w, &chunk.h);
+    memset(chunk.rock, 1, sizeof(chunk.rock));
+
+    if(chunk.w >= MAPGEN_MIN_SIDE && chunk.h >= MAPGEN_MIN_SIDE) {
+        cave = mapgen_below(chunk.rnd, 100) < (int)job->params->caves;
+        if(cave) {
+            mapgen_cave(&chunk);
+            center.x = chunk.w / 2;
+            center.y = chunk.h / 2;
+            chunk.rock[(center.y << MAP_CHUNK_SHIFT) | center.x] = 0;
+        }
+        else {
+            center = mapgen_bsp(&chunk, 1, 1, chunk.w - 2, chunk.h - 2);
+        }
+
+        //doors, and corridors from them to the middle
+        for(side = MAPGEN_NORTH; side <= MAPGEN_WEST; side++) {
+            if( (at = mapgen_door(m, job->params->seed, cx, cy, (enum mapgen_side)side)) < 0 ) { continue; }
+
+            door.x = side == MAPGEN_EAST ? chunk.w - 1 : side == MAPGEN_WEST ? 0 : at;
+            door.y = side == MAPGEN_SOUTH ? chunk.h - 1 : side == MAPGEN_NORTH ? 0 : at;
+            inside.x = door.x + (side == MAPGEN_WEST) - (side == MAPGEN_EAST);
+            inside.y = door.y + (side == MAPGEN_NORTH) - (side == MAPGEN_SOUTH);
+            chunk.rock[(door.y << MAP_CHUNK_SHIFT) | door.x] = 0;
+            mapgen_carve(&chunk, inside, center);
+        }
+
+        //fill the cave pockets the middle cannot reach
+        if(cave) {
+            stack[0] = (uint16_t)((center.y << MAP_CHUNK_SHIFT) | center.x);
+            chunk.rock[stack[0]] = 2;
+            for(n = 1; n; ) {
+                i = stack[--n];
+                x = i & MAP_CHUNK_MASK;
+                y = i >> MAP_CHUNK_SHIFT;
+                for(k = 0; k < 4; k++) {
+                    const int nx = x + (k == 1) - (k == 3), ny = y + (k == 2) - (k == 0);
+                    if(nx < 0 || ny < 0 || nx >= chunk.w || ny >= chunk.h) { continue; }
+                    if( !chunk.rock[(ny << MAP_CHUNK_SHIFT) | nx] ) {
+                        chunk.rock[(ny << MAP_CHUNK_SHIFT) | nx] = 2;
+                        stack[n++] = (uint16_t)((ny << MAP_CHUNK_SHIFT) | nx);
+                    }
+                }
+            }
+            for(i = 0; i < (int)MAP_CHUNK_CELLS; i++) {
+                chunk.rock[i] = chunk.rock[i] != 2;
+            }
+        }
+    }
+
+    for(i = 0; i < (int)MAP_CHUNK_CELLS; i++) {
+        if( (i & (int)MAP_CHUNK_MASK) >= chunk.w || (i >> MAP_CHUNK_SHIFT) >= chunk.h ) {
+            cells[i].floor = cells[i].wall = MAP_NONE;
+            continue;
+        }
+        cells[i].floor = job->params->floor;
+        cells[i].wall = chunk.rock[i] ? job->params->wall : MAP_NONE;
+    }
+
+    return;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Generate a whole map, overwriting its cells. Its listeners are told
+ *        of every cell that changed.
+ *
+ * @return MAPGEN_SUCCESS or MAPGEN_FAILURE.
+ */
+int mapgen_generate(struct map *m, const struct mapgen_params *params) {
+    struct mapgen_job job;
+    struct rnd_128 stream;
+    size_t nchunks, count, i;
+    int status = MAPGEN_SUCCESS;
+
+    if(!m || !params) {
+        dbgprint("mapgen_generate: formal params 'm', 'params': %s\n", ERROR_NULL_POINTER);
+        return MAPGEN_FAILURE;
+    }
+    if(params->floor == MAP_NONE || params->wall == MAP_NONE) {
+        dbgprint("mapgen_generate: Floor and wall values of map %s must not be MAP_NONE.\n", m->tag);
+        return MAPGEN_FAILURE;
+    }
+
+    job.map = m;
+    job.params = params;
+    job.streams = malloc(MAPGEN_WAVE * sizeof(struct rnd_128));
+    job.cells = malloc(MAPGEN_WAVE * sizeof(*job.cells));
+    if(!job.streams || !job.cells) {
+        dbgprint("mapgen_generate: %s\n", ERROR_MALLOC);
+        free(job.streams);
+        free(job.cells);
+        return MAPGEN_FAILURE;
+    }
+
+    rnd_128_seed(&stream, params->seed);
+    nchunks = (size_t)m->chunks_w * m->chunks_h;
+
+    for(job.first = 0; job.first < nchunks && status; job.first += count) {
+        count = nchunks - job.first < MAPGEN_WAVE ? nchunks - job.first : MAPGEN_WAVE;
+        for(i = 0; i < count; i++) {
+            job.streams[i] = stream;
+            rnd_128_jumpState(&stream);
+        }
+
+        workers_run(mapgen_chunkJob, &job, count);
+
+        for(i = 0; i < count && status; i++) {
+            status = map_setChunk(m, (unsigned int)((job.first + i) % m->chunks_w),
+                                  (unsigned int)((job.first + i) / m->chunks_w), job.cells[i]);
+        }
+    }
+
+    free(job.streams);
+    free(job.cells);
+
+    return status ? MAPGEN_SUCCESS : MAPGEN_FAILURE;
+}
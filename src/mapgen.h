@@ -0,0 +1,42 @@
+/*
+ * mapgen.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef MAPGEN_H
+#define MAPGEN_H
+
+#include <stdint.h>
+
+#include "map.h"
+
+#define MAPGEN_SUCCESS 1
+#define MAPGEN_FAILURE 0
+
+#define MAPGEN_MIN_SIDE 8   //chunks the map edge cuts narrower than this are solid rock
+
+/**
+ * @struct mapgen_params
+ *         What mapgen_generate() makes.
+ * @var seed
+ *      The same seed and map size always give the same map.
+ * @var floor, wall
+ *      Palette values of the cells: every cell gets 'floor', rock also 'wall'.
+ * @var caves
+ *      Percentage of chunks carved as caves; the others get rooms.
+ */
+struct mapgen_params {
+    uint64_t seed;
+    uint16_t floor;
+    uint16_t wall;
+    unsigned int caves;
+};
+
+/*
+ * Function declarations.
+ */
+extern int mapgen_generate (struct map *m, const struct mapgen_params *params);
+
+#endif /*MAPGEN_H*/
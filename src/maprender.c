@@ -0,0 +1,514 @@
+/**
+ * @file maprender.c
+ *
+ * @brief Map rendering through per-chunk caches. Every visible chunk is
+ *        composited once, floor then wall, into a surface of its own, and
+ *        afterwards drawn with a single render queue command. Cells of a map
+ *        are resolved to image regions through flat per-layer tables filled
+ *        from tiles or a palette, instead of palette -> sprite -> tile ->
+ *        image. The renderer listens to its map and re-composites only the
+ *        chunks whose cells changed. Caches of chunks that go off screen are
+ *        kept, least recently drawn first out, within a memory budget.
+ *
+ * Field Overview:
+ *  static:
+ *      maprender_changed
+ *      maprender_compare
+ *      maprender_composite
+ *      maprender_drop
+ *      maprender_trim
+ *  extern:
+ *      maprender_create
+ *      maprender_draw
+ *      maprender_free
+ *      maprender_getStats
+ *      maprender_invalidate
+ *      maprender_setPalette
+ *      maprender_setTile
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "debug.h"
+#include "image.h"
+#include "map.h"
+#include "maprender.h"
+#include "palette.h"
+#include "rqueue.h"
+#include "sprite.h"
+#include "tile.h"
+
+#define MAPRENDER_PIXELFORMAT SDL_PIXELFORMAT_ARGB8888  //chunks need alpha where cells are empty
+
+/**
+ * @struct maprender_paint
+ *         What a cell value of a layer draws: a region of an image.
+ */
+struct maprender_paint {
+    struct image *image;
+    SDL_Rect rect;
+};
+
+/**
+ * @struct maprender_cache
+ *         Composited surface of one chunk.
+ */
+struct maprender_cache {
+    struct image *image;    //anonymous image that owns the surface
+    size_t index;           //index of the chunk in the map
+    uint32_t stamp;         //last frame the cache was drawn
+    int dirty;              //a cell changed since it was composited
+};
+
+/**
+ * @struct maprender
+ *         Renderer of one map.
+ * @var map
+ *      The map.
+ * @var tile_w, tile_h
+ *      Size of a cell, in pixels.
+ * @var paints, npaints
+ *      Per layer: what each cell value draws, indexed by value.
+ * @var caches
+ *      Per chunk of the map: its cache, or NULL.
+ * @var live, capacity
+ *      Every cache (stats.cached of them), for eviction.
+ * @var budget
+ *      Caches kept once they are off screen.
+ * @var frame
+ *      Number of maprender_draw() calls so far.
+ * @var stats
+ *      Counters.
+ */
+struct maprender {
+    struct map *map;
+    int tile_w;
+    int tile_h;
+    struct maprender_paint *paints[MAP_LAYERS];
+    size_t npaints[MAP_LAYERS];
+    struct maprender_cache **caches;
+    struct maprender_cache **live;
+    size_t capacity;
+    size_t budget;
+    uint32_t frame;
+    struct maprender_stats stats;
+};
+
+
+
+/**
+ * @brief Map listener: mark the cache of the chunk of (x, y) dirty.
+ */
+static void maprender_changed(struct map *m, unsigned int x, unsigned int y, void *context) {
+    struct maprender *r = context;
+    struct maprender_cache *cache;
+
+    if( (cache = r->caches[(size_t)(y >> MAP_CHUNK_SHIFT) * m->chunks_w + (x >> MAP_CHUNK_SHIFT)]) ) {
+        cache->dirty = 1;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Order caches by stamp, oldest first.
+ */
+static int maprender_compare(const void *a, const void *b) {
+    uint32_t x = (*(struct maprender_cache *const *)a)->stamp;
+    uint32_t y = (*(struct maprender_cache *const *)b)->stamp;
+
+    return (x > y) - (x < y);
+}
+
+
+
+/**
+ * @brief Composite the cells of a chunk into its cache, floor then wall.
+ *        Tiles of another size than the cells are scaled.
+ */
+static void maprender_composite(struct maprender *r, struct maprender_cache *cache,
+                                const struct map_chunk *chunk) {
+    SDL_Surface *surface = image_getSurface(cache->image), *source;
+    const struct maprender_paint *paint;
+    SDL_Rect dest;
+    uint16_t value;
+    unsigned int i;
+    int layer;
+
+    SDL_FillRect(surface, NULL, 0);     //transparent
+
+    for(i = 0; i < MAP_CHUNK_CELLS; i++) {
+        for(layer = 0; layer < MAP_LAYERS; layer++) {
+            value = map_getLayer(&chunk->cells[i], (enum map_layer)layer);
+            if(value == MAP_NONE || value >= r->npaints[layer]) { continue; }
+
+            paint = &r->paints[layer][value];
+            if( !paint->image || !(source = image_getSurface(paint->image)) ) { continue; }
+
+            dest.x = (int)(i & MAP_CHUNK_MASK) * r->tile_w;
+            dest.y = (int)(i >> MAP_CHUNK_SHIFT) * r->tile_h;
+            dest.w = r->tile_w;
+            dest.h = r->tile_h;
+            if(paint->rect.w == r->tile_w && paint->rect.h == r->tile_h) {
+                SDL_BlitSurface(source, &paint->rect, surface, &dest);
+            }
+            else {
+                SDL_BlitScaled(source, &paint->rect, surface, &dest);
+            }
+        }
+    }
+
+    image_dropTexture(cache->image);    //upload the new pixels on next use
+    cache->dirty = 0;
+    r->stats.rendered++;
+
+    return;
+}
+
+
+
+/**
+ * @brief Free the cache of chunk 'index', if it has one.
+ */
+static void maprender_drop(struct maprender *r, size_t index) {
+    struct maprender_cache *cache = r->caches[index];
+    size_t i;
+
+    if(!cache) { return; }
+
+    for(i = 0; i < r->stats.cached; i++) {
+        if(r->live[i] == cache) {
+            r->live[i] = r->live[--r->stats.cached];
+            break;
+        }
+    }
+
+    image_free(cache->image);
+    free(cache);
+    r->caches[index] = NULL;
+
+    return;
+}
+
+
+
+/**
+ * @brief Free the least recently drawn caches until the budget is met. Caches
+ *        drawn this frame are kept.
+ */
+static void maprender_trim(struct maprender *r) {
+    struct maprender_cache *cache;
+    size_t i, evicted;
+
+    if(r->stats.cached <= r->budget) { return; }
+
+    qsort(r->live, r->stats.cached, sizeof(struct maprender_cache *), maprender_compare);
+
+    for(evicted = 0; r->stats.cached - evicted > r->budget; evicted++) {
+        if( (cache = r->live[evicted])->stamp == r->frame ) {
+            break;
+        }
+
+        r->caches[cache->index] = NULL;
+        image_free(cache->image);
+        free(cache);
+    }
+
+    for(i = evicted; i < r->stats.cached; i++) {
+        r->live[i - evicted] = r->live[i];
+    }
+    r->stats.cached -= evicted;
+    r->stats.evictions += evicted;
+
+    return;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Create a renderer for a map. Cell values draw nothing until they are
+ *        given tiles with maprender_setTile() or maprender_setPalette().
+ *
+ * @param m
+ *        The map; it must outlive the renderer.
+ * @param tile_w, tile_h
+ *        Size of a cell, in pixels.
+ * @param budget
+ *        Memory, in bytes, of cached chunk surfaces kept while off screen.
+ *
+ * @return The renderer, or NULL on failure.
+ */
+struct maprender *maprender_create(struct map *m, int tile_w, int tile_h, size_t budget) {
+    struct maprender *r;
+    size_t bytes;
+
+    if(!m || tile_w <= 0 || tile_h <= 0) {
+        dbgprint("maprender_create: Invalid map or tile size.\n");
+        return NULL;
+    }
+
+    if( !(r = calloc(1, sizeof(struct maprender))) ||
+        !(r->caches = calloc((size_t)m->chunks_w * m->chunks_h + 1, sizeof(struct maprender_cache *))) ) {
+        dbgprint("maprender_create: %s\n", ERROR_CALLOC);
+
+        free(r);
+        return NULL;
+    }
+
+    r->map = m;
+    r->tile_w = tile_w;
+    r->tile_h = tile_h;
+    bytes = (size_t)tile_w * tile_h * MAP_CHUNK_CELLS * 4;
+    r->budget = budget / bytes ? budget / bytes : 1;
+
+    if( !map_addListener(m, maprender_changed, r) ) {
+        free(r->caches);
+        free(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+
+
+/**
+ * @brief Queue every non-empty chunk that intersects the camera, compositing
+ *        the ones that are new or dirty first.
+ *
+ * @param layer
+ *        Render queue layer of the map.
+ * @param camera
+ *        Region of the map, in pixels, that the window shows.
+ *
+ * @return The number of chunks queued.
+ */
+size_t maprender_draw(struct maprender *r, uint8_t layer, const SDL_Rect *camera) {
+    const int chunk_w = r ? r->tile_w * (int)MAP_CHUNK_SIZE : 0;
+    const int chunk_h = r ? r->tile_h * (int)MAP_CHUNK_SIZE : 0;
+    struct maprender_cache *cache, **live;
+    struct map_chunk *chunk;
+    struct map *m;
+    SDL_Rect src, dest;
+    long cx0, cy0, cx1, cy1, cx, cy;
+    size_t i;
+
+    if(!r || !camera) { return 0; }
+    m = r->map;
+
+    r->stats.visible = 0;
+    r->stats.drawn = 0;
+    r->stats.rendered = 0;
+
+    //chunks under the camera, clamped to the map
+    cx0 = camera->x < 0 ? 0 : camera->x / chunk_w;
+    cy0 = camera->y < 0 ? 0 : camera->y / chunk_h;
+    cx1 = camera->x + camera->w <= 0 ? -1 : (camera->x + camera->w - 1) / chunk_w;
+    cy1 = camera->y + camera->h <= 0 ? -1 : (camera->y + camera->h - 1) / chunk_h;
+    if(cx1 >= (long)m->chunks_w) { cx1 = (long)m->chunks_w - 1; }
+    if(cy1 >= (long)m->chunks_h) { cy1 = (long)m->chunks_h - 1; }
+
+    src.x = src.y = 0;
+    src.w = dest.w = chunk_w;
+    src.h = dest.h = chunk_h;
+
+    for(cy = cy0; cy <= cy1; cy++) {
+        for(cx = cx0; cx <= cx1; cx++) {
+            i = (size_t)cy * m->chunks_w + (size_t)cx;
+            chunk = m->chunks[i];
+            cache = r->caches[i];
+
+            if(!chunk) {
+                //empty, or, for streamed maps, not loaded: a clean cache is still right
+                if(!m->stream) {
+                    maprender_drop(r, i);
+                }
+                if(!cache || cache->dirty || !m->stream) { continue; }
+            }
+            else if(!chunk->used && !cache) {
+                continue;
+            }
+            r->stats.visible++;
+
+            if(!cache) {
+                if(r->stats.cached == r->capacity) {
+                    if( !(live = realloc(r->live, (r->capacity ? r->capacity * 2 : 16) * sizeof(*live))) ) {
+                        dbgprint("maprender_draw: %s\n", ERROR_REALLOC);
+                        continue;
+                    }
+                    r->live = live;
+                    r->capacity = r->capacity ? r->capacity * 2 : 16;
+                }
+
+                //anonymous: the caches are ours alone, not for scripts or image_dumpAll()
+                if( !(cache = calloc(1, sizeof(struct maprender_cache))) ||
+                    !(cache->image = image_create_anonymous(
+                          SDL_CreateRGBSurfaceWithFormat(0, chunk_w, chunk_h, 32, MAPRENDER_PIXELFORMAT))) ) {
+                    dbgprint("maprender_draw: Unable to cache chunk (%ld, %ld) of map %s: %s\n",
+                             cx, cy, m->tag, SDL_GetError());
+                    free(cache);
+                    continue;
+                }
+                SDL_SetSurfaceBlendMode(image_getSurface(cache->image), SDL_BLENDMODE_BLEND);
+                cache->index = i;
+                cache->dirty = 1;
+                r->caches[i] = cache;
+                r->live[r->stats.cached++] = cache;
+            }
+
+            if(cache->dirty) {
+                maprender_composite(r, cache, chunk);
+            }
+            cache->stamp = r->frame;
+
+            dest.x = (int)cx * chunk_w - camera->x;
+            dest.y = (int)cy * chunk_h - camera->y;
+            if( rqueue_pushImage(layer, cache->image, &src, &dest, 0) ) {
+                r->stats.drawn++;
+            }
+        }
+    }
+
+    maprender_trim(r);
+    r->frame++;
+
+    return r->stats.drawn;
+}
+
+
+
+/**
+ * @brief Free a renderer and its caches, and stop listening to its map.
+ */
+void maprender_free(struct maprender *r) {
+    int layer;
+
+    if(!r) { return; }
+
+    map_removeListener(r->map, maprender_changed, r);
+
+    while(r->stats.cached) {
+        maprender_drop(r, r->live[0]->index);
+    }
+    for(layer = 0; layer < MAP_LAYERS; layer++) {
+        free(r->paints[layer]);
+    }
+    free(r->live);
+    free(r->caches);
+    free(r);
+
+    return;
+}
+
+
+
+/**
+ * @brief Retrieve the counters of a renderer.
+ */
+void maprender_getStats(const struct maprender *r, struct maprender_stats *stats) {
+    if(!stats) { return; }
+
+    if(r) {
+        *stats = r->stats;
+    }
+    else {
+        memset(stats, 0, sizeof(struct maprender_stats));
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Composite every cached chunk again on its next draw, e.g. after the
+ *        pixels of a tile changed.
+ */
+void maprender_invalidate(struct maprender *r) {
+    size_t i;
+
+    for(i = 0; r && i < r->stats.cached; i++) {
+        r->live[i]->dirty = 1;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Draw cell value i + 1 of each layer with the first frame of sprite i
+ *        of the matching palette (floor or wall).
+ *
+ * @return MAPRENDER_SUCCESS or MAPRENDER_FAILURE.
+ */
+int maprender_setPalette(struct maprender *r, const struct palette *palette) {
+    int i, status = MAPRENDER_SUCCESS;
+
+    if(!r || !palette) { return MAPRENDER_FAILURE; }
+
+    for(i = 0; i < palette->floor_palette_size && i < FLOOR_PALETTE_SIZE; i++) {
+        if( palette->floor_palette[i] && palette->floor_palette[i]->frames &&
+            !maprender_setTile(r, MAP_FLOOR, (uint16_t)(i + 1), palette->floor_palette[i]->tiles[0]) ) {
+            status = MAPRENDER_FAILURE;
+        }
+    }
+    for(i = 0; i < palette->wall_palette_size && i < WALL_PALETTE_SIZE; i++) {
+        if( palette->wall_palette[i] && palette->wall_palette[i]->frames &&
+            !maprender_setTile(r, MAP_WALL, (uint16_t)(i + 1), palette->wall_palette[i]->tiles[0]) ) {
+            status = MAPRENDER_FAILURE;
+        }
+    }
+
+    return status;
+}
+
+
+
+/**
+ * @brief Choose what a cell value of a layer draws. Cached chunks are
+ *        composited again.
+ *
+ * @param value
+ *        The cell value; MAP_NONE always draws nothing.
+ * @param tile
+ *        The tile to draw, scaled to the cell size, or NULL to draw nothing.
+ *
+ * @return MAPRENDER_SUCCESS or MAPRENDER_FAILURE.
+ */
+int maprender_setTile(struct maprender *r, enum map_layer layer, uint16_t value, struct tile *tile) {
+    struct maprender_paint *paints;
+    size_t count;
+
+    if(!r || layer < 0 || layer >= MAP_LAYERS || value == MAP_NONE) { return MAPRENDER_FAILURE; }
+
+    if(value >= r->npaints[layer]) {
+        count = (size_t)value + 1;
+        if( !(paints = realloc(r->paints[layer], count * sizeof(struct maprender_paint))) ) {
+            dbgprint("maprender_setTile: %s\n", ERROR_REALLOC);
+            return MAPRENDER_FAILURE;
+        }
+        memset(paints + r->npaints[layer], 0, (count - r->npaints[layer]) * sizeof(struct maprender_paint));
+        r->paints[layer] = paints;
+        r->npaints[layer] = count;
+    }
+
+    r->paints[layer][value].image = tile ? tile->src : NULL;
+    if(tile) {
+        r->paints[layer][value].rect = tile->rect;
+    }
+    maprender_invalidate(r);
+
+    return MAPRENDER_SUCCESS;
+}
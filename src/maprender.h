@@ -0,0 +1,57 @@
+/*
+ * maprender.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef MAPRENDER_H
+#define MAPRENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "map.h"
+#include "palette.h"
+#include "tile.h"
+
+#define MAPRENDER_SUCCESS   1
+#define MAPRENDER_FAILURE   0
+
+struct maprender;
+
+/**
+ * @struct maprender_stats
+ *         Counters of the last maprender_draw(), see maprender_getStats().
+ * @var visible
+ *      Non-empty chunks intersecting the camera.
+ * @var drawn
+ *      Chunks queued for drawing.
+ * @var rendered
+ *      Chunk surfaces composited again because they were dirty.
+ * @var cached
+ *      Chunk surfaces held by the renderer.
+ * @var evictions
+ *      Chunk surfaces dropped to stay within the budget, since creation.
+ */
+struct maprender_stats {
+    size_t visible;
+    size_t drawn;
+    size_t rendered;
+    size_t cached;
+    unsigned long evictions;
+};
+
+/*
+ * Function declarations.
+ */
+extern struct maprender *  maprender_create     (struct map *m, int tile_w, int tile_h, size_t budget);
+extern size_t              maprender_draw       (struct maprender *r, uint8_t layer, const SDL_Rect *camera);
+extern void                maprender_free       (struct maprender *r);
+extern void                maprender_getStats   (const struct maprender *r, struct maprender_stats *stats);
+extern void                maprender_invalidate (struct maprender *r);
+extern int                 maprender_setPalette (struct maprender *r, const struct palette *palette);
+extern int                 maprender_setTile    (struct maprender *r, enum map_layer layer, uint16_t value, struct tile *tile);
+
+#endif /*MAPRENDER_H*/
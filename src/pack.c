@@ -0,0 +1,475 @@
+/*
+ * pack.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief Read-only access to asset packs built by 'ainur-pack'. A pack is
+ *        mapped into memory and used in place: image surfaces are created
+ *        over the mapped pixels, fonts and scripts are read from the mapping.
+ *        Nothing is decoded at startup and the pages are shared through the
+ *        page cache with every other process that maps the same pack.
+ *
+ * Field Overview:
+ *  static:
+ *      pack_compare
+ *      pack_validate
+ *  extern:
+ *      pack_close
+ *      pack_data
+ *      pack_find
+ *      pack_loadImages
+ *      pack_loadScript
+ *      pack_loadTiles
+ *      pack_open
+ *      pack_openFont
+ *      pack_runScripts
+ *      pack_tag
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include "ainur.h"
+#include "debug.h"
+#include "image.h"
+#include "intern.h"
+#include "pack.h"
+#include "registry.h"
+#include "render.h"
+#include "tile.h"
+
+
+
+/**
+ * @brief Order an entry against a (type, tag) key, the order of the index.
+ */
+static int pack_compare(const struct pack *pack, const struct pack_entry *entry,
+                        enum pack_type type, const char *tag) {
+    if(entry->type != (uint32_t)type) {
+        return entry->type < (uint32_t)type ? -1 : 1;
+    }
+
+    return strcmp(pack->strings + entry->tag, tag);
+}
+
+
+
+/**
+ * @brief Check that every offset in the header and index stays inside the
+ *        mapping, and that every image has a known pixel format and rows
+ *        wide enough for its pixels, so later accesses need no checks.
+ *
+ * @return PACK_SUCCESS or PACK_FAILURE.
+ */
+static int pack_validate(const struct pack *pack) {
+    const struct pack_header *header = pack->header;
+    Uint32 rmask, gmask, bmask, amask;
+    uint32_t i;
+    int bpp;
+
+    if( pack->size < sizeof(struct pack_header) ||
+        memcmp(header->magic, PACK_MAGIC, PACK_MAGIC_LENGTH) ||
+        header->version != PACK_VERSION ||
+        header->size != pack->size ) {
+        return PACK_FAILURE;
+    }
+
+    //string table: inside the file, starts with "" and ends with a NUL
+    if( !header->nstrings ||
+        header->strings > pack->size || header->nstrings > pack->size - header->strings ||
+        pack->base[header->strings] || pack->base[header->strings + header->nstrings - 1] ) {
+        return PACK_FAILURE;
+    }
+
+    //index: inside the file and aligned for direct access
+    if( header->index % sizeof(uint64_t) ||
+        header->index > pack->size ||
+        header->count > (pack->size - header->index) / sizeof(struct pack_entry) ) {
+        return PACK_FAILURE;
+    }
+
+    for(i = 0; i < header->count; i++) {
+        const struct pack_entry *entry = &pack->entries[i];
+
+        if( entry->tag >= header->nstrings ||
+            entry->offset > pack->size || entry->size > pack->size - entry->offset ) {
+            return PACK_FAILURE;
+        }
+
+        switch(entry->type) {
+            case PACK_IMAGE:
+                //a row must hold 'width' pixels, or blits read past the entry
+                if( !SDL_PixelFormatEnumToMasks(entry->image.format, &bpp, &rmask, &gmask, &bmask, &amask) ||
+                    bpp <= 0 ||
+                    entry->image.pitch < ((uint64_t)entry->image.width * bpp + 7) / 8 ||
+                    (uint64_t)entry->image.pitch * entry->image.height > entry->size ||
+                    entry->image.width > INT_MAX || entry->image.height > INT_MAX ||
+                    entry->image.pitch > INT_MAX || entry->offset % PACK_ALIGN ) {
+                    return PACK_FAILURE;
+                }
+                break;
+            case PACK_TILE:
+                if(entry->tile.image >= header->nstrings) {
+                    return PACK_FAILURE;
+                }
+                break;
+            case PACK_FONT:
+            case PACK_SCRIPT:
+                break;
+            default:
+                return PACK_FAILURE;
+        }
+
+        //sorted, with unique (type, tag) pairs, for pack_find()
+        if( i && pack_compare(pack, &pack->entries[i - 1], entry->type, pack->strings + entry->tag) >= 0 ) {
+            return PACK_FAILURE;
+        }
+    }
+
+    return PACK_SUCCESS;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Unmap a pack and free it.
+ *
+ * @param pack
+ *        The pack (may be NULL).
+ * @note Images, tiles and fonts created from the pack must be freed first.
+ */
+void pack_close(struct pack *pack) {
+    if(!pack) { return; }
+
+    munmap((void *)pack->base, pack->size);
+    free(pack);
+
+    return;
+}
+
+
+
+/**
+ * @brief Retrieve the data of an entry.
+ *
+ * @return A pointer into the read-only mapping; entry->size bytes long.
+ */
+const void *pack_data(const struct pack *pack, const struct pack_entry *entry) {
+    return pack->base + entry->offset;
+}
+
+
+
+/**
+ * @brief Find an entry by type and tag in O(log n).
+ *
+ * @param pack
+ *        The pack to search.
+ * @param type
+ *        Kind of the entry.
+ * @param tag
+ *        Tag of the entry.
+ *
+ * @return The entry, or NULL if the pack has no such entry.
+ */
+const struct pack_entry *pack_find(const struct pack *pack, enum pack_type type, const char *tag) {
+    if(!pack || !tag) { return NULL; }
+
+    size_t low = 0, high = pack->header->count, middle;
+    int order;
+
+    while(low < high) {
+        middle = low + (high - low) / 2;
+        order = pack_compare(pack, &pack->entries[middle], type, tag);
+
+        if(!order) {
+            return &pack->entries[middle];
+        }
+        if(order < 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return NULL;
+}
+
+
+
+/**
+ * @brief Register every image of a pack in ainur.images. Surfaces are
+ *        created directly over the mapped pixels when the pack's pixel format
+ *        is the render backend's; otherwise they are converted once.
+ *
+ * @param pack
+ *        The pack; must stay open until the images are freed.
+ *
+ * @return The number of images registered.
+ */
+size_t pack_loadImages(struct pack *pack) {
+    if(!pack) { return 0; }
+
+    const SDL_PixelFormat *format = render_pixelFormat();
+    const struct pack_entry *entry, *end = pack->entries + pack->header->count;
+    SDL_Surface *surface, *converted;
+    Uint32 rmask, gmask, bmask, amask;
+    char name[PATH_MAX];
+    const char *tag;
+    size_t loaded = 0;
+    int bpp;
+
+    //images come first in the index
+    for(entry = pack->entries; entry < end && entry->type == PACK_IMAGE; entry++);
+    registry_reserve(&ainur.images, entry - pack->entries);
+
+    for(entry = pack->entries; entry < end && entry->type == PACK_IMAGE; entry++) {
+        tag = pack_tag(pack, entry);
+
+        if( !SDL_PixelFormatEnumToMasks(entry->image.format, &bpp, &rmask, &gmask, &bmask, &amask) ||
+            !(surface = SDL_CreateRGBSurfaceFrom((void *)pack_data(pack, entry),
+                                                 (int)entry->image.width, (int)entry->image.height,
+                                                 bpp, (int)entry->image.pitch,
+                                                 rmask, gmask, bmask, amask)) ) {
+            dbgprint("pack_loadImages: Unable to map image %s from %s: %s\n", tag, pack->path, SDL_GetError());
+            continue;
+        }
+
+        //a pack built for another pixel format still works, at the cost of a conversion
+        if(entry->image.format != format->format) {
+            converted = SDL_ConvertSurface(surface, format, 0);
+            SDL_FreeSurface(surface);   //the mapped pixels are not freed
+
+            if( !(surface = converted) ) {
+                dbgprint("pack_loadImages: Unable to convert image %s: %s\n", tag, SDL_GetError());
+                continue;
+            }
+        }
+
+        snprintf(name, sizeof(name), "%s:%s", pack->path, tag);
+        if( image_create_fromSurface(surface, name, tag) ) {
+            loaded++;
+        }
+    }
+
+    return loaded;
+}
+
+
+
+/**
+ * @brief Load a script of a pack as a Lua chunk without running it.
+ *
+ * @param pack
+ *        The pack.
+ * @param L
+ *        Lua state to push the chunk (or an error message) onto.
+ * @param tag
+ *        Tag of the script.
+ *
+ * @return 0 or a lua_load() error code, as luaL_loadbuffer().
+ */
+int pack_loadScript(const struct pack *pack, lua_State *L, const char *tag) {
+    const struct pack_entry *entry = pack_find(pack, PACK_SCRIPT, tag);
+
+    if(!entry) {
+        lua_pushfstring(L, "script %s not found in pack", tag ? tag : "(null)");
+        return LUA_ERRFILE;
+    }
+
+    return luaL_loadbuffer(L, pack_data(pack, entry), (size_t)entry->size, pack_tag(pack, entry));
+}
+
+
+
+/**
+ * @brief Create every tile of a pack. The images of the pack must be loaded
+ *        first (see pack_loadImages()).
+ *
+ * @return The number of tiles created.
+ */
+size_t pack_loadTiles(struct pack *pack) {
+    if(!pack) { return 0; }
+
+    const struct pack_entry *entry, *end = pack->entries + pack->header->count;
+    size_t loaded = 0;
+
+    for(entry = pack->entries; entry < end && entry->type < PACK_TILE; entry++);
+    registry_reserve(&ainur.tiles, end - entry);
+
+    for(; entry < end && entry->type == PACK_TILE; entry++) {
+        if( tile_create(pack->strings + entry->tile.image,
+                        entry->tile.x, entry->tile.y, entry->tile.w, entry->tile.h,
+                        pack_tag(pack, entry)) ) {
+            loaded++;
+        }
+    }
+
+    return loaded;
+}
+
+
+
+/**
+ * @brief Map a pack into memory and validate its index.
+ *
+ * @param filename
+ *        Name/path of the pack file.
+ *
+ * @return The open pack, or NULL on failure.
+ * @note The pack needs to be pack_close()ed.
+ */
+struct pack *pack_open(const char *filename) {
+    char buffer[PATH_MAX];
+    struct stat info;
+    struct pack *pack;
+    void *base;
+    int fd;
+
+    if(!filename) {
+        dbgprint("pack_open: formal param 'filename': %s\n", ERROR_NULL_STRING);
+
+        return NULL;
+    }
+
+    if( (fd = open(filename, O_RDONLY)) < 0 ) {
+        dbgprint("pack_open: %s: %s\n", filename, errno == ENOENT ? ERROR_NO_FILE : strerror(errno));
+
+        return NULL;
+    }
+
+    if( fstat(fd, &info) || (size_t)info.st_size < sizeof(struct pack_header) ) {
+        dbgprint("pack_open: %s is not an asset pack.\n", filename);
+
+        close(fd);
+        return NULL;
+    }
+
+    //the mapping keeps the file referenced; the descriptor is not needed
+    base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+        dbgprint("pack_open: Unable to map %s: %s\n", filename, strerror(errno));
+
+        return NULL;
+    }
+
+    if( !(pack = malloc(sizeof(struct pack))) ) {
+        dbgprint("pack_open: Unable to allocate pack %s: %s\n", filename, ERROR_MALLOC);
+
+        munmap(base, (size_t)info.st_size);
+        return NULL;
+    }
+
+    pack->base = base;
+    pack->size = (size_t)info.st_size;
+    pack->header = base;
+    pack->entries = (const struct pack_entry *)(pack->base + pack->header->index);
+    pack->strings = (const char *)(pack->base + pack->header->strings);
+    pack->path = intern_string( realpath(filename, buffer) ? buffer : filename );
+
+    if( !pack->path || !pack_validate(pack) ) {
+        dbgprint("pack_open: %s is not a valid version %d asset pack.\n", filename, PACK_VERSION);
+
+        pack_close(pack);
+        return NULL;
+    }
+
+    return pack;
+}
+
+
+
+/**
+ * @brief Open a font of a pack.
+ *
+ * @param pack
+ *        The pack; must stay open until the font is closed.
+ * @param tag
+ *        Tag of the font.
+ * @param ptsize
+ *        Size of the font to display.
+ *
+ * @return A loaded TTF_Font, or NULL. Loaded font needs to be TTF_CloseFont()ed.
+ */
+TTF_Font *pack_openFont(const struct pack *pack, const char *tag, int ptsize) {
+    const struct pack_entry *entry = pack_find(pack, PACK_FONT, tag);
+    SDL_RWops *rw;
+    TTF_Font *font;
+
+    if(!entry) { return NULL; }
+
+    if( !(rw = SDL_RWFromConstMem(pack_data(pack, entry), (int)entry->size)) ||
+        !(font = TTF_OpenFontRW(rw, 1, ptsize)) ) {
+        dbgprint("pack_openFont: Unable to open font %s from %s: %s\n", tag, pack->path, TTF_GetError());
+
+        return NULL;
+    }
+
+    return font;
+}
+
+
+
+/**
+ * @brief Run every script of a pack, in tag order.
+ *
+ * @param pack
+ *        The pack.
+ * @param L
+ *        Lua state to run the scripts in.
+ *
+ * @return The number of scripts that ran without error.
+ */
+size_t pack_runScripts(const struct pack *pack, lua_State *L) {
+    if(!pack || !L) { return 0; }
+
+    const struct pack_entry *entry, *end = pack->entries + pack->header->count;
+    const char *tag;
+    size_t ran = 0;
+
+    for(entry = pack->entries; entry < end && entry->type < PACK_SCRIPT; entry++);
+
+    for(; entry < end && entry->type == PACK_SCRIPT; entry++) {
+        tag = pack_tag(pack, entry);
+
+        if( luaL_loadbuffer(L, pack_data(pack, entry), (size_t)entry->size, tag) ||
+            lua_pcall(L, 0, 0, 0) ) {
+            dbgprint("pack_runScripts: %s: %s\n", tag, lua_tostring(L, -1));
+
+            lua_pop(L, 1);
+            continue;
+        }
+        ran++;
+    }
+
+    return ran;
+}
+
+
+
+/**
+ * @brief Retrieve the tag of an entry.
+ */
+const char *pack_tag(const struct pack *pack, const struct pack_entry *entry) {
+    return pack->strings + entry->tag;
+}
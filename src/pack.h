@@ -0,0 +1,151 @@
+/*
+ * pack.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <lua.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#define PACK_SUCCESS    1
+#define PACK_FAILURE    0
+
+/* File layout (native byte order):
+ *
+ *     struct pack_header
+ *     data blobs, each aligned to PACK_ALIGN bytes
+ *     string table: NUL terminated tags, offset 0 is ""
+ *     struct pack_entry index[count], sorted by (type, tag)
+ *
+ * Packs are built by the 'ainur-pack' tool (see tools/ainur-pack.c) on the
+ * same kind of machine that runs them. */
+#define PACK_MAGIC          "AINURPAK"
+#define PACK_MAGIC_LENGTH   8
+#define PACK_VERSION        1
+#define PACK_ALIGN          64
+#define PACK_PIXELFORMAT    SDL_PIXELFORMAT_ARGB8888    //images of another format are converted at load
+
+/**
+ * @brief Kinds of pack entries; the index is sorted by this value first.
+ */
+enum pack_type {
+    PACK_IMAGE  = 1,    //pixels in the pixel format of the entry
+    PACK_TILE   = 2,    //a region of a PACK_IMAGE entry; no data
+    PACK_FONT   = 3,    //a TrueType file
+    PACK_SCRIPT = 4     //Lua source or bytecode
+};
+
+/**
+ * @struct pack_header
+ *         First bytes of a pack file.
+ * @var magic
+ *      PACK_MAGIC, without a terminating NUL.
+ * @var version
+ *      PACK_VERSION of the tool that wrote the pack.
+ * @var count
+ *      Number of index entries.
+ * @var index
+ *      File offset of the index.
+ * @var strings
+ *      File offset of the string table.
+ * @var nstrings
+ *      Size of the string table in bytes.
+ * @var size
+ *      Size of the whole file in bytes.
+ */
+struct pack_header {
+    char magic[PACK_MAGIC_LENGTH];
+    uint32_t version;
+    uint32_t count;
+    uint64_t index;
+    uint64_t strings;
+    uint64_t nstrings;
+    uint64_t size;
+};
+
+/**
+ * @struct pack_entry
+ *         One asset of a pack.
+ * @var type
+ *      An enum pack_type.
+ * @var tag
+ *      Offset of the tag of the entry in the string table.
+ * @var offset
+ *      File offset of the data of the entry (0 for tiles).
+ * @var size
+ *      Size of the data in bytes.
+ * @var image
+ *      PACK_IMAGE: SDL pixel format, dimensions and pitch of the pixels.
+ * @var tile
+ *      PACK_TILE: string table offset of the image tag, and the region.
+ */
+struct pack_entry {
+    uint32_t type;
+    uint32_t tag;
+    uint64_t offset;
+    uint64_t size;
+    union {
+        struct {
+            uint32_t format;
+            uint32_t width;
+            uint32_t height;
+            uint32_t pitch;
+        } image;
+        struct {
+            uint32_t image;
+            int32_t x;
+            int32_t y;
+            int32_t w;
+            int32_t h;
+        } tile;
+    };
+};
+
+/**
+ * @struct pack
+ *         An open, memory-mapped pack. Everything created from it (images,
+ *         fonts) refers to the mapping, so it must be closed last.
+ * @var path
+ *      Interned canonical path of the file.
+ * @var base
+ *      Start of the read-only mapping.
+ * @var size
+ *      Size of the mapping in bytes.
+ * @var header
+ *      The header, at 'base'.
+ * @var entries
+ *      The index.
+ * @var strings
+ *      The string table.
+ */
+struct pack {
+    const char *path;
+    const unsigned char *base;
+    size_t size;
+    const struct pack_header *header;
+    const struct pack_entry *entries;
+    const char *strings;
+};
+
+/*
+ * Function declarations.
+ */
+extern void                      pack_close      (struct pack *pack);
+extern const void *              pack_data       (const struct pack *pack, const struct pack_entry *entry);
+extern const struct pack_entry * pack_find       (const struct pack *pack, enum pack_type type, const char *tag);
+extern size_t                    pack_loadImages (struct pack *pack);
+extern int                       pack_loadScript (const struct pack *pack, lua_State *L, const char *tag);
+extern size_t                    pack_loadTiles  (struct pack *pack);
+extern struct pack *             pack_open       (const char *filename);
+extern TTF_Font *                pack_openFont   (const struct pack *pack, const char *tag, int ptsize);
+extern size_t                    pack_runScripts (const struct pack *pack, lua_State *L);
+extern const char *              pack_tag        (const struct pack *pack, const struct pack_entry *entry);
+
+#endif /*PACK_H*/
@@ -0,0 +1,770 @@
+/**
+ * @file path.c
+ *
+ * @brief Grid pathfinding over maps: jump point search (JPS) for single
+ *        queries, and multi-source flow fields that any number of actors
+ *        heading to the same targets can follow. Moves are 8-directional, and
+ *        diagonal moves need both cells they pass between to be passable.
+ *
+ *        A search context keeps its open list (a binary heap) and its search
+ *        nodes between searches. Nodes are stored in pages of one map chunk
+ *        each, allocated the first time a search reaches the chunk; every page
+ *        carries the generation of the search that last reset it, so a new
+ *        search resets pages lazily instead of clearing the map. Once warm, a
+ *        context searches without allocating. Contexts are not shared between
+ *        threads: path_findBatch() runs queries on the worker pool with one
+ *        context per thread.
+ *
+ * Field Overview:
+ *  static:
+ *      path_batchJob
+ *      path_begin
+ *      path_contexts
+ *      path_jumpDiagonal
+ *      path_jumpStraight
+ *      path_neighbors
+ *      path_node
+ *      path_octile
+ *      path_sign
+ *      path_trace
+ *  extern:
+ *      path_buildField
+ *      path_close
+ *      path_createContext
+ *      path_createField
+ *      path_fieldDistance
+ *      path_fieldStep
+ *      path_find
+ *      path_findBatch
+ *      path_freeContext
+ *      path_freeField
+ *      path_freePath
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "astar.h"
+#include "debug.h"
+#include "map.h"
+#include "path.h"
+#include "workers.h"
+
+/**
+ * @struct path_node
+ *         Search state of a cell.
+ */
+struct path_node {
+    uint32_t g;         //best known cost from the start, UINT32_MAX if unseen
+    uint32_t parent;    //cell the best path comes from; the start is its own parent
+    uint32_t closed;    //expanded already
+};
+
+/**
+ * @struct path_page
+ *         Search nodes of one map chunk.
+ */
+struct path_page {
+    uint32_t generation;    //search the nodes belong to
+    struct path_node nodes[MAP_CHUNK_CELLS];
+};
+
+/**
+ * @struct path_context
+ *         Memory of a JPS search, reused from search to search.
+ * @var pages
+ *      One page per chunk of the map searched last, or NULL.
+ * @var npages
+ *      Length of 'pages'.
+ * @var chunks_w
+ *      Chunks per row of the map searched last.
+ * @var generation
+ *      Current search.
+ * @var open
+ *      Open list.
+ */
+struct path_context {
+    struct path_page **pages;
+    size_t npages;
+    unsigned int chunks_w;
+    uint32_t generation;
+    struct astar_heap open;
+};
+
+/**
+ * @struct path_field
+ *         Distances to the nearest target of every cell of a rectangle.
+ */
+struct path_field {
+    const struct map *map;
+    int x;                  //top left cell of the rectangle
+    int y;
+    unsigned int width;
+    unsigned int height;
+    uint32_t *distance;     //width * height, row-major
+    struct astar_heap open;
+};
+
+/**
+ * @struct path_batch
+ *         Arguments of a path_findBatch().
+ */
+struct path_batch {
+    const struct map *map;
+    struct path_query *queries;
+};
+
+/* Per thread contexts of path_findBatch(), indexed by workers_self(). */
+static struct path_context *path_contexts[WORKERS_MAX_THREADS + 1];
+
+
+
+/**
+ * @brief Sign of an integer: -1, 0 or 1.
+ */
+static inline int path_sign(int value) {
+    return (value > 0) - (value < 0);
+}
+
+
+
+/**
+ * @brief Cost of the cheapest 8-directional walk over (dx, dy) on an open grid.
+ */
+static inline uint32_t path_octile(int dx, int dy) {
+    uint32_t x = (uint32_t)abs(dx), y = (uint32_t)abs(dy);
+
+    return x > y ? PATH_COST_STRAIGHT * x + (PATH_COST_DIAGONAL - PATH_COST_STRAIGHT) * y
+                 : PATH_COST_STRAIGHT * y + (PATH_COST_DIAGONAL - PATH_COST_STRAIGHT) * x;
+}
+
+
+
+/**
+ * @brief Prepare a context for a search of 'm': size its page directory to the
+ *        map and start a new generation.
+ *
+ * @return PATH_SUCCESS or PATH_FAILURE.
+ */
+static int path_begin(struct path_context *context, const struct map *m) {
+    size_t i, npages = (size_t)m->chunks_w * m->chunks_h;
+
+    if( (uint64_t)m->width * m->height > UINT32_MAX ) {
+        dbgprint("path_begin: Map %s is too large to search.\n", m->tag);
+        return PATH_FAILURE;
+    }
+
+    if(npages != context->npages || m->chunks_w != context->chunks_w) {
+        for(i = 0; i < context->npages; i++) {
+            free(context->pages[i]);
+        }
+        free(context->pages);
+        context->npages = 0;
+
+        if( !(context->pages = calloc(npages + 1, sizeof(struct path_page *))) ) {
+            dbgprint("path_begin: %s\n", ERROR_CALLOC);
+            return PATH_FAILURE;
+        }
+        context->npages = npages;
+        context->chunks_w = m->chunks_w;
+    }
+
+    //pages still stamped with a wrapped-around generation would look current
+    if( ++context->generation == 0 ) {
+        for(i = 0; i < context->npages; i++) {
+            if(context->pages[i]) {
+                context->pages[i]->generation = 0;
+            }
+        }
+        context->generation = 1;
+    }
+    context->open.count = 0;
+
+    return PATH_SUCCESS;
+}
+
+
+
+/**
+ * @brief Retrieve the search node of a cell, allocating or resetting its page
+ *        as needed.
+ *
+ * @return The node, or NULL if its page cannot be allocated.
+ */
+static struct path_node *path_node(struct path_context *context, uint32_t x, uint32_t y) {
+    struct path_page **page = &context->pages[(size_t)(y >> MAP_CHUNK_SHIFT) * context->chunks_w +
+                                              (x >> MAP_CHUNK_SHIFT)];
+    unsigned int i;
+
+    if(!*page) {
+        if( !(*page = malloc(sizeof(struct path_page))) ) {
+            dbgprint("path_node: %s\n", ERROR_MALLOC);
+            return NULL;
+        }
+        (*page)->generation = context->generation - 1;
+    }
+
+    if((*page)->generation != context->generation) {
+        for(i = 0; i < MAP_CHUNK_CELLS; i++) {
+            (*page)->nodes[i].g = UINT32_MAX;
+            (*page)->nodes[i].closed = 0;
+        }
+        (*page)->generation = context->generation;
+    }
+
+    return &(*page)->nodes[((y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | (x & MAP_CHUNK_MASK)];
+}
+
+
+
+/**
+ * @brief Jump from (x, y) in the straight direction (dx, dy) until the goal,
+ *        a cell with a forced neighbor, or a blocked cell.
+ *
+ * @return 1 with the jump point in (*jx, *jy), or 0 if the way is blocked.
+ */
+static int path_jumpStraight(const struct map *m, int x, int y, int dx, int dy,
+                             int gx, int gy, int *jx, int *jy) {
+    for(;;) {
+        if( !path_passable(m, x, y) ) { return 0; }
+        if(x == gx && y == gy) { break; }
+
+        //a neighbor that can only be reached well through (x, y)
+        if(dx) {
+            if( (path_passable(m, x, y - 1) && !path_passable(m, x - dx, y - 1)) ||
+                (path_passable(m, x, y + 1) && !path_passable(m, x - dx, y + 1)) ) { break; }
+        }
+        else {
+            if( (path_passable(m, x - 1, y) && !path_passable(m, x - 1, y - dy)) ||
+                (path_passable(m, x + 1, y) && !path_passable(m, x + 1, y - dy)) ) { break; }
+        }
+
+        x += dx;
+        y += dy;
+    }
+
+    *jx = x;
+    *jy = y;
+    return 1;
+}
+
+
+
+/**
+ * @brief Jump from (x, y) in the diagonal direction (dx, dy) until the goal, a
+ *        cell from which a straight jump succeeds, or a blocked move.
+ *
+ * @return 1 with the jump point in (*jx, *jy), or 0 if the way is blocked.
+ */
+static int path_jumpDiagonal(const struct map *m, int x, int y, int dx, int dy,
+                             int gx, int gy, int *jx, int *jy) {
+    int tx, ty;
+
+    for(;;) {
+        if( !path_passable(m, x, y) ) { return 0; }
+        if(x == gx && y == gy) { break; }
+
+        if( path_jumpStraight(m, x + dx, y, dx, 0, gx, gy, &tx, &ty) ||
+            path_jumpStraight(m, x, y + dy, 0, dy, gx, gy, &tx, &ty) ) { break; }
+
+        //diagonal moves may not cut corners
+        if( !path_passable(m, x + dx, y) || !path_passable(m, x, y + dy) ) { return 0; }
+
+        x += dx;
+        y += dy;
+    }
+
+    *jx = x;
+    *jy = y;
+    return 1;
+}
+
+
+
+/**
+ * @brief Directions worth jumping in from (x, y), reached from (px, py):
+ *        the natural and forced neighbors of JPS.
+ *
+ * @return The number of directions written to 'dirs' (at most 8).
+ */
+static int path_neighbors(const struct map *m, int x, int y, int px, int py, struct path_point *dirs) {
+    int dx = path_sign(x - px), dy = path_sign(y - py), n = 0, k;
+
+    #define PATH_DIR(a, b) do { dirs[n].x = (a); dirs[n].y = (b); n++; } while(0)
+
+    if(!dx && !dy) {
+        //the start: every legal move
+        for(k = 0; k < 8; k++) {
+            if( k < 4 ? path_passable(m, x + astar_dx[k], y + astar_dy[k])
+                      : path_passable(m, x + astar_dx[k], y) && path_passable(m, x, y + astar_dy[k]) ) {
+                PATH_DIR(astar_dx[k], astar_dy[k]);
+            }
+        }
+    }
+    else if(dx && dy) {
+        int vertical = path_passable(m, x, y + dy), horizontal = path_passable(m, x + dx, y);
+
+        if(vertical) { PATH_DIR(0, dy); }
+        if(horizontal) { PATH_DIR(dx, 0); }
+        if(vertical && horizontal) { PATH_DIR(dx, dy); }
+    }
+    else if(dx) {
+        int next = path_passable(m, x + dx, y);
+        int below = path_passable(m, x, y + 1), above = path_passable(m, x, y - 1);
+
+        if(next) {
+            PATH_DIR(dx, 0);
+            if(below) { PATH_DIR(dx, 1); }
+            if(above) { PATH_DIR(dx, -1); }
+        }
+        if(below) { PATH_DIR(0, 1); }
+        if(above) { PATH_DIR(0, -1); }
+    }
+    else {
+        int next = path_passable(m, x, y + dy);
+        int right = path_passable(m, x + 1, y), left = path_passable(m, x - 1, y);
+
+        if(next) {
+            PATH_DIR(0, dy);
+            if(right) { PATH_DIR(1, dy); }
+            if(left) { PATH_DIR(-1, dy); }
+        }
+        if(right) { PATH_DIR(1, 0); }
+        if(left) { PATH_DIR(-1, 0); }
+    }
+
+    #undef PATH_DIR
+
+    return n;
+}
+
+
+
+/**
+ * @brief Write the cells of the path found to 'goal', following parents from
+ *        jump point to jump point.
+ *
+ * @return PATH_SUCCESS or PATH_FAILURE.
+ */
+static int path_trace(struct path_context *context, const struct map *m, uint32_t start, uint32_t goal,
+                      uint32_t cost, struct path *path) {
+    struct path_point *points;
+    uint32_t cell, parent;
+    int x, y, px, py, sx, sy;
+    size_t length = 1, i;
+
+    for(cell = goal; cell != start; cell = parent) {
+        parent = path_node(context, cell % m->width, cell / m->width)->parent;
+        x = (int)(cell % m->width) - (int)(parent % m->width);
+        y = (int)(cell / m->width) - (int)(parent / m->width);
+        length += (size_t)(abs(x) > abs(y) ? abs(x) : abs(y));
+    }
+
+    if(length > path->capacity) {
+        if( !(points = realloc(path->points, length * sizeof(struct path_point))) ) {
+            dbgprint("path_trace: %s\n", ERROR_REALLOC);
+            return PATH_FAILURE;
+        }
+        path->points = points;
+        path->capacity = length;
+    }
+
+    i = length - 1;
+    path->points[i].x = (int)(goal % m->width);
+    path->points[i].y = (int)(goal / m->width);
+    for(cell = goal; cell != start; cell = parent) {
+        parent = path_node(context, cell % m->width, cell / m->width)->parent;
+        x = (int)(cell % m->width);
+        y = (int)(cell / m->width);
+        px = (int)(parent % m->width);
+        py = (int)(parent / m->width);
+        sx = path_sign(px - x);
+        sy = path_sign(py - y);
+
+        //jump points are joined by straight or diagonal lines
+        while(x != px || y != py) {
+            x += sx;
+            y += sy;
+            i--;
+            path->points[i].x = x;
+            path->points[i].y = y;
+        }
+    }
+
+    path->length = length;
+    path->cost = cost;
+
+    return PATH_SUCCESS;
+}
+
+
+
+/**
+ * @brief Worker job of path_findBatch().
+ */
+static void path_batchJob(void *context, size_t index) {
+    struct path_batch *batch = context;
+    struct path_query *query = &batch->queries[index];
+    int self = workers_self();
+
+    if(!path_contexts[self]) {
+        path_contexts[self] = path_createContext();
+    }
+
+    query->status = path_contexts[self] ?
+                    path_find(path_contexts[self], batch->map, query->start, query->goal, query->path) :
+                    PATH_FAILURE;
+
+    return;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Compute the distance of every cell of a field to its nearest target
+ *        (Dijkstra from all targets at once). Reuses the field's memory.
+ *
+ * @param targets
+ *        'count' cells; those outside the field or not passable are ignored.
+ * @param limit
+ *        Cells farther than this (in PATH_COST_* units) are left unreachable;
+ *        0 for no limit.
+ *
+ * @return The number of cells reached.
+ */
+size_t path_buildField(struct path_field *field, const struct path_point *targets, size_t count, uint32_t limit) {
+    const struct map *m;
+    struct astar_entry entry;
+    uint32_t cell, distance;
+    size_t i, reached = 0;
+    int x, y, nx, ny, k;
+
+    if(!field) { return 0; }
+    m = field->map;
+
+    memset(field->distance, 0xff, (size_t)field->width * field->height * sizeof(uint32_t));
+    field->open.count = 0;
+
+    for(i = 0; targets && i < count; i++) {
+        x = targets[i].x - field->x;
+        y = targets[i].y - field->y;
+        if( (unsigned int)x >= field->width || (unsigned int)y >= field->height ||
+            !path_passable(m, targets[i].x, targets[i].y) ) {
+            continue;
+        }
+
+        cell = (uint32_t)y * field->width + (uint32_t)x;
+        if(field->distance[cell] && astar_heapPush(&field->open, 0, 0, cell)) {
+            field->distance[cell] = 0;
+        }
+    }
+
+    while(field->open.count) {
+        entry = astar_heapPop(&field->open);
+        if(entry.g != field->distance[entry.id]) { continue; }   //stale
+        reached++;
+
+        x = (int)(entry.id % field->width) + field->x;
+        y = (int)(entry.id / field->width) + field->y;
+
+        for(k = 0; k < 8; k++) {
+            nx = x + astar_dx[k];
+            ny = y + astar_dy[k];
+            if( (unsigned int)(nx - field->x) >= field->width || (unsigned int)(ny - field->y) >= field->height ||
+                !path_passable(m, nx, ny) ||
+                (k >= 4 && (!path_passable(m, nx, y) || !path_passable(m, x, ny))) ) {
+                continue;
+            }
+
+            distance = entry.g + (k < 4 ? PATH_COST_STRAIGHT : PATH_COST_DIAGONAL);
+            cell = (uint32_t)(ny - field->y) * field->width + (uint32_t)(nx - field->x);
+            if( (limit && distance > limit) || distance >= field->distance[cell] ) {
+                continue;
+            }
+
+            if( astar_heapPush(&field->open, distance, distance, cell) ) {
+                field->distance[cell] = distance;
+            }
+        }
+    }
+
+    return reached;
+}
+
+
+
+/**
+ * @brief Free the per-thread contexts of path_findBatch().
+ */
+void path_close(void) {
+    int i;
+
+    for(i = 0; i <= WORKERS_MAX_THREADS; i++) {
+        path_freeContext(path_contexts[i]);
+        path_contexts[i] = NULL;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Create a search context. It may search any map, but only from one
+ *        thread at a time.
+ *
+ * @return The context, or NULL on failure.
+ */
+struct path_context *path_createContext(void) {
+    struct path_context *context;
+
+    if( !(context = calloc(1, sizeof(struct path_context))) ) {
+        dbgprint("path_createContext: %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+
+    return context;
+}
+
+
+
+/**
+ * @brief Create a flow field over a rectangle of a map. Nothing is reachable
+ *        until path_buildField().
+ *
+ * @param x, y
+ *        Top left cell of the rectangle.
+ * @param width, height
+ *        Size of the rectangle; moves never leave it.
+ *
+ * @return The field, or NULL on failure.
+ */
+struct path_field *path_createField(const struct map *m, int x, int y, unsigned int width, unsigned int height) {
+    struct path_field *field;
+
+    if(!m || !width || !height || (uint64_t)width * height > UINT32_MAX) {
+        dbgprint("path_createField: Invalid map or field size.\n");
+        return NULL;
+    }
+
+    if( !(field = calloc(1, sizeof(struct path_field))) ||
+        !(field->distance = malloc((size_t)width * height * sizeof(uint32_t))) ) {
+        dbgprint("path_createField: %s\n", ERROR_MALLOC);
+
+        free(field);
+        return NULL;
+    }
+
+    field->map = m;
+    field->x = x;
+    field->y = y;
+    field->width = width;
+    field->height = height;
+    memset(field->distance, 0xff, (size_t)width * height * sizeof(uint32_t));
+
+    return field;
+}
+
+
+
+/**
+ * @brief Distance of a cell to the nearest target of a field.
+ *
+ * @return The distance, or PATH_UNREACHABLE.
+ */
+uint32_t path_fieldDistance(const struct path_field *field, int x, int y) {
+    if( !field || (unsigned int)(x - field->x) >= field->width || (unsigned int)(y - field->y) >= field->height ) {
+        return PATH_UNREACHABLE;
+    }
+
+    return field->distance[(size_t)(y - field->y) * field->width + (size_t)(x - field->x)];
+}
+
+
+
+/**
+ * @brief Next cell on the way from (x, y) to the nearest target of a field:
+ *        the legal move to the neighbor closest to a target.
+ *
+ * @return PATH_SUCCESS with the cell in *next, or PATH_FAILURE if (x, y) is a
+ *         target or no target can be reached from it.
+ */
+int path_fieldStep(const struct path_field *field, int x, int y, struct path_point *next) {
+    uint32_t best, distance;
+    int k, nx, ny;
+
+    if(!field || !next) { return PATH_FAILURE; }
+
+    best = path_fieldDistance(field, x, y);
+    if(best == 0 || best == PATH_UNREACHABLE) { return PATH_FAILURE; }
+
+    for(k = 0; k < 8; k++) {
+        nx = x + astar_dx[k];
+        ny = y + astar_dy[k];
+        if( (distance = path_fieldDistance(field, nx, ny)) >= best ||
+            (k >= 4 && (!path_passable(field->map, nx, y) || !path_passable(field->map, x, ny))) ) {
+            continue;
+        }
+
+        best = distance;
+        next->x = nx;
+        next->y = ny;
+    }
+
+    return best < path_fieldDistance(field, x, y) ? PATH_SUCCESS : PATH_FAILURE;
+}
+
+
+
+/**
+ * @brief Find a shortest 8-directional path with jump point search.
+ *
+ * @param context
+ *        Search memory; see path_createContext().
+ * @param start, goal
+ *        The end points; both must be passable.
+ * @param path
+ *        Receives the path; its buffer is reused.
+ *
+ * @return PATH_SUCCESS, or PATH_FAILURE if there is no path (path->length is 0).
+ */
+int path_find(struct path_context *context, const struct map *m, struct path_point start, struct path_point goal,
+              struct path *path) {
+    struct path_point dirs[8];
+    struct path_node *node, *jump;
+    struct astar_entry entry;
+    uint32_t origin, target, cell, g;
+    int x, y, jx, jy, n, k;
+
+    if(!context || !m || !path) { return PATH_FAILURE; }
+
+    path->length = 0;
+    path->cost = 0;
+
+    if( !path_passable(m, start.x, start.y) || !path_passable(m, goal.x, goal.y) ||
+        !path_begin(context, m) ) {
+        return PATH_FAILURE;
+    }
+
+    origin = (uint32_t)start.y * m->width + (uint32_t)start.x;
+    target = (uint32_t)goal.y * m->width + (uint32_t)goal.x;
+
+    if( !(node = path_node(context, (uint32_t)start.x, (uint32_t)start.y)) ) { return PATH_FAILURE; }
+    node->g = 0;
+    node->parent = origin;
+    if( !astar_heapPush(&context->open, path_octile(goal.x - start.x, goal.y - start.y), 0, origin) ) {
+        return PATH_FAILURE;
+    }
+
+    while(context->open.count) {
+        entry = astar_heapPop(&context->open);
+        x = (int)(entry.id % m->width);
+        y = (int)(entry.id / m->width);
+
+        node = path_node(context, (uint32_t)x, (uint32_t)y);
+        if(node->closed || entry.g != node->g) { continue; }   //stale
+        node->closed = 1;
+
+        if(entry.id == target) {
+            return path_trace(context, m, origin, target, entry.g, path);
+        }
+
+        n = path_neighbors(m, x, y, (int)(node->parent % m->width), (int)(node->parent / m->width), dirs);
+        for(k = 0; k < n; k++) {
+            if( !(dirs[k].x && dirs[k].y ?
+                  path_jumpDiagonal(m, x + dirs[k].x, y + dirs[k].y, dirs[k].x, dirs[k].y, goal.x, goal.y, &jx, &jy) :
+                  path_jumpStraight(m, x + dirs[k].x, y + dirs[k].y, dirs[k].x, dirs[k].y, goal.x, goal.y, &jx, &jy)) ) {
+                continue;
+            }
+
+            if( !(jump = path_node(context, (uint32_t)jx, (uint32_t)jy)) ) { return PATH_FAILURE; }
+
+            g = entry.g + path_octile(jx - x, jy - y);
+            if(jump->closed || g >= jump->g) { continue; }
+
+            cell = (uint32_t)jy * m->width + (uint32_t)jx;
+            if( !astar_heapPush(&context->open, g + path_octile(goal.x - jx, goal.y - jy), g, cell) ) {
+                return PATH_FAILURE;
+            }
+            jump->g = g;
+            jump->parent = entry.id;
+        }
+    }
+
+    return PATH_FAILURE;
+}
+
+
+
+/**
+ * @brief Run many searches of the same map on the worker pool, each thread
+ *        with a context of its own. The map must not change meanwhile.
+ */
+void path_findBatch(const struct map *m, struct path_query *queries, size_t count) {
+    struct path_batch batch;
+
+    if(!m || !queries) { return; }
+
+    batch.map = m;
+    batch.queries = queries;
+    workers_run(path_batchJob, &batch, count);
+
+    return;
+}
+
+
+
+/**
+ * @brief Free a search context.
+ */
+void path_freeContext(struct path_context *context) {
+    size_t i;
+
+    if(!context) { return; }
+
+    for(i = 0; i < context->npages; i++) {
+        free(context->pages[i]);
+    }
+    free(context->pages);
+    free(context->open.entries);
+    free(context);
+
+    return;
+}
+
+
+
+/**
+ * @brief Free a flow field.
+ */
+void path_freeField(struct path_field *field) {
+    if(!field) { return; }
+
+    free(field->distance);
+    free(field->open.entries);
+    free(field);
+
+    return;
+}
+
+
+
+/**
+ * @brief Free the buffer of a path (not the struct itself).
+ */
+void path_freePath(struct path *path) {
+    if(!path) { return; }
+
+    free(path->points);
+    path->points = NULL;
+    path->length = 0;
+    path->capacity = 0;
+
+    return;
+}
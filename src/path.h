@@ -0,0 +1,93 @@
+/*
+ * path.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef PATH_H
+#define PATH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+#define PATH_SUCCESS    1
+#define PATH_FAILURE    0
+
+/* Costs of a move, so that diagonal moves cost about sqrt(2) straight ones. */
+#define PATH_COST_STRAIGHT  100
+#define PATH_COST_DIAGONAL  141
+
+#define PATH_UNREACHABLE    UINT32_MAX  //distance of a cell a flow field does not reach
+
+struct path_context;
+struct path_field;
+
+/**
+ * @struct path_point
+ *         A cell of a map.
+ */
+struct path_point {
+    int x;
+    int y;
+};
+
+/**
+ * @struct path
+ *         Result of a search. Its buffer is reused by the next search into the
+ *         same struct, so keeping one per actor allocates nothing per search.
+ * @var points
+ *      Every cell from the start to the goal, both included.
+ * @var length
+ *      Number of points.
+ * @var capacity
+ *      Length of the buffer 'points'.
+ * @var cost
+ *      Cost of the path, in PATH_COST_* units.
+ */
+struct path {
+    struct path_point *points;
+    size_t length;
+    size_t capacity;
+    uint32_t cost;
+};
+
+/**
+ * @struct path_query
+ *         One search of a path_findBatch().
+ */
+struct path_query {
+    struct path_point start;
+    struct path_point goal;
+    struct path *path;  //receives the path
+    int status;         //PATH_SUCCESS or PATH_FAILURE, set by path_findBatch()
+};
+
+/**
+ * @brief Whether a cell can be walked on: it has a floor and no wall. Cells
+ *        outside the map, and unloaded chunks of streamed maps, cannot.
+ */
+static inline int path_passable(const struct map *m, int x, int y) {
+    const struct map_cell *cell = map_getCell(m, (unsigned int)x, (unsigned int)y);
+
+    return cell->floor != MAP_NONE && cell->wall == MAP_NONE;
+}
+
+/*
+ * Function declarations.
+ */
+extern size_t                path_buildField    (struct path_field *field, const struct path_point *targets, size_t count, uint32_t limit);
+extern void                  path_close         (void);
+extern struct path_context * path_createContext (void);
+extern struct path_field *   path_createField   (const struct map *m, int x, int y, unsigned int width, unsigned int height);
+extern uint32_t              path_fieldDistance (const struct path_field *field, int x, int y);
+extern int                   path_fieldStep     (const struct path_field *field, int x, int y, struct path_point *next);
+extern int                   path_find          (struct path_context *context, const struct map *m, struct path_point start, struct path_point goal, struct path *path);
+extern void                  path_findBatch     (const struct map *m, struct path_query *queries, size_t count);
+extern void                  path_freeContext   (struct path_context *context);
+extern void                  path_freeField     (struct path_field *field);
+extern void                  path_freePath      (struct path *path);
+
+#endif /*PATH_H*/
@@ -0,0 +1,557 @@
+/**
+ * @file region.c
+ *
+ * @brief Connectivity of the passable cells of a map. The passable cells of
+ *        each chunk are labeled into regions, sets connected inside the chunk
+ *        by straight moves; regions touching across chunk borders are linked,
+ *        and a union-find over those links sorts the regions into components.
+ *        Two cells can reach each other, diagonal moves included since they
+ *        may not cut corners, exactly when their regions share a component,
+ *        which region_reachable() checks in constant time.
+ *
+ *        The index listens to its map. Chunks whose cells changed are labeled
+ *        again by the next region_update(), on the worker pool, along with the
+ *        links of their neighbors; then the components are recomputed from
+ *        the links alone, which is cheap next to labeling, so that walls going
+ *        up and splitting components are handled as well as doors opening.
+ *
+ * Field Overview:
+ *  static:
+ *      region_changed
+ *      region_find
+ *      region_labelJob
+ *      region_link
+ *      region_linksJob
+ *      region_mark
+ *      region_reserve
+ *  extern:
+ *      region_at
+ *      region_component
+ *      region_create
+ *      region_free
+ *      region_getStats
+ *      region_neighbors
+ *      region_reachable
+ *      region_update
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "map.h"
+#include "path.h"
+#include "region.h"
+#include "workers.h"
+
+#define REGION_DIRTY    0x1     //the chunk must be labeled again
+#define REGION_RELINK   0x2     //the links of the chunk must be found again
+
+/**
+ * @struct region_chunk
+ *         Regions of one chunk.
+ */
+struct region_chunk {
+    uint16_t *labels;   //region of every cell from 1, 0 if impassable; NULL if none is passable
+    uint16_t count;     //number of regions
+    uint8_t east;       //links[0, east) go to the chunk east, [east, east + south) south
+    uint8_t south;
+    uint32_t base;      //id of region 1
+    uint16_t links[2 * MAP_CHUNK_SIZE][2];  //{region here, region across}
+};
+
+/**
+ * @struct region
+ *         Region index of a map.
+ * @var flags, work, nwork
+ *      Per chunk REGION_* flags, and the chunks having some.
+ * @var parent
+ *      Union-find forest of the regions, by id; scratch once the components
+ *      are known.
+ * @var component
+ *      Component of every region, numbered from 0.
+ * @var starts, neighbors
+ *      Regions linked to region i: neighbors[starts[i], starts[i + 1]).
+ */
+struct region {
+    struct map *map;
+    struct region_chunk *chunks;
+    size_t nchunks;
+    uint8_t *flags;
+    uint32_t *work;
+    size_t nwork;
+    uint32_t *parent;
+    uint32_t *component;
+    uint32_t *starts;
+    uint32_t *neighbors;
+    size_t capacity_parent;
+    size_t capacity_component;
+    size_t capacity_starts;
+    size_t capacity_neighbors;
+    struct region_stats stats;
+};
+
+
+
+/**
+ * @brief Grow an array of uint32_t to hold at least 'count' entries.
+ *
+ * @return REGION_SUCCESS or REGION_FAILURE.
+ */
+static int region_reserve(uint32_t **array, size_t *capacity, size_t count) {
+    uint32_t *grown;
+    size_t n;
+
+    if(count <= *capacity) { return REGION_SUCCESS; }
+
+    for(n = *capacity ? *capacity : 256; n < count; n *= 2);
+    if( !(grown = realloc(*array, n * sizeof(uint32_t))) ) {
+        dbgprint("region_reserve: %s\n", ERROR_REALLOC);
+        return REGION_FAILURE;
+    }
+    *array = grown;
+    *capacity = n;
+
+    return REGION_SUCCESS;
+}
+
+
+
+/**
+ * @brief Root of a region in the union-find forest, halving the path to it.
+ */
+static inline uint32_t region_find(uint32_t *parent, uint32_t id) {
+    while(parent[id] != id) {
+        parent[id] = parent[parent[id]];
+        id = parent[id];
+    }
+
+    return id;
+}
+
+
+
+/**
+ * @brief Queue chunk 'c' with REGION_* flags.
+ */
+static inline void region_mark(struct region *r, size_t c, uint8_t flags) {
+    if(!r->flags[c]) {
+        r->work[r->nwork++] = (uint32_t)c;
+    }
+    r->flags[c] |= flags;
+
+    return;
+}
+
+
+
+/**
+ * @brief Map listener: queue the chunk of a changed cell.
+ */
+static void region_changed(struct map *m, unsigned int x, unsigned int y, void *context) {
+    region_mark(context, (size_t)(y >> MAP_CHUNK_SHIFT) * m->chunks_w + (x >> MAP_CHUNK_SHIFT),
+                REGION_DIRTY | REGION_RELINK);
+    return;
+}
+
+
+
+/**
+ * @brief Worker job: label the cells of chunk r->work[index], if dirty, by
+ *        flood filling its passable cells.
+ */
+static void region_labelJob(void *context, size_t index) {
+    struct region *r = context;
+    const size_t c = r->work[index];
+    const int x0 = (int)((c % r->map->chunks_w) << MAP_CHUNK_SHIFT);
+    const int y0 = (int)((c / r->map->chunks_w) << MAP_CHUNK_SHIFT);
+    struct region_chunk *chunk = &r->chunks[c];
+    uint16_t stack[MAP_CHUNK_CELLS], label = 0;
+    unsigned int i, cell, n, k;
+    int x, y, nx, ny;
+
+    if( !(r->flags[c] & REGION_DIRTY) ) { return; }
+
+    chunk->count = 0;
+    if( !chunk->labels && !(chunk->labels = malloc(MAP_CHUNK_CELLS * sizeof(uint16_t))) ) {
+        dbgprint("region_labelJob: %s\n", ERROR_MALLOC);
+        return;
+    }
+
+    //UINT16_MAX: passable, not labeled yet
+    for(i = 0; i < MAP_CHUNK_CELLS; i++) {
+        chunk->labels[i] = path_passable(r->map, x0 + (int)(i & MAP_CHUNK_MASK), y0 + (int)(i >> MAP_CHUNK_SHIFT))
+                           ? UINT16_MAX : 0;
+    }
+
+    for(i = 0; i < MAP_CHUNK_CELLS; i++) {
+        if(chunk->labels[i] != UINT16_MAX) { continue; }
+
+        chunk->labels[i] = ++label;
+        stack[0] = (uint16_t)i;
+        for(n = 1; n; ) {
+            cell = stack[--n];
+            x = (int)(cell & MAP_CHUNK_MASK);
+            y = (int)(cell >> MAP_CHUNK_SHIFT);
+            for(k = 0; k < 4; k++) {
+                nx = x + (k == 1) - (k == 3);
+                ny = y + (k == 2) - (k == 0);
+                if( (unsigned int)nx >= MAP_CHUNK_SIZE || (unsigned int)ny >= MAP_CHUNK_SIZE ) { continue; }
+
+                cell = ((unsigned int)ny << MAP_CHUNK_SHIFT) | (unsigned int)nx;
+                if(chunk->labels[cell] == UINT16_MAX) {
+                    chunk->labels[cell] = label;
+                    stack[n++] = (uint16_t)cell;
+                }
+            }
+        }
+    }
+
+    chunk->count = label;
+    if(!label) {
+        free(chunk->labels);
+        chunk->labels = NULL;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Record a link of a chunk after its others, unless it is already
+ *        among links[first, end).
+ *
+ * @return 1 if it was recorded, 0 otherwise.
+ */
+static inline int region_link(struct region_chunk *chunk, unsigned int first, uint16_t here, uint16_t across) {
+    const unsigned int end = (unsigned int)chunk->east + chunk->south;
+    unsigned int i;
+
+    for(i = first; i < end; i++) {
+        if(chunk->links[i][0] == here && chunk->links[i][1] == across) { return 0; }
+    }
+    chunk->links[end][0] = here;
+    chunk->links[end][1] = across;
+
+    return 1;
+}
+
+
+
+/**
+ * @brief Worker job: find the links of chunk r->work[index] with the chunks
+ *        east and south of it.
+ */
+static void region_linksJob(void *context, size_t index) {
+    struct region *r = context;
+    const size_t c = r->work[index];
+    const unsigned int w = r->map->chunks_w;
+    struct region_chunk *chunk = &r->chunks[c];
+    const uint16_t *across;
+    uint16_t here, there;
+    unsigned int k;
+
+    chunk->east = chunk->south = 0;
+    if(!chunk->labels) { return; }
+
+    if( c % w + 1 < w && (across = r->chunks[c + 1].labels) ) {
+        for(k = 0; k < MAP_CHUNK_SIZE; k++) {
+            here = chunk->labels[(k << MAP_CHUNK_SHIFT) | MAP_CHUNK_MASK];
+            there = across[k << MAP_CHUNK_SHIFT];
+            if(here && there) {
+                chunk->east += region_link(chunk, 0, here, there);
+            }
+        }
+    }
+    if( c + w < r->nchunks && (across = r->chunks[c + w].labels) ) {
+        for(k = 0; k < MAP_CHUNK_SIZE; k++) {
+            here = chunk->labels[(MAP_CHUNK_MASK << MAP_CHUNK_SHIFT) | k];
+            there = across[k];
+            if(here && there) {
+                chunk->south += region_link(chunk, chunk->east, here, there);
+            }
+        }
+    }
+
+    return;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Region of a cell, as of the last region_update().
+ *
+ * @return Its id, or REGION_NONE if it cannot be walked on.
+ */
+uint32_t region_at(const struct region *r, int x, int y) {
+    const struct region_chunk *chunk;
+    uint16_t label;
+
+    if( !r || (unsigned int)x >= r->map->width || (unsigned int)y >= r->map->height ) { return REGION_NONE; }
+
+    chunk = &r->chunks[(size_t)((unsigned int)y >> MAP_CHUNK_SHIFT) * r->map->chunks_w + ((unsigned int)x >> MAP_CHUNK_SHIFT)];
+    if( !chunk->labels ||
+        !(label = chunk->labels[(((unsigned int)y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | ((unsigned int)x & MAP_CHUNK_MASK)]) ) {
+        return REGION_NONE;
+    }
+
+    return chunk->base + label - 1;
+}
+
+
+
+/**
+ * @brief Component of a region, as of the last region_update().
+ *
+ * @return The component, numbered from 0, or REGION_NONE for REGION_NONE.
+ */
+uint32_t region_component(const struct region *r, uint32_t id) {
+    if(!r || id >= r->stats.regions) { return REGION_NONE; }
+
+    return r->component[id];
+}
+
+
+
+/**
+ * @brief Label the regions of a map and keep them up to date as its cells
+ *        change.
+ *
+ * @param m
+ *        The map; it must outlive the index.
+ *
+ * @return The index, or NULL on failure.
+ */
+struct region *region_create(struct map *m) {
+    struct region *r;
+    size_t c;
+
+    if(!m) {
+        dbgprint("region_create: formal param 'm': %s\n", ERROR_NULL_POINTER);
+        return NULL;
+    }
+
+    if( !(r = calloc(1, sizeof(struct region))) ) {
+        dbgprint("region_create: %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+    r->map = m;
+    r->nchunks = (size_t)m->chunks_w * m->chunks_h;
+
+    if( !(r->chunks = calloc(r->nchunks + 1, sizeof(struct region_chunk))) ||
+        !(r->flags = calloc(r->nchunks + 1, sizeof(uint8_t))) ||
+        !(r->work = malloc((r->nchunks + 1) * sizeof(uint32_t))) ||
+        !map_addListener(m, region_changed, r) ) {
+        dbgprint("region_create: Unable to index map %s.\n", m->tag);
+
+        free(r->chunks);
+        free(r->flags);
+        free(r->work);
+        free(r);
+        return NULL;
+    }
+
+    for(c = 0; c < r->nchunks; c++) {
+        region_mark(r, c, REGION_DIRTY | REGION_RELINK);
+    }
+    region_update(r);
+
+    return r;
+}
+
+
+
+/**
+ * @brief Free a region index and stop listening to its map.
+ */
+void region_free(struct region *r) {
+    size_t c;
+
+    if(!r) { return; }
+
+    map_removeListener(r->map, region_changed, r);
+
+    for(c = 0; c < r->nchunks; c++) {
+        free(r->chunks[c].labels);
+    }
+    free(r->chunks);
+    free(r->flags);
+    free(r->work);
+    free(r->parent);
+    free(r->component);
+    free(r->starts);
+    free(r->neighbors);
+    free(r);
+
+    return;
+}
+
+
+
+/**
+ * @brief Retrieve the counters of a region index.
+ */
+void region_getStats(const struct region *r, struct region_stats *stats) {
+    if(!stats) { return; }
+
+    if(r) {
+        *stats = r->stats;
+    }
+    else {
+        memset(stats, 0, sizeof(struct region_stats));
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Regions linked to a region across chunk borders: the region
+ *        adjacency graph, as of the last region_update().
+ *
+ * @param count
+ *        Receives the number of neighbors.
+ *
+ * @return Their ids, or NULL if there are none.
+ */
+const uint32_t *region_neighbors(const struct region *r, uint32_t id, size_t *count) {
+    if(count) { *count = 0; }
+    if( !r || id >= r->stats.regions || r->starts[id] == r->starts[id + 1] ) { return NULL; }
+
+    if(count) { *count = r->starts[id + 1] - r->starts[id]; }
+
+    return r->neighbors + r->starts[id];
+}
+
+
+
+/**
+ * @brief Whether one cell can be walked to from another. Brings the index up
+ *        to date first, and takes constant time if the map did not change.
+ */
+int region_reachable(struct region *r, struct path_point a, struct path_point b) {
+    uint32_t ra, rb;
+
+    if(!r) { return 0; }
+
+    region_update(r);
+    ra = region_component(r, region_at(r, a.x, a.y));
+    rb = region_component(r, region_at(r, b.x, b.y));
+
+    return ra != REGION_NONE && ra == rb;
+}
+
+
+
+/**
+ * @brief Label the chunks whose cells changed again, then recompute links,
+ *        components and the adjacency graph. Called by region_reachable().
+ *
+ * @return The number of chunks labeled.
+ */
+size_t region_update(struct region *r) {
+    struct region_chunk *chunk, *other;
+    size_t i, n, c, total, labeled;
+    uint32_t a, b, *fill;
+    unsigned int w, k;
+
+    if(!r || !r->nwork) { return 0; }
+
+    w = r->map->chunks_w;
+    n = r->nwork;
+    workers_run(region_labelJob, r, n);
+
+    //links into a labeled chunk are found from the chunks west and north of it
+    for(i = 0; i < n; i++) {
+        c = r->work[i];
+        if(c % w) { region_mark(r, c - 1, REGION_RELINK); }
+        if(c >= w) { region_mark(r, c - w, REGION_RELINK); }
+    }
+    workers_run(region_linksJob, r, r->nwork);
+
+    labeled = 0;
+    for(i = 0; i < r->nwork; i++) {
+        labeled += (r->flags[r->work[i]] & REGION_DIRTY) != 0;
+        r->flags[r->work[i]] = 0;
+    }
+    r->nwork = 0;
+    r->stats.relabeled += labeled;
+
+    //ids, links and union-find
+    for(c = 0, total = 0, r->stats.links = 0; c < r->nchunks; c++) {
+        r->chunks[c].base = (uint32_t)total;
+        total += r->chunks[c].count;
+        r->stats.links += (size_t)r->chunks[c].east + r->chunks[c].south;
+    }
+
+    if( !region_reserve(&r->parent, &r->capacity_parent, total + 1) ||
+        !region_reserve(&r->component, &r->capacity_component, total + 1) ||
+        !region_reserve(&r->starts, &r->capacity_starts, total + 1) ||
+        !region_reserve(&r->neighbors, &r->capacity_neighbors, 2 * r->stats.links + 1) ) {
+        r->stats.regions = r->stats.components = 0;
+        return labeled;
+    }
+    r->stats.regions = total;
+
+    for(i = 0; i < total; i++) {
+        r->parent[i] = (uint32_t)i;
+        r->starts[i + 1] = 0;
+    }
+    r->starts[0] = 0;
+
+    for(c = 0; c < r->nchunks; c++) {
+        chunk = &r->chunks[c];
+        for(k = 0; k < (unsigned int)chunk->east + chunk->south; k++) {
+            other = &r->chunks[k < chunk->east ? c + 1 : c + w];
+            a = chunk->base + chunk->links[k][0] - 1;
+            b = other->base + chunk->links[k][1] - 1;
+            r->starts[a + 1]++;
+            r->starts[b + 1]++;
+
+            a = region_find(r->parent, a);
+            b = region_find(r->parent, b);
+            if(a != b) {
+                r->parent[a < b ? b : a] = a < b ? a : b;
+            }
+        }
+    }
+
+    //components numbered in order of their first region
+    for(i = 0; i < total; i++) {
+        r->component[i] = REGION_NONE;
+    }
+    for(i = 0, r->stats.components = 0; i < total; i++) {
+        a = region_find(r->parent, (uint32_t)i);
+        if(r->component[a] == REGION_NONE) {
+            r->component[a] = (uint32_t)r->stats.components++;
+        }
+        r->component[i] = r->component[a];
+    }
+
+    //adjacency graph: count, prefix sums, then fill using parent[] as cursors
+    for(i = 0; i < total; i++) {
+        r->starts[i + 1] += r->starts[i];
+        r->parent[i] = r->starts[i];
+    }
+    fill = r->parent;
+    for(c = 0; c < r->nchunks; c++) {
+        chunk = &r->chunks[c];
+        for(k = 0; k < (unsigned int)chunk->east + chunk->south; k++) {
+            other = &r->chunks[k < chunk->east ? c + 1 : c + w];
+            a = chunk->base + chunk->links[k][0] - 1;
+            b = other->base + chunk->links[k][1] - 1;
+            r->neighbors[fill[a]++] = b;
+            r->neighbors[fill[b]++] = a;
+        }
+    }
+
+    return labeled;
+}
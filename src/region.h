@@ -0,0 +1,56 @@
+/*
+ * region.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+#include "path.h"
+
+#define REGION_SUCCESS 1
+#define REGION_FAILURE 0
+
+#define REGION_NONE UINT32_MAX  //region of cells that cannot be walked on
+
+struct region;
+
+/**
+ * @struct region_stats
+ *         Counters of a region index, see region_getStats().
+ * @var regions
+ *      Regions: sets of passable cells of a chunk connected inside it.
+ * @var components
+ *      Sets of regions connected to each other; cells reach each other exactly
+ *      when they are in the same component.
+ * @var links
+ *      Pairs of regions touching across a chunk border.
+ * @var relabeled
+ *      Chunks labeled since creation.
+ */
+struct region_stats {
+    size_t regions;
+    size_t components;
+    size_t links;
+    unsigned long relabeled;
+};
+
+/*
+ * Function declarations.
+ */
+extern uint32_t         region_at        (const struct region *r, int x, int y);
+extern uint32_t         region_component (const struct region *r, uint32_t id);
+extern struct region *  region_create    (struct map *m);
+extern void             region_free      (struct region *r);
+extern void             region_getStats  (const struct region *r, struct region_stats *stats);
+extern const uint32_t * region_neighbors (const struct region *r, uint32_t id, size_t *count);
+extern int              region_reachable (struct region *r, struct path_point a, struct path_point b);
+extern size_t           region_update    (struct region *r);
+
+#endif /*REGION_H*/
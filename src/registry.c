@@ -0,0 +1,417 @@
+/*
+ * registry.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief Tag-indexed element tables shared by images, tiles and any other
+ *        engine table that needs lookups by tag.
+ *
+ * Field Overview:
+ *  static:
+ *      registry_handleOf
+ *      registry_probe
+ *      registry_rehash
+ *      registry_resizeSlots
+ *  extern:
+ *      registry_close
+ *      registry_find
+ *      registry_init
+ *      registry_insert
+ *      registry_lookup
+ *      registry_next
+ *      registry_remove
+ *      registry_reserve
+ *      registry_tag
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "intern.h"
+#include "registry.h"
+
+#define REGISTRY_TOMBSTONE          UINT32_MAX
+#define REGISTRY_INITIAL_SLOTS      16
+
+
+
+/**
+ * @brief Build the handle of a slot from its index and current generation.
+ */
+static inline registry_handle registry_handleOf(const struct registry *reg, size_t index) {
+    return ((registry_handle)reg->generations[index] << REGISTRY_INDEX_BITS) | (uint32_t)(index + 1);
+}
+
+
+
+/**
+ * @brief Find the bucket that references 'tag'.
+ *
+ * @return Index of the matching bucket, or reg->nbuckets if there is none.
+ */
+static size_t registry_probe(const struct registry *reg, const char *tag, uint32_t hash) {
+    if(!reg->nbuckets) { return 0; }
+
+    size_t mask = reg->nbuckets - 1, i;
+    uint32_t bucket;
+
+    for(i = hash & mask; (bucket = reg->buckets[i]); i = (i + 1) & mask) {
+        if(bucket == REGISTRY_TOMBSTONE) { continue; }
+
+        bucket--;
+        if( reg->hashes[bucket] == hash &&
+            (reg->tags[bucket] == tag || !strcmp(reg->tags[bucket], tag)) ) {
+            return i;
+        }
+    }
+
+    return reg->nbuckets;
+}
+
+
+
+/**
+ * @brief Rebuild the bucket table with 'nbuckets' buckets; drops tombstones.
+ *
+ * @return REGISTRY_SUCCESS or REGISTRY_FAILURE.
+ */
+static int registry_rehash(struct registry *reg, size_t nbuckets) {
+    uint32_t *buckets;
+
+    if( !(buckets = calloc(nbuckets, sizeof(uint32_t))) ) {
+        dbgprint("registry_rehash: local var 'buckets': %s\n", ERROR_CALLOC);
+
+        return REGISTRY_FAILURE;
+    }
+
+    size_t i, j, mask = nbuckets - 1;
+    for(i = 0; i < reg->slots; i++) {
+        if(!reg->elements[i]) { continue; }
+
+        for(j = reg->hashes[i] & mask; buckets[j]; j = (j + 1) & mask);
+        buckets[j] = (uint32_t)(i + 1);
+    }
+
+    free(reg->buckets);
+    reg->buckets = buckets;
+    reg->nbuckets = nbuckets;
+    reg->tombstones = 0;
+
+    return REGISTRY_SUCCESS;
+}
+
+
+
+/**
+ * @brief Grow every per-slot array to hold 'capacity' slots.
+ *
+ * @return REGISTRY_SUCCESS or REGISTRY_FAILURE.
+ */
+static int registry_resizeSlots(struct registry *reg, size_t capacity) {
+    void **elements;
+    const char **tags;
+    uint32_t *hashes, *freelist;
+    uint8_t *generations;
+
+    //each realloc() is committed immediately so a later failure leaves 'reg' consistent
+    if( !(elements = realloc(reg->elements, capacity * sizeof(void *))) ) {
+        goto error;
+    }
+    reg->elements = elements;
+
+    if( !(tags = realloc(reg->tags, capacity * sizeof(const char *))) ) {
+        goto error;
+    }
+    reg->tags = tags;
+
+    if( !(hashes = realloc(reg->hashes, capacity * sizeof(uint32_t))) ) {
+        goto error;
+    }
+    reg->hashes = hashes;
+
+    if( !(generations = realloc(reg->generations, capacity * sizeof(uint8_t))) ) {
+        goto error;
+    }
+    reg->generations = generations;
+
+    if( !(freelist = realloc(reg->freelist, capacity * sizeof(uint32_t))) ) {
+        goto error;
+    }
+    reg->freelist = freelist;
+
+    reg->capacity = capacity;
+    return REGISTRY_SUCCESS;
+
+error:
+    dbgprint("registry_resizeSlots: Unable to grow registry to %lu slots: %s\n",
+             (unsigned long)capacity, ERROR_REALLOC);
+
+    return REGISTRY_FAILURE;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Free the storage of a registry. Elements themselves are not freed.
+ *
+ * @param reg
+ *        Registry to close.
+ */
+void registry_close(struct registry *reg) {
+    if(!reg) { return; }
+
+    free(reg->elements);
+    free(reg->tags);
+    free(reg->hashes);
+    free(reg->generations);
+    free(reg->freelist);
+    free(reg->buckets);
+    memset(reg, 0, sizeof(struct registry));
+
+    return;
+}
+
+
+
+/**
+ * @brief Find the handle of the element registered under 'tag'.
+ *
+ * @param reg
+ *        Registry to search.
+ * @param tag
+ *        Tag to search for (need not be interned).
+ *
+ * @return The handle, or REGISTRY_INVALID_HANDLE if 'tag' is not registered.
+ */
+registry_handle registry_find(const struct registry *reg, const char *tag) {
+    if(!reg || !tag || !reg->count) { return REGISTRY_INVALID_HANDLE; }
+
+    size_t bucket = registry_probe(reg, tag, intern_hash(tag));
+    if(bucket == reg->nbuckets) {
+        return REGISTRY_INVALID_HANDLE;
+    }
+
+    return registry_handleOf(reg, reg->buckets[bucket] - 1);
+}
+
+
+
+/**
+ * @brief Initialize an empty registry.
+ *
+ * @param reg
+ *        Registry to initialize.
+ * @param hint
+ *        Expected number of elements (may be 0).
+ *
+ * @return REGISTRY_SUCCESS or REGISTRY_FAILURE.
+ */
+int registry_init(struct registry *reg, size_t hint) {
+    memset(reg, 0, sizeof(struct registry));
+
+    return registry_reserve(reg, hint ? hint : REGISTRY_INITIAL_SLOTS);
+}
+
+
+
+/**
+ * @brief Register an element under a unique tag.
+ *
+ * @param reg
+ *        Registry to insert into.
+ * @param tag
+ *        Tag for the element; it is interned by the registry.
+ * @param element
+ *        Element to register (cannot be NULL).
+ *
+ * @return The handle of the new entry, or REGISTRY_INVALID_HANDLE if 'tag' is
+ *         already registered or memory could not be allocated.
+ */
+registry_handle registry_insert(struct registry *reg, const char *tag, void *element) {
+    if(!reg || !tag || !element) {
+        dbgprint("registry_insert: formal params 'reg', 'tag' and 'element' must be non-NULL.\n");
+
+        return REGISTRY_INVALID_HANDLE;
+    }
+
+    uint32_t hash = intern_hash(tag);
+
+    //'tag' must be unique
+    if( reg->count && registry_probe(reg, tag, hash) != reg->nbuckets ) {
+        return REGISTRY_INVALID_HANDLE;
+    }
+
+    if( !registry_reserve(reg, 1) ) {
+        return REGISTRY_INVALID_HANDLE;
+    }
+
+    const char *interned = intern_string(tag);
+    if(!interned) {
+        return REGISTRY_INVALID_HANDLE;
+    }
+
+    //reuse a free slot before touching a new one
+    size_t index;
+    if(reg->nfree) {
+        index = reg->freelist[--reg->nfree];
+    }
+    else {
+        index = reg->slots++;
+        reg->generations[index] = 0;
+    }
+
+    reg->elements[index] = element;
+    reg->tags[index] = interned;
+    reg->hashes[index] = hash;
+
+    //place the slot in the first empty or tombstoned bucket
+    size_t mask = reg->nbuckets - 1, i;
+    for(i = hash & mask; reg->buckets[i] && reg->buckets[i] != REGISTRY_TOMBSTONE; i = (i + 1) & mask);
+    if(reg->buckets[i] == REGISTRY_TOMBSTONE) {
+        reg->tombstones--;
+    }
+    reg->buckets[i] = (uint32_t)(index + 1);
+    reg->count++;
+
+    return registry_handleOf(reg, index);
+}
+
+
+
+/**
+ * @brief Retrieve the element registered under 'tag'.
+ *
+ * @return The element, or NULL if 'tag' is not registered.
+ */
+void *registry_lookup(const struct registry *reg, const char *tag) {
+    return registry_get(reg, registry_find(reg, tag));
+}
+
+
+
+/**
+ * @brief Iterate over the entries of a registry.
+ *
+ * @param reg
+ *        Registry to iterate.
+ * @param handle
+ *        The previous handle returned, or REGISTRY_INVALID_HANDLE to start.
+ *
+ * @return The handle of the next entry, or REGISTRY_INVALID_HANDLE at the end.
+ * @note Removing the current entry while iterating is allowed.
+ */
+registry_handle registry_next(const struct registry *reg, registry_handle handle) {
+    size_t index = handle & REGISTRY_INDEX_MASK;   //slot index + 1 == next slot to test
+
+    for(; index < reg->slots; index++) {
+        if(reg->elements[index]) {
+            return registry_handleOf(reg, index);
+        }
+    }
+
+    return REGISTRY_INVALID_HANDLE;
+}
+
+
+
+/**
+ * @brief Unregister an element in O(1).
+ *
+ * @param reg
+ *        Registry to remove from.
+ * @param handle
+ *        Handle of the entry to remove.
+ *
+ * @return The removed element, or NULL if 'handle' is invalid or stale.
+ * @note The element itself is not freed.
+ */
+void *registry_remove(struct registry *reg, registry_handle handle) {
+    void *element;
+
+    if( !reg || !(element = registry_get(reg, handle)) ) {
+        return NULL;
+    }
+
+    size_t index = (handle & REGISTRY_INDEX_MASK) - 1;
+    size_t bucket = registry_probe(reg, reg->tags[index], reg->hashes[index]);
+
+    reg->buckets[bucket] = REGISTRY_TOMBSTONE;
+    reg->tombstones++;
+
+    reg->elements[index] = NULL;
+    reg->tags[index] = NULL;
+    reg->generations[index]++;      //invalidate outstanding handles
+    reg->freelist[reg->nfree++] = (uint32_t)index;
+    reg->count--;
+
+    return element;
+}
+
+
+
+/**
+ * @brief Make room for 'additional' more elements so the next 'additional'
+ *        insertions neither reallocate nor rehash.
+ *
+ * @return REGISTRY_SUCCESS or REGISTRY_FAILURE.
+ */
+int registry_reserve(struct registry *reg, size_t additional) {
+    size_t needed = reg->count + additional;
+
+    if(needed > REGISTRY_MAX_SLOTS) {
+        dbgprint("registry_reserve: Registry cannot hold %lu elements.\n", (unsigned long)needed);
+
+        return REGISTRY_FAILURE;
+    }
+
+    //grow slots geometrically; free slots are reused first
+    if( reg->slots + (additional > reg->nfree ? additional - reg->nfree : 0) > reg->capacity ) {
+        size_t capacity = reg->capacity ? reg->capacity : REGISTRY_INITIAL_SLOTS;
+        while(capacity < reg->slots + additional) {
+            capacity *= 2;
+        }
+        if(capacity > REGISTRY_MAX_SLOTS) {
+            capacity = REGISTRY_MAX_SLOTS;
+        }
+        if( !registry_resizeSlots(reg, capacity) ) {
+            return REGISTRY_FAILURE;
+        }
+    }
+
+    //keep live entries plus tombstones at or below half of the buckets
+    if( (needed + reg->tombstones) * 2 > reg->nbuckets ) {
+        size_t nbuckets = REGISTRY_INITIAL_SLOTS * 2;
+        while(nbuckets < needed * 2) {
+            nbuckets *= 2;
+        }
+        if( !registry_rehash(reg, nbuckets) ) {
+            return REGISTRY_FAILURE;
+        }
+    }
+
+    return REGISTRY_SUCCESS;
+}
+
+
+
+/**
+ * @brief Retrieve the interned tag of an entry.
+ *
+ * @return The tag, or NULL if 'handle' is invalid or stale.
+ */
+const char *registry_tag(const struct registry *reg, registry_handle handle) {
+    if( !registry_get(reg, handle) ) {
+        return NULL;
+    }
+
+    return reg->tags[(handle & REGISTRY_INDEX_MASK) - 1];
+}
@@ -0,0 +1,112 @@
+/*
+ * registry.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REGISTRY_SUCCESS    1
+#define REGISTRY_FAILURE    0
+
+/* A handle packs a slot index (low bits) and the generation of that slot
+ * (high bits). Handle 0 is never valid. */
+#define REGISTRY_INVALID_HANDLE     0
+#define REGISTRY_INDEX_BITS         24
+#define REGISTRY_INDEX_MASK         ((UINT32_C(1) << REGISTRY_INDEX_BITS) - 1)
+#define REGISTRY_MAX_SLOTS          (REGISTRY_INDEX_MASK - 1)
+
+typedef uint32_t registry_handle;
+
+/**
+ * @struct registry
+ *         A table of tagged elements with O(1) insertion, lookup and removal.
+ *         Tags are interned (see intern.h) and hashed into an open addressing
+ *         table. Elements live in slots that never move, so the handle of an
+ *         element stays valid until that element is removed.
+ * @var elements
+ *      Element stored in each slot (NULL if the slot is free).
+ * @var tags
+ *      Interned tag of each slot.
+ * @var hashes
+ *      Cached hash of each slot's tag.
+ * @var generations
+ *      Generation counter of each slot; bumped on removal to catch stale handles.
+ * @var freelist
+ *      Stack of free slot indices below 'slots'.
+ * @var nfree
+ *      Number of entries on 'freelist'.
+ * @var slots
+ *      Number of slots ever used (high-water mark).
+ * @var capacity
+ *      Number of slots allocated.
+ * @var buckets
+ *      Open addressing table; each bucket holds a slot index + 1, 0 (empty)
+ *      or REGISTRY_TOMBSTONE.
+ * @var nbuckets
+ *      Number of buckets (power of two).
+ * @var tombstones
+ *      Number of tombstoned buckets.
+ * @var count
+ *      Number of elements currently stored.
+ */
+struct registry {
+    void **elements;
+    const char **tags;
+    uint32_t *hashes;
+    uint8_t *generations;
+    uint32_t *freelist;
+    size_t nfree;
+    size_t slots;
+    size_t capacity;
+    uint32_t *buckets;
+    size_t nbuckets;
+    size_t tombstones;
+    size_t count;
+};
+
+/*
+ * Function declarations.
+ */
+extern void            registry_close   (struct registry *reg);
+extern registry_handle registry_find    (const struct registry *reg, const char *tag);
+extern int             registry_init    (struct registry *reg, size_t hint);
+extern registry_handle registry_insert  (struct registry *reg, const char *tag, void *element);
+extern void *          registry_lookup  (const struct registry *reg, const char *tag);
+extern registry_handle registry_next    (const struct registry *reg, registry_handle handle);
+extern void *          registry_remove  (struct registry *reg, registry_handle handle);
+extern int             registry_reserve (struct registry *reg, size_t additional);
+extern const char *    registry_tag     (const struct registry *reg, registry_handle handle);
+
+
+
+/**
+ * @brief Number of elements stored in a registry.
+ */
+static inline size_t registry_count(const struct registry *reg) {
+    return reg->count;
+}
+
+
+
+/**
+ * @brief Retrieve the element referenced by a handle.
+ *
+ * @return The element, or NULL if 'handle' is invalid or stale.
+ */
+static inline void *registry_get(const struct registry *reg, registry_handle handle) {
+    uint32_t index = (handle & REGISTRY_INDEX_MASK) - 1;
+
+    if( index >= reg->slots || reg->generations[index] != (handle >> REGISTRY_INDEX_BITS) ) {
+        return NULL;
+    }
+
+    return reg->elements[index];
+}
+
+#endif /*REGISTRY_H*/
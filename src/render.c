@@ -0,0 +1,378 @@
+/*
+ * render.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief Render backends. RENDER_SURFACE blits surfaces onto the window
+ *        surface on the CPU. RENDER_TEXTURE and RENDER_SOFTWARE draw through
+ *        an SDL_Renderer: every image source is uploaded to a texture once,
+ *        on first use, and frames are submitted as arrays of copy commands
+ *        that SDL batches. The backend is chosen once, at startup, and every
+ *        backend keeps the same frame time counters so they can be compared
+ *        on the same scene.
+ *
+ * Field Overview:
+ *  static:
+ *      render
+ *      render_names
+ *  extern:
+ *      render_backendFromName
+ *      render_backendName
+ *      render_begin
+ *      render_close
+ *      render_dumpStats
+ *      render_getBackend
+ *      render_getStats
+ *      render_init
+ *      render_pixelFormat
+ *      render_present
+ *      render_resetStats
+ *      render_submit
+ *      render_texture
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "ainur.h"
+#include "debug.h"
+#include "image.h"
+#include "render.h"
+
+
+
+/**
+ * @brief Backend state.
+ * @var backend
+ *      Backend in use.
+ * @var renderer
+ *      Renderer of the texture backends, or NULL.
+ * @var format
+ *      Pixel format images are converted to for the texture backends.
+ * @var started
+ *      Performance counter at render_begin().
+ * @var stats
+ *      Frame counters.
+ */
+static struct {
+    enum render_backend backend;
+    SDL_Renderer *renderer;
+    SDL_PixelFormat *format;
+    Uint64 started;
+    struct render_stats stats;
+} render = { RENDER_SURFACE, NULL, NULL, 0, { 0, 0, 0, 0, 0.0, 0.0, 0.0 } };
+
+/* Names of the backends, indexed by enum render_backend. */
+static const char *render_names[] = { "surface", "texture", "software" };
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Parse the name of a backend ("surface", "texture" or "software").
+ *
+ * @return RENDER_SUCCESS with *backend set, or RENDER_FAILURE.
+ */
+int render_backendFromName(const char *name, enum render_backend *backend) {
+    int i;
+
+    for(i = 0; name && i < (int)(sizeof(render_names) / sizeof(render_names[0])); i++) {
+        if( !strcmp(name, render_names[i]) ) {
+            *backend = (enum render_backend)i;
+            return RENDER_SUCCESS;
+        }
+    }
+
+    return RENDER_FAILURE;
+}
+
+
+
+/**
+ * @brief Retrieve the name of a backend.
+ */
+const char *render_backendName(enum render_backend backend) {
+    return render_names[backend];
+}
+
+
+
+/**
+ * @brief Start a frame: clear the window and start the frame timer.
+ */
+void render_begin(void) {
+    render.started = SDL_GetPerformanceCounter();
+    render.stats.copies = 0;
+    render.stats.switches = 0;
+
+    if(render.renderer) {
+        SDL_SetRenderDrawColor(render.renderer, 0, 0, 0, 255);
+        SDL_RenderClear(render.renderer);
+    }
+    else {
+        SDL_FillRect(SDL_GetWindowSurface(ainur.screen), NULL, 0);
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Destroy every texture and the renderer.
+ */
+void render_close(void) {
+    image_dropTextures();   //textures die with their renderer
+
+    if(render.renderer) {
+        SDL_DestroyRenderer(render.renderer);
+        render.renderer = NULL;
+    }
+    if(render.format) {
+        SDL_FreeFormat(render.format);
+        render.format = NULL;
+    }
+    render.backend = RENDER_SURFACE;
+
+    return;
+}
+
+
+
+/**
+ * @brief Print the frame counters.
+ *
+ * @return The number of characters written (similar to fprintf).
+ */
+int render_dumpStats(FILE *stream) {
+    return fprintf(stream,
+                   "render: %s backend\n"\
+                   "  frames = %lu\n"\
+                   "  frame time: average = %.3f ms, worst = %.3f ms, last = %.3f ms\n"\
+                   "  last frame: copies = %lu, source switches = %lu\n"\
+                   "  texture uploads = %lu\n",
+                   render_backendName(render.backend),
+                   render.stats.frames,
+                   render.stats.frames ? render.stats.total / render.stats.frames : 0.0,
+                   render.stats.worst,
+                   render.stats.last,
+                   render.stats.copies,
+                   render.stats.switches,
+                   render.stats.uploads);
+}
+
+
+
+/**
+ * @brief Retrieve the backend in use.
+ */
+enum render_backend render_getBackend(void) {
+    return render.backend;
+}
+
+
+
+/**
+ * @brief Retrieve the frame counters.
+ */
+void render_getStats(struct render_stats *stats) {
+    if(stats) {
+        *stats = render.stats;
+    }
+    return;
+}
+
+
+
+/**
+ * @brief Start a backend for the main window. Must be called after
+ *        screen_initMain() and before images are loaded, since it decides the
+ *        pixel format of every image (see render_pixelFormat()).
+ *
+ * @param backend
+ *        The backend to use.
+ *
+ * @return RENDER_SUCCESS, or RENDER_FAILURE, in which case RENDER_SURFACE is used.
+ */
+int render_init(enum render_backend backend) {
+    render_close();
+
+    if(backend == RENDER_SURFACE) {
+        return RENDER_SUCCESS;
+    }
+
+    //let SDL merge consecutive copies into as few draw calls as it can
+    SDL_SetHint(SDL_HINT_RENDER_BATCHING, "1");
+
+    render.renderer = SDL_CreateRenderer(ainur.screen, -1,
+                                         backend == RENDER_SOFTWARE ? SDL_RENDERER_SOFTWARE
+                                                                    : SDL_RENDERER_ACCELERATED);
+    if( !render.renderer || !(render.format = SDL_AllocFormat(SDL_PIXELFORMAT_ARGB8888)) ) {
+        dbgprint("render_init: Unable to start the %s backend: %s\n"\
+                 "             Falling back to the surface backend.\n",
+                 render_backendName(backend), SDL_GetError());
+
+        render_close();
+        return RENDER_FAILURE;
+    }
+
+    render.backend = backend;
+    return RENDER_SUCCESS;
+}
+
+
+
+/**
+ * @brief Pixel format that images should be converted to when they are
+ *        decoded: the window surface's for RENDER_SURFACE, the texture format
+ *        otherwise.
+ */
+const SDL_PixelFormat *render_pixelFormat(void) {
+    if(render.format) {
+        return render.format;
+    }
+
+    return SDL_GetWindowSurface(ainur.screen)->format;
+}
+
+
+
+/**
+ * @brief End a frame: show it and record its time.
+ */
+void render_present(void) {
+    if(render.renderer) {
+        SDL_RenderPresent(render.renderer);
+    }
+    else {
+        SDL_UpdateWindowSurface(ainur.screen);
+    }
+
+    double elapsed = (double)(SDL_GetPerformanceCounter() - render.started) * 1000.0 /
+                     (double)SDL_GetPerformanceFrequency();
+
+    render.stats.frames++;
+    render.stats.last = elapsed;
+    render.stats.total += elapsed;
+    if(elapsed > render.stats.worst) {
+        render.stats.worst = elapsed;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Reset the frame counters.
+ */
+void render_resetStats(void) {
+    memset(&render.stats, 0, sizeof(struct render_stats));
+    return;
+}
+
+
+
+/**
+ * @brief Draw a batch of copy commands, in order. Commands should be sorted
+ *        by the caller so that copies from the same source are adjacent.
+ *
+ * @param copies
+ *        Array of 'count' commands.
+ * @param count
+ *        Number of commands.
+ *
+ * @return The number of commands drawn.
+ */
+size_t render_submit(const struct render_copy *copies, size_t count) {
+    const struct image_source *current = NULL;
+    size_t i, drawn = 0;
+
+    if(!copies) { return 0; }
+
+    if(render.renderer) {
+        SDL_Texture *texture = NULL;
+
+        for(i = 0; i < count; i++) {
+            if(copies[i].image->source != current) {
+                current = copies[i].image->source;
+                texture = render_texture(copies[i].image);
+                render.stats.switches++;
+            }
+            if(!texture) { continue; }
+
+            if( (copies[i].flags ?
+                 SDL_RenderCopyEx(render.renderer, texture, &copies[i].src, &copies[i].dest, 0.0, NULL,
+                                  ((copies[i].flags & RENDER_FLIP_HORIZONTAL) ? SDL_FLIP_HORIZONTAL : 0) |
+                                  ((copies[i].flags & RENDER_FLIP_VERTICAL) ? SDL_FLIP_VERTICAL : 0)) :
+                 SDL_RenderCopy(render.renderer, texture, &copies[i].src, &copies[i].dest)) == 0 ) {
+                drawn++;
+            }
+        }
+    }
+    else {
+        SDL_Surface *window = SDL_GetWindowSurface(ainur.screen), *surface = NULL;
+        SDL_Rect dest;
+
+        for(i = 0; i < count; i++) {
+            if(copies[i].image->source != current) {
+                current = copies[i].image->source;
+                surface = image_getSurface(copies[i].image);
+                render.stats.switches++;
+            }
+            if(!surface) { continue; }
+
+            //stretch 'src' to 'dest' as SDL_RenderCopy() does; both clip 'dest' in place
+            dest = copies[i].dest;
+            if( !((copies[i].src.w == dest.w && copies[i].src.h == dest.h) ?
+                  SDL_BlitSurface(surface, &copies[i].src, window, &dest) :
+                  SDL_BlitScaled(surface, &copies[i].src, window, &dest)) ) {
+                drawn++;
+            }
+        }
+    }
+
+    render.stats.copies += count;
+    return drawn;
+}
+
+
+
+/**
+ * @brief Retrieve the texture of an image, uploading its pixels on first use.
+ *        Every image of the same source shares the texture.
+ *
+ * @param image
+ *        The image.
+ *
+ * @return The texture, or NULL if there is no renderer or the upload failed.
+ */
+SDL_Texture *render_texture(struct image *image) {
+    SDL_Surface *surface;
+
+    if(!render.renderer || !image) { return NULL; }
+
+    if(image->source->texture) {
+        return image->source->texture;
+    }
+
+    if( !(surface = image_getSurface(image)) ||
+        !(image->source->texture = SDL_CreateTextureFromSurface(render.renderer, surface)) ) {
+        dbgprint("render_texture: Unable to upload image %s: %s\n",
+                 image->tag ? image->tag : "(anonymous)", SDL_GetError());
+
+        return NULL;
+    }
+    SDL_SetTextureBlendMode(image->source->texture, SDL_BLENDMODE_BLEND);
+    render.stats.uploads++;
+
+    return image->source->texture;
+}
@@ -0,0 +1,98 @@
+/*
+ * render.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+
+#include "image.h"
+
+#define RENDER_SUCCESS  1
+#define RENDER_FAILURE  0
+
+/* render_copy flags; ignored by RENDER_SURFACE, which cannot flip (it does
+ * scale 'src' to 'dest', like the other backends). */
+#define RENDER_FLIP_HORIZONTAL  0x1
+#define RENDER_FLIP_VERTICAL    0x2
+
+/**
+ * @brief Ways to get pixels to the window; chosen once by render_init().
+ */
+enum render_backend {
+    RENDER_SURFACE  = 0,    //CPU blits onto the window surface
+    RENDER_TEXTURE  = 1,    //SDL_Renderer with textures, hardware accelerated if possible
+    RENDER_SOFTWARE = 2     //SDL_Renderer with SDL's software renderer (headless machines)
+};
+
+/**
+ * @struct render_copy
+ *         One copy command of a frame.
+ * @var image
+ *      Image to copy from.
+ * @var src
+ *      Region of the image.
+ * @var dest
+ *      Region of the window.
+ * @var flags
+ *      RENDER_FLIP_* flags.
+ */
+struct render_copy {
+    struct image *image;
+    SDL_Rect src;
+    SDL_Rect dest;
+    unsigned int flags;
+};
+
+/**
+ * @struct render_stats
+ *         Frame counters, see render_getStats().
+ * @var frames
+ *      Frames presented since the last reset.
+ * @var copies
+ *      Copies submitted during the last frame.
+ * @var switches
+ *      Changes of source surface/texture during the last frame.
+ * @var uploads
+ *      Textures uploaded since the last reset.
+ * @var last
+ *      Time of the last frame, render_begin() to render_present(), in milliseconds.
+ * @var total
+ *      Sum of all frame times in milliseconds.
+ * @var worst
+ *      Longest frame time in milliseconds.
+ */
+struct render_stats {
+    unsigned long frames;
+    unsigned long copies;
+    unsigned long switches;
+    unsigned long uploads;
+    double last;
+    double total;
+    double worst;
+};
+
+/*
+ * Function declarations.
+ */
+extern int                     render_backendFromName (const char *name, enum render_backend *backend);
+extern const char *            render_backendName     (enum render_backend backend);
+extern void                    render_begin           (void);
+extern void                    render_close           (void);
+extern int                     render_dumpStats       (FILE *stream);
+extern enum render_backend     render_getBackend      (void);
+extern void                    render_getStats        (struct render_stats *stats);
+extern int                     render_init            (enum render_backend backend);
+extern const SDL_PixelFormat * render_pixelFormat     (void);
+extern void                    render_present         (void);
+extern void                    render_resetStats      (void);
+extern size_t                  render_submit          (const struct render_copy *copies, size_t count);
+extern SDL_Texture *           render_texture         (struct image *image);
+
+#endif /*RENDER_H*/
@@ -1,30 +1,91 @@
 /*
- * Utilizes the xorshift128+ algorithm.
+ * Utilizes the xorshift128+ algorithm. The rnd_128_* functions draw from a
+ * process-wide generator; their *State variants from a caller's own, so that
+ * threads can each draw from a stream of their own.
  * Field Overview:
  *  static:
- *      s_128[2]
+ *      s_128
+ *      s_128x2
+ *      rnd_128_binomialBtrd
+ *      rnd_128_binomialInversion
+ *      rnd_128_initLanes
+ *      rnd_128_reduce
  *      rnd_128_rotl
  *      rnd_128_init_timeEntropy
+ *      rnd_fc
+ *      rnd_popcount
  *  extern:
+ *      rnd_128_binomial
+ *      rnd_128_bounded
+ *      rnd_128_boundedMany
+ *      rnd_128_boundedState
+ *      rnd_128_coins
+ *      rnd_128_double
+ *      rnd_128_fill
  *      rnd_128_jump
+ *      rnd_128_jumpState
  *      rnd_128_next
+ *      rnd_128_nextState
+ *      rnd_128_seed
  *      rnd_init
+ *      rnd_normal
  */
 
 #include <fcntl.h>
+#include <math.h>
 #include <stdint.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /*__SSE2__*/
 
 #include "rnd.h"
 #include "utils.h"
 
+#define RND_BTRD_MIN    10.0    //smallest n*p sampled by rejection (BTRD)
+#define RND_COINS_MAX   1024    //largest count of coins flipped bit by bit
+#define RND_BATCH       256     //words drawn at a time by rnd_128_boundedMany()
 
 
-static uint64_t s_128[2] = {0,0};
+
+static struct rnd_128 s_128 = { {0,0} };
+static struct rnd_128 s_128x2[2] = { { {0,0} }, { {0,0} } };    //lanes of rnd_128_fill()
+
+
+
+/**
+ * @brief Stirling series correction: ln(k!) minus
+ *        (k+1/2)ln(k+1) - (k+1) + ln(2 pi)/2.
+ */
+static double rnd_fc(double k) {
+    static const double table[] = {
+        0.08106146679532726, 0.04134069595540929, 0.02767792568499834,
+        0.02079067210376509, 0.01664469118982119, 0.01387612882307075,
+        0.01189670994589177, 0.01041126526197209, 0.009255462182712733,
+        0.008330563433362871
+    };
+
+    if(k < 10.0) {
+        return table[(int)k];
+    }
+
+    double inv = 1.0 / (k + 1.0),
+           inv2 = inv * inv;
+    return (1.0/12 - (1.0/360 - 1.0/1260 * inv2) * inv2) * inv;
+}
+
+
+
+static inline int rnd_popcount(uint64_t x) {
+    x -= (x >> 1) & UINT64_C(0x5555555555555555);
+    x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+    x = (x + (x >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+    return (int)((x * UINT64_C(0x0101010101010101)) >> 56);
+}
 
 
 
@@ -34,6 +95,189 @@ static inline uint64_t rnd_128_rotl(const uint64_t x, int k) {
 
 
 
+/**
+ * @brief Binomial variate by Hormann's transformed rejection with decomposition
+ *        (BTRD); expected O(1) draws for any 'n'.
+ *
+ * @note Requires p <= 1/2 and n*p >= RND_BTRD_MIN.
+ */
+static uint64_t rnd_128_binomialBtrd(uint64_t n, double p) {
+    const double nd = (double)n,
+                 r = p / (1.0 - p),
+                 nr = (nd + 1.0) * r,
+                 npq = nd * p * (1.0 - p),
+                 spq = sqrt(npq),
+                 b = 1.15 + 2.53 * spq,
+                 a = -0.0873 + 0.0248 * b + 0.01 * p,
+                 c = nd * p + 0.5,
+                 alpha = (2.83 + 5.1 / b) * spq,
+                 vr = 0.92 - 4.2 / b,
+                 urvr = 0.86 * vr,
+                 m = floor((nd + 1.0) * p);
+
+    for(;;) {
+        double u, v = rnd_128_double();
+
+        //most draws land in the box under the hat and are taken at once
+        if(v <= urvr) {
+            u = v / vr - 0.43;
+            return (uint64_t)floor((2.0 * a / (0.5 - fabs(u)) + b) * u + c);
+        }
+
+        if(v >= vr) {
+            u = rnd_128_double() - 0.5;
+        }
+        else {
+            u = v / vr - 0.93;
+            u = (u < 0.0 ? -0.5 : 0.5) - u;
+            v = rnd_128_double() * vr;
+        }
+
+        double us = 0.5 - fabs(u),
+               k = floor((2.0 * a / us + b) * u + c);
+        if(k < 0.0 || k > nd) {
+            continue;
+        }
+
+        v = v * alpha / (a / (us * us) + b);
+        double km = fabs(k - m);
+
+        //near the mode: f(k)/f(m) by recursion
+        if(km <= 15.0) {
+            double f = 1.0;
+            if(m < k) {
+                for(double i = m + 1.0; i <= k; i += 1.0) {
+                    f *= nr / i - r;
+                }
+            }
+            else if(m > k) {
+                for(double i = k + 1.0; i <= m; i += 1.0) {
+                    v *= nr / i - r;
+                }
+            }
+            if(v <= f) {
+                return (uint64_t)k;
+            }
+            continue;
+        }
+
+        //squeeze, then the exact log ratio through Stirling's series
+        v = log(v);
+        double rho = (km / npq) * (((km / 3.0 + 0.625) * km + 1.0 / 6.0) / npq + 0.5),
+               t = -km * km / (2.0 * npq);
+        if(v < t - rho) {
+            return (uint64_t)k;
+        }
+        if(v > t + rho) {
+            continue;
+        }
+
+        double nm = nd - m + 1.0,
+               nk = nd - k + 1.0,
+               h = (m + 0.5) * log((m + 1.0) / (r * nm)) + rnd_fc(m) + rnd_fc(nd - m);
+        if(v <= h + (nd + 1.0) * log(nm / nk) + (k + 0.5) * log(nk * r / (k + 1.0)) - rnd_fc(k) - rnd_fc(nd - k)) {
+            return (uint64_t)k;
+        }
+    }
+}
+
+
+
+/**
+ * @brief Binomial variate by sequential search from 0; expected n*p + 1 steps.
+ *
+ * @note Requires p <= 1/2.
+ */
+static uint64_t rnd_128_binomialInversion(uint64_t n, double p) {
+    const double q = 1.0 - p,
+                 s = p / q,
+                 a = ((double)n + 1.0) * s,
+                 r0 = pow(q, (double)n);
+
+    for(;;) {
+        double u = rnd_128_double(),
+               r = r0;
+        uint64_t x = 0;
+
+        while(u > r) {
+            u -= r;
+            //rounding left some mass past n: draw again
+            if(++x > n) {
+                break;
+            }
+            r *= a / (double)x - s;
+        }
+        if(x <= n) {
+            return x;
+        }
+    }
+}
+
+
+
+/**
+ * @brief Start the lanes of rnd_128_fill() one and two jumps ahead of the
+ *        process-wide generator, so that no two streams overlap.
+ */
+static void rnd_128_initLanes(void) {
+    struct rnd_128 state = s_128;
+
+    for(int i = 0; i < 2; i++) {
+        rnd_128_jumpState(&state);
+        s_128x2[i] = state;
+    }
+    return;
+}
+
+
+
+/**
+ * @brief Map the high 32 bits of each word to [0, range) by Lemire's
+ *        multiply, as rnd_128_boundedState() does (the low bits of
+ *        xorshift128+ are weak); draws whose low product is below
+ *        'threshold' (2^32 mod range) are rejected.
+ *
+ * @return The number of values written to 'out', at most 'max'.
+ */
+static size_t rnd_128_reduce(const uint64_t *words, size_t count, uint32_t range,
+                             uint32_t threshold, uint32_t *out, size_t max) {
+    size_t n = 0,
+           i = 0;
+
+#ifdef __SSE2__
+    const __m128i r = _mm_set1_epi32((int)range),
+                  sign = _mm_set1_epi32(INT32_MIN),
+                  t = _mm_xor_si128(_mm_set1_epi32((int)threshold), sign);
+
+    //four draws at once while none of them is rejected
+    for(; i + 4 <= count && n + 4 <= max; i += 4) {
+        __m128i a = _mm_mul_epu32(_mm_srli_epi64(_mm_loadu_si128((const __m128i *)(words + i)), 32), r),
+                b = _mm_mul_epu32(_mm_srli_epi64(_mm_loadu_si128((const __m128i *)(words + i + 2)), 32), r);
+
+        //low halves of the products first, then the high halves
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+
+        if( _mm_movemask_epi8(_mm_cmplt_epi32(_mm_xor_si128(_mm_unpacklo_epi64(a, b), sign), t)) ) {
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(out + n), _mm_unpackhi_epi64(a, b));
+        n += 4;
+    }
+#endif /*__SSE2__*/
+
+    for(; i < count && n < max; i++) {
+        uint64_t m = (words[i] >> 32) * (uint64_t)range;
+        if( (uint32_t)m >= threshold ) {
+            out[n++] = (uint32_t)(m >> 32);
+        }
+    }
+
+    return n;
+}
+
+
+
 /**
  * @brief Use time as a source of entropy.
  */
@@ -43,8 +287,184 @@ static void rnd_128_init_timeEntropy(void) {
 
     gettimeofday(&tv, NULL);
 
-    s_128[0] = ( reverse(tv.tv_sec) ^ tv.tv_sec );
-    s_128[1] = ( reverse(tv.tv_usec) ^ tv.tv_usec );
+    s_128.s[0] = ( reverse(tv.tv_sec) ^ tv.tv_sec );
+    s_128.s[1] = ( reverse(tv.tv_usec) ^ tv.tv_usec );
+    return;
+}
+
+
+
+/**
+ * @fn uint64_t rnd_128_binomial (uint64_t n, double p)
+ *
+ * @brief The number of successes in 'n' trials of probability 'p', drawn
+ *        exactly in O(1) expected time whatever 'n'.
+ */
+uint64_t rnd_128_binomial(uint64_t n, double p) {
+    if(!n || p <= 0.0) {
+        return 0;
+    }
+    if(p >= 1.0) {
+        return n;
+    }
+
+    //both samplers want the smaller tail
+    if(p > 0.5) {
+        return n - rnd_128_binomial(n, 1.0 - p);
+    }
+
+    return ((double)n * p < RND_BTRD_MIN) ? rnd_128_binomialInversion(n, p)
+                                          : rnd_128_binomialBtrd(n, p);
+}
+
+
+
+/**
+ * @fn uint32_t rnd_128_bounded (uint32_t range)
+ *
+ * @brief A uniform integer in [0, range), without modulo bias (Lemire's
+ *        multiply-and-reject; a division only on the rare rejection path).
+ *
+ * @return 0 if 'range' is 0.
+ */
+uint32_t rnd_128_bounded(uint32_t range) {
+    return rnd_128_boundedState(&s_128, range);
+}
+
+
+
+/**
+ * @fn void rnd_128_boundedMany (uint32_t *out, size_t n, uint32_t range)
+ *
+ * @brief rnd_128_bounded() 'n' times: draws from rnd_128_fill() reduced in
+ *        batches, with one division per call.
+ */
+void rnd_128_boundedMany(uint32_t *out, size_t n, uint32_t range) {
+    uint64_t words[RND_BATCH];
+
+    if(range <= 1) {
+        for(size_t i = 0; i < n; i++) {
+            out[i] = 0;
+        }
+        return;
+    }
+
+    uint32_t threshold = (uint32_t)-range % range;
+    while(n) {
+        size_t count = n;
+        if(count > RND_BATCH) {
+            count = RND_BATCH;
+        }
+
+        rnd_128_fill(words, count);
+        size_t done = rnd_128_reduce(words, count, range, threshold, out, n);
+        out += done;
+        n -= done;
+    }
+
+    return;
+}
+
+
+
+/**
+ * @fn uint32_t rnd_128_boundedState (struct rnd_128 *state, uint32_t range)
+ *
+ * @brief rnd_128_bounded() on a caller's generator.
+ */
+uint32_t rnd_128_boundedState(struct rnd_128 *state, uint32_t range) {
+    uint64_t m = (rnd_128_nextState(state) >> 32) * (uint64_t)range;
+    uint32_t low = (uint32_t)m;
+
+    if(low < range) {
+        //2^32 mod range: the low products that would favor some results
+        uint32_t threshold = (uint32_t)-range % range;
+        while(low < threshold) {
+            m = (rnd_128_nextState(state) >> 32) * (uint64_t)range;
+            low = (uint32_t)m;
+        }
+    }
+
+    return (uint32_t)(m >> 32);
+}
+
+
+
+/**
+ * @fn uint64_t rnd_128_coins (uint64_t n)
+ *
+ * @brief The number of heads in 'n' fair coin flips: the popcount of random
+ *        bits for small 'n', rnd_128_binomial() beyond.
+ */
+uint64_t rnd_128_coins(uint64_t n) {
+    if(n > RND_COINS_MAX) {
+        return rnd_128_binomial(n, 0.5);
+    }
+
+    uint64_t heads = 0;
+    for(; n >= 64; n -= 64) {
+        heads += rnd_popcount(rnd_128_next());
+    }
+    if(n) {
+        heads += rnd_popcount(rnd_128_next() >> (64 - n));
+    }
+
+    return heads;
+}
+
+
+
+/**
+ * @fn double rnd_128_double (void)
+ *
+ * @brief A uniform double in [0, 1) with 53 random bits.
+ */
+double rnd_128_double(void) {
+    return (double)(rnd_128_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+/**
+ * @fn void rnd_128_fill (uint64_t *out, size_t n)
+ *
+ * @brief Write 'n' random numbers to 'out' from two interleaved xorshift128+
+ *        streams, stepped together in SIMD registers where available; the
+ *        scalar build gives the same numbers.
+ */
+void rnd_128_fill(uint64_t *out, size_t n) {
+    size_t i = 0;
+
+    if( !(s_128x2[0].s[0] | s_128x2[0].s[1]) ) {
+        rnd_128_initLanes();
+    }
+
+#ifdef __SSE2__
+    __m128i s0 = _mm_set_epi64x((long long)s_128x2[1].s[0], (long long)s_128x2[0].s[0]),
+            s1 = _mm_set_epi64x((long long)s_128x2[1].s[1], (long long)s_128x2[0].s[1]);
+
+    for(; i + 2 <= n; i += 2) {
+        _mm_storeu_si128((__m128i *)(out + i), _mm_add_epi64(s0, s1));
+
+        s1 = _mm_xor_si128(s1, s0);
+        s0 = _mm_xor_si128(_mm_xor_si128(_mm_or_si128(_mm_slli_epi64(s0, 55), _mm_srli_epi64(s0, 9)), s1),
+                           _mm_slli_epi64(s1, 14));
+        s1 = _mm_or_si128(_mm_slli_epi64(s1, 36), _mm_srli_epi64(s1, 28));
+    }
+
+    uint64_t lanes[2][2];
+    _mm_storeu_si128((__m128i *)lanes[0], s0);
+    _mm_storeu_si128((__m128i *)lanes[1], s1);
+    for(int k = 0; k < 2; k++) {
+        s_128x2[k].s[0] = lanes[0][k];
+        s_128x2[k].s[1] = lanes[1][k];
+    }
+#endif /*__SSE2__*/
+
+    for(; i < n; i++) {
+        out[i] = rnd_128_nextState(&s_128x2[i & 1]);
+    }
+
     return;
 }
 
@@ -58,21 +478,32 @@ static void rnd_128_init_timeEntropy(void) {
  *        non-overlapping subsequences for parallel computations.
  */
 void rnd_128_jump(void) {
+    rnd_128_jumpState(&s_128);
+}
+
+
+
+/**
+ * @fn void rnd_128_jumpState (struct rnd_128 *state)
+ *
+ * @brief rnd_128_jump() on a caller's generator.
+ */
+void rnd_128_jumpState(struct rnd_128 *state) {
     static const uint64_t JUMP[] = { 0xbeac0467eba5facb, 0xd86b048b86aa9922 };
     uint64_t s0 = 0, s1 = 0;
 
     for(int i = 0; i < sizeof JUMP / sizeof *JUMP; i++) {
         for(int b = 0; b < 64; b++) {
             if (JUMP[i] & UINT64_C(1) << b) {
-                s0 ^= s_128[0];
-                s1 ^= s_128[1];
+                s0 ^= state->s[0];
+                s1 ^= state->s[1];
             }
-            rnd_128_next();
+            rnd_128_nextState(state);
         }
     }
 
-    s_128[0] = s0;
-    s_128[1] = s1;
+    state->s[0] = s0;
+    state->s[1] = s1;
 }
 
 
@@ -85,19 +516,53 @@ void rnd_128_jump(void) {
  * @return The next random number.
  */
 uint64_t rnd_128_next(void) {
-    const uint64_t s0 = s_128[0];
-    uint64_t s1 = s_128[1];
+    return rnd_128_nextState(&s_128);
+}
+
+
+
+/**
+ * @fn uint64_t rnd_128_nextState (struct rnd_128 *state)
+ *
+ * @brief Retrieve the next random number of a caller's generator.
+ *
+ * @return The next random number.
+ */
+uint64_t rnd_128_nextState(struct rnd_128 *state) {
+    const uint64_t s0 = state->s[0];
+    uint64_t s1 = state->s[1];
     const uint64_t result = s0 + s1;
 
     s1 ^= s0;
-    s_128[0] = rnd_128_rotl(s0, 55) ^ s1 ^ (s1 << 14); // a, b
-    s_128[1] = rnd_128_rotl(s1, 36); // c
+    state->s[0] = rnd_128_rotl(s0, 55) ^ s1 ^ (s1 << 14); // a, b
+    state->s[1] = rnd_128_rotl(s1, 36); // c
 
     return result;
 }
 
 
 
+/**
+ * @fn void rnd_128_seed (struct rnd_128 *state, uint64_t seed)
+ *
+ * @brief Seed a caller's generator from a 64 bit value, expanded with
+ *        splitmix64 so that close seeds give unrelated streams and the
+ *        state is never all zero.
+ */
+void rnd_128_seed(struct rnd_128 *state, uint64_t seed) {
+    for(int i = 0; i < 2; i++) {
+        uint64_t z = (seed += UINT64_C(0x9e3779b97f4a7c15));
+        z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+        state->s[i] = z ^ (z >> 31);
+    }
+    if(!state->s[0] && !state->s[1]) {
+        state->s[0] = 1;
+    }
+}
+
+
+
 /**
  * @fn void rnd_init (void)
  *
@@ -110,14 +575,20 @@ void rnd_init(void) {
 
     if(filedesc != -1) {
         size_t seed_size = sizeof(uint64_t)*2;
-        if(read(filedesc, s_128, seed_size) != ((ssize_t)seed_size)) {
+        if(read(filedesc, s_128.s, seed_size) != ((ssize_t)seed_size)) {
             rnd_128_init_timeEntropy();
-            return;
         }
+        close(filedesc);
     }
     else {
         rnd_128_init_timeEntropy();
     }
+
+    //the all zero state never leaves zero
+    if(!s_128.s[0] && !s_128.s[1]) {
+        s_128.s[0] = 1;
+    }
+    rnd_128_initLanes();
     return;
 }
 
@@ -144,14 +615,14 @@ double rnd_normal( double x )
     double t,
            series;
     const double b1 =  0.319381530,
-                 b2 = -0.356563782,gkfdjskgfijgkgjpjgdfgdsf
+                 b2 = -0.356563782,
                  b3 =  1.781477937,
                  b4 = -1.821255978,
                  b5 =  1.330274429,
                  p  =  0.2316419,
                  c  =  0.39894228;
 
-    t = 1. / ( 1. + p * FABS(x) );
+    t = 1. / ( 1. + p * fabs(x) );
     series = (1. - c * exp( -x * x / 2. ) * t *
             ( t *( t * ( t * ( t * b5 + b4 ) + b3 ) + b2 ) + b1 ));
     return (x > 0.) ? 1. - series : series;
@@ -1,10 +1,30 @@
 #ifndef RND_H
 #define RND_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-extern void     rnd_128_jump (void);
-extern uint64_t rnd_128_next (void);
-extern void     rnd_init     (void);
+/**
+ * @struct rnd_128
+ *         State of a xorshift128+ generator; never all zero.
+ */
+struct rnd_128 {
+    uint64_t s[2];
+};
+
+extern uint64_t rnd_128_binomial     (uint64_t n, double p);
+extern uint32_t rnd_128_bounded      (uint32_t range);
+extern void     rnd_128_boundedMany  (uint32_t *out, size_t n, uint32_t range);
+extern uint32_t rnd_128_boundedState (struct rnd_128 *state, uint32_t range);
+extern uint64_t rnd_128_coins        (uint64_t n);
+extern double   rnd_128_double       (void);
+extern void     rnd_128_fill         (uint64_t *out, size_t n);
+extern void     rnd_128_jump         (void);
+extern void     rnd_128_jumpState    (struct rnd_128 *state);
+extern uint64_t rnd_128_next         (void);
+extern uint64_t rnd_128_nextState    (struct rnd_128 *state);
+extern void     rnd_128_seed         (struct rnd_128 *state, uint64_t seed);
+extern void     rnd_init             (void);
+extern double   rnd_normal           (double x);
 
 #endif
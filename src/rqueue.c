@@ -0,0 +1,354 @@
+/*
+ * rqueue.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief Per-frame render command queue. Game code pushes (layer, tile, dest,
+ *        flags) commands while it updates; rqueue_flush() radix-sorts them by
+ *        layer, then by source surface, and hands the whole frame to the
+ *        render backend in one pass. Commands outside the viewport are culled
+ *        when they are pushed. The queue's buffers only grow, so once it has
+ *        seen its largest frame it never allocates again.
+ *
+ * Field Overview:
+ *  static:
+ *      rqueue
+ *      rqueue_grow
+ *      rqueue_sort
+ *  extern:
+ *      rqueue_clear
+ *      rqueue_close
+ *      rqueue_flush
+ *      rqueue_getStats
+ *      rqueue_init
+ *      rqueue_push
+ *      rqueue_pushImage
+ *      rqueue_setViewport
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "debug.h"
+#include "image.h"
+#include "registry.h"
+#include "render.h"
+#include "rqueue.h"
+#include "tile.h"
+
+#define RQUEUE_INITIAL_CAPACITY 1024
+
+
+
+/**
+ * @brief Queue state.
+ * @var commands
+ *      Commands in push order; their sort keys live in 'keys'.
+ * @var keys
+ *      (sort key << 32) | command index, one per command.
+ * @var scratch
+ *      Second key buffer for the radix sort.
+ * @var copies
+ *      Sorted frame handed to render_submit().
+ * @var count
+ *      Number of commands pushed this frame.
+ * @var capacity
+ *      Length of every buffer above.
+ * @var viewport
+ *      Commands that miss this rectangle are culled (if 'cull').
+ * @var cull
+ *      Whether a viewport is set.
+ * @var frame
+ *      Counters of the frame being built.
+ * @var stats
+ *      Counters of the last flushed frame.
+ */
+static struct {
+    struct render_copy *commands;
+    uint64_t *keys;
+    uint64_t *scratch;
+    struct render_copy *copies;
+    size_t count;
+    size_t capacity;
+    SDL_Rect viewport;
+    int cull;
+    struct rqueue_stats frame;
+    struct rqueue_stats stats;
+} rqueue = { NULL, NULL, NULL, NULL, 0, 0, { 0, 0, 0, 0 }, 0,
+             { 0, 0, 0, 0, 0, 0.0, 0 }, { 0, 0, 0, 0, 0, 0.0, 0 } };
+
+
+
+/**
+ * @brief Grow every buffer to hold 'capacity' commands.
+ *
+ * @return RQUEUE_SUCCESS or RQUEUE_FAILURE.
+ */
+static int rqueue_grow(size_t capacity) {
+    struct render_copy *commands, *copies;
+    uint64_t *keys, *scratch;
+
+    //each realloc() is committed immediately so a later failure leaves the queue consistent
+    if( !(commands = realloc(rqueue.commands, capacity * sizeof(struct render_copy))) ) {
+        goto error;
+    }
+    rqueue.commands = commands;
+
+    if( !(keys = realloc(rqueue.keys, capacity * sizeof(uint64_t))) ) {
+        goto error;
+    }
+    rqueue.keys = keys;
+
+    if( !(scratch = realloc(rqueue.scratch, capacity * sizeof(uint64_t))) ) {
+        goto error;
+    }
+    rqueue.scratch = scratch;
+
+    if( !(copies = realloc(rqueue.copies, capacity * sizeof(struct render_copy))) ) {
+        goto error;
+    }
+    rqueue.copies = copies;
+
+    rqueue.capacity = capacity;
+    rqueue.frame.capacity = capacity;
+    return RQUEUE_SUCCESS;
+
+error:
+    dbgprint("rqueue_grow: Unable to grow the render queue to %lu commands: %s\n",
+             (unsigned long)capacity, ERROR_REALLOC);
+
+    return RQUEUE_FAILURE;
+}
+
+
+
+/**
+ * @brief Stable LSD radix sort of 'count' keys on their upper 32 bits, one
+ *        byte per pass. Passes in which every key has the same byte are
+ *        skipped, so a frame with few layers and sources sorts in one or two.
+ *
+ * @return The buffer that holds the sorted keys ('keys' or 'scratch').
+ */
+static uint64_t *rqueue_sort(uint64_t *keys, uint64_t *scratch, size_t count) {
+    size_t histogram[256], i, sum, n;
+    uint64_t *swap;
+    int shift;
+
+    for(shift = 32; shift < 64; shift += 8) {
+        memset(histogram, 0, sizeof(histogram));
+        for(i = 0; i < count; i++) {
+            histogram[(keys[i] >> shift) & 0xff]++;
+        }
+        if(histogram[(keys[0] >> shift) & 0xff] == count) {
+            continue;   //every key has this byte
+        }
+
+        for(i = 0, sum = 0; i < 256; i++) {
+            n = histogram[i];
+            histogram[i] = sum;
+            sum += n;
+        }
+        for(i = 0; i < count; i++) {
+            scratch[histogram[(keys[i] >> shift) & 0xff]++] = keys[i];
+        }
+
+        swap = keys;
+        keys = scratch;
+        scratch = swap;
+    }
+
+    return keys;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Drop every command pushed this frame without drawing it.
+ */
+void rqueue_clear(void) {
+    rqueue.count = 0;
+    memset(&rqueue.frame, 0, sizeof(struct rqueue_stats));
+    rqueue.frame.capacity = rqueue.capacity;
+    return;
+}
+
+
+
+/**
+ * @brief Free the queue's buffers.
+ */
+void rqueue_close(void) {
+    free(rqueue.commands);
+    free(rqueue.keys);
+    free(rqueue.scratch);
+    free(rqueue.copies);
+
+    rqueue.commands = NULL;
+    rqueue.keys = NULL;
+    rqueue.scratch = NULL;
+    rqueue.copies = NULL;
+    rqueue.count = 0;
+    rqueue.capacity = 0;
+
+    return;
+}
+
+
+
+/**
+ * @brief Sort the frame by layer and source, draw it through the render
+ *        backend and clear the queue for the next frame.
+ *
+ * @return The number of commands drawn.
+ */
+size_t rqueue_flush(void) {
+    const struct image_source *previous = NULL;
+    uint64_t *sorted;
+    size_t i;
+
+    if(!rqueue.count) {
+        rqueue.stats = rqueue.frame;
+        rqueue_clear();
+        return 0;
+    }
+
+    Uint64 started = SDL_GetPerformanceCounter();
+    sorted = rqueue_sort(rqueue.keys, rqueue.scratch, rqueue.count);
+    rqueue.frame.sort = (double)(SDL_GetPerformanceCounter() - started) * 1000.0 /
+                        (double)SDL_GetPerformanceFrequency();
+
+    for(i = 0; i < rqueue.count; i++) {
+        rqueue.copies[i] = rqueue.commands[sorted[i] & UINT32_MAX];
+
+        //by pointer: every anonymous source shares key slot 0
+        if( rqueue.copies[i].image->source != previous ) {
+            previous = rqueue.copies[i].image->source;
+            rqueue.frame.switches++;
+        }
+    }
+
+    rqueue.frame.drawn = render_submit(rqueue.copies, rqueue.count);
+
+    rqueue.stats = rqueue.frame;
+    rqueue_clear();
+
+    return rqueue.stats.drawn;
+}
+
+
+
+/**
+ * @brief Retrieve the counters of the last flushed frame.
+ */
+void rqueue_getStats(struct rqueue_stats *stats) {
+    if(stats) {
+        *stats = rqueue.stats;
+    }
+    return;
+}
+
+
+
+/**
+ * @brief Allocate the queue's buffers.
+ *
+ * @param hint
+ *        Expected number of commands per frame (may be 0).
+ *
+ * @return RQUEUE_SUCCESS or RQUEUE_FAILURE.
+ */
+int rqueue_init(size_t hint) {
+    if(rqueue.capacity) {
+        return RQUEUE_SUCCESS;
+    }
+
+    rqueue_clear();
+    return rqueue_grow(hint ? hint : RQUEUE_INITIAL_CAPACITY);
+}
+
+
+
+/**
+ * @brief Queue a tile to be drawn this frame.
+ *
+ * @param layer
+ *        Layer of the command; lower layers are drawn first. Within a layer,
+ *        commands are grouped by source, so only their order per source is kept.
+ * @param tile
+ *        The tile to draw.
+ * @param dest
+ *        Region of the window to draw to.
+ * @param flags
+ *        RENDER_FLIP_* flags.
+ *
+ * @return RQUEUE_SUCCESS, or RQUEUE_FAILURE if the command was culled or dropped.
+ */
+int rqueue_push(uint8_t layer, struct tile *tile, const SDL_Rect *dest, unsigned int flags) {
+    if(!tile) { return RQUEUE_FAILURE; }
+
+    return rqueue_pushImage(layer, tile->src, &tile->rect, dest, flags);
+}
+
+
+
+/**
+ * @brief Queue a region of an image to be drawn this frame; see rqueue_push().
+ *
+ * @param src
+ *        Region of the image to draw.
+ */
+int rqueue_pushImage(uint8_t layer, struct image *image, const SDL_Rect *src, const SDL_Rect *dest,
+                     unsigned int flags) {
+    if(!image || !src || !dest) { return RQUEUE_FAILURE; }
+
+    rqueue.frame.pushed++;
+
+    if( rqueue.cull && !SDL_HasIntersection(dest, &rqueue.viewport) ) {
+        rqueue.frame.culled++;
+        return RQUEUE_FAILURE;
+    }
+
+    if( rqueue.count == rqueue.capacity &&
+        !rqueue_grow(rqueue.capacity ? rqueue.capacity * 2 : RQUEUE_INITIAL_CAPACITY) ) {
+        rqueue.frame.dropped++;
+        return RQUEUE_FAILURE;
+    }
+
+    uint32_t key = ((uint32_t)layer << RQUEUE_LAYER_SHIFT) |
+                   (image->source->handle & RQUEUE_SOURCE_MASK);
+
+    rqueue.commands[rqueue.count].image = image;
+    rqueue.commands[rqueue.count].src = *src;
+    rqueue.commands[rqueue.count].dest = *dest;
+    rqueue.commands[rqueue.count].flags = flags;
+    rqueue.keys[rqueue.count] = ((uint64_t)key << 32) | rqueue.count;
+    rqueue.count++;
+
+    return RQUEUE_SUCCESS;
+}
+
+
+
+/**
+ * @brief Set the rectangle outside of which commands are culled.
+ *
+ * @param viewport
+ *        The rectangle, or NULL to draw every command.
+ */
+void rqueue_setViewport(const SDL_Rect *viewport) {
+    if(viewport) {
+        rqueue.viewport = *viewport;
+    }
+    rqueue.cull = viewport != NULL;
+
+    return;
+}
@@ -0,0 +1,68 @@
+/*
+ * rqueue.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef RQUEUE_H
+#define RQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "image.h"
+#include "registry.h"
+#include "tile.h"
+
+#define RQUEUE_SUCCESS  1
+#define RQUEUE_FAILURE  0
+
+/* The sort key: the layer in the high bits, the source of the tile (its
+ * image source's registry slot) in the low bits. Anonymous sources, which
+ * have no slot, all sort as slot 0 (see image_create_anonymous()). */
+#define RQUEUE_LAYER_SHIFT  REGISTRY_INDEX_BITS
+#define RQUEUE_SOURCE_MASK  REGISTRY_INDEX_MASK
+
+/**
+ * @struct rqueue_stats
+ *         Counters of the last rqueue_flush(), see rqueue_getStats().
+ * @var pushed
+ *      Commands pushed during the frame.
+ * @var culled
+ *      Commands outside the viewport.
+ * @var drawn
+ *      Commands drawn by the render backend.
+ * @var dropped
+ *      Commands lost because the queue could not grow.
+ * @var switches
+ *      Source switches in the sorted frame.
+ * @var sort
+ *      Time spent sorting, in milliseconds.
+ * @var capacity
+ *      Commands the queue holds without allocating.
+ */
+struct rqueue_stats {
+    unsigned long pushed;
+    unsigned long culled;
+    unsigned long drawn;
+    unsigned long dropped;
+    unsigned long switches;
+    double sort;
+    size_t capacity;
+};
+
+/*
+ * Function declarations.
+ */
+extern void    rqueue_clear       (void);
+extern void    rqueue_close       (void);
+extern size_t  rqueue_flush       (void);
+extern void    rqueue_getStats    (struct rqueue_stats *stats);
+extern int     rqueue_init        (size_t hint);
+extern int     rqueue_push        (uint8_t layer, struct tile *tile, const SDL_Rect *dest, unsigned int flags);
+extern int     rqueue_pushImage   (uint8_t layer, struct image *image, const SDL_Rect *src, const SDL_Rect *dest, unsigned int flags);
+extern void    rqueue_setViewport (const SDL_Rect *viewport);
+
+#endif /*RQUEUE_H*/
@@ -0,0 +1,648 @@
+/**
+ * @file spatial.c
+ *
+ * @brief Spatial index of entities on a map. Entities are caller ids placed on
+ *        cells; the map is cut into square buckets aligned on its chunks, and
+ *        each bucket keeps the ids and positions of its entities packed in one
+ *        shared pool, buckets of the same chunk side by side. Inserting,
+ *        moving and removing an entity take constant time, and queries only
+ *        read the buckets they overlap.
+ *
+ *        A bucket that fills up moves to the end of the pool with twice its
+ *        room; the holes left behind are reclaimed by spatial_rebuild(), a
+ *        counting sort of every entity by bucket, which spatial_build() also
+ *        uses to load many entities at once.
+ *
+ * Field Overview:
+ *  static:
+ *      spatial_bucket
+ *      spatial_grow
+ *      spatial_layout
+ *      spatial_reserve
+ *      spatial_take
+ *  extern:
+ *      spatial_build
+ *      spatial_count
+ *      spatial_create
+ *      spatial_free
+ *      spatial_getPosition
+ *      spatial_insert
+ *      spatial_move
+ *      spatial_queryLine
+ *      spatial_queryRadius
+ *      spatial_queryRect
+ *      spatial_rebuild
+ *      spatial_remove
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "map.h"
+#include "path.h"
+#include "spatial.h"
+
+#define SPATIAL_NONE        UINT32_MAX  //bucket of ids not in the index
+#define SPATIAL_PER_CHUNK   (1u << (2 * (MAP_CHUNK_SHIFT - SPATIAL_SHIFT)))
+
+/**
+ * @struct spatial_entry
+ *         An entity in a bucket.
+ */
+struct spatial_entry {
+    int32_t x;
+    int32_t y;
+    uint32_t id;
+};
+
+/**
+ * @struct spatial_bucket
+ *         Entries pool[start, start + count) of a bucket, room for 'capacity'.
+ */
+struct spatial_bucket {
+    uint32_t start;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+/**
+ * @struct spatial_entity
+ *         Where an id is: entry 'slot' of bucket 'bucket', or SPATIAL_NONE.
+ */
+struct spatial_entity {
+    uint32_t bucket;
+    uint32_t slot;
+};
+
+/**
+ * @struct spatial
+ *         Spatial index of a map.
+ * @var buckets, nbuckets
+ *      Buckets, chunk by chunk: bucket (bx, by) is number
+ *      (bx, by) % SPATIAL_PER_CHUNK of its chunk.
+ * @var pool, used, capacity
+ *      Entries of every bucket; pool[0, used) is taken by buckets or holes.
+ * @var reserved
+ *      Sum of the bucket capacities; used - reserved entries are holes.
+ * @var entities, nentities
+ *      Location of every id below nentities.
+ */
+struct spatial {
+    const struct map *map;
+    unsigned int buckets_w;
+    unsigned int buckets_h;
+    struct spatial_bucket *buckets;
+    size_t nbuckets;
+    struct spatial_entry *pool;
+    size_t used;
+    size_t capacity;
+    size_t reserved;
+    size_t count;
+    struct spatial_entity *entities;
+    size_t nentities;
+};
+
+
+
+/**
+ * @brief Bucket of cell (x, y), which must be on the map.
+ */
+static inline uint32_t spatial_bucket(const struct spatial *s, int x, int y) {
+    const unsigned int bx = (unsigned int)x >> SPATIAL_SHIFT, by = (unsigned int)y >> SPATIAL_SHIFT;
+    const unsigned int per_side = MAP_CHUNK_SIZE >> SPATIAL_SHIFT;
+    const size_t chunk = (size_t)(by / per_side) * s->map->chunks_w + bx / per_side;
+
+    return (uint32_t)(chunk * SPATIAL_PER_CHUNK + (by % per_side) * per_side + bx % per_side);
+}
+
+
+
+/**
+ * @brief Make room for 'count' more entries at the end of the pool.
+ *
+ * @return SPATIAL_SUCCESS or SPATIAL_FAILURE.
+ */
+static int spatial_reserve(struct spatial *s, size_t count) {
+    struct spatial_entry *pool;
+    size_t capacity;
+
+    if(s->used + count <= s->capacity) { return SPATIAL_SUCCESS; }
+
+    for(capacity = s->capacity ? s->capacity : 256; capacity < s->used + count; capacity *= 2);
+    if( !(pool = realloc(s->pool, capacity * sizeof(struct spatial_entry))) ) {
+        dbgprint("spatial_reserve: %s\n", ERROR_REALLOC);
+        return SPATIAL_FAILURE;
+    }
+    s->pool = pool;
+    s->capacity = capacity;
+
+    return SPATIAL_SUCCESS;
+}
+
+
+
+/**
+ * @brief Ensure id 'id' has an entity slot.
+ *
+ * @return SPATIAL_SUCCESS or SPATIAL_FAILURE.
+ */
+static int spatial_grow(struct spatial *s, uint32_t id) {
+    struct spatial_entity *entities;
+    size_t n, i;
+
+    if(id < s->nentities) { return SPATIAL_SUCCESS; }
+
+    for(n = s->nentities ? s->nentities : 64; n <= id; n *= 2);
+    if( !(entities = realloc(s->entities, n * sizeof(struct spatial_entity))) ) {
+        dbgprint("spatial_grow: %s\n", ERROR_REALLOC);
+        return SPATIAL_FAILURE;
+    }
+    for(i = s->nentities; i < n; i++) {
+        entities[i].bucket = SPATIAL_NONE;
+    }
+    s->entities = entities;
+    s->nentities = n;
+
+    return SPATIAL_SUCCESS;
+}
+
+
+
+/**
+ * @brief Lay the buckets out again in a new pool, in bucket order without
+ *        holes, each with room for half as many entries again as it holds.
+ *        Their entries are copied from 'from' if not NULL.
+ *
+ * @return SPATIAL_SUCCESS or SPATIAL_FAILURE.
+ */
+static int spatial_layout(struct spatial *s, const struct spatial_entry *from) {
+    struct spatial_entry *pool;
+    struct spatial_bucket *bucket;
+    size_t b, total = 0;
+
+    for(b = 0; b < s->nbuckets; b++) {
+        if(s->buckets[b].count) {
+            total += s->buckets[b].count + s->buckets[b].count / 2 + 1;
+        }
+    }
+
+    if( !(pool = malloc((total ? total : 1) * sizeof(struct spatial_entry))) ) {
+        dbgprint("spatial_layout: %s\n", ERROR_MALLOC);
+        return SPATIAL_FAILURE;
+    }
+
+    for(b = 0, total = 0; b < s->nbuckets; b++) {
+        bucket = &s->buckets[b];
+        if(from && bucket->count) {
+            memcpy(pool + total, from + bucket->start, bucket->count * sizeof(struct spatial_entry));
+        }
+        bucket->start = (uint32_t)total;
+        bucket->capacity = bucket->count ? bucket->count + bucket->count / 2 + 1 : 0;
+        total += bucket->capacity;
+    }
+
+    free(s->pool);
+    s->pool = pool;
+    s->used = s->reserved = total;
+    s->capacity = total ? total : 1;
+
+    return SPATIAL_SUCCESS;
+}
+
+
+
+/**
+ * @brief Take the entry of an id out of its bucket, moving the bucket's last
+ *        entry into its place.
+ */
+static void spatial_take(struct spatial *s, uint32_t id) {
+    struct spatial_entity *entity = &s->entities[id];
+    struct spatial_bucket *bucket = &s->buckets[entity->bucket];
+    struct spatial_entry *last = &s->pool[bucket->start + --bucket->count];
+
+    if(entity->slot != bucket->count) {
+        s->pool[bucket->start + entity->slot] = *last;
+        s->entities[last->id].slot = entity->slot;
+    }
+    entity->bucket = SPATIAL_NONE;
+    s->count--;
+
+    return;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Replace the contents of an index with many entities at once, sorted
+ *        into their buckets in two passes. Faster than as many
+ *        spatial_insert(), and leaves no holes.
+ *
+ * @param ids
+ *        'count' distinct ids.
+ * @param points
+ *        Their cells, which must be on the map.
+ *
+ * @return SPATIAL_SUCCESS, or SPATIAL_FAILURE and an empty index.
+ */
+int spatial_build(struct spatial *s, const uint32_t *ids, const struct path_point *points, size_t count) {
+    struct spatial_entity *entity;
+    struct spatial_bucket *bucket;
+    struct spatial_entry *entry;
+    size_t i, max = 0;
+
+    if(!s) { return SPATIAL_FAILURE; }
+    if( count && (!ids || !points) ) {
+        dbgprint("spatial_build: formal params 'ids', 'points': %s\n", ERROR_NULL_POINTER);
+        return SPATIAL_FAILURE;
+    }
+
+    for(i = 0; i < s->nentities; i++) {
+        s->entities[i].bucket = SPATIAL_NONE;
+    }
+    for(i = 0; i < s->nbuckets; i++) {
+        s->buckets[i].count = 0;
+    }
+    s->count = 0;
+
+    for(i = 0; i < count; i++) {
+        if( (unsigned int)points[i].x >= s->map->width || (unsigned int)points[i].y >= s->map->height ) {
+            dbgprint("spatial_build: Entity %u is off map %s.\n", ids[i], s->map->tag);
+            break;
+        }
+        if(ids[i] > max) { max = ids[i]; }
+        s->buckets[spatial_bucket(s, points[i].x, points[i].y)].count++;
+    }
+    if( i < count || (count && !spatial_grow(s, (uint32_t)max)) || !spatial_layout(s, NULL) ) {
+        for(i = 0; i < s->nbuckets; i++) {
+            s->buckets[i].count = 0;
+        }
+        spatial_layout(s, NULL);
+        return SPATIAL_FAILURE;
+    }
+
+    //scatter: the counts fill up again as entries land
+    for(i = 0; i < s->nbuckets; i++) {
+        s->buckets[i].count = 0;
+    }
+    for(i = 0; i < count; i++) {
+        entity = &s->entities[ids[i]];
+        entity->bucket = spatial_bucket(s, points[i].x, points[i].y);
+        bucket = &s->buckets[entity->bucket];
+        entity->slot = bucket->count++;
+
+        entry = &s->pool[bucket->start + entity->slot];
+        entry->x = points[i].x;
+        entry->y = points[i].y;
+        entry->id = ids[i];
+    }
+    s->count = count;
+
+    return SPATIAL_SUCCESS;
+}
+
+
+
+/**
+ * @brief Number of entities in an index.
+ */
+size_t spatial_count(const struct spatial *s) {
+    return s ? s->count : 0;
+}
+
+
+
+/**
+ * @brief Create an empty spatial index over a map.
+ *
+ * @param m
+ *        The map; it must outlive the index.
+ *
+ * @return The index, or NULL on failure.
+ */
+struct spatial *spatial_create(const struct map *m) {
+    struct spatial *s;
+
+    if(!m) {
+        dbgprint("spatial_create: formal param 'm': %s\n", ERROR_NULL_POINTER);
+        return NULL;
+    }
+
+    if( !(s = calloc(1, sizeof(struct spatial))) ) {
+        dbgprint("spatial_create: %s\n", ERROR_CALLOC);
+        return NULL;
+    }
+    s->map = m;
+    s->buckets_w = (m->width + SPATIAL_SIZE - 1) >> SPATIAL_SHIFT;
+    s->buckets_h = (m->height + SPATIAL_SIZE - 1) >> SPATIAL_SHIFT;
+    s->nbuckets = (size_t)m->chunks_w * m->chunks_h * SPATIAL_PER_CHUNK;
+
+    if( !(s->buckets = calloc(s->nbuckets, sizeof(struct spatial_bucket))) ) {
+        dbgprint("spatial_create: %s\n", ERROR_CALLOC);
+        spatial_free(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+
+
+/**
+ * @brief Free a spatial index.
+ */
+void spatial_free(struct spatial *s) {
+    if(!s) { return; }
+
+    free(s->buckets);
+    free(s->pool);
+    free(s->entities);
+    free(s);
+
+    return;
+}
+
+
+
+/**
+ * @brief Retrieve the cell of an entity.
+ *
+ * @return SPATIAL_SUCCESS, or SPATIAL_FAILURE if the id is not in the index.
+ */
+int spatial_getPosition(const struct spatial *s, uint32_t id, struct path_point *where) {
+    const struct spatial_entry *entry;
+
+    if( !s || id >= s->nentities || s->entities[id].bucket == SPATIAL_NONE ) { return SPATIAL_FAILURE; }
+
+    entry = &s->pool[s->buckets[s->entities[id].bucket].start + s->entities[id].slot];
+    if(where) {
+        where->x = entry->x;
+        where->y = entry->y;
+    }
+
+    return SPATIAL_SUCCESS;
+}
+
+
+
+/**
+ * @brief Add an entity to an index.
+ *
+ * @param id
+ *        Caller id of the entity, not already in the index. Ids index an
+ *        array, so they should be small and dense.
+ *
+ * @return SPATIAL_SUCCESS or SPATIAL_FAILURE.
+ */
+int spatial_insert(struct spatial *s, uint32_t id, int x, int y) {
+    struct spatial_bucket *bucket;
+    struct spatial_entry *entry;
+    uint32_t b, capacity;
+
+    if(!s || id == SPATIAL_NONE) { return SPATIAL_FAILURE; }
+    if( (unsigned int)x >= s->map->width || (unsigned int)y >= s->map->height ) {
+        dbgprint("spatial_insert: Entity %u is off map %s.\n", id, s->map->tag);
+        return SPATIAL_FAILURE;
+    }
+    if( !spatial_grow(s, id) ) { return SPATIAL_FAILURE; }
+    if(s->entities[id].bucket != SPATIAL_NONE) {
+        dbgprint("spatial_insert: Entity %u is already indexed.\n", id);
+        return SPATIAL_FAILURE;
+    }
+
+    b = spatial_bucket(s, x, y);
+    bucket = &s->buckets[b];
+    if(bucket->count == bucket->capacity) {
+        capacity = bucket->capacity ? bucket->capacity * 2 : 4;
+
+        //out of room, and holes make up a third of the pool: compact it instead of growing it
+        if(s->used + capacity > s->capacity && (s->used - s->reserved) * 2 >= s->reserved) {
+            if( !spatial_rebuild(s) ) { return SPATIAL_FAILURE; }
+        }
+        if(bucket->count == bucket->capacity) {
+            if( !spatial_reserve(s, capacity) ) { return SPATIAL_FAILURE; }
+            memcpy(s->pool + s->used, s->pool + bucket->start, bucket->count * sizeof(struct spatial_entry));
+            bucket->start = (uint32_t)s->used;
+            s->used += capacity;
+            s->reserved += capacity - bucket->capacity;
+            bucket->capacity = capacity;
+        }
+    }
+
+    s->entities[id].bucket = b;
+    s->entities[id].slot = bucket->count;
+    entry = &s->pool[bucket->start + bucket->count++];
+    entry->x = x;
+    entry->y = y;
+    entry->id = id;
+    s->count++;
+
+    return SPATIAL_SUCCESS;
+}
+
+
+
+/**
+ * @brief Move an entity to another cell.
+ *
+ * @return SPATIAL_SUCCESS, or SPATIAL_FAILURE if the id is not in the index
+ *         or the cell is off the map. An entity that cannot be moved for
+ *         lack of memory is removed.
+ */
+int spatial_move(struct spatial *s, uint32_t id, int x, int y) {
+    struct spatial_entity *entity;
+    struct spatial_entry *entry;
+
+    if( !s || id >= s->nentities || s->entities[id].bucket == SPATIAL_NONE ) { return SPATIAL_FAILURE; }
+    if( (unsigned int)x >= s->map->width || (unsigned int)y >= s->map->height ) {
+        dbgprint("spatial_move: Entity %u is off map %s.\n", id, s->map->tag);
+        return SPATIAL_FAILURE;
+    }
+
+    entity = &s->entities[id];
+    if(spatial_bucket(s, x, y) == entity->bucket) {
+        entry = &s->pool[s->buckets[entity->bucket].start + entity->slot];
+        entry->x = x;
+        entry->y = y;
+        return SPATIAL_SUCCESS;
+    }
+
+    spatial_take(s, id);
+
+    return spatial_insert(s, id, x, y);
+}
+
+
+
+/**
+ * @brief Find the entities on the cells of a line, as drawn by Bresenham's
+ *        algorithm from (x0, y0) to (x1, y1) included.
+ *
+ * @param ids
+ *        Receives the first 'max' ids found, in order along the line.
+ *
+ * @return The number of entities on the line, which may exceed 'max'.
+ */
+size_t spatial_queryLine(const struct spatial *s, int x0, int y0, int x1, int y1, uint32_t *ids, size_t max) {
+    const struct spatial_bucket *bucket;
+    const struct spatial_entry *entry;
+    int dx, dy, sx, sy, err, e2;
+    size_t found = 0;
+    uint32_t i;
+
+    if(!s) { return 0; }
+
+    dx = abs(x1 - x0);
+    dy = -abs(y1 - y0);
+    sx = x0 < x1 ? 1 : -1;
+    sy = y0 < y1 ? 1 : -1;
+    err = dx + dy;
+
+    for(;;) {
+        if( (unsigned int)x0 < s->map->width && (unsigned int)y0 < s->map->height ) {
+            bucket = &s->buckets[spatial_bucket(s, x0, y0)];
+            for(i = 0; i < bucket->count; i++) {
+                entry = &s->pool[bucket->start + i];
+                if(entry->x == x0 && entry->y == y0) {
+                    if(found < max && ids) { ids[found] = entry->id; }
+                    found++;
+                }
+            }
+        }
+
+        if(x0 == x1 && y0 == y1) { break; }
+        e2 = 2 * err;
+        if(e2 >= dy) { err += dy; x0 += sx; }
+        if(e2 <= dx) { err += dx; y0 += sy; }
+    }
+
+    return found;
+}
+
+
+
+/**
+ * @brief Find the entities within 'radius' cells of (x, y), by Euclidean
+ *        distance.
+ *
+ * @param ids
+ *        Receives the first 'max' ids found, in no particular order.
+ *
+ * @return The number of entities in range, which may exceed 'max'.
+ */
+size_t spatial_queryRadius(const struct spatial *s, int x, int y, unsigned int radius, uint32_t *ids, size_t max) {
+    const long long r2 = (long long)radius * radius;
+    const struct spatial_bucket *bucket;
+    const struct spatial_entry *entry;
+    long long bx0, by0, bx1, by1, bx, by, dx, dy;
+    size_t found = 0;
+    uint32_t i;
+
+    if(!s) { return 0; }
+
+    bx0 = ((long long)x - radius) < 0 ? 0 : ((long long)x - radius) >> SPATIAL_SHIFT;
+    by0 = ((long long)y - radius) < 0 ? 0 : ((long long)y - radius) >> SPATIAL_SHIFT;
+    bx1 = ((long long)x + radius) >> SPATIAL_SHIFT;
+    by1 = ((long long)y + radius) >> SPATIAL_SHIFT;
+    if(bx1 >= s->buckets_w) { bx1 = (long long)s->buckets_w - 1; }
+    if(by1 >= s->buckets_h) { by1 = (long long)s->buckets_h - 1; }
+
+    for(by = by0; by <= by1; by++) {
+        for(bx = bx0; bx <= bx1; bx++) {
+            bucket = &s->buckets[spatial_bucket(s, (int)(bx << SPATIAL_SHIFT), (int)(by << SPATIAL_SHIFT))];
+            for(i = 0; i < bucket->count; i++) {
+                entry = &s->pool[bucket->start + i];
+                dx = entry->x - x;
+                dy = entry->y - y;
+                if(dx * dx + dy * dy <= r2) {
+                    if(found < max && ids) { ids[found] = entry->id; }
+                    found++;
+                }
+            }
+        }
+    }
+
+    return found;
+}
+
+
+
+/**
+ * @brief Find the entities in the rectangle of 'width' by 'height' cells
+ *        from (x, y).
+ *
+ * @param ids
+ *        Receives the first 'max' ids found, in no particular order.
+ *
+ * @return The number of entities in the rectangle, which may exceed 'max'.
+ */
+size_t spatial_queryRect(const struct spatial *s, int x, int y, unsigned int width, unsigned int height, uint32_t *ids, size_t max) {
+    const struct spatial_bucket *bucket;
+    const struct spatial_entry *entry;
+    long long x1, y1, bx0, by0, bx1, by1, bx, by;
+    size_t found = 0;
+    uint32_t i;
+
+    if(!s || !width || !height) { return 0; }
+
+    x1 = (long long)x + width - 1;
+    y1 = (long long)y + height - 1;
+    if(x1 < 0 || y1 < 0) { return 0; }
+
+    bx0 = x < 0 ? 0 : x >> SPATIAL_SHIFT;
+    by0 = y < 0 ? 0 : y >> SPATIAL_SHIFT;
+    bx1 = x1 >> SPATIAL_SHIFT;
+    by1 = y1 >> SPATIAL_SHIFT;
+    if(bx1 >= s->buckets_w) { bx1 = (long long)s->buckets_w - 1; }
+    if(by1 >= s->buckets_h) { by1 = (long long)s->buckets_h - 1; }
+
+    for(by = by0; by <= by1; by++) {
+        for(bx = bx0; bx <= bx1; bx++) {
+            bucket = &s->buckets[spatial_bucket(s, (int)(bx << SPATIAL_SHIFT), (int)(by << SPATIAL_SHIFT))];
+            for(i = 0; i < bucket->count; i++) {
+                entry = &s->pool[bucket->start + i];
+                if(entry->x >= x && entry->x <= x1 && entry->y >= y && entry->y <= y1) {
+                    if(found < max && ids) { ids[found] = entry->id; }
+                    found++;
+                }
+            }
+        }
+    }
+
+    return found;
+}
+
+
+
+/**
+ * @brief Compact an index: lay its buckets out again in order, without the
+ *        holes left as buckets grew. Worth calling after mass spawns.
+ *
+ * @return SPATIAL_SUCCESS or SPATIAL_FAILURE; the index is intact either way.
+ */
+int spatial_rebuild(struct spatial *s) {
+    if(!s) { return SPATIAL_FAILURE; }
+
+    return spatial_layout(s, s->pool);
+}
+
+
+
+/**
+ * @brief Remove an entity from an index.
+ *
+ * @return SPATIAL_SUCCESS, or SPATIAL_FAILURE if the id is not in the index.
+ */
+int spatial_remove(struct spatial *s, uint32_t id) {
+    if( !s || id >= s->nentities || s->entities[id].bucket == SPATIAL_NONE ) { return SPATIAL_FAILURE; }
+
+    spatial_take(s, id);
+
+    return SPATIAL_SUCCESS;
+}
@@ -0,0 +1,42 @@
+/*
+ * spatial.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+#include "path.h"
+
+#define SPATIAL_SUCCESS 1
+#define SPATIAL_FAILURE 0
+
+/* Buckets are SPATIAL_SIZE cells square, (MAP_CHUNK_SIZE / SPATIAL_SIZE)^2 per chunk. */
+#define SPATIAL_SHIFT   (MAP_CHUNK_SHIFT - 2)
+#define SPATIAL_SIZE    (1u << SPATIAL_SHIFT)
+
+struct spatial;
+
+/*
+ * Function declarations.
+ */
+extern int              spatial_build       (struct spatial *s, const uint32_t *ids, const struct path_point *points, size_t count);
+extern size_t           spatial_count       (const struct spatial *s);
+extern struct spatial * spatial_create      (const struct map *m);
+extern void             spatial_free        (struct spatial *s);
+extern int              spatial_getPosition (const struct spatial *s, uint32_t id, struct path_point *where);
+extern int              spatial_insert      (struct spatial *s, uint32_t id, int x, int y);
+extern int              spatial_move        (struct spatial *s, uint32_t id, int x, int y);
+extern size_t           spatial_queryLine   (const struct spatial *s, int x0, int y0, int x1, int y1, uint32_t *ids, size_t max);
+extern size_t           spatial_queryRadius (const struct spatial *s, int x, int y, unsigned int radius, uint32_t *ids, size_t max);
+extern size_t           spatial_queryRect   (const struct spatial *s, int x, int y, unsigned int width, unsigned int height, uint32_t *ids, size_t max);
+extern int              spatial_rebuild     (struct spatial *s);
+extern int              spatial_remove      (struct spatial *s, uint32_t id);
+
+#endif /*SPATIAL_H*/
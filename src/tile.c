@@ -3,9 +3,19 @@
  *
  * Field Overview:
  *  static:
- *      tile_compare_bsearch
- *      tile_compare_qsort
+ *      tile_formatIndex
  *  extern:
+ *      tile_close
+ *      tile_create
+ *      tile_create_fromImage
+ *      tile_createGrid
+ *      tile_free
+ *      tile_freeAll
+ *      tile_get
+ *      tile_handle
+ *      tile_init
+ *      tile_lookup
+ *      tile_numRegistered
  */
 
 #include <stdlib.h>
@@ -15,44 +25,32 @@
 #include "ainur.h"
 #include "debug.h"
 #include "image.h"
+#include "intern.h"
+#include "registry.h"
 #include "tile.h"
 
 
 
 /**
- * @brief Wrapper function that performs a comparison between a key and
- *        the 'tag' of a tile struct.
+ * @brief Write the decimal digits of 'index' and a terminating NUL.
  *
- * @param pkey
- *        A pointer to a (char *) key to be compared.
- * @param pelem
- *        A pointer to a (struct tile *) to be compared.
- *
- * @return < 0: pkey has a lower 'tag' string value than pelem.
- *         = 0: pkey and pelem have the same 'tag' label.
- *         > 0: pkey has a higher 'tag' string value than pelem.
+ * @return Pointer to the NUL.
  */
-static int tile_compare_bsearch(const void *pkey, const void *pelem) {
-    return strcmp( ((char *)pkey), ((struct tile **)pelem)[0]->tag );
-}
+static char *tile_formatIndex(char *output, size_t index) {
+    char digits[24];
+    int n = 0;
 
+    do {
+        digits[n++] = (char)('0' + index % 10);
+        index /= 10;
+    } while(index);
 
+    while(n) {
+        *output++ = digits[--n];
+    }
+    *output = '\0';
 
-/**
- * @brief Wrapper function that performs a comparison on the 'tag's of two
- *        struct tiles *'s.
- *
- * @param p1
- *        A pointer to a (struct tile *) to be compared.
- * @param p2
- *        A pointer to a (struct tile *) to be compared.
- *
- * @return < 0: p1 has a lower 'tag' string value than p2.
- *         = 0: p1 and p2 have the same 'tag' label.
- *         > 0: p1 has a higher 'tag' string value than p2.
- */
-static int tile_compare_qsort(const void *p1, const void *p2) {
-    return strcmp( ((struct tile **)p1)[0]->tag, ((struct tile **)p2)[0]->tag );
+    return output;
 }
 
 
@@ -63,27 +61,6 @@ static int tile_compare_qsort(const void *p1, const void *p2) {
 
 
 
-/**
- * @brief A wrapper function to perform a binary search on 'tiles' in the ainur engine.
- *        Retrieve an element, if one exists, that has the 'tag', 'tag' within it.
- *
- * @param tag
- *        The 'tag' of the (struct tile *) to search for.
- *
- * @return A pointer to the array position with the correct 'tag', or NULL (no match).
- */
-struct tile **tile_bsearch(const char *tag) {
-    if(!tag) { return NULL; }
-
-    return (struct tile **)bsearch( tag,
-                                    ainur.tiles,
-                                    tile_numRegistered(),
-                                    sizeof(struct tile *),
-                                    tile_compare_bsearch );
-}
-
-
-
 /**
  * @brief Wrapper function to perform cleanup protocols for tile functionalities.
  */
@@ -98,7 +75,7 @@ void tile_close(void) {
  * 
  */
 struct tile *tile_create(const char *image_tag, int x, int y, int width, int height, const char *tag) {
-    struct image **image = image_bsearch(image_tag);
+    struct image *image = image_lookup(image_tag);
     if(!image) {
         dbgprint("tile_create: Unable to create tile: %s\n"\
                  "             Image not found.\n", tag);
@@ -106,7 +83,7 @@ struct tile *tile_create(const char *image_tag, int x, int y, int width, int hei
         return NULL;
     }
 
-    return tile_create_fromImage( *image, x, y, width, height, tag );
+    return tile_create_fromImage( image, x, y, width, height, tag );
 }
 
 
@@ -139,7 +116,7 @@ struct tile *tile_create_fromImage( struct image *src, int x, int y, int width,
     }
 
     //'tag' must be unique!!!
-    if( tile_bsearch(tag) ) {
+    if( tile_handle(tag) ) {
         dbgprint("tile_create_fromImage: Unable to create tile: 'tag' %s is not unique.\n", tag);
 
         return NULL;
@@ -161,33 +138,124 @@ struct tile *tile_create_fromImage( struct image *src, int x, int y, int width,
     output->rect.h = height;
     //put image source in tile struct
     output->src = src;
+    output->sheet = NULL;
 
-    //attempt to allocate memory for 'tag' string
-    size_t length = strlen(tag);
-    if( !(output->tag = malloc( sizeof(char) * (length + 1) )) ) {
-        dbgprint("tile_create_fromImage: Unable to allocate memory for new (struct tile *): %s\n", tag);
+    //register the tile; the registry interns 'tag'
+    if( !(output->handle = registry_insert(&ainur.tiles, tag, output)) ) {
+        dbgprint("tile_create_fromImage: Unable to register tile %s in ainur.(struct registry tiles).\n", tag);
 
-        tile_free(output);
+        free(output);
         return NULL;
     }
-    //copy 'tag' to output->tag
-    memcpy(output->tag, tag, sizeof(char) * (length + 1));
+    output->tag = registry_tag(&ainur.tiles, output->handle);
+
+    return output;
+}
+
 
-    //attempt to allocate more memory for the tile array
-    length = tile_numRegistered();
-    if( !(ainur.tiles = realloc(ainur.tiles, sizeof(struct tile *) * (length + 2))) ) {
-        dbgprint("tile_create_fromImage: Unable to allocate more memory for ainur.(struct tile **tiles).\n");
 
-        tile_free(output);
+/**
+ * @brief Cut a whole sheet into a grid of tiles with one allocation and one
+ *        registry resize. Tile i (row-major) is registered as "<prefix>_<i>".
+ *
+ * @param src
+ *        Image the grid is cut from.
+ * @param tile_w
+ *        Width of every tile.
+ * @param tile_h
+ *        Height of every tile.
+ * @param margin
+ *        Pixels between the edges of the image and the outer tiles.
+ * @param spacing
+ *        Pixels between neighbouring tiles.
+ * @param prefix
+ *        Prefix of the generated tags; every generated tag must be unique.
+ *
+ * @return The sheet, or NULL on failure (no tile is registered).
+ * @note The tiles can be freed one by one with tile_free(); the sheet is freed
+ *       with its last tile.
+ */
+struct tile_sheet *tile_createGrid(struct image *src, int tile_w, int tile_h, int margin, int spacing, const char *prefix) {
+    SDL_Surface *surface = image_getSurface(src);
+    char tag[TILE_TAG_LENGTH], *digits;
+    struct tile_sheet *sheet;
+    struct tile *tile;
+    size_t i, length;
+    int x, y;
+
+    if( !surface || !prefix || tile_w <= 0 || tile_h <= 0 || margin < 0 || spacing < 0 ) {
+        dbgprint("tile_createGrid: Unable to create tile sheet %s: invalid parameters.\n", prefix);
+
         return NULL;
     }
+    if( (length = strlen(prefix)) + 2 + 20 > sizeof(tag) ) {
+        dbgprint("tile_createGrid: Unable to create tile sheet: prefix %s is too long.\n", prefix);
 
-    ainur.tiles[length] = output;     //add the new tile to the end of the array
-    ainur.tiles[length + 1] = NULL;   //add new NULL terminator
+        return NULL;
+    }
 
-    tile_qsort();   //resort the list
+    //allocate the sheet and all of its tiles at once
+    if( !(sheet = malloc(sizeof(struct tile_sheet))) ) {
+        dbgprint("tile_createGrid: Unable to allocate tile sheet %s: %s\n", prefix, ERROR_MALLOC);
 
-    return output;
+        return NULL;
+    }
+    sheet->src = src;
+    sheet->columns = (surface->w - 2 * margin + spacing) / (tile_w + spacing);
+    sheet->rows = (surface->h - 2 * margin + spacing) / (tile_h + spacing);
+    if(sheet->columns < 0) { sheet->columns = 0; }
+    if(sheet->rows < 0) { sheet->rows = 0; }
+    sheet->count = (size_t)sheet->columns * sheet->rows;
+    sheet->live = 0;
+
+    if( !sheet->count || !(sheet->tiles = malloc(sheet->count * sizeof(struct tile))) ||
+        !registry_reserve(&ainur.tiles, sheet->count) || !(sheet->prefix = intern_string(prefix)) ) {
+        dbgprint("tile_createGrid: Unable to create %lu tiles for sheet %s.\n", (unsigned long)sheet->count, prefix);
+
+        if(sheet->count) {
+            free(sheet->tiles);
+        }
+        free(sheet);
+        return NULL;
+    }
+
+    //the prefix is written once; only the digits change
+    memcpy(tag, prefix, length);
+    tag[length] = '_';
+    digits = tag + length + 1;
+
+    tile = sheet->tiles;
+    for(y = 0, i = 0; y < sheet->rows; y++) {
+        for(x = 0; x < sheet->columns; x++, i++, tile++) {
+            tile->src = src;
+            tile->rect.x = margin + x * (tile_w + spacing);
+            tile->rect.y = margin + y * (tile_h + spacing);
+            tile->rect.w = tile_w;
+            tile->rect.h = tile_h;
+            tile->sheet = sheet;
+
+            tile_formatIndex(digits, i);
+            if( !(tile->handle = registry_insert(&ainur.tiles, tag, tile)) ) {
+                dbgprint("tile_createGrid: Unable to register tile %s: 'tag' is not unique.\n", tag);
+
+                //undo; the sheet is freed along with its last registered tile
+                if(!sheet->live) {
+                    free(sheet->tiles);
+                    free(sheet);
+                    return NULL;
+                }
+                for(tile = sheet->tiles; sheet->live > 1; tile++) {
+                    tile_free(tile);
+                }
+                tile_free(tile);
+                return NULL;
+            }
+            tile->tag = registry_tag(&ainur.tiles, tile->handle);
+            sheet->live++;
+        }
+    }
+
+    return sheet;
 }
 
 
@@ -200,8 +268,19 @@ struct tile *tile_create_fromImage( struct image *src, int x, int y, int width,
 void tile_free(struct tile *tile) {
     if(!tile) { return; }
 
-    if(tile->tag) {
-        free(tile->tag);
+    //unregister the tile; 'tag' is interned and not ours to free
+    registry_remove(&ainur.tiles, tile->handle);
+
+    //tiles of a sheet share one allocation
+    if(tile->sheet) {
+        struct tile_sheet *sheet = tile->sheet;
+
+        tile->sheet = NULL;
+        if(!--sheet->live) {
+            free(sheet->tiles);
+            free(sheet);
+        }
+        return;
     }
 
     free(tile);
@@ -211,39 +290,65 @@ void tile_free(struct tile *tile) {
 
 
 /**
- * @brief Free all tiles within ainur.tiles and free the ainur.tiles array, itself.
+ * @brief Free all tiles within ainur.tiles and free the ainur.tiles registry, itself.
  */
 void tile_freeAll(void) {
-    if(!ainur.tiles) { return; }
+    registry_handle handle = REGISTRY_INVALID_HANDLE;
 
-    size_t len;
-    for(len = tile_numRegistered(); len > 0; len--) {
-        tile_free(ainur.tiles[len-1]);
+    while( (handle = registry_next(&ainur.tiles, handle)) ) {
+        tile_free(registry_get(&ainur.tiles, handle));
     }
 
-    free(ainur.tiles);
+    registry_close(&ainur.tiles);
     return;
 }
 
 
 
 /**
- * @brief Allocate memory for ainur.tiles; attach NULL terminator.
+ * @brief Retrieve a tile through its registry handle.
+ *
+ * @param handle
+ *        Handle returned by tile_handle() or stored in tile->handle.
+ *
+ * @return The tile, or NULL if the handle is stale or invalid.
+ */
+struct tile *tile_get(registry_handle handle) {
+    return registry_get(&ainur.tiles, handle);
+}
+
+
+
+/**
+ * @brief Retrieve the registry handle of a tile.
+ *
+ * @param tag
+ *        The 'tag' of the tile.
+ *
+ * @return The handle, or REGISTRY_INVALID_HANDLE (no match).
+ */
+registry_handle tile_handle(const char *tag) {
+    return registry_find(&ainur.tiles, tag);
+}
+
+
+
+/**
+ * @brief Allocate memory for the ainur.tiles registry.
  *
  * @return TILE_SUCCESS if initalization was successful;
  *         TILE_FAILURE if initalization did not succeed.
  */
 int tile_init(void) {
-    if(ainur.tiles) {
+    if(ainur.tiles.buckets) {
         return TILE_SUCCESS;
     }
 
-    if( !(ainur.tiles = malloc(sizeof(struct tile *))) ) {
-        dbgprint("tile_init: Unable to allocate memory for ainur.(struct tile **tiles).\n");
+    if( !registry_init(&ainur.tiles, 0) ) {
+        dbgprint("tile_init: Unable to allocate memory for ainur.(struct registry tiles).\n");
 
         return TILE_FAILURE;
     }
-    ainur.tiles[0] = NULL;    //add NULL terminator
 
     return TILE_SUCCESS;
 }
@@ -251,25 +356,24 @@ int tile_init(void) {
 
 
 /**
- * @brief Determine the number of tile structs in ainur.tiles.
+ * @brief Retrieve a tile by its tag.
  *
- * @return The number of tile structs in ainur.tiles before the NULL terminator.
+ * @param tag
+ *        The 'tag' of the (struct tile *) to search for.
+ *
+ * @return The tile with the correct 'tag', or NULL (no match).
  */
-size_t tile_numRegistered(void) {
-    size_t i;
-    for(i = 0; ainur.tiles[i]; i++);
-    return i;
+struct tile *tile_lookup(const char *tag) {
+    return registry_lookup(&ainur.tiles, tag);
 }
 
 
 
 /**
- * @brief A wrapper function to perform a quicksort (qsort()) on ainur.tiles.
+ * @brief Determine the number of tile structs in ainur.tiles.
+ *
+ * @return The number of tile structs registered in ainur.tiles.
  */
-void tile_qsort(void) {
-    qsort( ainur.tiles,
-           tile_numRegistered(),
-           sizeof(struct tile *),
-           tile_compare_qsort );
-    return;
+size_t tile_numRegistered(void) {
+    return registry_count(&ainur.tiles);
 }
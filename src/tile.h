@@ -4,10 +4,15 @@
 #include <SDL2/SDL.h>
 
 #include "image.h"
+#include "registry.h"
 
 #define TILE_SUCCESS 1
 #define TILE_FAILURE 0
 
+#define TILE_TAG_LENGTH 256     //longest tag generated by tile_createGrid(), NUL included
+
+struct tile_sheet;
+
 /**
  * @struct tile
  * 
@@ -16,21 +21,55 @@
 struct tile {
     struct image *src;  //source of the image
     SDL_Rect rect;      //area on the image that corresponds to this tile
-    char *tag;          //tag under which this tile is listed; used for sorting, finding
+    const char *tag;    //interned tag under which this tile is listed; used for finding
+    registry_handle handle; //handle of this tile in ainur.tiles
+    struct tile_sheet *sheet; //sheet whose array holds this tile, or NULL
+};
+
+/**
+ * @struct tile_sheet
+ *
+ * @brief A grid of tiles cut from one image, stored in a single array.
+ *        Tile i of the grid (row-major) is registered as "<prefix>_<i>".
+ */
+struct tile_sheet {
+    struct image *src;  //image the grid is cut from
+    const char *prefix; //interned tag prefix
+    int columns;        //tiles per row
+    int rows;           //tiles per column
+    size_t count;       //columns * rows
+    size_t live;        //tiles not freed yet; the sheet is freed with the last
+    struct tile *tiles; //'count' tiles, row-major
 };
 
 /*
  * Function declarations.
  */
-extern struct tile ** tile_bsearch          (const char *tag);
-extern void           tile_close            (void);
-extern struct tile *  tile_create           (const char *image_tag, int x, int y, int width, int height, const char *tag);
-extern struct tile *  tile_create_fromImage (struct image *src, int x, int y, int width, int height, const char *tag);
-extern void           tile_free             (struct tile *tile);
-extern void           tile_freeAll          (void);
-extern int            tile_init             (void);
-extern size_t         tile_numRegistered    (void);
-extern void           tile_qsort            (void);
+extern void                tile_close            (void);
+extern struct tile *       tile_create           (const char *image_tag, int x, int y, int width, int height, const char *tag);
+extern struct tile *       tile_create_fromImage (struct image *src, int x, int y, int width, int height, const char *tag);
+extern struct tile_sheet * tile_createGrid       (struct image *src, int tile_w, int tile_h, int margin, int spacing, const char *prefix);
+extern void                tile_free             (struct tile *tile);
+extern void                tile_freeAll          (void);
+extern struct tile *       tile_get              (registry_handle handle);
+extern registry_handle     tile_handle           (const char *tag);
+extern int                 tile_init             (void);
+extern struct tile *       tile_lookup           (const char *tag);
+extern size_t              tile_numRegistered    (void);
+
+
+
+/**
+ * @brief Retrieve the tile at a column and row of a sheet.
+ *
+ * @return The tile, or NULL if the cell is outside the grid.
+ */
+static inline struct tile *tile_sheetAt(const struct tile_sheet *sheet, int column, int row) {
+    if( column < 0 || row < 0 || column >= sheet->columns || row >= sheet->rows ) {
+        return NULL;
+    }
 
+    return &sheet->tiles[(size_t)row * sheet->columns + column];
+}
 
 #endif /*TILE_H*/
@@ -0,0 +1,466 @@
+/*
+ * ainur-pack.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief Offline asset compiler. Reads a manifest and writes an asset pack
+ *        (see pack.h) that the engine maps at startup. Images are decoded and
+ *        converted to PACK_PIXELFORMAT here; the engine uses the pixels in
+ *        place only when its render backend has that format, and converts
+ *        each image once at load otherwise.
+ *
+ *        Usage: ainur-pack <manifest> <output>
+ *
+ *        Manifest lines ('#' starts a comment; files are relative to the
+ *        manifest):
+ *            image  <tag> <file>
+ *            tile   <tag> <image tag> <x> <y> <width> <height>
+ *            font   <tag> <file>
+ *            script <tag> <file>
+ *
+ * Field Overview:
+ *  static:
+ *      pack_items
+ *      pack_strings
+ *      pack_addString
+ *      pack_compare
+ *      pack_parse
+ *      pack_readFile
+ *      pack_writeImage
+ *      pack_writePadding
+ *  extern:
+ *      main
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "pack.h"
+
+#define PACK_LINE_LENGTH    1024
+
+
+
+/**
+ * @struct pack_item
+ *         A manifest entry on its way into the pack.
+ * @var entry
+ *      The index entry being built.
+ * @var tag
+ *      Tag of the entry.
+ * @var file
+ *      Source file (NULL for tiles).
+ * @var image
+ *      Tag of the image of a tile.
+ * @var line
+ *      Manifest line, for error messages.
+ */
+struct pack_item {
+    struct pack_entry entry;
+    char *tag;
+    char *file;
+    char *image;
+    int line;
+};
+
+/* Manifest entries. */
+static struct {
+    struct pack_item *items;
+    size_t count;
+    size_t capacity;
+} pack_items = { NULL, 0, 0 };
+
+/* String table being built; offset 0 holds "". */
+static struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} pack_strings = { NULL, 0, 0 };
+
+
+
+/**
+ * @brief Append a string to the string table.
+ *
+ * @return Offset of the string, or 0 on failure.
+ */
+static uint32_t pack_addString(const char *string) {
+    size_t length = strlen(string) + 1;
+    uint32_t offset;
+
+    if(pack_strings.length + length > pack_strings.capacity) {
+        size_t capacity = pack_strings.capacity ? pack_strings.capacity : 4096;
+        char *data;
+
+        while(capacity < pack_strings.length + length) {
+            capacity *= 2;
+        }
+        if( !(data = realloc(pack_strings.data, capacity)) ) {
+            return 0;
+        }
+        pack_strings.data = data;
+        pack_strings.capacity = capacity;
+    }
+
+    offset = (uint32_t)pack_strings.length;
+    memcpy(pack_strings.data + offset, string, length);
+    pack_strings.length += length;
+
+    return offset;
+}
+
+
+
+/**
+ * @brief qsort() comparator: the order of the pack index, (type, tag).
+ */
+static int pack_compare(const void *a, const void *b) {
+    const struct pack_item *x = a, *y = b;
+
+    if(x->entry.type != y->entry.type) {
+        return x->entry.type < y->entry.type ? -1 : 1;
+    }
+
+    return strcmp(x->tag, y->tag);
+}
+
+
+
+/**
+ * @brief Read the manifest into pack_items.
+ *
+ * @return 1 on success, 0 on failure (reported).
+ */
+static int pack_parse(const char *manifest) {
+    char line[PACK_LINE_LENGTH], path[PACK_LINE_LENGTH * 2];
+    const char *slash = strrchr(manifest, '/');
+    int directory = slash ? (int)(slash - manifest + 1) : 0;
+    int number = 0;
+    FILE *stream;
+
+    if( !(stream = fopen(manifest, "r")) ) {
+        fprintf(stderr, "ainur-pack: Unable to open manifest %s.\n", manifest);
+        return 0;
+    }
+
+    while( fgets(line, sizeof(line), stream) ) {
+        char *kind, *tag, *arg, *comment;
+        struct pack_item item;
+
+        number++;
+        if( (comment = strchr(line, '#')) ) {
+            *comment = '\0';
+        }
+        if( !(kind = strtok(line, " \t\r\n")) ) {
+            continue;   //blank line
+        }
+
+        memset(&item, 0, sizeof(item));
+        item.line = number;
+
+        if( !(tag = strtok(NULL, " \t\r\n")) || !(arg = strtok(NULL, " \t\r\n")) ) {
+            fprintf(stderr, "ainur-pack: %s:%d: Expected a tag and an argument.\n", manifest, number);
+            goto error;
+        }
+
+        if( !strcmp(kind, "tile") ) {
+            const char *x = strtok(NULL, " \t\r\n"), *y = strtok(NULL, " \t\r\n");
+            const char *w = strtok(NULL, " \t\r\n"), *h = strtok(NULL, " \t\r\n");
+
+            if(!x || !y || !w || !h) {
+                fprintf(stderr, "ainur-pack: %s:%d: Expected: tile <tag> <image tag> <x> <y> <width> <height>\n",
+                        manifest, number);
+                goto error;
+            }
+            item.entry.type = PACK_TILE;
+            item.entry.tile.x = atoi(x);
+            item.entry.tile.y = atoi(y);
+            item.entry.tile.w = atoi(w);
+            item.entry.tile.h = atoi(h);
+            item.image = strdup(arg);
+        }
+        else {
+            if( !strcmp(kind, "image") ) {
+                item.entry.type = PACK_IMAGE;
+            }
+            else if( !strcmp(kind, "font") ) {
+                item.entry.type = PACK_FONT;
+            }
+            else if( !strcmp(kind, "script") ) {
+                item.entry.type = PACK_SCRIPT;
+            }
+            else {
+                fprintf(stderr, "ainur-pack: %s:%d: Unknown entry kind \"%s\".\n", manifest, number, kind);
+                goto error;
+            }
+
+            if(arg[0] == '/') {
+                snprintf(path, sizeof(path), "%s", arg);
+            }
+            else {
+                snprintf(path, sizeof(path), "%.*s%s", directory, manifest, arg);
+            }
+            item.file = strdup(path);
+        }
+        item.tag = strdup(tag);
+
+        if(pack_items.count == pack_items.capacity) {
+            size_t capacity = pack_items.capacity ? pack_items.capacity * 2 : 64;
+            struct pack_item *items = realloc(pack_items.items, capacity * sizeof(struct pack_item));
+
+            if(!items) {
+                fprintf(stderr, "ainur-pack: Out of memory.\n");
+                goto error;
+            }
+            pack_items.items = items;
+            pack_items.capacity = capacity;
+        }
+        pack_items.items[pack_items.count++] = item;
+    }
+
+    fclose(stream);
+    return 1;
+
+error:
+    fclose(stream);
+    return 0;
+}
+
+
+
+/**
+ * @brief Read a whole file.
+ *
+ * @return The contents (to be free()d), or NULL on failure.
+ */
+static void *pack_readFile(const char *filename, size_t *size) {
+    FILE *stream = fopen(filename, "rb");
+    void *data = NULL;
+    long length;
+
+    if(!stream) { return NULL; }
+
+    if( !fseek(stream, 0, SEEK_END) && (length = ftell(stream)) >= 0 && !fseek(stream, 0, SEEK_SET) &&
+        (data = malloc(length ? (size_t)length : 1)) ) {
+        if( fread(data, 1, (size_t)length, stream) != (size_t)length ) {
+            free(data);
+            data = NULL;
+        }
+        *size = (size_t)length;
+    }
+
+    fclose(stream);
+    return data;
+}
+
+
+
+/**
+ * @brief Decode an image, convert it to PACK_PIXELFORMAT and write its pixels.
+ *
+ * @return 1 on success, 0 on failure (reported).
+ */
+static int pack_writeImage(FILE *output, struct pack_item *item) {
+    SDL_Surface *temp, *surface;
+    int row, fail = 0;
+
+    if( !(temp = IMG_Load(item->file)) ) {
+        fprintf(stderr, "ainur-pack: %s: %s\n", item->file, IMG_GetError());
+        return 0;
+    }
+    surface = SDL_ConvertSurfaceFormat(temp, PACK_PIXELFORMAT, 0);
+    SDL_FreeSurface(temp);
+    if(!surface) {
+        fprintf(stderr, "ainur-pack: %s: %s\n", item->file, SDL_GetError());
+        return 0;
+    }
+
+    item->entry.image.format = PACK_PIXELFORMAT;
+    item->entry.image.width = (uint32_t)surface->w;
+    item->entry.image.height = (uint32_t)surface->h;
+    item->entry.image.pitch = (uint32_t)surface->pitch;
+    item->entry.size = (uint64_t)surface->pitch * surface->h;
+
+    SDL_LockSurface(surface);
+    for(row = 0; row < surface->h && !fail; row++) {
+        fail = fwrite((Uint8 *)surface->pixels + (size_t)row * surface->pitch,
+                      (size_t)surface->pitch, 1, output) != 1;
+    }
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+
+    return !fail;
+}
+
+
+
+/**
+ * @brief Pad the output with zeros up to a multiple of 'align'.
+ *
+ * @return The new file offset, or -1 on failure.
+ */
+static long pack_writePadding(FILE *output, long align) {
+    long offset = ftell(output);
+
+    while(offset >= 0 && offset % align) {
+        if(fputc(0, output) == EOF) { return -1; }
+        offset++;
+    }
+
+    return offset;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+int main(int argc, char *argv[]) {
+    struct pack_header header;
+    struct pack_item *item, *end, key;
+    FILE *output;
+    long offset;
+    size_t i;
+
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s <manifest> <output>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if( !pack_parse(argv[1]) ) {
+        return EXIT_FAILURE;
+    }
+
+    //the index is sorted by (type, tag) so the engine can bsearch it
+    qsort(pack_items.items, pack_items.count, sizeof(struct pack_item), pack_compare);
+    end = pack_items.items + pack_items.count;
+    for(i = 1; i < pack_items.count; i++) {
+        if( !pack_compare(&pack_items.items[i - 1], &pack_items.items[i]) ) {
+            fprintf(stderr, "ainur-pack: %s:%d: Duplicate tag \"%s\".\n",
+                    argv[1], pack_items.items[i].line, pack_items.items[i].tag);
+            return EXIT_FAILURE;
+        }
+    }
+    for(item = pack_items.items; item < end; item++) {
+        key.entry.type = PACK_IMAGE;
+        key.tag = item->image;
+        if( item->entry.type == PACK_TILE &&
+            !bsearch(&key, pack_items.items, pack_items.count, sizeof(struct pack_item), pack_compare) ) {
+            fprintf(stderr, "ainur-pack: %s:%d: Tile \"%s\" refers to unknown image \"%s\".\n",
+                    argv[1], item->line, item->tag, item->image);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if( SDL_Init(0) || !(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG) ) {
+        fprintf(stderr, "ainur-pack: Unable to initialize SDL: %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+    if( !(output = fopen(argv[2], "wb")) ) {
+        fprintf(stderr, "ainur-pack: Unable to create %s.\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    //the header is written last, once every offset is known
+    memset(&header, 0, sizeof(header));
+    pack_addString("");
+    if( fwrite(&header, sizeof(header), 1, output) != 1 ) {
+        goto error;
+    }
+
+    for(item = pack_items.items; item < end; item++) {
+        if( !(item->entry.tag = pack_addString(item->tag)) ) {
+            goto error;
+        }
+
+        if(item->entry.type == PACK_TILE) {
+            if( !(item->entry.tile.image = pack_addString(item->image)) ) {
+                goto error;
+            }
+            continue;
+        }
+
+        //blobs are aligned so mapped pixels suit SIMD blitters
+        if( (offset = pack_writePadding(output, PACK_ALIGN)) < 0 ) {
+            goto error;
+        }
+        item->entry.offset = (uint64_t)offset;
+
+        if(item->entry.type == PACK_IMAGE) {
+            if( !pack_writeImage(output, item) ) {
+                goto error;
+            }
+        }
+        else {
+            size_t size;
+            void *data = pack_readFile(item->file, &size);
+
+            if(!data) {
+                fprintf(stderr, "ainur-pack: Unable to read %s.\n", item->file);
+                goto error;
+            }
+            item->entry.size = size;
+            if( size && fwrite(data, size, 1, output) != 1 ) {
+                free(data);
+                goto error;
+            }
+            free(data);
+        }
+    }
+
+    //string table, then the index
+    if( (offset = ftell(output)) < 0 ||
+        fwrite(pack_strings.data, pack_strings.length, 1, output) != 1 ) {
+        goto error;
+    }
+    header.strings = (uint64_t)offset;
+    header.nstrings = pack_strings.length;
+
+    if( (offset = pack_writePadding(output, sizeof(uint64_t))) < 0 ) {
+        goto error;
+    }
+    header.index = (uint64_t)offset;
+    header.count = (uint32_t)pack_items.count;
+    for(item = pack_items.items; item < end; item++) {
+        if( fwrite(&item->entry, sizeof(struct pack_entry), 1, output) != 1 ) {
+            goto error;
+        }
+    }
+
+    memcpy(header.magic, PACK_MAGIC, PACK_MAGIC_LENGTH);
+    header.version = PACK_VERSION;
+    if( (offset = ftell(output)) < 0 ) {
+        goto error;
+    }
+    header.size = (uint64_t)offset;
+    if( fseek(output, 0, SEEK_SET) || fwrite(&header, sizeof(header), 1, output) != 1 ) {
+        goto error;
+    }
+    if( fclose(output) ) {
+        fprintf(stderr, "ainur-pack: Unable to write %s.\n", argv[2]);
+        remove(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    printf("ainur-pack: %s: %lu entries, %lu bytes.\n",
+           argv[2], (unsigned long)pack_items.count, (unsigned long)header.size);
+
+    IMG_Quit();
+    SDL_Quit();
+    return EXIT_SUCCESS;
+
+error:
+    fprintf(stderr, "ainur-pack: Unable to write %s.\n", argv[2]);
+    fclose(output);
+    remove(argv[2]);
+    return EXIT_FAILURE;
+}
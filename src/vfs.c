@@ -0,0 +1,421 @@
+/*
+ * vfs.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief Virtual filesystem. Assets are named relative to a list of search
+ *        roots (base game, mods, user directory). Each root is scanned once
+ *        when it is added, into an in-memory index of interned names, so
+ *        existence checks and path resolution are hash lookups that neither
+ *        allocate nor touch the disk. A file in a later root overrides the
+ *        file of the same name in an earlier one.
+ *
+ * Field Overview:
+ *  static:
+ *      vfs
+ *      vfs_add
+ *      vfs_normalize
+ *      vfs_scan
+ *  extern:
+ *      vfs_addRoot
+ *      vfs_close
+ *      vfs_exclude
+ *      vfs_exists
+ *      vfs_init
+ *      vfs_lookup
+ *      vfs_openRW
+ *      vfs_rescan
+ *      vfs_resolve
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_rwops.h>
+
+#include "debug.h"
+#include "intern.h"
+#include "registry.h"
+#include "vfs.h"
+
+#define VFS_BLOCK_ENTRIES   256
+
+
+
+/**
+ * @struct vfs_block
+ *         Entries are allocated in blocks; entries never move.
+ */
+struct vfs_block {
+    struct vfs_block *next;
+    size_t used;
+    struct vfs_entry entries[VFS_BLOCK_ENTRIES];
+};
+
+/**
+ * @brief VFS state.
+ * @var index
+ *      Every known file, indexed by name.
+ * @var roots
+ *      Interned canonical paths of the search roots, in priority order.
+ * @var nroots
+ *      Number of search roots.
+ * @var excluded
+ *      Interned canonical paths of directories never scanned.
+ * @var nexcluded
+ *      Number of excluded directories.
+ * @var blocks
+ *      Storage of the entries; newest block first.
+ */
+static struct {
+    struct registry index;
+    const char *roots[VFS_MAX_ROOTS];
+    int nroots;
+    const char *excluded[VFS_MAX_ROOTS];
+    int nexcluded;
+    struct vfs_block *blocks;
+} vfs = { { 0 }, { NULL }, 0, { NULL }, 0, NULL };
+
+
+
+/**
+ * @brief Add or override the entry of a scanned file.
+ *
+ * @return VFS_SUCCESS or VFS_FAILURE.
+ */
+static int vfs_add(int root, const char *name, const char *path, const struct stat *info) {
+    struct vfs_entry *entry = registry_lookup(&vfs.index, name);
+
+    if(!entry) {
+        if( !vfs.blocks || vfs.blocks->used == VFS_BLOCK_ENTRIES ) {
+            struct vfs_block *block = malloc(sizeof(struct vfs_block));
+
+            if(!block) {
+                dbgprint("vfs_add: Unable to allocate entries: %s\n", ERROR_MALLOC);
+
+                return VFS_FAILURE;
+            }
+            block->next = vfs.blocks;
+            block->used = 0;
+            vfs.blocks = block;
+        }
+
+        entry = &vfs.blocks->entries[vfs.blocks->used];
+        registry_handle handle = registry_insert(&vfs.index, name, entry);
+        if(!handle) {
+            return VFS_FAILURE;
+        }
+        vfs.blocks->used++;
+        entry->name = registry_tag(&vfs.index, handle);
+    }
+
+    if( !(entry->path = intern_string(path)) ) {
+        return VFS_FAILURE;
+    }
+    entry->size = (uint64_t)info->st_size;
+    entry->mtime = info->st_mtime;
+    entry->root = root;
+
+    return VFS_SUCCESS;
+}
+
+
+
+/**
+ * @brief Skip the leading "./" of a name, so "./a.png" and "a.png" match.
+ */
+static const char *vfs_normalize(const char *name) {
+    while(name[0] == '.' && name[1] == '/') {
+        name += 2;
+    }
+
+    return name;
+}
+
+
+
+/**
+ * @brief Index every regular file below a directory. Symbolic links to
+ *        files are followed, links to directories are not (they may point
+ *        back up the tree), and excluded directories are skipped.
+ *
+ * @param root
+ *        Index of the root being scanned.
+ * @param path
+ *        PATH_MAX buffer holding the directory; restored on return.
+ * @param base
+ *        Offset of the file names relative to the root in 'path'.
+ * @param length
+ *        Length of the directory in 'path'.
+ * @param depth
+ *        Current depth below the root.
+ */
+static void vfs_scan(int root, char *path, size_t base, size_t length, int depth) {
+    struct dirent *item;
+    struct stat info;
+    size_t n;
+    int i;
+    DIR *dir;
+
+    if(depth > VFS_MAX_DEPTH) { return; }
+    for(i = 0; depth && i < vfs.nexcluded; i++) {   //a root is never excluded from itself
+        if( !strcmp(path, vfs.excluded[i]) ) { return; }
+    }
+    if( !(dir = opendir(path)) ) { return; }
+
+    while( (item = readdir(dir)) ) {
+        if(item->d_name[0] == '.') { continue; }   //'.', '..' and hidden files
+
+        n = strlen(item->d_name);
+        if(length + 1 + n >= PATH_MAX) {
+            dbgprint("vfs_scan: Path too long, skipping: %s/%s\n", path, item->d_name);
+            continue;
+        }
+        path[length] = '/';
+        memcpy(path + length + 1, item->d_name, n + 1);
+
+        if( lstat(path, &info) ) { continue; }
+        if( S_ISLNK(info.st_mode) && (stat(path, &info) || !S_ISREG(info.st_mode)) ) {
+            continue;
+        }
+
+        if( S_ISDIR(info.st_mode) ) {
+            vfs_scan(root, path, base, length + 1 + n, depth + 1);
+        }
+        else if( S_ISREG(info.st_mode) ) {
+            vfs_add(root, path + base, path, &info);
+        }
+    }
+    path[length] = '\0';
+
+    closedir(dir);
+    return;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Add a search root and index the files below it. Roots added later
+ *        take priority over earlier ones.
+ *
+ * @param directory
+ *        The directory.
+ *
+ * @return VFS_SUCCESS or VFS_FAILURE (the directory does not exist, or there
+ *         are too many roots).
+ */
+int vfs_addRoot(const char *directory) {
+    char path[PATH_MAX];
+    size_t length;
+
+    if(!directory) {
+        dbgprint("vfs_addRoot: formal param 'directory': %s\n", ERROR_NULL_STRING);
+
+        return VFS_FAILURE;
+    }
+    if(vfs.nroots == VFS_MAX_ROOTS) {
+        dbgprint("vfs_addRoot: Unable to add %s: too many search roots.\n", directory);
+
+        return VFS_FAILURE;
+    }
+    if( !realpath(directory, path) ) {
+        dbgprint("vfs_addRoot: %s: %s\n", directory, ERROR_NO_FILE);
+
+        return VFS_FAILURE;
+    }
+
+    if( !(vfs.roots[vfs.nroots] = intern_string(path)) ) {
+        return VFS_FAILURE;
+    }
+
+    length = strlen(path);
+    vfs_scan(vfs.nroots, path, length + 1, length, 0);
+    vfs.nroots++;
+
+    return VFS_SUCCESS;
+}
+
+
+
+/**
+ * @brief Forget every root and excluded directory, and free the index.
+ */
+void vfs_close(void) {
+    struct vfs_block *block;
+
+    while( (block = vfs.blocks) ) {
+        vfs.blocks = block->next;
+        free(block);
+    }
+
+    registry_close(&vfs.index);
+    vfs.nroots = 0;
+    vfs.nexcluded = 0;
+
+    return;
+}
+
+
+
+/**
+ * @brief Never index a directory, e.g. one below the base game root that is
+ *        a search root of its own. Applies to roots added afterwards.
+ *
+ * @param directory
+ *        The directory.
+ *
+ * @return VFS_SUCCESS or VFS_FAILURE (the directory does not exist, or too
+ *         many directories are excluded).
+ */
+int vfs_exclude(const char *directory) {
+    char path[PATH_MAX];
+
+    if(!directory) {
+        dbgprint("vfs_exclude: formal param 'directory': %s\n", ERROR_NULL_STRING);
+
+        return VFS_FAILURE;
+    }
+    if(vfs.nexcluded == VFS_MAX_ROOTS) {
+        dbgprint("vfs_exclude: Unable to exclude %s: too many directories.\n", directory);
+
+        return VFS_FAILURE;
+    }
+    if( !realpath(directory, path) ) {
+        dbgprint("vfs_exclude: %s: %s\n", directory, ERROR_NO_FILE);
+
+        return VFS_FAILURE;
+    }
+
+    if( !(vfs.excluded[vfs.nexcluded] = intern_string(path)) ) {
+        return VFS_FAILURE;
+    }
+    vfs.nexcluded++;
+
+    return VFS_SUCCESS;
+}
+
+
+
+/**
+ * @brief Determine whether a file is known to the VFS.
+ *
+ * @param name
+ *        Name of the file relative to the search roots.
+ *
+ * @return 1 if the file exists, 0 otherwise.
+ * @note Does not allocate or touch the disk.
+ */
+int vfs_exists(const char *name) {
+    return vfs_lookup(name) != NULL;
+}
+
+
+
+/**
+ * @brief Initialize the VFS with no search roots.
+ *
+ * @return VFS_SUCCESS; exit()s on failure.
+ */
+int vfs_init(void) {
+    if( !registry_init(&vfs.index, 0) ) {
+        dbgprint("vfs_init: Unable to allocate the file index.\n");
+
+        exit(EXIT_FAILURE);
+    }
+
+    return VFS_SUCCESS;
+}
+
+
+
+/**
+ * @brief Find the indexed entry of a file.
+ *
+ * @param name
+ *        Name of the file relative to the search roots.
+ *
+ * @return The entry, or NULL if the file is unknown.
+ */
+const struct vfs_entry *vfs_lookup(const char *name) {
+    if(!name) { return NULL; }
+
+    return registry_lookup(&vfs.index, vfs_normalize(name));
+}
+
+
+
+/**
+ * @brief Open a file for reading.
+ *
+ * @param name
+ *        Name of the file relative to the search roots. Names that are not
+ *        indexed (such as absolute paths) are opened as they are.
+ *
+ * @return A read-only SDL_RWops, or NULL on failure. It needs to be
+ *         SDL_RWclose()d (or handed to a function that closes it).
+ */
+SDL_RWops *vfs_openRW(const char *name) {
+    const struct vfs_entry *entry = vfs_lookup(name);
+    SDL_RWops *rw;
+
+    if(!name) { return NULL; }
+
+    if( !(rw = SDL_RWFromFile(entry ? entry->path : name, "rb")) ) {
+        dbgprint("vfs_openRW: %s: %s\n", name, SDL_GetError());
+    }
+
+    return rw;
+}
+
+
+
+/**
+ * @brief Scan every root again, e.g. after files were added or changed.
+ *
+ * @return VFS_SUCCESS or VFS_FAILURE.
+ */
+int vfs_rescan(void) {
+    const char *roots[VFS_MAX_ROOTS];
+    int i, nroots = vfs.nroots, nexcluded = vfs.nexcluded;
+
+    memcpy(roots, vfs.roots, sizeof(roots));
+    vfs_close();
+    vfs_init();
+    vfs.nexcluded = nexcluded;  //'excluded' is kept by vfs_close()
+
+    for(i = 0; i < nroots; i++) {
+        if( !vfs_addRoot(roots[i]) ) {
+            return VFS_FAILURE;
+        }
+    }
+
+    return VFS_SUCCESS;
+}
+
+
+
+/**
+ * @brief Resolve the name of a file to its path on disk.
+ *
+ * @param name
+ *        Name of the file relative to the search roots.
+ *
+ * @return The interned path, or NULL if the file is unknown.
+ * @note Does not allocate or touch the disk.
+ */
+const char *vfs_resolve(const char *name) {
+    const struct vfs_entry *entry = vfs_lookup(name);
+
+    return entry ? entry->path : NULL;
+}
@@ -0,0 +1,56 @@
+/*
+ * vfs.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <SDL2/SDL_rwops.h>
+
+#define VFS_SUCCESS 1
+#define VFS_FAILURE 0
+
+#define VFS_MAX_ROOTS   16
+#define VFS_MAX_DEPTH   16
+
+/**
+ * @struct vfs_entry
+ *         A file found under one of the search roots; doubles as its stat cache.
+ * @var name
+ *      Interned name of the file relative to its root, with '/' separators.
+ * @var path
+ *      Interned path of the file on disk (root path + name).
+ * @var size
+ *      Size of the file in bytes when it was scanned.
+ * @var mtime
+ *      Modification time of the file when it was scanned.
+ * @var root
+ *      Index of the root that provides the file; later roots override earlier ones.
+ */
+struct vfs_entry {
+    const char *name;
+    const char *path;
+    uint64_t size;
+    time_t mtime;
+    int root;
+};
+
+/*
+ * Function declarations.
+ */
+extern int                      vfs_addRoot (const char *directory);
+extern void                     vfs_close   (void);
+extern int                      vfs_exclude (const char *directory);
+extern int                      vfs_exists  (const char *name);
+extern int                      vfs_init    (void);
+extern const struct vfs_entry * vfs_lookup  (const char *name);
+extern SDL_RWops *              vfs_openRW  (const char *name);
+extern int                      vfs_rescan  (void);
+extern const char *             vfs_resolve (const char *name);
+
+#endif /*VFS_H*/
@@ -0,0 +1,281 @@
+/*
+ * workers.c
+ *
+ *     Created on: 17 October 2026
+ *         Author: oceaquaris
+ *  Last Modified:
+ *
+ * @brief A fixed pool of worker threads that executes parallel-for jobs.
+ *        The calling thread works alongside the pool, so a pool of zero
+ *        threads simply runs every job serially.
+ *
+ * Field Overview:
+ *  static:
+ *      workers
+ *      workers_drain
+ *      workers_main
+ *  extern:
+ *      workers_close
+ *      workers_count
+ *      workers_init
+ *      workers_run
+ *      workers_self
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+
+#include "debug.h"
+#include "workers.h"
+
+
+
+/**
+ * @brief State shared between the pool and workers_run().
+ * @var threads
+ *      The worker threads.
+ * @var nthreads
+ *      Number of worker threads.
+ * @var lock
+ *      Protects every field below it.
+ * @var start
+ *      Signalled when a new job is posted (or the pool shuts down).
+ * @var done
+ *      Signalled when the last worker finishes the current job.
+ * @var next
+ *      Next index of the current job to hand out.
+ * @var active
+ *      Number of workers still inside the current job.
+ * @var generation
+ *      Incremented for every job posted.
+ */
+static struct {
+    SDL_Thread *threads[WORKERS_MAX_THREADS];
+    int nthreads;
+    SDL_mutex *lock;
+    SDL_cond *start;
+    SDL_cond *done;
+    workers_job job;
+    void *context;
+    size_t count;
+    SDL_atomic_t next;
+    int active;
+    unsigned int generation;
+    int busy;
+    int quit;
+} workers = { {NULL}, 0, NULL, NULL, NULL, NULL, NULL, 0, {0}, 0, 0, 0, 0 };
+
+/* Index of the calling thread, see workers_self(). */
+static _Thread_local int workers_id = 0;
+
+
+
+/**
+ * @brief Run indices of the current job until none are left.
+ */
+static void workers_drain(workers_job job, void *context, size_t count) {
+    size_t index;
+
+    while( (index = (size_t)SDL_AtomicAdd(&workers.next, 1)) < count ) {
+        job(context, index);
+    }
+
+    return;
+}
+
+
+
+/**
+ * @brief Worker thread entry point.
+ */
+static int workers_main(void *id) {
+    unsigned int seen = 0;
+
+    workers_id = (int)(intptr_t)id;
+
+    SDL_LockMutex(workers.lock);
+    for(;;) {
+        while( !workers.quit && workers.generation == seen ) {
+            SDL_CondWait(workers.start, workers.lock);
+        }
+        if(workers.quit) { break; }
+
+        seen = workers.generation;
+        workers_job job = workers.job;
+        void *context = workers.context;
+        size_t count = workers.count;
+        SDL_UnlockMutex(workers.lock);
+
+        workers_drain(job, context, count);
+
+        SDL_LockMutex(workers.lock);
+        if( --workers.active == 0 ) {
+            SDL_CondSignal(workers.done);
+        }
+    }
+    SDL_UnlockMutex(workers.lock);
+
+    return 0;
+}
+
+
+
+/*****************************************************************************/
+/*****************************************************************************/
+/*****************************************************************************/
+
+
+
+/**
+ * @brief Stop and join every worker thread.
+ */
+void workers_close(void) {
+    int i;
+
+    if(!workers.lock) { return; }
+
+    SDL_LockMutex(workers.lock);
+    workers.quit = 1;
+    SDL_CondBroadcast(workers.start);
+    SDL_UnlockMutex(workers.lock);
+
+    for(i = 0; i < workers.nthreads; i++) {
+        SDL_WaitThread(workers.threads[i], NULL);
+        workers.threads[i] = NULL;
+    }
+    workers.nthreads = 0;
+
+    SDL_DestroyCond(workers.done);
+    SDL_DestroyCond(workers.start);
+    SDL_DestroyMutex(workers.lock);
+    workers.done = NULL;
+    workers.start = NULL;
+    workers.lock = NULL;
+    workers.quit = 0;
+
+    return;
+}
+
+
+
+/**
+ * @brief Number of threads that execute a job, including the caller.
+ */
+int workers_count(void) {
+    return workers.nthreads + 1;
+}
+
+
+
+/**
+ * @brief Start the worker pool.
+ *
+ * @param threads
+ *        Number of worker threads to start; 0 starts one fewer than the
+ *        number of CPUs (the caller of workers_run() is the last worker).
+ *
+ * @return WORKERS_SUCCESS or WORKERS_FAILURE. On failure jobs still run,
+ *         serially, on the calling thread.
+ */
+int workers_init(int threads) {
+    if(workers.lock) {
+        return WORKERS_SUCCESS;
+    }
+
+    if(threads <= 0) {
+        threads = SDL_GetCPUCount() - 1;
+    }
+    if(threads > WORKERS_MAX_THREADS) {
+        threads = WORKERS_MAX_THREADS;
+    }
+
+    if( !(workers.lock = SDL_CreateMutex()) ||
+        !(workers.start = SDL_CreateCond()) ||
+        !(workers.done = SDL_CreateCond()) ) {
+        dbgprint("workers_init: Unable to create synchronization primitives: %s\n", SDL_GetError());
+
+        workers_close();
+        return WORKERS_FAILURE;
+    }
+
+    for(workers.nthreads = 0; workers.nthreads < threads; workers.nthreads++) {
+        workers.threads[workers.nthreads] = SDL_CreateThread(workers_main, "ainur-worker",
+                                                           (void *)(intptr_t)(workers.nthreads + 1));
+        if(!workers.threads[workers.nthreads]) {
+            dbgprint("workers_init: Unable to start worker thread %d: %s\n",
+                     workers.nthreads, SDL_GetError());
+            break;  //run with the threads we have
+        }
+    }
+
+    return WORKERS_SUCCESS;
+}
+
+
+
+/**
+ * @brief Call 'job' for every index in [0, count) and wait until all calls
+ *        have returned.
+ *
+ * @param job
+ *        Function to run; must be safe to call from several threads at once.
+ * @param context
+ *        Pointer handed to every call of 'job'.
+ * @param count
+ *        Number of indices.
+ *
+ * @note A job started from inside another job runs serially on the caller.
+ */
+void workers_run(workers_job job, void *context, size_t count) {
+    size_t index;
+
+    if(!job || !count) { return; }
+
+    if(workers.lock) {
+        SDL_LockMutex(workers.lock);
+    }
+    if( !workers.lock || !workers.nthreads || workers.busy || count == 1 ) {
+        if(workers.lock) {
+            SDL_UnlockMutex(workers.lock);
+        }
+
+        for(index = 0; index < count; index++) {
+            job(context, index);
+        }
+        return;
+    }
+
+    workers.busy = 1;
+    workers.job = job;
+    workers.context = context;
+    workers.count = count;
+    SDL_AtomicSet(&workers.next, 0);
+    workers.active = workers.nthreads;
+    workers.generation++;
+    SDL_CondBroadcast(workers.start);
+    SDL_UnlockMutex(workers.lock);
+
+    workers_drain(job, context, count);    //the caller pitches in
+
+    SDL_LockMutex(workers.lock);
+    while(workers.active) {
+        SDL_CondWait(workers.done, workers.lock);
+    }
+    workers.busy = 0;
+    SDL_UnlockMutex(workers.lock);
+
+    return;
+}
+
+
+
+/**
+ * @brief Index of the calling thread: 1 to workers_count() - 1 for pool
+ *        threads, 0 for any other thread. Jobs can use it to pick per-thread
+ *        scratch memory without locking.
+ */
+int workers_self(void) {
+    return workers_id;
+}
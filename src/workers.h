@@ -0,0 +1,33 @@
+/*
+ * workers.h
+ *
+ *  Created on: 17 October 2026
+ *      Author: oceaquaris
+ */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stddef.h>
+
+#define WORKERS_SUCCESS 1
+#define WORKERS_FAILURE 0
+
+#define WORKERS_MAX_THREADS 64
+
+/**
+ * @brief A parallel job: called once for every index in [0, count) of a
+ *        workers_run() call, possibly from several threads at once.
+ */
+typedef void (*workers_job)(void *context, size_t index);
+
+/*
+ * Function declarations.
+ */
+extern void workers_close (void);
+extern int  workers_count (void);
+extern int  workers_init  (int threads);
+extern void workers_run   (workers_job job, void *context, size_t count);
+extern int  workers_self  (void);
+
+#endif /*WORKERS_H*/